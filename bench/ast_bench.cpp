@@ -0,0 +1,235 @@
+// AST dispatch cost: walks a parsed translation unit of over a million nodes,
+// once finding each node's class through a dynamic_cast chain (how Sema and
+// CodeGen used to dispatch) and once through a switch on Node::kind:
+//   cmake --build build --target ast_bench
+//   ./build/ast_bench [-n <iterations>] [-f <functions>]
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+#include "../src/diag.h"
+#include "../src/lexer.h"
+#include "../src/parser.h"
+
+using namespace c99cc;
+
+// In the order codegen's emitExpr and emitStmt used to test them.
+#define C99CC_EXPR_NODES(X)                                                   \
+  X(IntLiteralExpr) X(FloatLiteralExpr) X(StringLiteralExpr) X(IncDecExpr)    \
+  X(SizeofExpr) X(CastExpr) X(VarRefExpr) X(CallExpr) X(TernaryExpr)          \
+  X(UnaryExpr) X(SubscriptExpr) X(MemberExpr) X(BinaryExpr) X(AssignExpr)     \
+  X(InitListExpr)
+#define C99CC_STMT_NODES(X)                                                   \
+  X(BlockStmt) X(DeclStmt) X(AssignStmt) X(ReturnStmt) X(BreakStmt)           \
+  X(ContinueStmt) X(SwitchStmt) X(IfStmt) X(WhileStmt) X(DoWhileStmt)         \
+  X(ForStmt) X(ExprStmt) X(TypedefStmt) X(EmptyStmt)
+
+// Statement and expression mix of ordinary code: loops, conditions, calls,
+// member and array accesses, casts and a switch.
+static std::string generatedInput(size_t functions) {
+  std::ostringstream os;
+  os << "struct point { int x; int y; };\n"
+     << "int table[64];\n";
+  for (size_t f = 0; f < functions; f++) {
+    os << "int f" << f << "(struct point *p, int a, int b) {\n"
+       << "  int i;\n"
+       << "  int acc = a * 3 + b - (a >> 1);\n"
+       << "  for (i = 0; i < 16; i++) {\n"
+       << "    if (acc > i && p->x != 0) acc += table[i & 63] * p->y - b;\n"
+       << "    else acc -= (a + i) / (b | 1);\n"
+       << "  }\n"
+       << "  while (acc > 1000) acc = acc / 2 + p->x;\n"
+       << "  switch (a & 3) {\n"
+       << "  case 0: acc++; break;\n"
+       << "  case 1: acc--; break;\n"
+       << "  default: acc = acc ? acc : (int)sizeof(struct point);\n"
+       << "  }\n";
+    if (f > 0) os << "  acc += f" << f - 1 << "(p, acc & 7, b + " << f % 13 << ");\n";
+    os << "  return acc;\n"
+       << "}\n";
+  }
+  return os.str();
+}
+
+template <bool UseKind> struct Walker {
+  uint64_t nodes = 0;
+  uint64_t sum = 0; // checked below, so the walk cannot be optimized away
+
+  void expr(const Expr& e) {
+    nodes++;
+    if constexpr (UseKind) {
+      switch (e.kind) {
+#define C99CC_CASE(T) case NodeKind::T: return visit(cast<T>(e));
+        C99CC_EXPR_NODES(C99CC_CASE)
+#undef C99CC_CASE
+        default: return;
+      }
+    } else {
+#define C99CC_TRY(T) if (auto* n = dynamic_cast<const T*>(&e)) return visit(*n);
+      C99CC_EXPR_NODES(C99CC_TRY)
+#undef C99CC_TRY
+    }
+  }
+
+  void stmt(const Stmt& s) {
+    nodes++;
+    if constexpr (UseKind) {
+      switch (s.kind) {
+#define C99CC_CASE(T) case NodeKind::T: return visit(cast<T>(s));
+        C99CC_STMT_NODES(C99CC_CASE)
+#undef C99CC_CASE
+        default: return;
+      }
+    } else {
+#define C99CC_TRY(T) if (auto* n = dynamic_cast<const T*>(&s)) return visit(*n);
+      C99CC_STMT_NODES(C99CC_TRY)
+#undef C99CC_TRY
+    }
+  }
+
+  void visit(const IntLiteralExpr& e) { sum += static_cast<uint64_t>(e.value); }
+  void visit(const FloatLiteralExpr&) { sum++; }
+  void visit(const StringLiteralExpr& e) { sum += e.value.size(); }
+  void visit(const VarRefExpr& e) { sum += e.name.id(); }
+  void visit(const IncDecExpr& e) { expr(*e.operand); }
+  void visit(const SizeofExpr& e) {
+    if (e.expr) expr(*e.expr);
+  }
+  void visit(const CastExpr& e) { expr(*e.expr); }
+  void visit(const CallExpr& e) {
+    if (e.calleeExpr) expr(*e.calleeExpr);
+    for (const auto& arg : e.args) expr(*arg);
+  }
+  void visit(const TernaryExpr& e) {
+    expr(*e.cond);
+    expr(*e.thenExpr);
+    expr(*e.elseExpr);
+  }
+  void visit(const UnaryExpr& e) { expr(*e.operand); }
+  void visit(const SubscriptExpr& e) {
+    expr(*e.base);
+    expr(*e.index);
+  }
+  void visit(const MemberExpr& e) { expr(*e.base); }
+  void visit(const BinaryExpr& e) {
+    expr(*e.lhs);
+    expr(*e.rhs);
+  }
+  void visit(const AssignExpr& e) {
+    expr(*e.lhs);
+    expr(*e.rhs);
+  }
+  void visit(const InitListExpr& e) {
+    for (const auto& elem : e.elems) expr(*elem.expr);
+  }
+
+  void visit(const BlockStmt& s) {
+    for (const auto& st : s.stmts) stmt(*st);
+  }
+  void visit(const DeclStmt& s) {
+    for (const auto& item : s.items) {
+      if (item.initExpr) expr(*item.initExpr);
+    }
+  }
+  void visit(const TypedefStmt&) {}
+  void visit(const AssignStmt& s) { expr(*s.valueExpr); }
+  void visit(const ReturnStmt& s) {
+    if (s.valueExpr) expr(*s.valueExpr);
+  }
+  void visit(const ExprStmt& s) { expr(*s.expr); }
+  void visit(const EmptyStmt&) {}
+  void visit(const BreakStmt&) {}
+  void visit(const ContinueStmt&) {}
+  void visit(const IfStmt& s) {
+    expr(*s.cond);
+    stmt(*s.thenBranch);
+    if (s.elseBranch) stmt(*s.elseBranch);
+  }
+  void visit(const WhileStmt& s) {
+    expr(*s.cond);
+    stmt(*s.body);
+  }
+  void visit(const DoWhileStmt& s) {
+    stmt(*s.body);
+    expr(*s.cond);
+  }
+  void visit(const ForStmt& s) {
+    if (s.init) stmt(*s.init);
+    if (s.cond) expr(*s.cond);
+    if (s.inc) expr(*s.inc);
+    stmt(*s.body);
+  }
+  void visit(const SwitchStmt& s) {
+    expr(*s.cond);
+    for (const auto& c : s.cases) {
+      for (const auto& st : c.stmts) stmt(*st);
+    }
+  }
+
+  void unit(const AstTranslationUnit& tu) {
+    for (const auto& item : tu.items) {
+      if (auto* fn = std::get_if<FunctionDef>(&item)) {
+        for (const auto& st : fn->body) stmt(*st);
+      }
+    }
+  }
+};
+
+// Best of `iterations` walks, in seconds; `last` is the final walker.
+template <bool UseKind>
+static double timeWalk(const AstTranslationUnit& tu, unsigned iterations, Walker<UseKind>& last) {
+  double best = 1e300;
+  for (unsigned it = 0; it < std::max(iterations, 1u); it++) {
+    auto start = std::chrono::steady_clock::now();
+    last = Walker<UseKind>();
+    last.unit(tu);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+int main(int argc, char** argv) {
+  unsigned iterations = 10;
+  size_t functions = 12000;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "-n" && i + 1 < argc) {
+      iterations = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (a == "-f" && i + 1 < argc) {
+      functions = std::strtoul(argv[++i], nullptr, 10);
+    } else {
+      std::fprintf(stderr, "usage: %s [-n <iterations>] [-f <functions>]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::string source = generatedInput(functions);
+  Diagnostics diags;
+  Lexer lex(source, diags);
+  Parser parser(lex, diags);
+  auto tu = parser.parse();
+  if (!tu || diags.hasError()) {
+    diags.printAll("<generated>", source);
+    return 1;
+  }
+
+  Walker<false> rttiWalk;
+  Walker<true> kindWalk;
+  double rtti = timeWalk(*tu, iterations, rttiWalk);
+  double kind = timeWalk(*tu, iterations, kindWalk);
+  if (rttiWalk.nodes != kindWalk.nodes || rttiWalk.sum != kindWalk.sum) {
+    std::fprintf(stderr, "the two walks disagree\n");
+    return 1;
+  }
+  double nodes = static_cast<double>(kindWalk.nodes);
+  std::printf("%llu nodes\n", static_cast<unsigned long long>(kindWalk.nodes));
+  std::printf("dynamic_cast chain: %.3f ms, %.1f ns/node\n", rtti * 1e3, rtti * 1e9 / nodes);
+  std::printf("kind switch:        %.3f ms, %.1f ns/node (%.2fx)\n", kind * 1e3,
+              kind * 1e9 / nodes, rtti / kind);
+  return 0;
+}
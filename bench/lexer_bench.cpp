@@ -0,0 +1,98 @@
+// Lexer throughput in MB/s and tokens/s, over the given (preprocessed) files
+// or a generated translation unit:
+//   cmake --build build --target lexer_bench
+//   ./build/lexer_bench [-n <iterations>] [-j <threads>] [file.i...]
+// -j lexes each input into a TokenBuffer on that many threads (-fprelex).
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/diag.h"
+#include "../src/lexer.h"
+#include "../src/token_buffer.h"
+
+// Roughly what the lexer sees from real code: indented statements, comments,
+// keywords, long identifiers, numbers and string literals.
+static std::string generatedInput(size_t functions) {
+  std::ostringstream os;
+  for (size_t f = 0; f < functions; f++) {
+    os << "// helper " << f << ": folds the table into a running checksum\n"
+       << "static unsigned long checksum_table_entry_" << f
+       << "(const struct table_entry *entry, unsigned long running_total) {\n"
+       << "    unsigned long value = running_total ^ " << f * 2654435761u % 100003 << "UL;\n"
+       << "    for (int index = 0; index < entry->length; index++) {\n"
+       << "        if (entry->values[index] >= 0.5f && index != " << f % 17 << ") {\n"
+       << "            value = (value << 5) + value + entry->values[index];\n"
+       << "        } else {\n"
+       << "            value -= entry->offset * 3.25e-2;\n"
+       << "        }\n"
+       << "    }\n"
+       << "    printf(\"entry %d: %lu\\n\", " << f << ", value);\n"
+       << "    return value;\n"
+       << "}\n\n";
+  }
+  return os.str();
+}
+
+static bool readFile(const std::string& path, std::string& out) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return false;
+  std::ostringstream ss;
+  ss << in.rdbuf();
+  out = ss.str();
+  return true;
+}
+
+int main(int argc, char** argv) {
+  unsigned iterations = 20;
+  unsigned threads = 0;
+  std::vector<std::string> inputs;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "-n" && i + 1 < argc) {
+      iterations = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (a == "-j" && i + 1 < argc) {
+      threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else {
+      std::string text;
+      if (!readFile(a, text)) {
+        std::cerr << "cannot read " << a << "\n";
+        return 1;
+      }
+      inputs.push_back(std::move(text));
+    }
+  }
+  if (inputs.empty()) inputs.push_back(generatedInput(20000));
+
+  size_t bytes = 0;
+  for (const auto& text : inputs) bytes += text.size();
+
+  // best of `iterations`, so the number reflects the lexer rather than noise
+  double best = 1e300;
+  size_t tokens = 0;
+  for (unsigned it = 0; it < std::max(iterations, 1u); it++) {
+    auto start = std::chrono::steady_clock::now();
+    tokens = 0;
+    for (const auto& text : inputs) {
+      c99cc::Diagnostics diags;
+      if (threads) {
+        tokens += c99cc::TokenBuffer::lex(text, threads, diags).size() - 1; // not Eof
+        continue;
+      }
+      c99cc::Lexer lex(text, diags);
+      while (lex.next().kind != c99cc::TokenKind::Eof) tokens++;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+
+  std::printf("%zu bytes, %zu tokens: %.3f ms, %.1f MB/s, %.1f Mtokens/s\n", bytes, tokens,
+              best * 1e3, bytes / best / 1e6, tokens / best / 1e6);
+  return 0;
+}
@@ -0,0 +1,26 @@
+#include "arena.h"
+
+#include <algorithm>
+
+namespace c99cc {
+
+namespace {
+
+// Blocks grow with the arena, so a large TU takes few of them and a small
+// one does not pay for a large block.
+constexpr size_t kFirstBlockSize = 64 * 1024;
+constexpr size_t kMaxBlockSize = 4 * 1024 * 1024;
+
+} // namespace
+
+void* Arena::allocateSlow(size_t size, size_t align) {
+  size_t blockSize = kFirstBlockSize << std::min<size_t>(blocks_.size() / 4, 6);
+  blockSize = std::max(std::min(blockSize, kMaxBlockSize), size + align);
+  blocks_.emplace_back(new char[blockSize]); // left uninitialized
+  reserved_ += blockSize;
+  next_ = blocks_.back().get();
+  end_ = next_ + blockSize;
+  return allocate(size, align);
+}
+
+} // namespace c99cc
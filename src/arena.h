@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace c99cc {
+
+// Bump-pointer allocation for data that all dies at once (a TU's AST).
+// Nothing is freed on its own; the blocks go when the arena does.
+class Arena {
+public:
+  Arena() = default;
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(size_t size, size_t align) {
+    uintptr_t p = (reinterpret_cast<uintptr_t>(next_) + align - 1) & ~uintptr_t(align - 1);
+    if (next_ && p + size <= reinterpret_cast<uintptr_t>(end_)) {
+      used_ += p + size - reinterpret_cast<uintptr_t>(next_);
+      next_ = reinterpret_cast<char*>(p + size);
+      return reinterpret_cast<void*>(p);
+    }
+    return allocateSlow(size, align);
+  }
+
+  // Handed out, including alignment padding.
+  size_t bytesUsed() const { return used_; }
+  // Held in blocks.
+  size_t bytesReserved() const { return reserved_; }
+
+private:
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* next_ = nullptr;
+  char* end_ = nullptr;
+  size_t used_ = 0;
+  size_t reserved_ = 0;
+
+  void* allocateSlow(size_t size, size_t align);
+};
+
+// For standard containers whose storage lives in an Arena. Deallocation is a
+// no-op, so a container should be sized once rather than grown.
+template <class T> class ArenaAllocator {
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment = std::true_type;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  ArenaAllocator() = default; // for empty containers only
+  explicit ArenaAllocator(Arena& arena) : arena_(&arena) {}
+  template <class U> ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) { return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T))); }
+  void deallocate(T*, size_t) {}
+
+  Arena* arena() const { return arena_; }
+  friend bool operator==(const ArenaAllocator& a, const ArenaAllocator& b) {
+    return a.arena_ == b.arena_;
+  }
+  friend bool operator!=(const ArenaAllocator& a, const ArenaAllocator& b) {
+    return a.arena_ != b.arena_;
+  }
+
+private:
+  Arena* arena_ = nullptr;
+};
+
+} // namespace c99cc
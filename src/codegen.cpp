@@ -17,6 +17,8 @@
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
 
+#include "timing.h"
+
 namespace c99cc {
 
 namespace {
@@ -30,13 +32,13 @@ struct CGEnv {
   Type currentReturnType{};
 
   // function table: name -> llvm::Function*
-  std::unordered_map<std::string, llvm::Function*> functions;
-  std::unordered_map<std::string, std::vector<Type>> functionParamTypes;
+  std::unordered_map<Symbol, llvm::Function*> functions;
+  std::unordered_map<Symbol, std::vector<Type>> functionParamTypes;
 
   // struct table: name -> llvm::StructType*
-  std::unordered_map<std::string, llvm::StructType*> structs;
-  std::unordered_map<std::string, std::vector<StructField>> structFields;
-  std::unordered_map<std::string, int64_t> enumConstants;
+  std::unordered_map<Symbol, llvm::StructType*> structs;
+  std::unordered_map<Symbol, std::vector<StructField>> structFields;
+  std::unordered_map<Symbol, int64_t> enumConstants;
 
   struct GlobalBinding {
     llvm::GlobalVariable* gv = nullptr;
@@ -49,10 +51,10 @@ struct CGEnv {
   };
 
   // global variables: name -> binding
-  std::unordered_map<std::string, GlobalBinding> globals;
+  std::unordered_map<Symbol, GlobalBinding> globals;
 
   // local scopes: name -> binding
-  std::vector<std::unordered_map<std::string, LocalBinding>> scopes;
+  std::vector<std::unordered_map<Symbol, LocalBinding>> scopes;
 
   // loop stack: {breakTarget, continueTarget}
   std::vector<std::pair<llvm::BasicBlock*, llvm::BasicBlock*>> loops;
@@ -74,7 +76,7 @@ struct CGEnv {
     staticLocalCounter = 0;
   }
 
-  LocalBinding* lookupLocal(const std::string& name) {
+  LocalBinding* lookupLocal(Symbol name) {
     for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
       auto f = it->find(name);
       if (f != it->end()) return &f->second;
@@ -82,20 +84,20 @@ struct CGEnv {
     return nullptr;
   }
 
-  GlobalBinding* lookupGlobal(const std::string& name) {
+  GlobalBinding* lookupGlobal(Symbol name) {
     auto it = globals.find(name);
     if (it == globals.end()) return nullptr;
     return &it->second;
   }
 
-  bool insertLocal(const std::string& name, llvm::Value* slot, const Type& type) {
+  bool insertLocal(Symbol name, llvm::Value* slot, const Type& type) {
     auto& cur = scopes.back();
     if (cur.count(name)) return false;
     cur.emplace(name, LocalBinding{slot, type});
     return true;
   }
 
-  bool insertGlobal(const std::string& name, llvm::GlobalVariable* gv, const Type& type) {
+  bool insertGlobal(Symbol name, llvm::GlobalVariable* gv, const Type& type) {
     if (globals.count(name)) return false;
     globals.emplace(name, GlobalBinding{gv, type});
     return true;
@@ -184,6 +186,7 @@ static llvm::Type* llvmType(CGEnv& env, const Type& t) {
 static llvm::AllocaInst* createEntryAlloca(CGEnv& env, const std::string& name, const Type& type);
 
 static llvm::Type* abiReturnType(CGEnv& env, const Type& t) {
+  if (t.isVoid() && !t.func) return llvm::Type::getVoidTy(env.ctx);
   if (t.base == Type::Base::Struct && t.ptrDepth == 0) {
     llvm::Type* stTy = llvmType(env, t);
     uint64_t size = env.mod.getDataLayout().getTypeAllocSize(stTy);
@@ -396,12 +399,12 @@ static const FunctionProto* getProto(const TopLevelItem& item) {
 }
 
 static const Type& exprType(const Expr& e) {
-  assert(e.semaType.has_value());
+  assert(e.semaType);
   return *e.semaType;
 }
 
 static bool isNullPointerLiteral(const Expr& e) {
-  if (auto* lit = dynamic_cast<const IntLiteralExpr*>(&e)) return lit->value == 0;
+  if (auto* lit = dyn_cast<IntLiteralExpr>(&e)) return lit->value == 0;
   return false;
 }
 
@@ -516,7 +519,7 @@ static llvm::Value* emitEqual(CGEnv& env, const Type& ty, llvm::Value* lhs, llvm
 
 static bool resolveDesignatorAddr(
     CGEnv& env, const Type& baseTy, llvm::Value* baseAddr,
-    const std::vector<Designator>& designators, Type& outTy, llvm::Value*& outAddr) {
+    const AstVector<Designator>& designators, Type& outTy, llvm::Value*& outAddr) {
   Type curTy = baseTy;
   llvm::Value* curAddr = baseAddr;
   for (const auto& d : designators) {
@@ -552,7 +555,7 @@ static bool resolveDesignatorAddr(
 }
 
 static void emitInitToAddr(CGEnv& env, const Type& ty, llvm::Value* addr, const Expr& init) {
-  if (auto* str = dynamic_cast<const StringLiteralExpr*>(&init)) {
+  if (auto* str = dyn_cast<StringLiteralExpr>(&init)) {
     if (ty.isArray() && !ty.ptrOutsideArrays) {
       Type elemTy = ty.elementType();
       if (elemTy.base == Type::Base::Char && elemTy.ptrDepth == 0 && elemTy.arrayDims.empty()) {
@@ -571,10 +574,10 @@ static void emitInitToAddr(CGEnv& env, const Type& ty, llvm::Value* addr, const
       }
     }
   }
-  if (auto* list = dynamic_cast<const InitListExpr*>(&init)) {
+  if (auto* list = dyn_cast<InitListExpr>(&init)) {
     if (ty.isArray() && !ty.ptrOutsideArrays && list->elems.size() == 1 &&
         list->elems[0].designators.empty()) {
-      if (auto* str = dynamic_cast<const StringLiteralExpr*>(list->elems[0].expr.get())) {
+      if (auto* str = dyn_cast<StringLiteralExpr>(list->elems[0].expr.get())) {
         emitInitToAddr(env, ty, addr, *str);
         return;
       }
@@ -1053,191 +1056,184 @@ static llvm::Value* emitBinary(CGEnv& env, const BinaryExpr& bin) {
 }
 
 static llvm::Value* emitLValue(CGEnv& env, const Expr& e) {
-  if (auto* vr = dynamic_cast<const VarRefExpr*>(&e)) {
-    if (auto* local = env.lookupLocal(vr->name)) return local->slot;
-    if (auto* global = env.lookupGlobal(vr->name)) return global->gv;
-    return nullptr;
-  }
-
-  if (auto* un = dynamic_cast<const UnaryExpr*>(&e)) {
-    if (un->op == TokenKind::Star) return emitExpr(env, *un->operand);
-  }
-
-  if (auto* sub = dynamic_cast<const SubscriptExpr*>(&e)) {
-    llvm::Value* basePtr = emitExpr(env, *sub->base);
-    llvm::Value* idx = emitExpr(env, *sub->index);
-    Type baseTy = exprType(*sub->base);
-    if (baseTy.isArray() && !baseTy.ptrOutsideArrays) baseTy = baseTy.decayType();
-    Type elemTy = baseTy.pointee();
-    llvm::Type* llvmElemTy = llvmType(env, elemTy);
-    Type idxTy = exprType(*sub->index);
-    llvm::Value* adjIdx = castIndex(env, idx, idxTy);
-    return env.b.CreateGEP(llvmElemTy, basePtr, adjIdx, "sub.addr");
-  }
-
-  if (auto* mem = dynamic_cast<const MemberExpr*>(&e)) {
-    Type baseTy = exprType(*mem->base);
-    Type structTy = baseTy;
-    llvm::Value* basePtr = nullptr;
-    if (mem->isArrow) {
-      basePtr = emitExpr(env, *mem->base);
-      structTy = baseTy.pointee();
-    } else {
-      basePtr = emitLValue(env, *mem->base);
-    }
+  switch (e.kind) {
+    case NodeKind::VarRefExpr: {
+      auto* vr = cast<VarRefExpr>(&e);
+      if (auto* local = env.lookupLocal(vr->name)) return local->slot;
+      if (auto* global = env.lookupGlobal(vr->name)) return global->gv;
+      return nullptr;
+    }
+    case NodeKind::UnaryExpr: {
+      auto* un = cast<UnaryExpr>(&e);
+      if (un->op == TokenKind::Star) return emitExpr(env, *un->operand);
+      break;
+    }
+    case NodeKind::SubscriptExpr: {
+      auto* sub = cast<SubscriptExpr>(&e);
+      llvm::Value* basePtr = emitExpr(env, *sub->base);
+      llvm::Value* idx = emitExpr(env, *sub->index);
+      Type baseTy = exprType(*sub->base);
+      if (baseTy.isArray() && !baseTy.ptrOutsideArrays) baseTy = baseTy.decayType();
+      Type elemTy = baseTy.pointee();
+      llvm::Type* llvmElemTy = llvmType(env, elemTy);
+      Type idxTy = exprType(*sub->index);
+      llvm::Value* adjIdx = castIndex(env, idx, idxTy);
+      return env.b.CreateGEP(llvmElemTy, basePtr, adjIdx, "sub.addr");
+    }
+    case NodeKind::MemberExpr: {
+      auto* mem = cast<MemberExpr>(&e);
+      Type baseTy = exprType(*mem->base);
+      Type structTy = baseTy;
+      llvm::Value* basePtr = nullptr;
+      if (mem->isArrow) {
+        basePtr = emitExpr(env, *mem->base);
+        structTy = baseTy.pointee();
+      } else {
+        basePtr = emitLValue(env, *mem->base);
+      }
 
-    auto it = env.structFields.find(structTy.structName);
-    if (it == env.structFields.end()) return nullptr;
-    size_t fieldIndex = 0;
-    bool found = false;
-    for (size_t i = 0; i < it->second.size(); ++i) {
-      if (it->second[i].name == mem->member) {
-        fieldIndex = i;
-        found = true;
-        break;
+      auto it = env.structFields.find(structTy.structName);
+      if (it == env.structFields.end()) return nullptr;
+      size_t fieldIndex = 0;
+      bool found = false;
+      for (size_t i = 0; i < it->second.size(); ++i) {
+        if (it->second[i].name == mem->member) {
+          fieldIndex = i;
+          found = true;
+          break;
+        }
       }
+      if (!found) return nullptr;
+      auto stIt = env.structs.find(structTy.structName);
+      if (stIt == env.structs.end()) return nullptr;
+      return env.b.CreateStructGEP(stIt->second, basePtr,
+                                   static_cast<unsigned>(fieldIndex), "member.addr");
+      break;
     }
-    if (!found) return nullptr;
-    auto stIt = env.structs.find(structTy.structName);
-    if (stIt == env.structs.end()) return nullptr;
-    return env.b.CreateStructGEP(stIt->second, basePtr,
-                                 static_cast<unsigned>(fieldIndex), "member.addr");
+    default:
+      break;
   }
 
   return nullptr;
 }
 
 static llvm::Value* emitExpr(CGEnv& env, const Expr& e) {
-  if (auto* lit = dynamic_cast<const IntLiteralExpr*>(&e)) {
-    Type ty = exprType(e);
-    if (!ty.isInteger()) return i32Const(env, lit->value);
-    llvm::Type* llvmTy = llvmType(env, ty);
-    return llvm::ConstantInt::get(llvmTy, lit->value, !ty.isUnsigned);
-  }
-  if (auto* flt = dynamic_cast<const FloatLiteralExpr*>(&e)) {
-    llvm::Type* ty = flt->isFloat ? llvm::Type::getFloatTy(env.ctx)
-                                  : llvm::Type::getDoubleTy(env.ctx);
-    return llvm::ConstantFP::get(ty, flt->value);
-  }
-
-  if (auto* str = dynamic_cast<const StringLiteralExpr*>(&e)) {
-    return emitStringLiteral(env, str->value);
-  }
-
-  if (auto* inc = dynamic_cast<const IncDecExpr*>(&e)) {
-    llvm::Value* addr = emitLValue(env, *inc->operand);
-    if (!addr) return i32Const(env, 0);
-    Type opTy = exprType(*inc->operand);
-    llvm::Value* oldV = env.b.CreateLoad(llvmType(env, opTy), addr, "incdec.old");
-    llvm::Value* newV = nullptr;
-    if (opTy.isPointer()) {
-      llvm::Type* elemTy = oldV->getType()->getPointerElementType();
-      llvm::Value* idx = llvm::ConstantInt::get(env.b.getInt64Ty(), inc->isInc ? 1 : -1, true);
-      newV = env.b.CreateGEP(elemTy, oldV, idx, "incdec.ptr");
-    } else {
-      llvm::Value* one = llvm::ConstantInt::get(oldV->getType(), 1, true);
-      newV = inc->isInc ? env.b.CreateAdd(oldV, one, "incdec.add")
-                        : env.b.CreateSub(oldV, one, "incdec.sub");
-    }
-    env.b.CreateStore(newV, addr);
-    return inc->isPost ? oldV : newV;
-  }
-
-  if (auto* sz = dynamic_cast<const SizeofExpr*>(&e)) {
-    Type t = sz->isType ? sz->type : exprType(*sz->expr);
-    uint64_t size = sizeOfType(t, env);
-    return i32Const(env, static_cast<int64_t>(size));
-  }
-
-  if (auto* cast = dynamic_cast<const CastExpr*>(&e)) {
-    llvm::Value* v = emitExpr(env, *cast->expr);
-    const Type& srcTy = exprType(*cast->expr);
-    const Type& dstTy = cast->targetType;
-    if (dstTy.isPointer()) {
-      llvm::Type* llvmDst = llvmType(env, dstTy);
-      if (srcTy.isPointer()) return castPointerIfNeeded(env, v, llvmDst);
-      if (srcTy.isInteger()) return env.b.CreateIntToPtr(v, llvmDst, "int.to.ptr");
-      return v;
-    }
-    if (dstTy.isInteger()) {
-      if (srcTy.isPointer()) {
-        llvm::Value* asInt = env.b.CreatePtrToInt(v, env.b.getInt64Ty(), "ptr.to.int");
-        return castIntegerToType(env, asInt, Type{Type::Base::LongLong, 0}, dstTy);
+  switch (e.kind) {
+    case NodeKind::IntLiteralExpr: {
+      auto* lit = cast<IntLiteralExpr>(&e);
+      Type ty = exprType(e);
+      if (!ty.isInteger()) return i32Const(env, lit->value);
+      llvm::Type* llvmTy = llvmType(env, ty);
+      return llvm::ConstantInt::get(llvmTy, lit->value, !ty.isUnsigned);
+    }
+    case NodeKind::FloatLiteralExpr: {
+      auto* flt = cast<FloatLiteralExpr>(&e);
+      llvm::Type* ty = flt->isFloat ? llvm::Type::getFloatTy(env.ctx)
+                                    : llvm::Type::getDoubleTy(env.ctx);
+      return llvm::ConstantFP::get(ty, flt->value);
+    }
+    case NodeKind::StringLiteralExpr: {
+      auto* str = cast<StringLiteralExpr>(&e);
+      return emitStringLiteral(env, str->value);
+    }
+    case NodeKind::IncDecExpr: {
+      auto* inc = cast<IncDecExpr>(&e);
+      llvm::Value* addr = emitLValue(env, *inc->operand);
+      if (!addr) return i32Const(env, 0);
+      Type opTy = exprType(*inc->operand);
+      llvm::Value* oldV = env.b.CreateLoad(llvmType(env, opTy), addr, "incdec.old");
+      llvm::Value* newV = nullptr;
+      if (opTy.isPointer()) {
+        llvm::Type* elemTy = oldV->getType()->getPointerElementType();
+        llvm::Value* idx = llvm::ConstantInt::get(env.b.getInt64Ty(), inc->isInc ? 1 : -1, true);
+        newV = env.b.CreateGEP(elemTy, oldV, idx, "incdec.ptr");
+      } else {
+        llvm::Value* one = llvm::ConstantInt::get(oldV->getType(), 1, true);
+        newV = inc->isInc ? env.b.CreateAdd(oldV, one, "incdec.add")
+                          : env.b.CreateSub(oldV, one, "incdec.sub");
+      }
+      env.b.CreateStore(newV, addr);
+      return inc->isPost ? oldV : newV;
+    }
+    case NodeKind::SizeofExpr: {
+      auto* sz = cast<SizeofExpr>(&e);
+      Type t = sz->isType ? sz->type : exprType(*sz->expr);
+      uint64_t size = sizeOfType(t, env);
+      return i32Const(env, static_cast<int64_t>(size));
+    }
+    case NodeKind::CastExpr: {
+      auto* ce = cast<CastExpr>(&e);
+      llvm::Value* v = emitExpr(env, *ce->expr);
+      const Type& srcTy = exprType(*ce->expr);
+      const Type& dstTy = ce->targetType;
+      if (dstTy.isPointer()) {
+        llvm::Type* llvmDst = llvmType(env, dstTy);
+        if (srcTy.isPointer()) return castPointerIfNeeded(env, v, llvmDst);
+        if (srcTy.isInteger()) return env.b.CreateIntToPtr(v, llvmDst, "int.to.ptr");
+        return v;
+      }
+      if (dstTy.isInteger()) {
+        if (srcTy.isPointer()) {
+          llvm::Value* asInt = env.b.CreatePtrToInt(v, env.b.getInt64Ty(), "ptr.to.int");
+          return castIntegerToType(env, asInt, Type{Type::Base::LongLong, 0}, dstTy);
+        }
+        if (srcTy.isNumeric()) return castNumericToType(env, v, srcTy, dstTy);
+        return v;
+      }
+      if (dstTy.isFloating()) {
+        if (srcTy.isNumeric()) return castNumericToType(env, v, srcTy, dstTy);
+        return v;
       }
-      if (srcTy.isNumeric()) return castNumericToType(env, v, srcTy, dstTy);
-      return v;
-    }
-    if (dstTy.isFloating()) {
-      if (srcTy.isNumeric()) return castNumericToType(env, v, srcTy, dstTy);
       return v;
     }
-    return v;
-  }
-
-  if (auto* vr = dynamic_cast<const VarRefExpr*>(&e)) {
-    if (auto* local = env.lookupLocal(vr->name)) {
-      if (local->type.isArray() && !local->type.ptrOutsideArrays) {
-        return decayArrayToPointer(env, local->slot, local->type);
+    case NodeKind::VarRefExpr: {
+      auto* vr = cast<VarRefExpr>(&e);
+      if (auto* local = env.lookupLocal(vr->name)) {
+        if (local->type.isArray() && !local->type.ptrOutsideArrays) {
+          return decayArrayToPointer(env, local->slot, local->type);
+        }
+        return env.b.CreateLoad(llvmType(env, local->type), local->slot, vr->name + ".val");
       }
-      return env.b.CreateLoad(llvmType(env, local->type), local->slot, vr->name + ".val");
-    }
-    if (auto* global = env.lookupGlobal(vr->name)) {
-      if (global->type.isArray() && !global->type.ptrOutsideArrays) {
-        return decayArrayToPointer(env, global->gv, global->type);
+      if (auto* global = env.lookupGlobal(vr->name)) {
+        if (global->type.isArray() && !global->type.ptrOutsideArrays) {
+          return decayArrayToPointer(env, global->gv, global->type);
+        }
+        return env.b.CreateLoad(llvmType(env, global->type), global->gv, vr->name + ".gval");
       }
-      return env.b.CreateLoad(llvmType(env, global->type), global->gv, vr->name + ".gval");
-    }
-    auto it = env.enumConstants.find(vr->name);
-    if (it != env.enumConstants.end()) {
-      return i32Const(env, it->second);
-    }
-    auto fit = env.functions.find(vr->name);
-    if (fit != env.functions.end()) {
-      return fit->second;
+      auto it = env.enumConstants.find(vr->name);
+      if (it != env.enumConstants.end()) {
+        return i32Const(env, it->second);
+      }
+      auto fit = env.functions.find(vr->name);
+      if (fit != env.functions.end()) {
+        return fit->second;
+      }
+      return i32Const(env, 0);
     }
-    return i32Const(env, 0);
-  }
-
-  if (auto* call = dynamic_cast<const CallExpr*>(&e)) {
-    llvm::Value* calleeV = nullptr;
-    llvm::FunctionType* fnTy = nullptr;
-    const std::vector<Type>* paramTypes = nullptr;
-    if (call->calleeExpr) {
-      const Type& calleeTy = exprType(*call->calleeExpr);
-      if (!calleeTy.func) return i32Const(env, 0);
-      calleeV = emitExpr(env, *call->calleeExpr);
-      std::vector<llvm::Type*> paramTys;
-      paramTys.reserve(calleeTy.func->params.size());
-      for (const auto& param : calleeTy.func->params) {
-        Type adj = param;
-        if (adj.isArray()) adj = adj.decayType();
-        paramTys.push_back(llvmType(env, adj));
-      }
-      fnTy = llvm::FunctionType::get(abiReturnType(env, calleeTy.func->returnType),
-                                     paramTys, calleeTy.func->isVariadic);
-      paramTypes = &calleeTy.func->params;
-    } else {
-      if (auto* local = env.lookupLocal(call->callee)) {
-        if (local->type.isFunctionPointer()) {
-          calleeV = env.b.CreateLoad(llvmType(env, local->type), local->slot, call->callee + ".fn");
-          const auto& fnInfo = *local->type.func;
-          std::vector<llvm::Type*> paramTys;
-          paramTys.reserve(fnInfo.params.size());
-          for (const auto& param : fnInfo.params) {
-            Type adj = param;
-            if (adj.isArray()) adj = adj.decayType();
-            paramTys.push_back(llvmType(env, adj));
-          }
-          fnTy = llvm::FunctionType::get(abiReturnType(env, fnInfo.returnType),
-                                         paramTys, fnInfo.isVariadic);
-          paramTypes = &fnInfo.params;
+    case NodeKind::CallExpr: {
+      auto* call = cast<CallExpr>(&e);
+      llvm::Value* calleeV = nullptr;
+      llvm::FunctionType* fnTy = nullptr;
+      const std::vector<Type>* paramTypes = nullptr;
+      if (call->calleeExpr) {
+        const Type& calleeTy = exprType(*call->calleeExpr);
+        if (!calleeTy.func) return i32Const(env, 0);
+        calleeV = emitExpr(env, *call->calleeExpr);
+        std::vector<llvm::Type*> paramTys;
+        paramTys.reserve(calleeTy.func->params.size());
+        for (const auto& param : calleeTy.func->params) {
+          Type adj = param;
+          if (adj.isArray()) adj = adj.decayType();
+          paramTys.push_back(llvmType(env, adj));
         }
-      }
-      if (!calleeV) {
-        if (auto* global = env.lookupGlobal(call->callee)) {
-          if (global->type.isFunctionPointer()) {
-            calleeV = env.b.CreateLoad(llvmType(env, global->type), global->gv, call->callee + ".fn");
-            const auto& fnInfo = *global->type.func;
+        fnTy = llvm::FunctionType::get(abiReturnType(env, calleeTy.func->returnType),
+                                       paramTys, calleeTy.func->isVariadic);
+        paramTypes = &calleeTy.func->params;
+      } else {
+        if (auto* local = env.lookupLocal(call->callee)) {
+          if (local->type.isFunctionPointer()) {
+            calleeV = env.b.CreateLoad(llvmType(env, local->type), local->slot, call->callee + ".fn");
+            const auto& fnInfo = *local->type.func;
             std::vector<llvm::Type*> paramTys;
             paramTys.reserve(fnInfo.params.size());
             for (const auto& param : fnInfo.params) {
@@ -1250,232 +1246,253 @@ static llvm::Value* emitExpr(CGEnv& env, const Expr& e) {
             paramTypes = &fnInfo.params;
           }
         }
-      }
-      if (!calleeV) {
-        auto it = env.functions.find(call->callee);
-        if (it != env.functions.end()) {
-          calleeV = it->second;
-          auto pit = env.functionParamTypes.find(call->callee);
-          if (pit != env.functionParamTypes.end()) paramTypes = &pit->second;
-          fnTy = it->second->getFunctionType();
-        }
-      }
-      if (!calleeV || !fnTy) return i32Const(env, 0);
-    }
-
-    std::vector<llvm::Value*> argsV;
-    argsV.reserve(call->args.size());
-    for (size_t i = 0; i < call->args.size(); ++i) {
-      const auto& a = call->args[i];
-      if (paramTypes && i < paramTypes->size()) {
-        const Type& dstTy = (*paramTypes)[i];
-        llvm::Type* paramTy = llvmType(env, dstTy);
-        if (dstTy.isPointer() && isNullPointerLiteral(*a)) {
-          argsV.push_back(llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(paramTy)));
-          continue;
+        if (!calleeV) {
+          if (auto* global = env.lookupGlobal(call->callee)) {
+            if (global->type.isFunctionPointer()) {
+              calleeV = env.b.CreateLoad(llvmType(env, global->type), global->gv, call->callee + ".fn");
+              const auto& fnInfo = *global->type.func;
+              std::vector<llvm::Type*> paramTys;
+              paramTys.reserve(fnInfo.params.size());
+              for (const auto& param : fnInfo.params) {
+                Type adj = param;
+                if (adj.isArray()) adj = adj.decayType();
+                paramTys.push_back(llvmType(env, adj));
+              }
+              fnTy = llvm::FunctionType::get(abiReturnType(env, fnInfo.returnType),
+                                             paramTys, fnInfo.isVariadic);
+              paramTypes = &fnInfo.params;
+            }
+          }
         }
-        if (dstTy.isPointer() && exprType(*a).isPointer()) {
-          llvm::Value* v = emitExpr(env, *a);
-          argsV.push_back(castPointerIfNeeded(env, v, paramTy));
-          continue;
+        if (!calleeV) {
+          auto it = env.functions.find(call->callee);
+          if (it != env.functions.end()) {
+            calleeV = it->second;
+            auto pit = env.functionParamTypes.find(call->callee);
+            if (pit != env.functionParamTypes.end()) paramTypes = &pit->second;
+            fnTy = it->second->getFunctionType();
+          }
         }
-        if (dstTy.isNumeric() && exprType(*a).isNumeric()) {
-          llvm::Value* v = emitExpr(env, *a);
-          argsV.push_back(castNumericToType(env, v, exprType(*a), dstTy));
-          continue;
+        if (!calleeV || !fnTy) return i32Const(env, 0);
+      }
+
+      std::vector<llvm::Value*> argsV;
+      argsV.reserve(call->args.size());
+      for (size_t i = 0; i < call->args.size(); ++i) {
+        const auto& a = call->args[i];
+        if (paramTypes && i < paramTypes->size()) {
+          const Type& dstTy = (*paramTypes)[i];
+          llvm::Type* paramTy = llvmType(env, dstTy);
+          if (dstTy.isPointer() && isNullPointerLiteral(*a)) {
+            argsV.push_back(llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(paramTy)));
+            continue;
+          }
+          if (dstTy.isPointer() && exprType(*a).isPointer()) {
+            llvm::Value* v = emitExpr(env, *a);
+            argsV.push_back(castPointerIfNeeded(env, v, paramTy));
+            continue;
+          }
+          if (dstTy.isNumeric() && exprType(*a).isNumeric()) {
+            llvm::Value* v = emitExpr(env, *a);
+            argsV.push_back(castNumericToType(env, v, exprType(*a), dstTy));
+            continue;
+          }
         }
+        argsV.push_back(emitExpr(env, *a));
       }
-      argsV.push_back(emitExpr(env, *a));
-    }
 
-    llvm::Value* callV = env.b.CreateCall(fnTy, calleeV, argsV, "calltmp");
-    const Type& resTy = exprType(*call);
-    if (resTy.base == Type::Base::Struct && resTy.ptrDepth == 0) {
-      callV = unpackReturnValue(env, resTy, callV);
+      llvm::Value* callV = env.b.CreateCall(
+          fnTy, calleeV, argsV, fnTy->getReturnType()->isVoidTy() ? "" : "calltmp");
+      const Type& resTy = exprType(*call);
+      if (resTy.base == Type::Base::Struct && resTy.ptrDepth == 0) {
+        callV = unpackReturnValue(env, resTy, callV);
+      }
+      return callV;
     }
-    return callV;
-  }
-
-  if (auto* ter = dynamic_cast<const TernaryExpr*>(&e)) {
-    llvm::Value* condV = emitExpr(env, *ter->cond);
-    llvm::Value* condB = asBoolI1(env, condV);
-
-    llvm::Function* F = env.fn;
-    llvm::BasicBlock* thenBB = llvm::BasicBlock::Create(env.ctx, "ternary.then", F);
-    llvm::BasicBlock* elseBB = llvm::BasicBlock::Create(env.ctx, "ternary.else", F);
-    llvm::BasicBlock* endBB  = llvm::BasicBlock::Create(env.ctx, "ternary.end", F);
-
-    env.b.CreateCondBr(condB, thenBB, elseBB);
+    case NodeKind::TernaryExpr: {
+      auto* ter = cast<TernaryExpr>(&e);
+      llvm::Value* condV = emitExpr(env, *ter->cond);
+      llvm::Value* condB = asBoolI1(env, condV);
 
-    env.b.SetInsertPoint(thenBB);
-    llvm::Value* thenV = emitExpr(env, *ter->thenExpr);
-    if (!env.b.GetInsertBlock()->getTerminator()) env.b.CreateBr(endBB);
-    thenBB = env.b.GetInsertBlock();
+      llvm::Function* F = env.fn;
+      llvm::BasicBlock* thenBB = llvm::BasicBlock::Create(env.ctx, "ternary.then", F);
+      llvm::BasicBlock* elseBB = llvm::BasicBlock::Create(env.ctx, "ternary.else", F);
+      llvm::BasicBlock* endBB  = llvm::BasicBlock::Create(env.ctx, "ternary.end", F);
 
-    env.b.SetInsertPoint(elseBB);
-    llvm::Value* elseV = emitExpr(env, *ter->elseExpr);
-    if (!env.b.GetInsertBlock()->getTerminator()) env.b.CreateBr(endBB);
-    elseBB = env.b.GetInsertBlock();
-
-    env.b.SetInsertPoint(endBB);
-    const Type& resTy = exprType(*ter);
-    llvm::Type* resLlvmTy = llvmType(env, resTy);
-    if (resTy.isPointer()) {
-      if (isNullPointerLiteral(*ter->thenExpr)) {
-        thenV = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(resLlvmTy));
-      }
-      if (isNullPointerLiteral(*ter->elseExpr)) {
-        elseV = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(resLlvmTy));
-      }
-    } else if (resTy.isNumeric()) {
-      thenV = castNumericToType(env, thenV, exprType(*ter->thenExpr), resTy);
-      elseV = castNumericToType(env, elseV, exprType(*ter->elseExpr), resTy);
-    }
-    llvm::PHINode* phi = env.b.CreatePHI(resLlvmTy, 2, "ternary");
-    phi->addIncoming(thenV, thenBB);
-    phi->addIncoming(elseV, elseBB);
-    return phi;
-  }
+      env.b.CreateCondBr(condB, thenBB, elseBB);
 
-  if (auto* un = dynamic_cast<const UnaryExpr*>(&e)) {
-    return emitUnary(env, *un);
-  }
+      env.b.SetInsertPoint(thenBB);
+      llvm::Value* thenV = emitExpr(env, *ter->thenExpr);
+      if (!env.b.GetInsertBlock()->getTerminator()) env.b.CreateBr(endBB);
+      thenBB = env.b.GetInsertBlock();
 
-  if (auto* sub = dynamic_cast<const SubscriptExpr*>(&e)) {
-    llvm::Value* addr = emitLValue(env, *sub);
-    const Type& elemTy = exprType(e);
-    if (elemTy.isArray()) {
-      return decayArrayToPointer(env, addr, elemTy);
-    }
-    return env.b.CreateLoad(llvmType(env, elemTy), addr, "sub.val");
-  }
+      env.b.SetInsertPoint(elseBB);
+      llvm::Value* elseV = emitExpr(env, *ter->elseExpr);
+      if (!env.b.GetInsertBlock()->getTerminator()) env.b.CreateBr(endBB);
+      elseBB = env.b.GetInsertBlock();
 
-  if (auto* mem = dynamic_cast<const MemberExpr*>(&e)) {
-    llvm::Value* addr = emitLValue(env, *mem);
-    Type baseTy = exprType(*mem->base);
-    Type structTy = mem->isArrow ? baseTy.pointee() : baseTy;
-    Type fieldTy;
-    bool found = false;
-    auto it = env.structFields.find(structTy.structName);
-    if (it != env.structFields.end()) {
-      for (const auto& field : it->second) {
-        if (field.name == mem->member) {
-          fieldTy = field.type;
-          found = true;
-          break;
+      env.b.SetInsertPoint(endBB);
+      const Type& resTy = exprType(*ter);
+      llvm::Type* resLlvmTy = llvmType(env, resTy);
+      if (resTy.isPointer()) {
+        if (isNullPointerLiteral(*ter->thenExpr)) {
+          thenV = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(resLlvmTy));
+        }
+        if (isNullPointerLiteral(*ter->elseExpr)) {
+          elseV = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(resLlvmTy));
+        }
+      } else if (resTy.isNumeric()) {
+        thenV = castNumericToType(env, thenV, exprType(*ter->thenExpr), resTy);
+        elseV = castNumericToType(env, elseV, exprType(*ter->elseExpr), resTy);
+      }
+      llvm::PHINode* phi = env.b.CreatePHI(resLlvmTy, 2, "ternary");
+      phi->addIncoming(thenV, thenBB);
+      phi->addIncoming(elseV, elseBB);
+      return phi;
+    }
+    case NodeKind::UnaryExpr: {
+      auto* un = cast<UnaryExpr>(&e);
+      return emitUnary(env, *un);
+    }
+    case NodeKind::SubscriptExpr: {
+      auto* sub = cast<SubscriptExpr>(&e);
+      llvm::Value* addr = emitLValue(env, *sub);
+      const Type& elemTy = exprType(e);
+      if (elemTy.isArray()) {
+        return decayArrayToPointer(env, addr, elemTy);
+      }
+      return env.b.CreateLoad(llvmType(env, elemTy), addr, "sub.val");
+    }
+    case NodeKind::MemberExpr: {
+      auto* mem = cast<MemberExpr>(&e);
+      llvm::Value* addr = emitLValue(env, *mem);
+      Type baseTy = exprType(*mem->base);
+      Type structTy = mem->isArrow ? baseTy.pointee() : baseTy;
+      Type fieldTy;
+      bool found = false;
+      auto it = env.structFields.find(structTy.structName);
+      if (it != env.structFields.end()) {
+        for (const auto& field : it->second) {
+          if (field.name == mem->member) {
+            fieldTy = field.type;
+            found = true;
+            break;
+          }
         }
       }
-    }
-    const Type& elemTy = found ? fieldTy : exprType(e);
-    if (elemTy.isArray() && !elemTy.ptrOutsideArrays) {
-      return decayArrayToPointer(env, addr, elemTy);
-    }
-    return env.b.CreateLoad(llvmType(env, elemTy), addr, "member.val");
-  }
-
-  if (auto* bin = dynamic_cast<const BinaryExpr*>(&e)) {
-    return emitBinary(env, *bin);
-  }
-
-  if (auto* asn = dynamic_cast<const AssignExpr*>(&e)) {
-    llvm::Value* addr = emitLValue(env, *asn->lhs);
-    const Type& lhsTy = exprType(*asn->lhs);
-    const Type& rhsTy = exprType(*asn->rhs);
-    llvm::Value* rhsV = emitExpr(env, *asn->rhs);
-
-    if (asn->op != TokenKind::Assign) {
-      llvm::Value* lhsV = env.b.CreateLoad(llvmType(env, lhsTy), addr, "assign.lhs");
-      llvm::Value* newV = nullptr;
-      Type resultTy = lhsTy;
-      if (asn->op == TokenKind::PlusAssign || asn->op == TokenKind::MinusAssign) {
-        if (lhsTy.isPointer() && rhsTy.isInteger()) {
-          llvm::Value* idx = castIndex(env, rhsV, rhsTy);
-          if (asn->op == TokenKind::MinusAssign) {
-            llvm::Value* zero = llvm::ConstantInt::get(idx->getType(), 0, true);
-            idx = env.b.CreateSub(zero, idx, "neg");
+      const Type& elemTy = found ? fieldTy : exprType(e);
+      if (elemTy.isArray() && !elemTy.ptrOutsideArrays) {
+        return decayArrayToPointer(env, addr, elemTy);
+      }
+      return env.b.CreateLoad(llvmType(env, elemTy), addr, "member.val");
+    }
+    case NodeKind::BinaryExpr: {
+      auto* bin = cast<BinaryExpr>(&e);
+      return emitBinary(env, *bin);
+    }
+    case NodeKind::AssignExpr: {
+      auto* asn = cast<AssignExpr>(&e);
+      llvm::Value* addr = emitLValue(env, *asn->lhs);
+      const Type& lhsTy = exprType(*asn->lhs);
+      const Type& rhsTy = exprType(*asn->rhs);
+      llvm::Value* rhsV = emitExpr(env, *asn->rhs);
+
+      if (asn->op != TokenKind::Assign) {
+        llvm::Value* lhsV = env.b.CreateLoad(llvmType(env, lhsTy), addr, "assign.lhs");
+        llvm::Value* newV = nullptr;
+        Type resultTy = lhsTy;
+        if (asn->op == TokenKind::PlusAssign || asn->op == TokenKind::MinusAssign) {
+          if (lhsTy.isPointer() && rhsTy.isInteger()) {
+            llvm::Value* idx = castIndex(env, rhsV, rhsTy);
+            if (asn->op == TokenKind::MinusAssign) {
+              llvm::Value* zero = llvm::ConstantInt::get(idx->getType(), 0, true);
+              idx = env.b.CreateSub(zero, idx, "neg");
+            }
+            llvm::Type* elemTy = lhsV->getType()->getPointerElementType();
+            newV = env.b.CreateGEP(elemTy, lhsV, idx, "ptr.add");
+          } else {
+            Type resTy = commonNumericType(lhsTy, rhsTy);
+            resultTy = resTy;
+            llvm::Value* L = castNumericToType(env, lhsV, lhsTy, resTy);
+            llvm::Value* R = castNumericToType(env, rhsV, rhsTy, resTy);
+            if (resTy.isFloating()) {
+              newV = (asn->op == TokenKind::PlusAssign)
+                        ? env.b.CreateFAdd(L, R, "fadd")
+                        : env.b.CreateFSub(L, R, "fsub");
+            } else {
+              newV = (asn->op == TokenKind::PlusAssign)
+                        ? env.b.CreateAdd(L, R, "add")
+                        : env.b.CreateSub(L, R, "sub");
+            }
           }
-          llvm::Type* elemTy = lhsV->getType()->getPointerElementType();
-          newV = env.b.CreateGEP(elemTy, lhsV, idx, "ptr.add");
-        } else {
+        } else if (asn->op == TokenKind::StarAssign || asn->op == TokenKind::SlashAssign) {
           Type resTy = commonNumericType(lhsTy, rhsTy);
           resultTy = resTy;
           llvm::Value* L = castNumericToType(env, lhsV, lhsTy, resTy);
           llvm::Value* R = castNumericToType(env, rhsV, rhsTy, resTy);
           if (resTy.isFloating()) {
-            newV = (asn->op == TokenKind::PlusAssign)
-                      ? env.b.CreateFAdd(L, R, "fadd")
-                      : env.b.CreateFSub(L, R, "fsub");
+            newV = (asn->op == TokenKind::StarAssign)
+                      ? env.b.CreateFMul(L, R, "fmul")
+                      : env.b.CreateFDiv(L, R, "fdiv");
           } else {
-            newV = (asn->op == TokenKind::PlusAssign)
-                      ? env.b.CreateAdd(L, R, "add")
-                      : env.b.CreateSub(L, R, "sub");
+            newV = (asn->op == TokenKind::StarAssign)
+                      ? env.b.CreateMul(L, R, "mul")
+                      : (resTy.isUnsigned ? env.b.CreateUDiv(L, R, "udiv")
+                                          : env.b.CreateSDiv(L, R, "sdiv"));
           }
+        } else if (asn->op == TokenKind::PercentAssign) {
+          Type resTy = commonIntegerType(lhsTy, rhsTy);
+          resultTy = resTy;
+          llvm::Value* L = castNumericToType(env, lhsV, lhsTy, resTy);
+          llvm::Value* R = castNumericToType(env, rhsV, rhsTy, resTy);
+          newV = resTy.isUnsigned ? env.b.CreateURem(L, R, "urem")
+                                  : env.b.CreateSRem(L, R, "srem");
+        } else if (asn->op == TokenKind::LessLessAssign || asn->op == TokenKind::GreaterGreaterAssign) {
+          Type resTy = promoteInteger(lhsTy);
+          resultTy = resTy;
+          llvm::Value* L = castNumericToType(env, lhsV, lhsTy, resTy);
+          llvm::Value* R = castNumericToType(env, rhsV, rhsTy, resTy);
+          if (asn->op == TokenKind::LessLessAssign) {
+            newV = env.b.CreateShl(L, R, "shl");
+          } else if (resTy.isUnsigned) {
+            newV = env.b.CreateLShr(L, R, "lshr");
+          } else {
+            newV = env.b.CreateAShr(L, R, "ashr");
+          }
+        } else if (asn->op == TokenKind::AmpAssign || asn->op == TokenKind::PipeAssign ||
+                   asn->op == TokenKind::CaretAssign) {
+          Type resTy = commonIntegerType(lhsTy, rhsTy);
+          resultTy = resTy;
+          llvm::Value* L = castNumericToType(env, lhsV, lhsTy, resTy);
+          llvm::Value* R = castNumericToType(env, rhsV, rhsTy, resTy);
+          if (asn->op == TokenKind::AmpAssign) newV = env.b.CreateAnd(L, R, "and");
+          else if (asn->op == TokenKind::PipeAssign) newV = env.b.CreateOr(L, R, "or");
+          else newV = env.b.CreateXor(L, R, "xor");
         }
-      } else if (asn->op == TokenKind::StarAssign || asn->op == TokenKind::SlashAssign) {
-        Type resTy = commonNumericType(lhsTy, rhsTy);
-        resultTy = resTy;
-        llvm::Value* L = castNumericToType(env, lhsV, lhsTy, resTy);
-        llvm::Value* R = castNumericToType(env, rhsV, rhsTy, resTy);
-        if (resTy.isFloating()) {
-          newV = (asn->op == TokenKind::StarAssign)
-                    ? env.b.CreateFMul(L, R, "fmul")
-                    : env.b.CreateFDiv(L, R, "fdiv");
-        } else {
-          newV = (asn->op == TokenKind::StarAssign)
-                    ? env.b.CreateMul(L, R, "mul")
-                    : (resTy.isUnsigned ? env.b.CreateUDiv(L, R, "udiv")
-                                        : env.b.CreateSDiv(L, R, "sdiv"));
-        }
-      } else if (asn->op == TokenKind::PercentAssign) {
-        Type resTy = commonIntegerType(lhsTy, rhsTy);
-        resultTy = resTy;
-        llvm::Value* L = castNumericToType(env, lhsV, lhsTy, resTy);
-        llvm::Value* R = castNumericToType(env, rhsV, rhsTy, resTy);
-        newV = resTy.isUnsigned ? env.b.CreateURem(L, R, "urem")
-                                : env.b.CreateSRem(L, R, "srem");
-      } else if (asn->op == TokenKind::LessLessAssign || asn->op == TokenKind::GreaterGreaterAssign) {
-        Type resTy = promoteInteger(lhsTy);
-        resultTy = resTy;
-        llvm::Value* L = castNumericToType(env, lhsV, lhsTy, resTy);
-        llvm::Value* R = castNumericToType(env, rhsV, rhsTy, resTy);
-        if (asn->op == TokenKind::LessLessAssign) {
-          newV = env.b.CreateShl(L, R, "shl");
-        } else if (resTy.isUnsigned) {
-          newV = env.b.CreateLShr(L, R, "lshr");
-        } else {
-          newV = env.b.CreateAShr(L, R, "ashr");
+
+        if (!newV) return i32Const(env, 0);
+        llvm::Value* storeV = newV;
+        if (lhsTy.isNumeric() && storeV->getType() != llvmType(env, lhsTy)) {
+          storeV = castNumericToType(env, storeV, resultTy, lhsTy);
         }
-      } else if (asn->op == TokenKind::AmpAssign || asn->op == TokenKind::PipeAssign ||
-                 asn->op == TokenKind::CaretAssign) {
-        Type resTy = commonIntegerType(lhsTy, rhsTy);
-        resultTy = resTy;
-        llvm::Value* L = castNumericToType(env, lhsV, lhsTy, resTy);
-        llvm::Value* R = castNumericToType(env, rhsV, rhsTy, resTy);
-        if (asn->op == TokenKind::AmpAssign) newV = env.b.CreateAnd(L, R, "and");
-        else if (asn->op == TokenKind::PipeAssign) newV = env.b.CreateOr(L, R, "or");
-        else newV = env.b.CreateXor(L, R, "xor");
-      }
-
-      if (!newV) return i32Const(env, 0);
-      llvm::Value* storeV = newV;
-      if (lhsTy.isNumeric() && storeV->getType() != llvmType(env, lhsTy)) {
-        storeV = castNumericToType(env, storeV, resultTy, lhsTy);
-      }
-      env.b.CreateStore(storeV, addr);
-      return storeV;
-    }
-
-    if (lhsTy.isPointer() && isNullPointerLiteral(*asn->rhs)) {
-      llvm::Type* ptrTy = llvmType(env, lhsTy);
-      rhsV = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(ptrTy));
-    } else if (lhsTy.isPointer() && rhsTy.isPointer()) {
-      llvm::Type* ptrTy = llvmType(env, lhsTy);
-      rhsV = castPointerIfNeeded(env, rhsV, ptrTy);
-    } else if (lhsTy.isNumeric() && rhsTy.isNumeric()) {
-      rhsV = castNumericToType(env, rhsV, rhsTy, lhsTy);
-    }
-    env.b.CreateStore(rhsV, addr);
-    return rhsV;
+        env.b.CreateStore(storeV, addr);
+        return storeV;
+      }
+
+      if (lhsTy.isPointer() && isNullPointerLiteral(*asn->rhs)) {
+        llvm::Type* ptrTy = llvmType(env, lhsTy);
+        rhsV = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(ptrTy));
+      } else if (lhsTy.isPointer() && rhsTy.isPointer()) {
+        llvm::Type* ptrTy = llvmType(env, lhsTy);
+        rhsV = castPointerIfNeeded(env, rhsV, ptrTy);
+      } else if (lhsTy.isNumeric() && rhsTy.isNumeric()) {
+        rhsV = castNumericToType(env, rhsV, rhsTy, lhsTy);
+      }
+      env.b.CreateStore(rhsV, addr);
+      return rhsV;
+    }
+    default:
+      break;
   }
 
   return i32Const(env, 0);
@@ -1675,125 +1692,124 @@ static bool emitFor(CGEnv& env, const ForStmt& s) {
 static bool emitStmt(CGEnv& env, const Stmt& s) {
   if (env.b.GetInsertBlock()->getTerminator()) return true;
 
-  if (auto* blk = dynamic_cast<const BlockStmt*>(&s)) return emitBlock(env, *blk);
+  switch (s.kind) {
+    case NodeKind::BlockStmt: return emitBlock(env, cast<BlockStmt>(s));
+    case NodeKind::DeclStmt: {
+      auto* d = cast<DeclStmt>(&s);
+      for (const auto& item : d->items) {
+        if (item.storage == StorageClass::Extern) {
+          if (!env.lookupGlobal(item.name)) {
+            llvm::Type* gvTy = llvmType(env, item.type);
+            auto* gv = new llvm::GlobalVariable(
+                env.mod, gvTy, /*isConstant=*/false, llvm::GlobalValue::ExternalLinkage,
+                /*Initializer=*/nullptr, item.name.str());
+            env.insertGlobal(item.name, gv, item.type);
+          }
+          continue;
+        }
+        if (item.storage == StorageClass::Static) {
+          std::string unique = "__c99cc_static_";
+          if (env.fn) {
+            unique += env.fn->getName().str();
+          } else {
+            unique += "global";
+          }
+          unique += "_" + item.name + "_" + std::to_string(env.staticLocalCounter++);
 
-  if (auto* d = dynamic_cast<const DeclStmt*>(&s)) {
-    for (const auto& item : d->items) {
-      if (item.storage == StorageClass::Extern) {
-        if (!env.lookupGlobal(item.name)) {
           llvm::Type* gvTy = llvmType(env, item.type);
+          llvm::Constant* init = nullptr;
+          if (item.type.isArray()) {
+            init = llvm::ConstantAggregateZero::get(gvTy);
+          } else if (item.type.base == Type::Base::Struct && item.type.ptrDepth == 0) {
+            init = llvm::ConstantAggregateZero::get(gvTy);
+          } else if (item.type.isPointer()) {
+            init = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(gvTy));
+          } else {
+            init = zeroValue(env, item.type);
+          }
           auto* gv = new llvm::GlobalVariable(
-              env.mod, gvTy, /*isConstant=*/false, llvm::GlobalValue::ExternalLinkage,
-              /*Initializer=*/nullptr, item.name);
-          env.insertGlobal(item.name, gv, item.type);
-        }
-        continue;
-      }
-      if (item.storage == StorageClass::Static) {
-        std::string unique = "__c99cc_static_";
-        if (env.fn) {
-          unique += env.fn->getName().str();
-        } else {
-          unique += "global";
+              env.mod, gvTy, /*isConstant=*/false, llvm::GlobalValue::InternalLinkage, init, unique);
+          env.insertGlobal(Symbol::intern(unique), gv, item.type);
+          env.insertLocal(item.name, gv, item.type);
+          if (item.initExpr && env.globalInits) env.globalInits->emplace_back(gv, item.initExpr.get());
+          continue;
         }
-        unique += "_" + item.name + "_" + std::to_string(env.staticLocalCounter++);
-
-        llvm::Type* gvTy = llvmType(env, item.type);
-        llvm::Constant* init = nullptr;
-        if (item.type.isArray()) {
-          init = llvm::ConstantAggregateZero::get(gvTy);
-        } else if (item.type.base == Type::Base::Struct && item.type.ptrDepth == 0) {
-          init = llvm::ConstantAggregateZero::get(gvTy);
-        } else if (item.type.isPointer()) {
-          init = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(gvTy));
+
+        llvm::AllocaInst* slot = createEntryAlloca(env, item.name, item.type);
+        env.insertLocal(item.name, slot, item.type);
+        if (item.initExpr) {
+          emitInitToAddr(env, item.type, slot, *item.initExpr);
         } else {
-          init = zeroValue(env, item.type);
+          env.b.CreateStore(zeroValue(env, item.type), slot);
         }
-        auto* gv = new llvm::GlobalVariable(
-            env.mod, gvTy, /*isConstant=*/false, llvm::GlobalValue::InternalLinkage, init, unique);
-        env.insertGlobal(unique, gv, item.type);
-        env.insertLocal(item.name, gv, item.type);
-        if (item.initExpr && env.globalInits) env.globalInits->emplace_back(gv, item.initExpr.get());
-        continue;
-      }
-
-      llvm::AllocaInst* slot = createEntryAlloca(env, item.name, item.type);
-      env.insertLocal(item.name, slot, item.type);
-      if (item.initExpr) {
-        emitInitToAddr(env, item.type, slot, *item.initExpr);
-      } else {
-        env.b.CreateStore(zeroValue(env, item.type), slot);
       }
+      return false;
     }
-    return false;
-  }
-
-  // legacy AssignStmt
-  if (auto* a = dynamic_cast<const AssignStmt*>(&s)) {
-    llvm::Value* rhsV = emitExpr(env, *a->valueExpr);
-    if (auto* local = env.lookupLocal(a->name)) {
-      env.b.CreateStore(rhsV, local->slot);
-    } else if (auto* global = env.lookupGlobal(a->name)) {
-      env.b.CreateStore(rhsV, global->gv);
-    }
-    return false;
-  }
-
-  if (auto* r = dynamic_cast<const ReturnStmt*>(&s)) {
-    if (!r->valueExpr) {
-      env.b.CreateRetVoid();
-      return true;
-    }
-    llvm::Value* retV = emitExpr(env, *r->valueExpr);
-    if (env.currentReturnType.isPointer() && isNullPointerLiteral(*r->valueExpr)) {
-      llvm::Type* ptrTy = llvmType(env, env.currentReturnType);
-      retV = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(ptrTy));
-    } else if (env.currentReturnType.isPointer() && exprType(*r->valueExpr).isPointer()) {
-      llvm::Type* ptrTy = llvmType(env, env.currentReturnType);
-      retV = castPointerIfNeeded(env, retV, ptrTy);
-    } else if (env.currentReturnType.isNumeric() && exprType(*r->valueExpr).isNumeric()) {
-      retV = castNumericToType(env, retV, exprType(*r->valueExpr), env.currentReturnType);
-    }
-    if (env.currentReturnType.base == Type::Base::Struct && env.currentReturnType.ptrDepth == 0) {
-      retV = packReturnValue(env, env.currentReturnType, retV);
+    // legacy AssignStmt
+    case NodeKind::AssignStmt: {
+      auto* a = cast<AssignStmt>(&s);
+      llvm::Value* rhsV = emitExpr(env, *a->valueExpr);
+      if (auto* local = env.lookupLocal(a->name)) {
+        env.b.CreateStore(rhsV, local->slot);
+      } else if (auto* global = env.lookupGlobal(a->name)) {
+        env.b.CreateStore(rhsV, global->gv);
+      }
+      return false;
     }
-    env.b.CreateRet(retV);
-    return true;
-  }
-
-  if (auto* br = dynamic_cast<const BreakStmt*>(&s)) {
-    if (!env.loops.empty()) {
-      env.b.CreateBr(env.loops.back().first);
+    case NodeKind::ReturnStmt: {
+      auto* r = cast<ReturnStmt>(&s);
+      if (!r->valueExpr) {
+        env.b.CreateRetVoid();
+        return true;
+      }
+      llvm::Value* retV = emitExpr(env, *r->valueExpr);
+      if (env.currentReturnType.isPointer() && isNullPointerLiteral(*r->valueExpr)) {
+        llvm::Type* ptrTy = llvmType(env, env.currentReturnType);
+        retV = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(ptrTy));
+      } else if (env.currentReturnType.isPointer() && exprType(*r->valueExpr).isPointer()) {
+        llvm::Type* ptrTy = llvmType(env, env.currentReturnType);
+        retV = castPointerIfNeeded(env, retV, ptrTy);
+      } else if (env.currentReturnType.isNumeric() && exprType(*r->valueExpr).isNumeric()) {
+        retV = castNumericToType(env, retV, exprType(*r->valueExpr), env.currentReturnType);
+      }
+      if (env.currentReturnType.base == Type::Base::Struct && env.currentReturnType.ptrDepth == 0) {
+        retV = packReturnValue(env, env.currentReturnType, retV);
+      }
+      env.b.CreateRet(retV);
       return true;
     }
-    return false;
-  }
-
-  if (auto* co = dynamic_cast<const ContinueStmt*>(&s)) {
-    for (auto it = env.loops.rbegin(); it != env.loops.rend(); ++it) {
-      if (it->second) {
-        env.b.CreateBr(it->second);
+    case NodeKind::BreakStmt: {
+      if (!env.loops.empty()) {
+        env.b.CreateBr(env.loops.back().first);
         return true;
       }
+      return false;
     }
-    return false;
-  }
-
-  if (auto* sw = dynamic_cast<const SwitchStmt*>(&s)) return emitSwitch(env, *sw);
-  if (auto* iff = dynamic_cast<const IfStmt*>(&s)) return emitIf(env, *iff);
-  if (auto* wh  = dynamic_cast<const WhileStmt*>(&s)) return emitWhile(env, *wh);
-  if (auto* dw  = dynamic_cast<const DoWhileStmt*>(&s)) return emitDoWhile(env, *dw);
-  if (auto* fo  = dynamic_cast<const ForStmt*>(&s)) return emitFor(env, *fo);
-
-  if (auto* es = dynamic_cast<const ExprStmt*>(&s)) {
-    (void)emitExpr(env, *es->expr);
-    return false;
+    case NodeKind::ContinueStmt: {
+      for (auto it = env.loops.rbegin(); it != env.loops.rend(); ++it) {
+        if (it->second) {
+          env.b.CreateBr(it->second);
+          return true;
+        }
+      }
+      return false;
+    }
+    case NodeKind::SwitchStmt: return emitSwitch(env, cast<SwitchStmt>(s));
+    case NodeKind::IfStmt: return emitIf(env, cast<IfStmt>(s));
+    case NodeKind::WhileStmt: return emitWhile(env, cast<WhileStmt>(s));
+    case NodeKind::DoWhileStmt: return emitDoWhile(env, cast<DoWhileStmt>(s));
+    case NodeKind::ForStmt: return emitFor(env, cast<ForStmt>(s));
+    case NodeKind::ExprStmt: {
+      auto* es = cast<ExprStmt>(&s);
+      (void)emitExpr(env, *es->expr);
+      return false;
+    }
+    case NodeKind::TypedefStmt: return false;
+    case NodeKind::EmptyStmt: return false;
+    default:
+      break;
   }
 
-  if (dynamic_cast<const TypedefStmt*>(&s)) return false;
-
-  if (dynamic_cast<const EmptyStmt*>(&s)) return false;
-
   return false;
 }
 
@@ -1805,6 +1821,7 @@ std::unique_ptr<llvm::Module> CodeGen::emitLLVM(
     llvm::LLVMContext& ctx,
     const AstTranslationUnit& tu,
     const std::string& moduleName) {
+  TimeScope scope("EmitLLVM", moduleName);
   auto mod = std::make_unique<llvm::Module>(moduleName, ctx);
   llvm::IRBuilder<> builder(ctx);
   CGEnv env{ctx, *mod, builder};
@@ -1825,7 +1842,7 @@ std::unique_ptr<llvm::Module> CodeGen::emitLLVM(
     auto* sd = std::get_if<StructDef>(&item);
     if (!sd) continue;
     if (env.structs.count(sd->name)) continue;
-    env.structs.emplace(sd->name, llvm::StructType::create(ctx, sd->name));
+    env.structs.emplace(sd->name, llvm::StructType::create(ctx, sd->name.str()));
     env.structFields.emplace(sd->name, sd->fields);
   }
 
@@ -1854,7 +1871,7 @@ std::unique_ptr<llvm::Module> CodeGen::emitLLVM(
         llvm::Type* gvTy = llvmType(env, decl.type);
         auto* gv = new llvm::GlobalVariable(
             *mod, gvTy, /*isConstant=*/false, llvm::GlobalValue::ExternalLinkage,
-            /*Initializer=*/nullptr, decl.name);
+            /*Initializer=*/nullptr, decl.name.str());
         env.insertGlobal(decl.name, gv, decl.type);
         continue;
       }
@@ -1878,7 +1895,7 @@ std::unique_ptr<llvm::Module> CodeGen::emitLLVM(
         existing->gv->setInitializer(init);
       } else if (!existing) {
         auto* gv = new llvm::GlobalVariable(
-            *mod, gvTy, /*isConstant=*/false, linkage, init, decl.name);
+            *mod, gvTy, /*isConstant=*/false, linkage, init, decl.name.str());
         env.insertGlobal(decl.name, gv, decl.type);
         existing = env.lookupGlobal(decl.name);
       }
@@ -1891,7 +1908,7 @@ std::unique_ptr<llvm::Module> CodeGen::emitLLVM(
     const FunctionProto* p = getProto(item);
     if (!p) continue;
 
-    const std::string& name = p->name;
+    Symbol name = p->name;
 
     // if already declared, skip (Sema guarantees signature consistency)
     if (env.functions.count(name)) continue;
@@ -1909,14 +1926,14 @@ std::unique_ptr<llvm::Module> CodeGen::emitLLVM(
     auto linkage = p->storage == StorageClass::Static
         ? llvm::GlobalValue::InternalLinkage
         : llvm::GlobalValue::ExternalLinkage;
-    llvm::Function* F = llvm::Function::Create(fnTy, linkage, name, mod.get());
+    llvm::Function* F = llvm::Function::Create(fnTy, linkage, name.str(), mod.get());
     env.functions[name] = F;
     env.functionParamTypes.emplace(name, std::move(paramTypes));
 
     // name args if we have parameter names (definition may have names even if earlier decl didn't)
     unsigned i = 0;
     for (auto& arg : F->args()) {
-      if (i < p->params.size() && p->params[i].name.has_value()) arg.setName(*p->params[i].name);
+      if (i < p->params.size() && p->params[i].name.has_value()) arg.setName(p->params[i].name->str());
       ++i;
     }
   }
@@ -1934,6 +1951,7 @@ std::unique_ptr<llvm::Module> CodeGen::emitLLVM(
       // already emitted (shouldn't happen if Sema prevents redefinition)
       continue;
     }
+    TimeScope fnScope("EmitFunction", p.name.str());
 
     llvm::BasicBlock* entry = llvm::BasicBlock::Create(ctx, "entry", F);
     builder.SetInsertPoint(entry);
@@ -1946,7 +1964,7 @@ std::unique_ptr<llvm::Module> CodeGen::emitLLVM(
     unsigned idx = 0;
     for (auto& arg : F->args()) {
       if (idx < p.params.size() && p.params[idx].name.has_value()) {
-        std::string pname = *p.params[idx].name;
+        Symbol pname = *p.params[idx].name;
         Type prmTy = adjustParamType(p.params[idx].type);
         llvm::AllocaInst* slot = createEntryAlloca(env, pname, prmTy);
         env.insertLocal(pname, slot, prmTy);
@@ -1962,7 +1980,9 @@ std::unique_ptr<llvm::Module> CodeGen::emitLLVM(
     }
 
     if (!builder.GetInsertBlock()->getTerminator()) {
-      if (p.returnType.isPointer()) {
+      if (p.returnType.isVoid()) {
+        builder.CreateRetVoid();
+      } else if (p.returnType.isPointer()) {
         llvm::Type* ptrTy = llvmType(env, p.returnType);
         builder.CreateRet(llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(ptrTy)));
       } else {
@@ -1988,7 +2008,7 @@ std::unique_ptr<llvm::Module> CodeGen::emitLLVM(
     env.resetFunctionState(initFn);
 
     for (const auto& gi : globalInits) {
-      auto* binding = env.lookupGlobal(gi.first->getName().str());
+      auto* binding = env.lookupGlobal(Symbol::intern(gi.first->getName()));
       if (binding) {
         emitInitToAddr(env, binding->type, gi.first, *gi.second);
       }
@@ -1997,7 +2017,7 @@ std::unique_ptr<llvm::Module> CodeGen::emitLLVM(
     builder.CreateRetVoid();
     llvm::verifyFunction(*initFn);
 
-    auto it = env.functions.find("main");
+    auto it = env.functions.find(Symbol::intern("main"));
     if (it != env.functions.end() && !it->second->empty()) {
       llvm::Function* mainFn = it->second;
       llvm::BasicBlock& mainEntry = mainFn->getEntryBlock();
@@ -18,6 +18,11 @@ void Diagnostics::error(const SourceLocation& loc, std::string msg) {
   diags_.push_back(Diagnostic{Diagnostic::Level::Error, std::move(msg), loc});
 }
 
+void Diagnostics::append(const Diagnostics& other) {
+  has_error_ = has_error_ || other.has_error_;
+  diags_.insert(diags_.end(), other.diags_.begin(), other.diags_.end());
+}
+
 static std::string getLineText(const std::string& src, int line) {
   int cur = 1;
   size_t start = 0;
@@ -33,14 +38,19 @@ static std::string getLineText(const std::string& src, int line) {
 }
 
 void Diagnostics::printAll(const std::string& filename, const std::string& source) const {
+  printAll(std::cerr, filename, source);
+}
+
+void Diagnostics::printAll(
+    std::ostream& os, const std::string& filename, const std::string& source) const {
   for (const auto& d : diags_) {
-    std::cerr << filename << ":" << d.loc.line << ":" << d.loc.col
-              << ": " << levelName(d.level) << ": " << d.message << "\n";
+    os << filename << ":" << d.loc.line << ":" << d.loc.col
+       << ": " << levelName(d.level) << ": " << d.message << "\n";
 
     auto lineText = getLineText(source, d.loc.line);
     if (!lineText.empty()) {
-      std::cerr << "  " << lineText << "\n";
-      std::cerr << "  " << std::string(std::max(0, d.loc.col - 1), ' ') << "^\n";
+      os << "  " << lineText << "\n";
+      os << "  " << std::string(std::max(0, d.loc.col - 1), ' ') << "^\n";
     }
   }
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include <iosfwd>
 #include <string>
 #include <vector>
 
@@ -20,8 +21,11 @@ struct Diagnostic {
 class Diagnostics {
 public:
   void error(const SourceLocation& loc, std::string msg);
+  // Adds everything `other` reported, after what is here already.
+  void append(const Diagnostics& other);
   bool hasError() const { return has_error_; }
   void printAll(const std::string& filename, const std::string& source) const;
+  void printAll(std::ostream& os, const std::string& filename, const std::string& source) const;
 
 private:
   bool has_error_ = false;
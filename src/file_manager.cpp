@@ -0,0 +1,171 @@
+#include "file_manager.h"
+
+#include <filesystem>
+
+#include "llvm/Support/MemoryBuffer.h"
+
+namespace c99cc {
+
+namespace {
+
+bool statFile(const std::filesystem::path& path, uintmax_t& size, int64_t& mtime) {
+  std::error_code ec;
+  size = std::filesystem::file_size(path, ec);
+  if (ec) return false;
+  auto time = std::filesystem::last_write_time(path, ec);
+  if (ec) return false;
+  mtime = static_cast<int64_t>(time.time_since_epoch().count());
+  return true;
+}
+
+std::string joinPath(const std::string& dir, const std::string& file) {
+  std::string path = dir;
+  if (!path.empty() && path.back() != '/') path += "/";
+  path += file;
+  return path;
+}
+
+} // namespace
+
+FileManager::FileManager() = default;
+FileManager::~FileManager() = default;
+
+FileManager::Buffer FileManager::getBuffer(const std::string& path) {
+  std::string key = uniquePath(path);
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = buffers_.find(key);
+    if (it != buffers_.end() && it->second.verified) return it->second.buffer;
+  }
+
+  uintmax_t size = 0;
+  int64_t mtime = 0;
+  if (!statFile(key, size, mtime)) return nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = buffers_.find(key);
+    if (it != buffers_.end() && it->second.size == size && it->second.mtime == mtime) {
+      it->second.verified = true;
+      return it->second.buffer;
+    }
+  }
+
+  // read outside the lock; if two threads race, both buffers are identical
+  auto file = llvm::MemoryBuffer::getFile(key, /*IsText=*/false,
+                                          /*RequiresNullTerminator=*/false);
+  if (!file) return nullptr;
+  Buffer buffer(std::move(*file));
+
+  std::lock_guard<std::mutex> lock(mu_);
+  Entry& entry = buffers_[key];
+  entry.size = size;
+  entry.mtime = mtime;
+  entry.verified = true;
+  entry.buffer = buffer;
+  loaded_.push_back(key);
+  return buffer;
+}
+
+FileManager::SearchListId FileManager::searchList(const std::vector<std::string>& dirs) {
+  std::string key;
+  for (const auto& dir : dirs) key.append(dir).push_back('\0');
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = searchListIds_.find(key);
+  if (it != searchListIds_.end()) return it->second;
+  SearchListId id = static_cast<SearchListId>(searchLists_.size());
+  searchLists_.push_back(dirs);
+  searchListIds_.emplace(std::move(key), id);
+  return id;
+}
+
+std::optional<std::string> FileManager::resolveInclude(
+    const std::string& header, const std::string& includerDir, SearchListId list) {
+  std::string key = std::to_string(list);
+  key.push_back('\0');
+  key.append(includerDir).push_back('\0');
+  key.append(header);
+
+  std::vector<std::string> dirs;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = resolved_.find(key);
+    if (it != resolved_.end()) {
+      if (it->second.empty()) return std::nullopt;
+      return it->second;
+    }
+    dirs = searchLists_.at(list);
+  }
+
+  std::string found;
+  if (std::filesystem::path(header).is_absolute()) {
+    if (exists(header)) found = header;
+  } else {
+    if (!includerDir.empty()) dirs.insert(dirs.begin(), includerDir);
+    for (const auto& dir : dirs) {
+      std::string candidate = joinPath(dir, header);
+      if (exists(candidate)) {
+        found = std::move(candidate);
+        break;
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mu_);
+  resolved_[key] = found;
+  if (found.empty()) return std::nullopt;
+  return found;
+}
+
+std::string FileManager::uniquePath(const std::string& path) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = uniquePaths_.find(path);
+    if (it != uniquePaths_.end()) return it->second;
+  }
+  std::error_code ec;
+  std::filesystem::path abs = std::filesystem::absolute(path, ec);
+  std::string unique = ec ? path : abs.lexically_normal().string();
+  std::lock_guard<std::mutex> lock(mu_);
+  uniquePaths_.emplace(path, unique);
+  return unique;
+}
+
+bool FileManager::exists(const std::string& path) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = present_.find(path);
+    if (it != present_.end()) return it->second;
+  }
+  std::error_code ec;
+  bool present = std::filesystem::is_regular_file(path, ec);
+  std::lock_guard<std::mutex> lock(mu_);
+  present_.emplace(path, present);
+  return present;
+}
+
+void FileManager::invalidate() {
+  std::lock_guard<std::mutex> lock(mu_);
+  for (auto& entry : buffers_) entry.second.verified = false;
+  resolved_.clear();
+  present_.clear();
+  uniquePaths_.clear();
+}
+
+void FileManager::preload(const std::string& path) {
+  std::string key = uniquePath(path);
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = buffers_.find(key);
+    if (it != buffers_.end()) it->second.verified = false;
+  }
+  getBuffer(key);
+}
+
+std::vector<std::string> FileManager::takeLoaded() {
+  std::lock_guard<std::mutex> lock(mu_);
+  std::vector<std::string> out;
+  out.swap(loaded_);
+  return out;
+}
+
+} // namespace c99cc
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm {
+class MemoryBuffer;
+}
+
+namespace c99cc {
+
+// File access shared by every translation unit (and -j worker thread) of an
+// invocation: immutable file buffers, memory-mapped where LLVM finds it
+// worthwhile, plus cached #include resolutions and misses. The compile server
+// keeps one warm across requests; invalidate() makes it re-check the disk.
+class FileManager {
+public:
+  using Buffer = std::shared_ptr<const llvm::MemoryBuffer>;
+  using SearchListId = unsigned;
+
+  FileManager();
+  ~FileManager();
+
+  // Contents of `path`, or null if it cannot be read. Buffers are validated
+  // against size and mtime once after each invalidate().
+  Buffer getBuffer(const std::string& path);
+  // Equal include search lists get the same id.
+  SearchListId searchList(const std::vector<std::string>& dirs);
+  // Looks for `header` in `includerDir` (skipped when empty, as for <...>) and
+  // then in `list`; absolute headers are only checked for existence.
+  std::optional<std::string> resolveInclude(
+      const std::string& header, const std::string& includerDir, SearchListId list);
+  // Normalized absolute path: one key per file however it was spelled.
+  std::string uniquePath(const std::string& path);
+
+  // Forgets resolutions and misses; buffers are re-validated on next use.
+  void invalidate();
+  // Loads a file ahead of time, e.g. a header a server worker reported.
+  void preload(const std::string& path);
+  // Absolute paths read from disk rather than served from memory since the
+  // last call.
+  std::vector<std::string> takeLoaded();
+
+private:
+  struct Entry {
+    uintmax_t size = 0;
+    int64_t mtime = 0;
+    bool verified = false;
+    Buffer buffer;
+  };
+
+  bool exists(const std::string& path);
+
+  std::mutex mu_;
+  std::unordered_map<std::string, Entry> buffers_; // by uniquePath()
+  std::vector<std::vector<std::string>> searchLists_;
+  std::unordered_map<std::string, SearchListId> searchListIds_;
+  // (search list, includer dir, header) -> resolved path, "" when not found
+  std::unordered_map<std::string, std::string> resolved_;
+  // candidate paths already stat'ed, and whether a regular file was there
+  std::unordered_map<std::string, bool> present_;
+  std::unordered_map<std::string, std::string> uniquePaths_;
+  std::vector<std::string> loaded_;
+};
+
+} // namespace c99cc
@@ -1,11 +1,231 @@
 #include "lexer.h"
+#include <algorithm>
 #include <cctype>
+#include <cstring>
+#include <memory>
 #include <optional>
+#include <utility>
+
+#include "llvm/Support/MathExtras.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define C99CC_LEXER_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define C99CC_LEXER_NEON 1
+#endif
 
 namespace c99cc {
 
-Lexer::Lexer(const std::string& input, Diagnostics& diags)
-  : input_(input), diags_(diags) {}
+namespace {
+
+// Runs of whitespace, identifier characters and string-literal text are
+// measured 16 bytes at a time on SSE2 and NEON targets, and a byte at a time
+// elsewhere and for the tail of the input. Comments end at the next newline,
+// which memchr already finds with the widest vectors the C library has.
+bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+bool isIdentChar(char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; }
+bool isStringText(char c) { return c != '"' && c != '\\' && c != '\n'; }
+
+#if C99CC_LEXER_SSE2
+constexpr size_t kBlock = 16;
+using Block = __m128i;
+Block load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+Block eq(Block v, char c) { return _mm_cmpeq_epi8(v, _mm_set1_epi8(c)); }
+Block either(Block a, Block b) { return _mm_or_si128(a, b); }
+Block negate(Block v) { return _mm_xor_si128(v, _mm_set1_epi8(-1)); }
+// Signed compares: bytes >= 0x80 are negative, so never inside an ASCII range.
+Block inRange(Block v, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(static_cast<char>(lo - 1))),
+                       _mm_cmplt_epi8(v, _mm_set1_epi8(static_cast<char>(hi + 1))));
+}
+// How many bytes at the start of the block are set in `v`.
+size_t leadingSet(Block v) {
+  unsigned clear = ~static_cast<unsigned>(_mm_movemask_epi8(v)) & 0xFFFF;
+  return clear ? llvm::countTrailingZeros(clear) : kBlock;
+}
+#elif C99CC_LEXER_NEON
+constexpr size_t kBlock = 16;
+using Block = uint8x16_t;
+Block load(const char* p) { return vld1q_u8(reinterpret_cast<const uint8_t*>(p)); }
+Block eq(Block v, char c) { return vceqq_u8(v, vdupq_n_u8(static_cast<uint8_t>(c))); }
+Block either(Block a, Block b) { return vorrq_u8(a, b); }
+Block negate(Block v) { return vmvnq_u8(v); }
+Block inRange(Block v, char lo, char hi) {
+  return vandq_u8(vcgeq_u8(v, vdupq_n_u8(static_cast<uint8_t>(lo))),
+                  vcleq_u8(v, vdupq_n_u8(static_cast<uint8_t>(hi))));
+}
+// No movemask on NEON: narrowing by 4 leaves one nibble per byte.
+size_t leadingSet(Block v) {
+  uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(v), 4);
+  uint64_t clear = ~vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+  return clear ? llvm::countTrailingZeros(clear) / 4 : kBlock;
+}
+#endif
+
+// Length of the run at the start of [p, end) whose bytes all satisfy
+// `scalar`; `vector` is the same test on a whole block.
+template <typename VectorTest, typename ScalarTest>
+size_t runLength(const char* p, const char* end, VectorTest vector, ScalarTest scalar) {
+  const char* start = p;
+#if C99CC_LEXER_SSE2 || C99CC_LEXER_NEON
+  while (static_cast<size_t>(end - p) >= kBlock) {
+    size_t n = leadingSet(vector(load(p)));
+    p += n;
+    if (n < kBlock) return static_cast<size_t>(p - start);
+  }
+#else
+  (void)vector;
+#endif
+  while (p < end && scalar(*p)) p++;
+  return static_cast<size_t>(p - start);
+}
+
+#if C99CC_LEXER_SSE2 || C99CC_LEXER_NEON
+#define C99CC_BLOCK_TEST(body) [](Block v) { return body; }
+#else
+#define C99CC_BLOCK_TEST(body) nullptr
+#endif
+
+size_t blankRun(const char* p, const char* end) {
+  return runLength(p, end, C99CC_BLOCK_TEST(
+      either(either(eq(v, ' '), eq(v, '\t')), either(eq(v, '\r'), eq(v, '\n')))), isBlank);
+}
+
+size_t identifierRun(const char* p, const char* end) {
+  return runLength(p, end, C99CC_BLOCK_TEST(
+      either(either(inRange(v, 'a', 'z'), inRange(v, 'A', 'Z')),
+             either(inRange(v, '0', '9'), eq(v, '_')))), isIdentChar);
+}
+
+size_t stringTextRun(const char* p, const char* end) {
+  return runLength(p, end, C99CC_BLOCK_TEST(
+      negate(either(either(eq(v, '"'), eq(v, '\\')), eq(v, '\n')))), isStringText);
+}
+
+#undef C99CC_BLOCK_TEST
+
+// Keywords go through a perfect hash of first byte, last byte and length:
+// the multipliers are searched for at compile time, so every keyword has a
+// slot of its own and a lookup is one hash and one compare.
+struct Keyword {
+  std::string_view name;
+  TokenKind kind;
+};
+
+constexpr Keyword kKeywords[] = {
+  {"char", TokenKind::KwChar},         {"short", TokenKind::KwShort},
+  {"int", TokenKind::KwInt},           {"long", TokenKind::KwLong},
+  {"unsigned", TokenKind::KwUnsigned}, {"float", TokenKind::KwFloat},
+  {"double", TokenKind::KwDouble},     {"void", TokenKind::KwVoid},
+  {"struct", TokenKind::KwStruct},     {"enum", TokenKind::KwEnum},
+  {"typedef", TokenKind::KwTypedef},   {"sizeof", TokenKind::KwSizeof},
+  {"return", TokenKind::KwReturn},     {"if", TokenKind::KwIf},
+  {"else", TokenKind::KwElse},         {"while", TokenKind::KwWhile},
+  {"for", TokenKind::KwFor},           {"break", TokenKind::KwBreak},
+  {"continue", TokenKind::KwContinue}, {"do", TokenKind::KwDo},
+  {"switch", TokenKind::KwSwitch},     {"case", TokenKind::KwCase},
+  {"default", TokenKind::KwDefault},   {"const", TokenKind::KwConst},
+  {"static", TokenKind::KwStatic},     {"extern", TokenKind::KwExtern},
+  {"NULL", TokenKind::IntegerLiteral}, // lexed as the literal 0
+};
+
+constexpr size_t kKeywordSlots = 64;
+
+struct KeywordHash {
+  unsigned first = 0, last = 0, length = 0;
+  constexpr size_t operator()(std::string_view s) const {
+    return (static_cast<unsigned char>(s.front()) * first +
+            static_cast<unsigned char>(s.back()) * last + s.size() * length) % kKeywordSlots;
+  }
+};
+
+constexpr KeywordHash findKeywordHash() {
+  for (unsigned first = 1; first < 64; first++) {
+    for (unsigned last = 0; last < 64; last++) {
+      for (unsigned length = 0; length < 8; length++) {
+        KeywordHash hash{first, last, length};
+        uint64_t used = 0;
+        bool collides = false;
+        for (const Keyword& kw : kKeywords) {
+          uint64_t bit = uint64_t(1) << hash(kw.name);
+          if (used & bit) {
+            collides = true;
+            break;
+          }
+          used |= bit;
+        }
+        if (!collides) return hash;
+      }
+    }
+  }
+  return KeywordHash{};
+}
+
+constexpr KeywordHash kKeywordHash = findKeywordHash();
+static_assert(kKeywordHash.first != 0, "no perfect hash for the keyword set");
+
+struct KeywordTable {
+  Keyword slots[kKeywordSlots] = {};
+  constexpr KeywordTable() {
+    for (const Keyword& kw : kKeywords) slots[kKeywordHash(kw.name)] = kw;
+  }
+};
+
+constexpr KeywordTable kKeywordTable;
+
+// The keyword `s` spells, if any; `s` is never empty.
+const Keyword* findKeyword(std::string_view s) {
+  const Keyword& slot = kKeywordTable.slots[kKeywordHash(s)];
+  return slot.name == s ? &slot : nullptr;
+}
+
+} // namespace
+
+Lexer::Lexer(std::string_view input, Diagnostics& diags, SourceLocation start)
+  : input_(input), base_(start.offset), diags_(diags), line_(start.line),
+    lineStart_(start.offset) {}
+
+Lexer::Lexer(ChunkSource source, Diagnostics& diags)
+  : source_(std::move(source)), streamed_(true), diags_(diags) {}
+
+std::vector<std::unique_ptr<char[]>> Lexer::releaseStorage() {
+  std::vector<std::unique_ptr<char[]>> storage = std::move(saved_);
+  saved_.clear();
+  savedNext_ = nullptr;
+  savedLeft_ = 0;
+  return storage;
+}
+
+std::string_view Lexer::save(std::string_view text) {
+  constexpr size_t kBlockSize = 16 * 1024;
+  if (text.size() > savedLeft_) {
+    size_t size = std::max(kBlockSize, text.size());
+    saved_.push_back(std::make_unique<char[]>(size));
+    savedNext_ = saved_.back().get();
+    savedLeft_ = size;
+  }
+  char* dest = savedNext_;
+  std::memcpy(dest, text.data(), text.size());
+  savedNext_ += text.size();
+  savedLeft_ -= text.size();
+  return std::string_view(dest, text.size());
+}
+
+// Tokens end before a newline and chunks end after one, so the lexer only
+// runs dry between tokens, where dropping the old chunk is safe.
+bool Lexer::refill() {
+  while (source_) {
+    base_ += input_.size();
+    chunk_.clear();
+    i_ = 0;
+    if (!source_(chunk_)) source_ = nullptr;
+    input_ = chunk_;
+    if (!input_.empty()) return true;
+  }
+  return false;
+}
 
 char Lexer::peek() const {
   if (i_ >= input_.size()) return '\0';
@@ -15,21 +235,39 @@ char Lexer::peek() const {
 char Lexer::get() {
   if (i_ >= input_.size()) return '\0';
   char c = input_[i_++];
-  if (c == '\n') { line_++; col_ = 1; }
-  else { col_++; }
+  if (c == '\n') {
+    line_++;
+    lineStart_ = base_ + i_;
+  }
   return c;
 }
 
-bool Lexer::eof() const { return i_ >= input_.size(); }
+void Lexer::skip(size_t n) {
+  const char* p = input_.data() + i_;
+  const char* end = p + n;
+  while (const void* nl = std::memchr(p, '\n', static_cast<size_t>(end - p))) {
+    p = static_cast<const char*>(nl) + 1;
+    line_++;
+    lineStart_ = base_ + static_cast<size_t>(p - input_.data());
+  }
+  i_ += n;
+}
+
+bool Lexer::eof() { return i_ >= input_.size() && !refill(); }
 
 void Lexer::skipWhitespace() {
   while (!eof()) {
-    char c = peek();
-    if (c == ' ' || c == '\t' || c == '\r' || c == '\n') { get(); continue; }
+    const char* p = input_.data() + i_;
+    const char* end = input_.data() + input_.size();
+    if (size_t n = blankRun(p, end)) {
+      skip(n);
+      continue;
+    }
 
-    // support // comments
-    if (c == '/' && i_ + 1 < input_.size() && input_[i_ + 1] == '/') {
-      while (!eof() && peek() != '\n') get();
+    // support // comments; the newline is left for the next blank run
+    if (*p == '/' && p + 1 < end && p[1] == '/') {
+      const void* nl = std::memchr(p, '\n', static_cast<size_t>(end - p));
+      i_ = nl ? static_cast<size_t>(static_cast<const char*>(nl) - input_.data()) : input_.size();
       continue;
     }
     break;
@@ -57,14 +295,19 @@ std::optional<char> Lexer::parseEscapeChar(SourceLocation loc) {
 }
 
 Token Lexer::lexStringLiteral() {
-  SourceLocation loc{ i_, line_, col_ };
+  SourceLocation loc = here();
   std::string value;
   get(); // opening "
+  size_t start = i_;
   while (true) {
     if (eof()) {
       diags_.error(loc, "unterminated string literal");
-      return Token{TokenKind::StringLiteral, value, loc};
+      return Token{TokenKind::StringLiteral, save(value), loc};
     }
+    size_t n = stringTextRun(input_.data() + i_, input_.data() + input_.size());
+    value.append(input_.data() + i_, n);
+    i_ += n;
+    if (i_ >= input_.size()) continue;
     char c = get();
     if (c == '"') break;
     if (c == '\\') {
@@ -74,15 +317,19 @@ Token Lexer::lexStringLiteral() {
     }
     if (c == '\n') {
       diags_.error(loc, "unterminated string literal");
-      return Token{TokenKind::StringLiteral, value, loc};
+      return Token{TokenKind::StringLiteral, save(value), loc};
     }
     value.push_back(c);
   }
-  return Token{TokenKind::StringLiteral, value, loc};
+  // without escapes the value is the source text between the quotes
+  if (value.size() == i_ - start - 1) {
+    return Token{TokenKind::StringLiteral, keep(input_.substr(start, value.size())), loc};
+  }
+  return Token{TokenKind::StringLiteral, save(value), loc};
 }
 
 Token Lexer::lexCharLiteral() {
-  SourceLocation loc{ i_, line_, col_ };
+  SourceLocation loc = here();
   get(); // opening '
   if (eof()) {
     diags_.error(loc, "unterminated char literal");
@@ -101,73 +348,48 @@ Token Lexer::lexCharLiteral() {
   if (eof() || get() != '\'') {
     diags_.error(loc, "unterminated char literal");
   }
-  return Token{TokenKind::CharLiteral, std::to_string(static_cast<unsigned char>(value)), loc};
+  return Token{TokenKind::CharLiteral, save(std::to_string(static_cast<unsigned char>(value))), loc};
 }
 
 Token Lexer::lexIdentifierOrKeyword() {
-  SourceLocation loc{ i_, line_, col_ };
-  std::string s;
-  while (!eof()) {
-    char c = peek();
-    if (std::isalnum((unsigned char)c) || c == '_') s.push_back(get());
-    else break;
+  SourceLocation loc = here();
+  // chunks end on line boundaries, so an identifier never spans two
+  size_t n = identifierRun(input_.data() + i_, input_.data() + input_.size());
+  std::string_view s = input_.substr(i_, n);
+  i_ += n;
+
+  if (const Keyword* kw = findKeyword(s)) {
+    if (kw->kind == TokenKind::IntegerLiteral) return Token{kw->kind, "0", loc};
+    return Token{kw->kind, kw->name, loc};
   }
-
-  if (s == "char")     return Token{TokenKind::KwChar, s, loc};
-  if (s == "short")    return Token{TokenKind::KwShort, s, loc};
-  if (s == "int")      return Token{TokenKind::KwInt, s, loc};
-  if (s == "long")     return Token{TokenKind::KwLong, s, loc};
-  if (s == "unsigned") return Token{TokenKind::KwUnsigned, s, loc};
-  if (s == "float")    return Token{TokenKind::KwFloat, s, loc};
-  if (s == "double")   return Token{TokenKind::KwDouble, s, loc};
-  if (s == "void")     return Token{TokenKind::KwVoid, s, loc};
-  if (s == "struct")   return Token{TokenKind::KwStruct, s, loc};
-  if (s == "enum")     return Token{TokenKind::KwEnum, s, loc};
-  if (s == "typedef")  return Token{TokenKind::KwTypedef, s, loc};
-  if (s == "sizeof")   return Token{TokenKind::KwSizeof, s, loc};
-  if (s == "return")   return Token{TokenKind::KwReturn, s, loc};
-  if (s == "if")       return Token{TokenKind::KwIf, s, loc};
-  if (s == "else")     return Token{TokenKind::KwElse, s, loc};
-  if (s == "while")    return Token{TokenKind::KwWhile, s, loc};
-  if (s == "for")      return Token{TokenKind::KwFor, s, loc};
-  if (s == "break")    return Token{TokenKind::KwBreak, s, loc};
-  if (s == "continue") return Token{TokenKind::KwContinue, s, loc};
-  if (s == "do") return Token{TokenKind::KwDo, s, loc};
-  if (s == "switch")   return Token{TokenKind::KwSwitch, s, loc};
-  if (s == "case")     return Token{TokenKind::KwCase, s, loc};
-  if (s == "default")  return Token{TokenKind::KwDefault, s, loc};
-  if (s == "const")    return Token{TokenKind::KwConst, s, loc};
-  if (s == "static")   return Token{TokenKind::KwStatic, s, loc};
-  if (s == "extern")   return Token{TokenKind::KwExtern, s, loc};
-  if (s == "NULL")     return Token{TokenKind::IntegerLiteral, "0", loc};
-
-  return Token{TokenKind::Identifier, s, loc};
+  Symbol symbol = Symbol::intern(s);
+  return Token{TokenKind::Identifier, symbol.str(), loc, symbol};
 }
 
 Token Lexer::lexNumber() {
-  SourceLocation loc{ i_, line_, col_ };
-  std::string s;
+  SourceLocation loc = here();
+  size_t start = i_;
   bool isFloat = false;
   if (peek() == '.') {
     isFloat = true;
-    s.push_back(get());
+    get();
     while (!eof()) {
       char c = peek();
-      if (std::isdigit((unsigned char)c)) s.push_back(get());
+      if (std::isdigit((unsigned char)c)) get();
       else break;
     }
   } else {
     while (!eof()) {
       char c = peek();
-      if (std::isdigit((unsigned char)c)) s.push_back(get());
+      if (std::isdigit((unsigned char)c)) get();
       else break;
     }
     if (!eof() && peek() == '.') {
       isFloat = true;
-      s.push_back(get());
+      get();
       while (!eof()) {
         char c = peek();
-        if (std::isdigit((unsigned char)c)) s.push_back(get());
+        if (std::isdigit((unsigned char)c)) get();
         else break;
       }
     }
@@ -175,35 +397,35 @@ Token Lexer::lexNumber() {
 
   if (!eof() && (peek() == 'e' || peek() == 'E')) {
     isFloat = true;
-    s.push_back(get());
-    if (!eof() && (peek() == '+' || peek() == '-')) s.push_back(get());
+    get();
+    if (!eof() && (peek() == '+' || peek() == '-')) get();
     while (!eof()) {
       char c = peek();
-      if (std::isdigit((unsigned char)c)) s.push_back(get());
+      if (std::isdigit((unsigned char)c)) get();
       else break;
     }
   }
 
   if (!eof() && (peek() == 'f' || peek() == 'F')) {
     isFloat = true;
-    s.push_back(get());
+    get();
   }
 
-  if (isFloat) return Token{TokenKind::FloatLiteral, s, loc};
+  if (isFloat) return Token{TokenKind::FloatLiteral, keep(input_.substr(start, i_ - start)), loc};
   while (!eof()) {
     char c = peek();
     if (c == 'u' || c == 'U' || c == 'l' || c == 'L') {
-      s.push_back(get());
+      get();
       continue;
     }
     break;
   }
-  return Token{TokenKind::IntegerLiteral, s, loc};
+  return Token{TokenKind::IntegerLiteral, keep(input_.substr(start, i_ - start)), loc};
 }
 
 Token Lexer::next() {
   skipWhitespace();
-  SourceLocation loc{ i_, line_, col_ };
+  SourceLocation loc = here();
 
   if (eof()) return Token{TokenKind::Eof, "", loc};
 
@@ -1,11 +1,17 @@
 #pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 #include "diag.h"
+#include "symbol.h"
 
 namespace c99cc {
 
-enum class TokenKind {
+enum class TokenKind : uint8_t {
   Eof,
   Identifier,
   IntegerLiteral,
@@ -90,21 +96,44 @@ enum class TokenKind {
   Ellipsis // ...
 };
 
+// `text` views the source buffer, the symbol table or the lexer's own
+// storage, never a temporary, so it stays valid for as long as the Lexer.
 struct Token {
   TokenKind kind;
-  std::string text;
+  std::string_view text;
   SourceLocation loc;
+  Symbol symbol{}; // identifiers only
 };
 
+// Supplies input piecewise, for lexing preprocessor output as it is
+// produced: appends the next chunk to `chunk` and returns false once there is
+// no more. Chunks end on line boundaries, so no token spans two of them.
+using ChunkSource = std::function<bool(std::string& chunk)>;
+
 class Lexer {
 public:
-  Lexer(const std::string& input, Diagnostics& diags);
+  // `input` must outlive the lexer. `start` places it inside a larger
+  // buffer, for locations when only a piece of the buffer is lexed; it must
+  // be the start of a line.
+  Lexer(std::string_view input, Diagnostics& diags, SourceLocation start = {});
+  Lexer(ChunkSource source, Diagnostics& diags);
   Token next();
+  // Storage behind token texts that are not views of the input (string
+  // literals with escapes, char literals, streamed text), for tokens that
+  // outlive the lexer.
+  std::vector<std::unique_ptr<char[]>> releaseStorage();
 
 private:
   char peek() const;
   char get();
-  bool eof() const;
+  // Moves past the next `n` bytes, counting the lines they end.
+  void skip(size_t n);
+  bool eof();
+  bool refill();
+  // Columns are only worked out here, from where the current line starts.
+  SourceLocation here() const {
+    return SourceLocation{base_ + i_, line_, static_cast<int>(base_ + i_ - lineStart_) + 1};
+  }
 
   void skipWhitespace();
   Token lexIdentifierOrKeyword();
@@ -112,12 +141,23 @@ private:
   Token lexStringLiteral();
   Token lexCharLiteral();
   std::optional<char> parseEscapeChar(SourceLocation loc);
-
-  const std::string& input_;
+  // Copies `text` somewhere it outlives the current chunk.
+  std::string_view save(std::string_view text);
+  // `text` from the input: a view of it when the input is one buffer.
+  std::string_view keep(std::string_view text) { return streamed_ ? save(text) : text; }
+
+  std::string_view input_;
+  ChunkSource source_;
+  std::string chunk_; // streamed input: the chunk input_ views
+  bool streamed_ = false;
+  std::vector<std::unique_ptr<char[]>> saved_;
+  char* savedNext_ = nullptr;
+  size_t savedLeft_ = 0;
+  size_t base_ = 0;   // offset of input_[0] in the whole input
   Diagnostics& diags_;
   size_t i_ = 0;
   int line_ = 1;
-  int col_ = 1;
+  size_t lineStart_ = 0; // offset of the current line in the whole input
 };
 
 } // namespace c99cc
@@ -1,7 +1,10 @@
 #include "parser.h"
 
+#include <algorithm>
 #include <functional>
 
+#include "timing.h"
+
 namespace c99cc {
 
 namespace {
@@ -13,7 +16,7 @@ struct ParsedIntLiteral {
 };
 
 static std::optional<ParsedIntLiteral> parseIntLiteralToken(
-    Diagnostics& diags, SourceLocation loc, const std::string& text) {
+    Diagnostics& diags, SourceLocation loc, std::string_view text) {
   size_t pos = text.size();
   while (pos > 0) {
     char c = text[pos - 1];
@@ -27,8 +30,8 @@ static std::optional<ParsedIntLiteral> parseIntLiteralToken(
     diags.error(loc, "invalid integer literal");
     return std::nullopt;
   }
-  std::string digits = text.substr(0, pos);
-  std::string suffix = text.substr(pos);
+  std::string digits(text.substr(0, pos));
+  std::string_view suffix = text.substr(pos);
   int64_t value = 0;
   try {
     value = std::stoll(digits);
@@ -62,17 +65,23 @@ static std::optional<ParsedIntLiteral> parseIntLiteralToken(
 } // namespace
 
 void Parser::advance() {
-  if (hasPeek_) {
+  if (tokens_) {
+    // the buffer ends in Eof, which the parser may ask past
+    if (pos_ + 1 < tokens_->size()) pos_++;
+    cur_ = tokens_->token(pos_);
+  } else if (hasPeek_) {
     cur_ = peek_;
     hasPeek_ = false;
   } else {
-    cur_ = lex_.next();
+    cur_ = lex_->next();
   }
 }
 
 const Token& Parser::peekToken() {
-  if (!hasPeek_) {
-    peek_ = lex_.next();
+  if (tokens_) {
+    peek_ = tokens_->token(std::min(pos_ + 1, tokens_->size() - 1));
+  } else if (!hasPeek_) {
+    peek_ = lex_->next();
     hasPeek_ = true;
   }
   return peek_;
@@ -283,7 +292,7 @@ std::optional<Parser::ParsedTypeSpec> Parser::parseTypeSpec(bool allowStructDef,
     advance();
     spec.type.base = Type::Base::Enum;
     if (cur_.kind == TokenKind::Identifier) {
-      spec.type.enumName = cur_.text;
+      spec.type.enumName = cur_.symbol;
       advance();
     }
     while (cur_.kind == TokenKind::KwConst) {
@@ -305,8 +314,8 @@ std::optional<Parser::ParsedTypeSpec> Parser::parseTypeSpec(bool allowStructDef,
       advance();
       EnumDef def;
       def.name = spec.type.enumName.empty()
-                     ? std::optional<std::string>{}
-                     : std::optional<std::string>{spec.type.enumName};
+                     ? std::optional<Symbol>{}
+                     : std::optional<Symbol>{spec.type.enumName};
       def.nameLoc = typeLoc;
       def.items = std::move(*items);
       spec.enumDef = std::move(def);
@@ -319,7 +328,7 @@ std::optional<Parser::ParsedTypeSpec> Parser::parseTypeSpec(bool allowStructDef,
   if (cur_.kind == TokenKind::KwStruct) {
     advance();
     if (!expect(TokenKind::Identifier, "struct name")) return std::nullopt;
-    std::string name = cur_.text;
+    Symbol name = cur_.symbol;
     SourceLocation nameLoc = cur_.loc;
     advance();
     spec.type.base = Type::Base::Struct;
@@ -342,7 +351,7 @@ std::optional<Parser::ParsedTypeSpec> Parser::parseTypeSpec(bool allowStructDef,
       if (!expect(TokenKind::RBrace, "'}'")) return std::nullopt;
       advance();
       StructDef def;
-      def.name = std::move(name);
+      def.name = name;
       def.nameLoc = nameLoc;
       def.fields = std::move(*fields);
       spec.structDef = std::move(def);
@@ -350,7 +359,7 @@ std::optional<Parser::ParsedTypeSpec> Parser::parseTypeSpec(bool allowStructDef,
     return spec;
   }
   if (cur_.kind == TokenKind::Identifier) {
-    auto it = typedefs_.find(cur_.text);
+    auto it = typedefs_.find(cur_.symbol);
     if (it != typedefs_.end()) {
       spec.type = it->second;
       advance();
@@ -399,7 +408,7 @@ std::optional<std::vector<EnumItem>> Parser::parseEnumItems() {
   while (cur_.kind != TokenKind::RBrace && cur_.kind != TokenKind::Eof) {
     if (!expect(TokenKind::Identifier, "identifier")) return std::nullopt;
     EnumItem item;
-    item.name = cur_.text;
+    item.name = cur_.symbol;
     item.nameLoc = cur_.loc;
     advance();
     int64_t value = current + 1;
@@ -417,9 +426,9 @@ std::optional<std::vector<EnumItem>> Parser::parseEnumItems() {
         if (neg) value = -value;
         advance();
       } else if (cur_.kind == TokenKind::Identifier) {
-        auto it = enumConstants_.find(cur_.text);
+        auto it = enumConstants_.find(cur_.symbol);
         if (it == enumConstants_.end()) {
-          diags_.error(cur_.loc, "unknown enum constant '" + cur_.text + "'");
+          diags_.error(cur_.loc, "unknown enum constant '" + cur_.symbol + "'");
           return std::nullopt;
         }
         value = it->second;
@@ -509,7 +518,7 @@ std::optional<Declarator> Parser::parseDeclarator(const Type& baseType, bool all
       advance();
     }
     if (!expect(TokenKind::Identifier, "identifier")) return std::nullopt;
-    d.name = cur_.text;
+    d.name = cur_.symbol;
     d.nameLoc = cur_.loc;
     advance();
     std::optional<std::vector<std::optional<size_t>>> dims;
@@ -544,7 +553,7 @@ std::optional<Declarator> Parser::parseDeclarator(const Type& baseType, bool all
   }
 
   if (!expect(TokenKind::Identifier, "identifier")) return std::nullopt;
-  d.name = cur_.text;
+  d.name = cur_.symbol;
   d.nameLoc = cur_.loc;
   advance();
   d.type = baseType;
@@ -604,7 +613,7 @@ std::optional<Parser::ParamList> Parser::parseParamList() {
         advance();
       }
       if (cur_.kind == TokenKind::Identifier) {
-        p.name = cur_.text;
+        p.name = cur_.symbol;
         p.nameLoc = cur_.loc;
         advance();
       } else {
@@ -637,7 +646,7 @@ std::optional<Parser::ParamList> Parser::parseParamList() {
       p.type = baseType;
       p.type.addPointerQuals(retQuals.consts);
       if (cur_.kind == TokenKind::Identifier) {
-        p.name = cur_.text;
+        p.name = cur_.symbol;
         p.nameLoc = cur_.loc;
         advance();
         if (cur_.kind == TokenKind::LBracket) {
@@ -680,7 +689,7 @@ std::optional<FunctionProto> Parser::parseFunctionProto() {
   FunctionProto proto;
   proto.returnType = specOpt->type;
   proto.returnType.addPointerQuals(retQuals.consts);
-  proto.name = cur_.text;
+  proto.name = cur_.symbol;
   proto.nameLoc = cur_.loc;
   advance();
 
@@ -706,14 +715,16 @@ std::optional<FunctionDef> Parser::parseFunctionDefAfterProto(FunctionProto prot
   FunctionDef def;
   def.proto = std::move(proto);
 
+  std::vector<std::unique_ptr<Stmt>> body;
   while (cur_.kind != TokenKind::RBrace && cur_.kind != TokenKind::Eof) {
     auto s = parseStmt();
     if (!s) return std::nullopt;
-    def.body.push_back(std::move(*s));
+    body.push_back(std::move(*s));
   }
 
   if (!expect(TokenKind::RBrace, "'}'")) return std::nullopt;
   advance();
+  def.body = own(std::move(body));
   return def;
 }
 
@@ -862,6 +873,12 @@ std::optional<TopLevelItem> Parser::parseTopLevelItem() {
   return TopLevelItem{std::move(decl)};
 }
 
+std::optional<AstTranslationUnit> Parser::parse() {
+  // lexing is on demand, so its time is part of this phase
+  TimeScope scope("Parse");
+  return parseTranslationUnit();
+}
+
 std::optional<AstTranslationUnit> Parser::parseTranslationUnit() {
   AstTranslationUnit tu;
 
@@ -871,6 +888,7 @@ std::optional<AstTranslationUnit> Parser::parseTranslationUnit() {
     tu.items.push_back(std::move(*item));
   }
 
+  tu.arena = std::move(arena_);
   return tu;
 }
 
@@ -887,7 +905,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseStmt() {
       cur_.kind == TokenKind::KwDouble ||
       cur_.kind == TokenKind::KwVoid || cur_.kind == TokenKind::KwStruct ||
       cur_.kind == TokenKind::KwEnum ||
-      (cur_.kind == TokenKind::Identifier && typedefs_.count(cur_.text) > 0)) {
+      (cur_.kind == TokenKind::Identifier && typedefs_.count(cur_.symbol) > 0)) {
     return parseDeclStmt();
   }
   if (cur_.kind == TokenKind::KwReturn) return parseReturnStmt();
@@ -903,7 +921,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseStmt() {
   if (cur_.kind == TokenKind::Semicolon) {
     SourceLocation l = cur_.loc;
     advance();
-    return std::make_unique<EmptyStmt>(l);
+    return node<EmptyStmt>(l);
   }
 
   // expression statement
@@ -912,7 +930,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseStmt() {
   if (!e) return std::nullopt;
   if (!expect(TokenKind::Semicolon, "';'")) return std::nullopt;
   advance();
-  return std::make_unique<ExprStmt>(l, std::move(*e));
+  return node<ExprStmt>(l, std::move(*e));
 }
 
 std::optional<std::unique_ptr<Stmt>> Parser::parseDeclStmt() {
@@ -952,7 +970,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseDeclStmt() {
   if (!expect(TokenKind::Semicolon, "';'")) return std::nullopt;
   advance();
 
-  return std::make_unique<DeclStmt>(l, std::move(items));
+  return node<DeclStmt>(l, own(std::move(items)));
 }
 
 std::optional<std::vector<DeclItem>> Parser::parseTypedefItems(bool allowStructDef) {
@@ -1011,7 +1029,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseTypedefStmt() {
   SourceLocation l = cur_.loc;
   auto items = parseTypedefItems(/*allowStructDef=*/false);
   if (!items) return std::nullopt;
-  return std::make_unique<TypedefStmt>(l, std::move(*items));
+  return node<TypedefStmt>(l, own(std::move(*items)));
 }
 
 std::optional<std::unique_ptr<Stmt>> Parser::parseAssignStmt() {
@@ -1019,7 +1037,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseAssignStmt() {
   SourceLocation l = cur_.loc;
 
   if (!expect(TokenKind::Identifier, "identifier")) return std::nullopt;
-  std::string name = cur_.text;
+  Symbol name = cur_.symbol;
   SourceLocation nameLoc = cur_.loc;
   advance();
 
@@ -1032,7 +1050,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseAssignStmt() {
   if (!expect(TokenKind::Semicolon, "';'")) return std::nullopt;
   advance();
 
-  return std::make_unique<AssignStmt>(l, std::move(name), nameLoc, std::move(*rhs));
+  return node<AssignStmt>(l, name, nameLoc, std::move(*rhs));
 }
 
 std::optional<std::unique_ptr<Stmt>> Parser::parseReturnStmt() {
@@ -1042,7 +1060,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseReturnStmt() {
 
   if (cur_.kind == TokenKind::Semicolon) {
     advance();
-    return std::make_unique<ReturnStmt>(l);
+    return node<ReturnStmt>(l);
   }
 
   auto e = parseExpr();
@@ -1051,7 +1069,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseReturnStmt() {
   if (!expect(TokenKind::Semicolon, "';'")) return std::nullopt;
   advance();
 
-  return std::make_unique<ReturnStmt>(l, std::move(*e));
+  return node<ReturnStmt>(l, std::move(*e));
 }
 
 std::optional<std::unique_ptr<Stmt>> Parser::parseBreakStmt() {
@@ -1060,7 +1078,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseBreakStmt() {
   advance();
   if (!expect(TokenKind::Semicolon, "';'")) return std::nullopt;
   advance();
-  return std::make_unique<BreakStmt>(l);
+  return node<BreakStmt>(l);
 }
 
 std::optional<std::unique_ptr<Stmt>> Parser::parseContinueStmt() {
@@ -1069,7 +1087,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseContinueStmt() {
   advance();
   if (!expect(TokenKind::Semicolon, "';'")) return std::nullopt;
   advance();
-  return std::make_unique<ContinueStmt>(l);
+  return node<ContinueStmt>(l);
 }
 
 std::optional<std::unique_ptr<Stmt>> Parser::parseBlockStmt() {
@@ -1087,7 +1105,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseBlockStmt() {
   if (!expect(TokenKind::RBrace, "'}'")) return std::nullopt;
   advance();
 
-  return std::make_unique<BlockStmt>(l, std::move(stmts));
+  return node<BlockStmt>(l, own(std::move(stmts)));
 }
 
 std::optional<std::unique_ptr<Stmt>> Parser::parseIfStmt() {
@@ -1115,7 +1133,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseIfStmt() {
     elseS = std::move(*e);
   }
 
-  return std::make_unique<IfStmt>(ifLoc, std::move(*cond), std::move(*thenS), std::move(elseS));
+  return node<IfStmt>(ifLoc, std::move(*cond), std::move(*thenS), std::move(elseS));
 }
 
 std::optional<std::unique_ptr<Stmt>> Parser::parseWhileStmt() {
@@ -1135,7 +1153,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseWhileStmt() {
   auto body = parseStmt();
   if (!body) return std::nullopt;
 
-  return std::make_unique<WhileStmt>(wLoc, std::move(*cond), std::move(*body));
+  return node<WhileStmt>(wLoc, std::move(*cond), std::move(*body));
 }
 
 std::optional<std::unique_ptr<Stmt>> Parser::parseDoWhileStmt() {
@@ -1162,7 +1180,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseDoWhileStmt() {
   if (!expect(TokenKind::Semicolon, "';'")) return std::nullopt;
   advance();
 
-  return std::make_unique<DoWhileStmt>(loc, std::move(*body), std::move(*cond));
+  return node<DoWhileStmt>(loc, std::move(*body), std::move(*cond));
 }
 
 std::optional<std::unique_ptr<Stmt>> Parser::parseForStmt() {
@@ -1193,7 +1211,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseForStmt() {
     if (!expect(TokenKind::Semicolon, "';'")) return std::nullopt;
     advance();
 
-    init = std::make_unique<ExprStmt>(loc, std::move(*e));
+    init = node<ExprStmt>(loc, std::move(*e));
   }
 
   std::unique_ptr<Expr> cond = nullptr;
@@ -1221,7 +1239,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseForStmt() {
   auto body = parseStmt();
   if (!body) return std::nullopt;
 
-  return std::make_unique<ForStmt>(fLoc, std::move(init), std::move(cond), std::move(inc), std::move(*body));
+  return node<ForStmt>(fLoc, std::move(init), std::move(cond), std::move(inc), std::move(*body));
 }
 
 std::optional<std::unique_ptr<Stmt>> Parser::parseSwitchStmt() {
@@ -1262,12 +1280,14 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseSwitchStmt() {
       c.value = value;
       c.loc = caseLoc;
 
+      std::vector<std::unique_ptr<Stmt>> stmts;
       while (cur_.kind != TokenKind::KwCase && cur_.kind != TokenKind::KwDefault &&
              cur_.kind != TokenKind::RBrace && cur_.kind != TokenKind::Eof) {
         auto st = parseStmt();
         if (!st) return std::nullopt;
-        c.stmts.push_back(std::move(*st));
+        stmts.push_back(std::move(*st));
       }
+      c.stmts = own(std::move(stmts));
 
       cases.push_back(std::move(c));
       continue;
@@ -1283,12 +1303,14 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseSwitchStmt() {
       c.value = std::nullopt;
       c.loc = defLoc;
 
+      std::vector<std::unique_ptr<Stmt>> stmts;
       while (cur_.kind != TokenKind::KwCase && cur_.kind != TokenKind::KwDefault &&
              cur_.kind != TokenKind::RBrace && cur_.kind != TokenKind::Eof) {
         auto st = parseStmt();
         if (!st) return std::nullopt;
-        c.stmts.push_back(std::move(*st));
+        stmts.push_back(std::move(*st));
       }
+      c.stmts = own(std::move(stmts));
 
       cases.push_back(std::move(c));
       continue;
@@ -1301,7 +1323,7 @@ std::optional<std::unique_ptr<Stmt>> Parser::parseSwitchStmt() {
   if (!expect(TokenKind::RBrace, "'}'")) return std::nullopt;
   advance();
 
-  return std::make_unique<SwitchStmt>(sLoc, std::move(*cond), std::move(cases));
+  return node<SwitchStmt>(sLoc, std::move(*cond), own(std::move(cases)));
 }
 
 // -------------------- Expression parsing --------------------
@@ -1312,17 +1334,17 @@ std::optional<std::unique_ptr<Expr>> Parser::parsePrimary() {
     auto parsed = parseIntLiteralToken(diags_, cur_.loc, cur_.text);
     if (!parsed) return std::nullopt;
     advance();
-    return std::make_unique<IntLiteralExpr>(l, parsed->value, parsed->isUnsigned, parsed->longKind);
+    return node<IntLiteralExpr>(l, parsed->value, parsed->isUnsigned, parsed->longKind);
   }
   if (cur_.kind == TokenKind::CharLiteral) {
     SourceLocation l = cur_.loc;
-    int64_t v = std::stoll(cur_.text);
+    int64_t v = std::stoll(std::string(cur_.text));
     advance();
-    return std::make_unique<IntLiteralExpr>(l, v, false, 0);
+    return node<IntLiteralExpr>(l, v, false, 0);
   }
   if (cur_.kind == TokenKind::FloatLiteral) {
     SourceLocation l = cur_.loc;
-    std::string text = cur_.text;
+    std::string text(cur_.text);
     bool isFloat = false;
     if (!text.empty()) {
       char last = text.back();
@@ -1333,24 +1355,24 @@ std::optional<std::unique_ptr<Expr>> Parser::parsePrimary() {
     }
     double v = std::stod(text);
     advance();
-    return std::make_unique<FloatLiteralExpr>(l, v, isFloat);
+    return node<FloatLiteralExpr>(l, v, isFloat);
   }
   if (cur_.kind == TokenKind::StringLiteral) {
     SourceLocation l = cur_.loc;
-    std::string text = cur_.text;
+    std::string text(cur_.text);
     advance();
     while (cur_.kind == TokenKind::StringLiteral) {
       text += cur_.text;
       advance();
     }
-    return std::make_unique<StringLiteralExpr>(l, std::move(text));
+    return node<StringLiteralExpr>(l, std::move(text));
   }
 
   if (cur_.kind == TokenKind::Identifier) {
     SourceLocation idLoc = cur_.loc;
-    std::string name = cur_.text;
+    Symbol name = cur_.symbol;
     advance();
-    return std::make_unique<VarRefExpr>(idLoc, std::move(name));
+    return node<VarRefExpr>(idLoc, name);
   }
 
   if (cur_.kind == TokenKind::LParen) {
@@ -1376,7 +1398,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseUnary() {
       return true;
     }
     if (t.kind == TokenKind::Identifier) {
-      return typedefs_.count(t.text) > 0;
+      return typedefs_.count(t.symbol) > 0;
     }
     return false;
   };
@@ -1390,11 +1412,11 @@ std::optional<std::unique_ptr<Expr>> Parser::parseUnary() {
       if (!typeOpt) return std::nullopt;
       if (!expect(TokenKind::RParen, "')'")) return std::nullopt;
       advance();
-      return std::make_unique<SizeofExpr>(l, std::move(*typeOpt));
+      return node<SizeofExpr>(l, std::move(*typeOpt));
     }
     auto rhs = parseUnary();
     if (!rhs) return std::nullopt;
-    return std::make_unique<SizeofExpr>(l, std::move(*rhs));
+    return node<SizeofExpr>(l, std::move(*rhs));
   }
 
   if (cur_.kind == TokenKind::PlusPlus || cur_.kind == TokenKind::MinusMinus) {
@@ -1403,7 +1425,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseUnary() {
     advance();
     auto rhs = parseUnary();
     if (!rhs) return std::nullopt;
-    return std::make_unique<IncDecExpr>(l, isInc, /*post=*/false, std::move(*rhs));
+    return node<IncDecExpr>(l, isInc, /*post=*/false, std::move(*rhs));
   }
 
   if (cur_.kind == TokenKind::LParen && isTypeStartToken(peekToken())) {
@@ -1415,7 +1437,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseUnary() {
     advance();
     auto rhs = parseUnary();
     if (!rhs) return std::nullopt;
-    return std::make_unique<CastExpr>(l, std::move(*typeOpt), std::move(*rhs));
+    return node<CastExpr>(l, std::move(*typeOpt), std::move(*rhs));
   }
 
   if (cur_.kind == TokenKind::Plus || cur_.kind == TokenKind::Minus ||
@@ -1426,7 +1448,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseUnary() {
     advance();
     auto rhs = parseUnary();
     if (!rhs) return std::nullopt;
-    return std::make_unique<UnaryExpr>(l, op, std::move(*rhs));
+    return node<UnaryExpr>(l, op, std::move(*rhs));
   }
   return parsePostfix();
 }
@@ -1442,7 +1464,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parsePostfix() {
       if (!idx) return std::nullopt;
       if (!expect(TokenKind::RBracket, "']'")) return std::nullopt;
       advance();
-      base = std::make_unique<SubscriptExpr>(l, std::move(*base), std::move(*idx));
+      base = node<SubscriptExpr>(l, std::move(*base), std::move(*idx));
       continue;
     }
     if (cur_.kind == TokenKind::Dot || cur_.kind == TokenKind::Arrow) {
@@ -1450,10 +1472,10 @@ std::optional<std::unique_ptr<Expr>> Parser::parsePostfix() {
       bool isArrow = cur_.kind == TokenKind::Arrow;
       advance();
       if (!expect(TokenKind::Identifier, "member name")) return std::nullopt;
-      std::string member = cur_.text;
+      Symbol member = cur_.symbol;
       SourceLocation memberLoc = cur_.loc;
       advance();
-      base = std::make_unique<MemberExpr>(l, std::move(*base), std::move(member), memberLoc, isArrow);
+      base = node<MemberExpr>(l, std::move(*base), member, memberLoc, isArrow);
       continue;
     }
     if (cur_.kind == TokenKind::LParen) {
@@ -1482,12 +1504,12 @@ std::optional<std::unique_ptr<Expr>> Parser::parsePostfix() {
       if (!expect(TokenKind::RParen, "')'")) return std::nullopt;
       advance();
 
-      if (auto* vr = dynamic_cast<VarRefExpr*>(base->get())) {
+      if (auto* vr = dyn_cast<VarRefExpr>(base->get())) {
         SourceLocation calleeLoc = vr->loc;
-        std::string name = vr->name;
-        base = std::make_unique<CallExpr>(calleeLoc, std::move(name), calleeLoc, std::move(args));
+        Symbol name = vr->name;
+        base = node<CallExpr>(calleeLoc, name, calleeLoc, own(std::move(args)));
       } else {
-        base = std::make_unique<CallExpr>(l, std::move(*base), std::move(args));
+        base = node<CallExpr>(l, std::move(*base), own(std::move(args)));
       }
       continue;
     }
@@ -1495,7 +1517,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parsePostfix() {
       SourceLocation l = cur_.loc;
       bool isInc = cur_.kind == TokenKind::PlusPlus;
       advance();
-      base = std::make_unique<IncDecExpr>(l, isInc, /*post=*/true, std::move(*base));
+      base = node<IncDecExpr>(l, isInc, /*post=*/true, std::move(*base));
       break;
     }
     break;
@@ -1540,9 +1562,9 @@ std::optional<std::unique_ptr<Expr>> Parser::parseInitializer() {
             SourceLocation dLoc = cur_.loc;
             advance();
             if (!expect(TokenKind::Identifier, "member name")) return std::nullopt;
-            std::string name = cur_.text;
+            Symbol name = cur_.symbol;
             advance();
-            designators.push_back(Designator::fieldName(dLoc, std::move(name)));
+            designators.push_back(Designator::fieldName(dLoc, name));
             continue;
           }
           SourceLocation dLoc = cur_.loc;
@@ -1566,7 +1588,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseInitializer() {
         auto elem = parseInitializer();
         if (!elem) return std::nullopt;
         if (!hasDesignator) elemLoc = (*elem)->loc;
-        elems.emplace_back(elemLoc, std::move(designators), std::move(*elem));
+        elems.emplace_back(elemLoc, own(std::move(designators)), std::move(*elem));
         if (cur_.kind == TokenKind::Comma) {
           advance();
           if (cur_.kind == TokenKind::RBrace) break;
@@ -1577,7 +1599,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseInitializer() {
     }
     if (!expect(TokenKind::RBrace, "'}'")) return std::nullopt;
     advance();
-    return std::make_unique<InitListExpr>(l, std::move(elems));
+    return node<InitListExpr>(l, own(std::move(elems)));
   }
   return parseAssignmentExpr();
 }
@@ -1606,15 +1628,15 @@ std::optional<std::unique_ptr<Expr>> Parser::parseAssignmentExpr() {
   };
 
   if (isAssignOp(cur_.kind)) {
-    bool ok = dynamic_cast<VarRefExpr*>(lhs->get()) != nullptr;
+    bool ok = isa<VarRefExpr>(lhs->get());
     if (!ok) {
-      if (auto* un = dynamic_cast<UnaryExpr*>(lhs->get())) ok = (un->op == TokenKind::Star);
+      if (auto* un = dyn_cast<UnaryExpr>(lhs->get())) ok = (un->op == TokenKind::Star);
     }
     if (!ok) {
-      if (dynamic_cast<SubscriptExpr*>(lhs->get())) ok = true;
+      if (isa<SubscriptExpr>(lhs->get())) ok = true;
     }
     if (!ok) {
-      if (dynamic_cast<MemberExpr*>(lhs->get())) ok = true;
+      if (isa<MemberExpr>(lhs->get())) ok = true;
     }
     if (!ok) {
       diags_.error(cur_.loc, "expected identifier on left-hand side of assignment");
@@ -1627,7 +1649,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseAssignmentExpr() {
     auto rhs = parseAssignmentExpr(); // right associative
     if (!rhs) return std::nullopt;
 
-    return std::make_unique<AssignExpr>(assignLoc, op, std::move(*lhs), std::move(*rhs));
+    return node<AssignExpr>(assignLoc, op, std::move(*lhs), std::move(*rhs));
   }
 
   return lhs;
@@ -1644,7 +1666,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseConditionalExpr() {
       advance();
       auto rhs = parseUnary();
       if (!rhs) return std::nullopt;
-      lhs = std::make_unique<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
+      lhs = node<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
     }
     return lhs;
   };
@@ -1658,7 +1680,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseConditionalExpr() {
       advance();
       auto rhs = parseMultiplicative();
       if (!rhs) return std::nullopt;
-      lhs = std::make_unique<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
+      lhs = node<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
     }
     return lhs;
   };
@@ -1673,7 +1695,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseConditionalExpr() {
         advance();
         auto rhs = parseAdditive();
         if (!rhs) return std::nullopt;
-        lhs = std::make_unique<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
+        lhs = node<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
       }
       return lhs;
     };
@@ -1687,7 +1709,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseConditionalExpr() {
       advance();
       auto rhs = parseShift();
       if (!rhs) return std::nullopt;
-      lhs = std::make_unique<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
+      lhs = node<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
     }
     return lhs;
   };
@@ -1701,7 +1723,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseConditionalExpr() {
       advance();
       auto rhs = parseRelational();
       if (!rhs) return std::nullopt;
-      lhs = std::make_unique<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
+      lhs = node<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
     }
     return lhs;
   };
@@ -1715,7 +1737,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseConditionalExpr() {
       advance();
       auto rhs = parseEquality();
       if (!rhs) return std::nullopt;
-      lhs = std::make_unique<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
+      lhs = node<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
     }
     return lhs;
   };
@@ -1729,7 +1751,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseConditionalExpr() {
       advance();
       auto rhs = parseBitAnd();
       if (!rhs) return std::nullopt;
-      lhs = std::make_unique<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
+      lhs = node<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
     }
     return lhs;
   };
@@ -1743,7 +1765,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseConditionalExpr() {
       advance();
       auto rhs = parseBitXor();
       if (!rhs) return std::nullopt;
-      lhs = std::make_unique<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
+      lhs = node<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
     }
     return lhs;
   };
@@ -1757,7 +1779,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseConditionalExpr() {
       advance();
       auto rhs = parseBitOr();
       if (!rhs) return std::nullopt;
-      lhs = std::make_unique<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
+      lhs = node<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
     }
     return lhs;
   };
@@ -1771,7 +1793,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseConditionalExpr() {
       advance();
       auto rhs = parseLogicalAnd();
       if (!rhs) return std::nullopt;
-      lhs = std::make_unique<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
+      lhs = node<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
     }
     return lhs;
   };
@@ -1791,7 +1813,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseConditionalExpr() {
     auto elseExpr = parseConditionalExpr(); // right associative
     if (!elseExpr) return std::nullopt;
 
-    return std::make_unique<TernaryExpr>(qLoc, std::move(*lhs), std::move(*thenExpr),
+    return node<TernaryExpr>(qLoc, std::move(*lhs), std::move(*thenExpr),
                                          std::move(*elseExpr));
   }
 
@@ -1817,7 +1839,7 @@ std::optional<std::unique_ptr<Expr>> Parser::parseExpr() {
     auto rhs = parseAssignmentExpr();
     if (!rhs) return std::nullopt;
 
-    lhs = std::make_unique<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
+    lhs = node<BinaryExpr>(l, op, std::move(*lhs), std::move(*rhs));
   }
 
   return lhs;
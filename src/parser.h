@@ -1,26 +1,91 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <variant>
 #include <vector>
 
+#include "llvm/Support/Casting.h"
+
+#include "arena.h"
 #include "diag.h"
 #include "lexer.h"
+#include "symbol.h"
+#include "token_buffer.h"
 
 namespace c99cc {
 
+using llvm::cast;
+using llvm::dyn_cast;
+using llvm::isa;
+
 // -------------------- AST --------------------
 
+enum class NodeKind : uint8_t {
+  // expressions, IntLiteralExpr..AssignExpr
+  IntLiteralExpr,
+  FloatLiteralExpr,
+  StringLiteralExpr,
+  VarRefExpr,
+  IncDecExpr,
+  CastExpr,
+  SizeofExpr,
+  CallExpr,
+  UnaryExpr,
+  SubscriptExpr,
+  MemberExpr,
+  InitListExpr,
+  BinaryExpr,
+  TernaryExpr,
+  AssignExpr,
+  // statements, DeclStmt..SwitchStmt
+  DeclStmt,
+  TypedefStmt,
+  AssignStmt,
+  ReturnStmt,
+  ExprStmt,
+  EmptyStmt,
+  BreakStmt,
+  ContinueStmt,
+  BlockStmt,
+  IfStmt,
+  WhileStmt,
+  DoWhileStmt,
+  ForStmt,
+  SwitchStmt,
+};
+
+// Nodes live in their TU's arena (AstTranslationUnit::arena). unique_ptr
+// still runs their destructors, but deleting one frees nothing: the memory
+// goes with the arena.
+//
+// `kind` names the concrete class, for switches and for isa/cast/dyn_cast
+// (each class has a classof), which cost a byte compare where dynamic_cast
+// walks RTTI.
 struct Node {
   SourceLocation loc;
-  explicit Node(SourceLocation l) : loc(l) {}
+  const NodeKind kind;
+  Node(NodeKind k, SourceLocation l) : loc(l), kind(k) {}
   virtual ~Node() = default;
+
+  static void* operator new(size_t size, Arena& arena) {
+    return arena.allocate(size, alignof(std::max_align_t));
+  }
+  static void* operator new(size_t size) = delete;
+  static void operator delete(void*, Arena&) {}
+  static void operator delete(void*) {}
 };
 
+// Child lists of nodes, also in the arena.
+template <class T> using AstVector = std::vector<T, ArenaAllocator<T>>;
+
 struct FunctionType;
 
 enum class StorageClass {
@@ -34,8 +99,8 @@ struct Type {
   Base base = Base::Int;
   bool isUnsigned = false;
   bool isConst = false;
-  std::string structName;
-  std::string enumName;
+  Symbol structName;
+  Symbol enumName;
   int ptrDepth = 0; // 0 == int, 1 == int*, 2 == int**, ...
   std::vector<bool> ptrConst;
   std::vector<std::optional<size_t>> arrayDims;
@@ -149,21 +214,66 @@ inline bool Type::operator==(const Type& other) const {
          ptrOutsideArrays == other.ptrOutsideArrays && ptrConst == other.ptrConst;
 }
 
+// Keeps one copy of each distinct Type, so that interned types compare by
+// pointer and are passed around as `const Type*` instead of by value. The
+// types derived from one (pointee, element, decayed, pointer-to) are worked
+// out once and cached. Interned types live as long as the context.
+class TypeContext {
+public:
+  TypeContext() = default;
+  TypeContext(const TypeContext&) = delete;
+  TypeContext& operator=(const TypeContext&) = delete;
+
+  const Type* get(const Type& t);
+  const Type* pointee(const Type* t);
+  const Type* elementType(const Type* t);
+  const Type* decay(const Type* t);
+  // `t*`; never points outside arrays
+  const Type* pointerTo(const Type* t);
+
+  size_t size() const { return storage_.size(); }
+
+private:
+  struct Hash {
+    size_t operator()(const Type* t) const;
+  };
+  struct Equal {
+    bool operator()(const Type* a, const Type* b) const { return *a == *b; }
+  };
+  struct Derived {
+    const Type* pointee = nullptr;
+    const Type* element = nullptr;
+    const Type* decayed = nullptr;
+    const Type* pointer = nullptr;
+  };
+
+  std::deque<Type> storage_;
+  std::unordered_set<const Type*, Hash, Equal> interned_;
+  std::unordered_map<const Type*, Derived> derived_;
+};
+
 struct Declarator {
   Type type;
-  std::string name;
+  Symbol name;
   SourceLocation nameLoc;
 };
 
 struct Expr : Node {
   using Node::Node;
-  mutable std::optional<Type> semaType;
+  // set by Sema, interned in the TU's TypeContext
+  mutable const Type* semaType = nullptr;
   virtual ~Expr() = default;
+  static bool classof(const Node* n) {
+    return n->kind >= NodeKind::IntLiteralExpr && n->kind <= NodeKind::AssignExpr;
+  }
 };
 
 struct Stmt : Node {
   using Node::Node;
   virtual ~Stmt() = default;
+  static bool classof(const Node* n) {
+    return n->kind >= NodeKind::DeclStmt && n->kind <= NodeKind::SwitchStmt;
+  }
 };
 
 struct IntLiteralExpr final : Expr {
@@ -171,31 +281,36 @@ struct IntLiteralExpr final : Expr {
   bool isUnsigned = false;
   int longKind = 0; // 0=int, 1=long, 2=long long
   IntLiteralExpr(SourceLocation l, int64_t v, bool isU, int lk)
-      : Expr(l), value(v), isUnsigned(isU), longKind(lk) {}
+      : Expr(NodeKind::IntLiteralExpr, l), value(v), isUnsigned(isU), longKind(lk) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::IntLiteralExpr; }
 };
 
 struct FloatLiteralExpr final : Expr {
   double value;
   bool isFloat = false;
-  FloatLiteralExpr(SourceLocation l, double v, bool isF) : Expr(l), value(v), isFloat(isF) {}
+  FloatLiteralExpr(SourceLocation l, double v, bool isF)
+      : Expr(NodeKind::FloatLiteralExpr, l), value(v), isFloat(isF) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::FloatLiteralExpr; }
 };
 
 struct StringLiteralExpr final : Expr {
   std::string value;
-  StringLiteralExpr(SourceLocation l, std::string v) : Expr(l), value(std::move(v)) {}
+  StringLiteralExpr(SourceLocation l, std::string v)
+      : Expr(NodeKind::StringLiteralExpr, l), value(std::move(v)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::StringLiteralExpr; }
 };
 
 struct Designator {
   enum class Kind { Field, Index };
   Kind kind = Kind::Index;
   SourceLocation loc;
-  std::string field;
+  Symbol field;
   size_t index = 0;
-  static Designator fieldName(SourceLocation l, std::string name) {
+  static Designator fieldName(SourceLocation l, Symbol name) {
     Designator d;
     d.kind = Kind::Field;
     d.loc = l;
-    d.field = std::move(name);
+    d.field = name;
     return d;
   }
   static Designator arrayIndex(SourceLocation l, size_t idx) {
@@ -209,15 +324,16 @@ struct Designator {
 
 struct InitElem {
   SourceLocation loc;
-  std::vector<Designator> designators;
+  AstVector<Designator> designators;
   std::unique_ptr<Expr> expr;
-  InitElem(SourceLocation l, std::vector<Designator> ds, std::unique_ptr<Expr> e)
+  InitElem(SourceLocation l, AstVector<Designator> ds, std::unique_ptr<Expr> e)
       : loc(l), designators(std::move(ds)), expr(std::move(e)) {}
 };
 
 struct VarRefExpr final : Expr {
-  std::string name;
-  VarRefExpr(SourceLocation l, std::string n) : Expr(l), name(std::move(n)) {}
+  Symbol name;
+  VarRefExpr(SourceLocation l, Symbol n) : Expr(NodeKind::VarRefExpr, l), name(n) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::VarRefExpr; }
 };
 
 struct IncDecExpr final : Expr {
@@ -225,64 +341,74 @@ struct IncDecExpr final : Expr {
   bool isPost = false;
   std::unique_ptr<Expr> operand;
   IncDecExpr(SourceLocation l, bool inc, bool post, std::unique_ptr<Expr> e)
-      : Expr(l), isInc(inc), isPost(post), operand(std::move(e)) {}
+      : Expr(NodeKind::IncDecExpr, l), isInc(inc), isPost(post), operand(std::move(e)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::IncDecExpr; }
 };
 
 struct CastExpr final : Expr {
   Type targetType;
   std::unique_ptr<Expr> expr;
   CastExpr(SourceLocation l, Type t, std::unique_ptr<Expr> e)
-      : Expr(l), targetType(std::move(t)), expr(std::move(e)) {}
+      : Expr(NodeKind::CastExpr, l), targetType(std::move(t)), expr(std::move(e)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::CastExpr; }
 };
 
 struct SizeofExpr final : Expr {
   bool isType = false;
   Type type;
   std::unique_ptr<Expr> expr;
-  SizeofExpr(SourceLocation l, Type t) : Expr(l), isType(true), type(std::move(t)) {}
+  SizeofExpr(SourceLocation l, Type t)
+      : Expr(NodeKind::SizeofExpr, l), isType(true), type(std::move(t)) {}
   SizeofExpr(SourceLocation l, std::unique_ptr<Expr> e)
-      : Expr(l), isType(false), expr(std::move(e)) {}
+      : Expr(NodeKind::SizeofExpr, l), isType(false), expr(std::move(e)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::SizeofExpr; }
 };
 
 struct CallExpr final : Expr {
-  std::string callee;
+  Symbol callee;
   SourceLocation calleeLoc;
   std::unique_ptr<Expr> calleeExpr;
-  std::vector<std::unique_ptr<Expr>> args;
-  CallExpr(SourceLocation l, std::string c, SourceLocation cLoc, std::vector<std::unique_ptr<Expr>> a)
-      : Expr(l), callee(std::move(c)), calleeLoc(cLoc), args(std::move(a)) {}
-  CallExpr(SourceLocation l, std::unique_ptr<Expr> cExpr, std::vector<std::unique_ptr<Expr>> a)
-      : Expr(l), calleeExpr(std::move(cExpr)), args(std::move(a)) {}
+  AstVector<std::unique_ptr<Expr>> args;
+  CallExpr(SourceLocation l, Symbol c, SourceLocation cLoc, AstVector<std::unique_ptr<Expr>> a)
+      : Expr(NodeKind::CallExpr, l), callee(c), calleeLoc(cLoc), args(std::move(a)) {}
+  CallExpr(SourceLocation l, std::unique_ptr<Expr> cExpr, AstVector<std::unique_ptr<Expr>> a)
+      : Expr(NodeKind::CallExpr, l), calleeExpr(std::move(cExpr)), args(std::move(a)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::CallExpr; }
 };
 
 struct UnaryExpr final : Expr {
   TokenKind op;
   std::unique_ptr<Expr> operand;
   UnaryExpr(SourceLocation l, TokenKind o, std::unique_ptr<Expr> e)
-      : Expr(l), op(o), operand(std::move(e)) {}
+      : Expr(NodeKind::UnaryExpr, l), op(o), operand(std::move(e)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::UnaryExpr; }
 };
 
 struct SubscriptExpr final : Expr {
   std::unique_ptr<Expr> base;
   std::unique_ptr<Expr> index;
   SubscriptExpr(SourceLocation l, std::unique_ptr<Expr> b, std::unique_ptr<Expr> i)
-      : Expr(l), base(std::move(b)), index(std::move(i)) {}
+      : Expr(NodeKind::SubscriptExpr, l), base(std::move(b)), index(std::move(i)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::SubscriptExpr; }
 };
 
 struct MemberExpr final : Expr {
   std::unique_ptr<Expr> base;
-  std::string member;
+  Symbol member;
   SourceLocation memberLoc;
   bool isArrow = false;
-  MemberExpr(SourceLocation l, std::unique_ptr<Expr> b, std::string m, SourceLocation mLoc,
+  MemberExpr(SourceLocation l, std::unique_ptr<Expr> b, Symbol m, SourceLocation mLoc,
              bool arrow)
-      : Expr(l), base(std::move(b)), member(std::move(m)), memberLoc(mLoc), isArrow(arrow) {}
+      : Expr(NodeKind::MemberExpr, l), base(std::move(b)), member(m), memberLoc(mLoc),
+        isArrow(arrow) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::MemberExpr; }
 };
 
 struct InitListExpr final : Expr {
-  std::vector<InitElem> elems;
-  InitListExpr(SourceLocation l, std::vector<InitElem> es)
-      : Expr(l), elems(std::move(es)) {}
+  AstVector<InitElem> elems;
+  InitListExpr(SourceLocation l, AstVector<InitElem> es)
+      : Expr(NodeKind::InitListExpr, l), elems(std::move(es)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::InitListExpr; }
 };
 
 struct BinaryExpr final : Expr {
@@ -290,7 +416,8 @@ struct BinaryExpr final : Expr {
   std::unique_ptr<Expr> lhs;
   std::unique_ptr<Expr> rhs;
   BinaryExpr(SourceLocation l, TokenKind o, std::unique_ptr<Expr> a, std::unique_ptr<Expr> b)
-      : Expr(l), op(o), lhs(std::move(a)), rhs(std::move(b)) {}
+      : Expr(NodeKind::BinaryExpr, l), op(o), lhs(std::move(a)), rhs(std::move(b)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::BinaryExpr; }
 };
 
 struct TernaryExpr final : Expr {
@@ -299,7 +426,9 @@ struct TernaryExpr final : Expr {
   std::unique_ptr<Expr> elseExpr;
   TernaryExpr(SourceLocation l, std::unique_ptr<Expr> c, std::unique_ptr<Expr> t,
               std::unique_ptr<Expr> e)
-      : Expr(l), cond(std::move(c)), thenExpr(std::move(t)), elseExpr(std::move(e)) {}
+      : Expr(NodeKind::TernaryExpr, l), cond(std::move(c)), thenExpr(std::move(t)),
+        elseExpr(std::move(e)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::TernaryExpr; }
 };
 
 struct AssignExpr final : Expr {
@@ -307,13 +436,14 @@ struct AssignExpr final : Expr {
   std::unique_ptr<Expr> lhs;
   std::unique_ptr<Expr> rhs;
   AssignExpr(SourceLocation l, TokenKind o, std::unique_ptr<Expr> left, std::unique_ptr<Expr> r)
-      : Expr(l), op(o), lhs(std::move(left)), rhs(std::move(r)) {}
+      : Expr(NodeKind::AssignExpr, l), op(o), lhs(std::move(left)), rhs(std::move(r)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::AssignExpr; }
 };
 
 // statements
 struct DeclItem {
   Type type;
-  std::string name;
+  Symbol name;
   SourceLocation nameLoc;
   std::unique_ptr<Expr> initExpr; // nullable
   StorageClass storage = StorageClass::None;
@@ -321,57 +451,68 @@ struct DeclItem {
 
 struct StructField {
   Type type;
-  std::string name;
+  Symbol name;
   SourceLocation nameLoc;
 };
 
 struct DeclStmt final : Stmt {
-  std::vector<DeclItem> items;
-  DeclStmt(SourceLocation l, std::vector<DeclItem> d)
-      : Stmt(l), items(std::move(d)) {}
+  AstVector<DeclItem> items;
+  DeclStmt(SourceLocation l, AstVector<DeclItem> d)
+      : Stmt(NodeKind::DeclStmt, l), items(std::move(d)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::DeclStmt; }
 };
 
 struct TypedefStmt final : Stmt {
-  std::vector<DeclItem> items;
-  TypedefStmt(SourceLocation l, std::vector<DeclItem> d)
-      : Stmt(l), items(std::move(d)) {}
+  AstVector<DeclItem> items;
+  TypedefStmt(SourceLocation l, AstVector<DeclItem> d)
+      : Stmt(NodeKind::TypedefStmt, l), items(std::move(d)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::TypedefStmt; }
 };
 
 struct AssignStmt final : Stmt {
-  std::string name;
+  Symbol name;
   SourceLocation nameLoc;
   std::unique_ptr<Expr> valueExpr;
-  AssignStmt(SourceLocation l, std::string n, SourceLocation nLoc, std::unique_ptr<Expr> v)
-      : Stmt(l), name(std::move(n)), nameLoc(nLoc), valueExpr(std::move(v)) {}
+  AssignStmt(SourceLocation l, Symbol n, SourceLocation nLoc, std::unique_ptr<Expr> v)
+      : Stmt(NodeKind::AssignStmt, l), name(n), nameLoc(nLoc), valueExpr(std::move(v)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::AssignStmt; }
 };
 
 struct ReturnStmt final : Stmt {
   std::unique_ptr<Expr> valueExpr; // nullable for 'return;'
-  ReturnStmt(SourceLocation l, std::unique_ptr<Expr> v) : Stmt(l), valueExpr(std::move(v)) {}
-  explicit ReturnStmt(SourceLocation l) : Stmt(l) {}
+  ReturnStmt(SourceLocation l, std::unique_ptr<Expr> v)
+      : Stmt(NodeKind::ReturnStmt, l), valueExpr(std::move(v)) {}
+  explicit ReturnStmt(SourceLocation l) : Stmt(NodeKind::ReturnStmt, l) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::ReturnStmt; }
 };
 
 struct ExprStmt final : Stmt {
   std::unique_ptr<Expr> expr;
-  ExprStmt(SourceLocation l, std::unique_ptr<Expr> e) : Stmt(l), expr(std::move(e)) {}
+  ExprStmt(SourceLocation l, std::unique_ptr<Expr> e)
+      : Stmt(NodeKind::ExprStmt, l), expr(std::move(e)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::ExprStmt; }
 };
 
 struct EmptyStmt final : Stmt {
-  explicit EmptyStmt(SourceLocation l) : Stmt(l) {}
+  explicit EmptyStmt(SourceLocation l) : Stmt(NodeKind::EmptyStmt, l) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::EmptyStmt; }
 };
 
 struct BreakStmt final : Stmt {
-  explicit BreakStmt(SourceLocation l) : Stmt(l) {}
+  explicit BreakStmt(SourceLocation l) : Stmt(NodeKind::BreakStmt, l) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::BreakStmt; }
 };
 
 struct ContinueStmt final : Stmt {
-  explicit ContinueStmt(SourceLocation l) : Stmt(l) {}
+  explicit ContinueStmt(SourceLocation l) : Stmt(NodeKind::ContinueStmt, l) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::ContinueStmt; }
 };
 
 struct BlockStmt final : Stmt {
-  std::vector<std::unique_ptr<Stmt>> stmts;
-  BlockStmt(SourceLocation l, std::vector<std::unique_ptr<Stmt>> s)
-      : Stmt(l), stmts(std::move(s)) {}
+  AstVector<std::unique_ptr<Stmt>> stmts;
+  BlockStmt(SourceLocation l, AstVector<std::unique_ptr<Stmt>> s)
+      : Stmt(NodeKind::BlockStmt, l), stmts(std::move(s)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::BlockStmt; }
 };
 
 struct IfStmt final : Stmt {
@@ -379,21 +520,25 @@ struct IfStmt final : Stmt {
   std::unique_ptr<Stmt> thenBranch;
   std::unique_ptr<Stmt> elseBranch; // nullable
   IfStmt(SourceLocation l, std::unique_ptr<Expr> c, std::unique_ptr<Stmt> t, std::unique_ptr<Stmt> e)
-      : Stmt(l), cond(std::move(c)), thenBranch(std::move(t)), elseBranch(std::move(e)) {}
+      : Stmt(NodeKind::IfStmt, l), cond(std::move(c)), thenBranch(std::move(t)),
+        elseBranch(std::move(e)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::IfStmt; }
 };
 
 struct WhileStmt final : Stmt {
   std::unique_ptr<Expr> cond;
   std::unique_ptr<Stmt> body;
   WhileStmt(SourceLocation l, std::unique_ptr<Expr> c, std::unique_ptr<Stmt> b)
-      : Stmt(l), cond(std::move(c)), body(std::move(b)) {}
+      : Stmt(NodeKind::WhileStmt, l), cond(std::move(c)), body(std::move(b)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::WhileStmt; }
 };
 
 struct DoWhileStmt final : Stmt {
   std::unique_ptr<Stmt> body;
   std::unique_ptr<Expr> cond;
   DoWhileStmt(SourceLocation l, std::unique_ptr<Stmt> b, std::unique_ptr<Expr> c)
-      : Stmt(l), body(std::move(b)), cond(std::move(c)) {}
+      : Stmt(NodeKind::DoWhileStmt, l), body(std::move(b)), cond(std::move(c)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::DoWhileStmt; }
 };
 
 struct ForStmt final : Stmt {
@@ -403,20 +548,23 @@ struct ForStmt final : Stmt {
   std::unique_ptr<Stmt> body;
   ForStmt(SourceLocation l, std::unique_ptr<Stmt> i, std::unique_ptr<Expr> c,
           std::unique_ptr<Expr> in, std::unique_ptr<Stmt> b)
-      : Stmt(l), init(std::move(i)), cond(std::move(c)), inc(std::move(in)), body(std::move(b)) {}
+      : Stmt(NodeKind::ForStmt, l), init(std::move(i)), cond(std::move(c)), inc(std::move(in)),
+        body(std::move(b)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::ForStmt; }
 };
 
 struct SwitchCase {
   std::optional<int64_t> value; // nullopt for default
   SourceLocation loc;
-  std::vector<std::unique_ptr<Stmt>> stmts;
+  AstVector<std::unique_ptr<Stmt>> stmts;
 };
 
 struct SwitchStmt final : Stmt {
   std::unique_ptr<Expr> cond;
-  std::vector<SwitchCase> cases;
-  SwitchStmt(SourceLocation l, std::unique_ptr<Expr> c, std::vector<SwitchCase> cs)
-      : Stmt(l), cond(std::move(c)), cases(std::move(cs)) {}
+  AstVector<SwitchCase> cases;
+  SwitchStmt(SourceLocation l, std::unique_ptr<Expr> c, AstVector<SwitchCase> cs)
+      : Stmt(NodeKind::SwitchStmt, l), cond(std::move(c)), cases(std::move(cs)) {}
+  static bool classof(const Node* n) { return n->kind == NodeKind::SwitchStmt; }
 };
 
 // ---- functions / TU ----
@@ -424,14 +572,14 @@ struct SwitchStmt final : Stmt {
 struct Param {
   Type type;
   // param name is optional (prototype can omit names)
-  std::optional<std::string> name;
+  std::optional<Symbol> name;
   SourceLocation nameLoc; // valid iff name.has_value()
   SourceLocation loc;     // location of 'int' keyword for this param
 };
 
 struct FunctionProto {
   Type returnType;
-  std::string name;
+  Symbol name;
   SourceLocation nameLoc;
   std::vector<Param> params;
   bool isVariadic = false;
@@ -445,7 +593,7 @@ struct FunctionDecl {
 
 struct FunctionDef {
   FunctionProto proto;
-  std::vector<std::unique_ptr<Stmt>> body;
+  AstVector<std::unique_ptr<Stmt>> body;
 };
 
 struct GlobalVarDecl {
@@ -453,19 +601,19 @@ struct GlobalVarDecl {
 };
 
 struct StructDef {
-  std::string name;
+  Symbol name;
   SourceLocation nameLoc;
   std::vector<StructField> fields;
 };
 
 struct EnumItem {
-  std::string name;
+  Symbol name;
   SourceLocation nameLoc;
   int64_t value = 0;
 };
 
 struct EnumDef {
-  std::optional<std::string> name;
+  std::optional<Symbol> name;
   SourceLocation nameLoc;
   std::vector<EnumItem> items;
 };
@@ -478,25 +626,57 @@ using TopLevelItem = std::variant<StructDef, EnumDef, TypedefDecl,
                                   FunctionDecl, FunctionDef, GlobalVarDecl>;
 
 struct AstTranslationUnit {
+  // every node below; declared first so that it goes last
+  std::unique_ptr<Arena> arena;
   std::vector<TopLevelItem> items;
+  // what Expr::semaType points into; filled in by Sema
+  std::unique_ptr<TypeContext> types = std::make_unique<TypeContext>();
 };
 
 // -------------------- Parser --------------------
 
 class Parser {
 public:
-  Parser(Lexer& lex, Diagnostics& diags) : lex_(lex), diags_(diags) { cur_ = lex_.next(); }
-  std::optional<AstTranslationUnit> parse() { return parseTranslationUnit(); }
+  Parser(Lexer& lex, Diagnostics& diags) : lex_(&lex), diags_(diags) { cur_ = lex_->next(); }
+  // Reads pre-lexed tokens (-fprelex) instead of pulling them from a Lexer.
+  Parser(const TokenBuffer& tokens, Diagnostics& diags)
+      : tokens_(&tokens), diags_(diags) { cur_ = tokens_->token(0); }
+  std::optional<AstTranslationUnit> parse();
+
+  // Typedef names and enum constants declared so far. A precompiled header
+  // saves them and hands them to the parser of each TU that includes it.
+  const std::unordered_map<Symbol, Type>& typedefs() const { return typedefs_; }
+  const std::unordered_map<Symbol, int64_t>& enumConstants() const { return enumConstants_; }
+  void addDeclarations(
+      const std::unordered_map<Symbol, Type>& typedefs,
+      const std::unordered_map<Symbol, int64_t>& enumConstants) {
+    typedefs_.insert(typedefs.begin(), typedefs.end());
+    enumConstants_.insert(enumConstants.begin(), enumConstants.end());
+  }
 
 private:
-  Lexer& lex_;
+  // Nodes and their child lists, handed to the TU by parse(). Declared first
+  // so that half-built nodes are gone before it when a parse fails.
+  std::unique_ptr<Arena> arena_ = std::make_unique<Arena>();
+  Lexer* lex_ = nullptr;
+  const TokenBuffer* tokens_ = nullptr;
+  size_t pos_ = 0; // of cur_ in tokens_
   Diagnostics& diags_;
   Token cur_;
   Token peek_{};
   bool hasPeek_ = false;
   std::vector<TopLevelItem> pending_;
-  std::unordered_map<std::string, Type> typedefs_;
-  std::unordered_map<std::string, int64_t> enumConstants_;
+  std::unordered_map<Symbol, Type> typedefs_;
+  std::unordered_map<Symbol, int64_t> enumConstants_;
+
+  template <class T, class... Args> std::unique_ptr<T> node(Args&&... args) {
+    return std::unique_ptr<T>(new (*arena_) T(std::forward<Args>(args)...));
+  }
+  // Moves a list built up in a std::vector into the arena, at its final size.
+  template <class T> AstVector<T> own(std::vector<T>&& list) {
+    return AstVector<T>(std::make_move_iterator(list.begin()), std::make_move_iterator(list.end()),
+                        ArenaAllocator<T>(*arena_));
+  }
 
   void advance();
   bool expect(TokenKind k, const char* what);
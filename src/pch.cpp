@@ -0,0 +1,455 @@
+#include "pch.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <utility>
+
+namespace c99cc {
+
+namespace {
+
+constexpr char kMagic[8] = {'C', '9', '9', 'C', 'P', 'C', 'H', '\n'};
+constexpr uint32_t kVersion = 1;
+
+enum ItemTag : uint8_t { TagStruct, TagEnum, TagTypedef, TagFunctionDecl, TagGlobalVar };
+
+class Writer {
+public:
+  explicit Writer(std::string& out) : out_(out) {}
+
+  void u8(uint8_t v) { out_.push_back(static_cast<char>(v)); }
+  void u32(uint32_t v) {
+    for (int i = 0; i < 4; i++) u8(static_cast<uint8_t>(v >> (8 * i)));
+  }
+  void u64(uint64_t v) {
+    for (int i = 0; i < 8; i++) u8(static_cast<uint8_t>(v >> (8 * i)));
+  }
+  void i64(int64_t v) { u64(static_cast<uint64_t>(v)); }
+  void str(std::string_view s) {
+    u32(static_cast<uint32_t>(s.size()));
+    out_.append(s.data(), s.size());
+  }
+  void name(Symbol s) { str(s.str()); }
+  void loc(const SourceLocation& l) {
+    u64(l.offset);
+    u32(static_cast<uint32_t>(l.line));
+    u32(static_cast<uint32_t>(l.col));
+  }
+
+  void type(const Type& t) {
+    u8(static_cast<uint8_t>(t.base));
+    u8(static_cast<uint8_t>(t.isUnsigned | t.isConst << 1 | t.ptrOutsideArrays << 2 |
+                            (t.func != nullptr) << 3));
+    name(t.structName);
+    name(t.enumName);
+    u32(static_cast<uint32_t>(t.ptrDepth));
+    u32(static_cast<uint32_t>(t.ptrConst.size()));
+    for (bool c : t.ptrConst) u8(c);
+    u32(static_cast<uint32_t>(t.arrayDims.size()));
+    for (const auto& dim : t.arrayDims) {
+      u8(dim.has_value());
+      u64(dim.value_or(0));
+    }
+    if (t.func) {
+      type(t.func->returnType);
+      u32(static_cast<uint32_t>(t.func->params.size()));
+      for (const Type& p : t.func->params) type(p);
+      u8(t.func->isVariadic);
+    }
+  }
+
+  void declItems(const std::vector<DeclItem>& items) {
+    u32(static_cast<uint32_t>(items.size()));
+    for (const DeclItem& d : items) {
+      type(d.type);
+      name(d.name);
+      loc(d.nameLoc);
+      u8(static_cast<uint8_t>(d.storage));
+    }
+  }
+
+  void item(const TopLevelItem& item) {
+    if (auto* s = std::get_if<StructDef>(&item)) {
+      u8(TagStruct);
+      name(s->name);
+      loc(s->nameLoc);
+      u32(static_cast<uint32_t>(s->fields.size()));
+      for (const StructField& f : s->fields) {
+        type(f.type);
+        name(f.name);
+        loc(f.nameLoc);
+      }
+    } else if (auto* e = std::get_if<EnumDef>(&item)) {
+      u8(TagEnum);
+      u8(e->name.has_value());
+      name(e->name.value_or(Symbol()));
+      loc(e->nameLoc);
+      u32(static_cast<uint32_t>(e->items.size()));
+      for (const EnumItem& ei : e->items) {
+        name(ei.name);
+        loc(ei.nameLoc);
+        i64(ei.value);
+      }
+    } else if (auto* t = std::get_if<TypedefDecl>(&item)) {
+      u8(TagTypedef);
+      declItems(t->items);
+    } else if (auto* f = std::get_if<FunctionDecl>(&item)) {
+      u8(TagFunctionDecl);
+      const FunctionProto& p = f->proto;
+      type(p.returnType);
+      name(p.name);
+      loc(p.nameLoc);
+      u32(static_cast<uint32_t>(p.params.size()));
+      for (const Param& param : p.params) {
+        type(param.type);
+        u8(param.name.has_value());
+        name(param.name.value_or(Symbol()));
+        loc(param.nameLoc);
+        loc(param.loc);
+      }
+      u8(p.isVariadic);
+      u8(static_cast<uint8_t>(p.storage));
+      loc(f->semiLoc);
+    } else if (auto* g = std::get_if<GlobalVarDecl>(&item)) {
+      u8(TagGlobalVar);
+      declItems(g->items);
+    }
+  }
+
+private:
+  std::string& out_;
+};
+
+// Reads back what Writer wrote. Running off the end or an impossible value
+// clears ok() and yields zeros, so callers check once at the end.
+class Reader {
+public:
+  explicit Reader(std::string_view data) : data_(data) {}
+
+  bool ok() const { return ok_; }
+  bool atEnd() const { return pos_ == data_.size(); }
+
+  bool take(size_t n) {
+    if (!ok_ || data_.size() - pos_ < n) {
+      ok_ = false;
+      return false;
+    }
+    return true;
+  }
+  uint8_t u8() {
+    if (!take(1)) return 0;
+    return static_cast<uint8_t>(data_[pos_++]);
+  }
+  uint32_t u32() {
+    if (!take(4)) return 0;
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v |= uint32_t(static_cast<uint8_t>(data_[pos_++])) << (8 * i);
+    return v;
+  }
+  uint64_t u64() {
+    if (!take(8)) return 0;
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= uint64_t(static_cast<uint8_t>(data_[pos_++])) << (8 * i);
+    return v;
+  }
+  int64_t i64() { return static_cast<int64_t>(u64()); }
+  std::string str() {
+    uint32_t n = u32();
+    if (!take(n)) return {};
+    std::string s(data_.substr(pos_, n));
+    pos_ += n;
+    return s;
+  }
+  Symbol name() {
+    uint32_t n = u32();
+    if (!take(n)) return {};
+    Symbol s = Symbol::intern(data_.substr(pos_, n));
+    pos_ += n;
+    return s;
+  }
+  // An element count; every element takes at least one byte, which bounds
+  // the reservation a corrupt file can ask for.
+  uint32_t count() {
+    uint32_t n = u32();
+    if (n > data_.size() - pos_) ok_ = false;
+    return ok_ ? n : 0;
+  }
+  SourceLocation loc() {
+    SourceLocation l;
+    l.offset = u64();
+    l.line = static_cast<int>(u32());
+    l.col = static_cast<int>(u32());
+    return l;
+  }
+
+  Type type(int depth = 0) {
+    Type t;
+    uint8_t base = u8();
+    if (base > static_cast<uint8_t>(Type::Base::Enum) || depth > 64) ok_ = false;
+    t.base = static_cast<Type::Base>(base);
+    uint8_t flags = u8();
+    t.isUnsigned = flags & 1;
+    t.isConst = flags & 2;
+    t.ptrOutsideArrays = flags & 4;
+    t.structName = name();
+    t.enumName = name();
+    t.ptrDepth = static_cast<int>(u32());
+    for (uint32_t n = count(); n > 0; n--) t.ptrConst.push_back(u8() != 0);
+    for (uint32_t n = count(); n > 0; n--) {
+      bool has = u8() != 0;
+      uint64_t dim = u64();
+      t.arrayDims.push_back(has ? std::optional<size_t>(dim) : std::nullopt);
+    }
+    if ((flags & 8) && ok_) {
+      auto func = std::make_shared<FunctionType>();
+      func->returnType = type(depth + 1);
+      for (uint32_t n = count(); n > 0 && ok_; n--) func->params.push_back(type(depth + 1));
+      func->isVariadic = u8() != 0;
+      t.func = std::move(func);
+    }
+    return t;
+  }
+
+  StorageClass storage() {
+    uint8_t s = u8();
+    if (s > static_cast<uint8_t>(StorageClass::Extern)) ok_ = false;
+    return static_cast<StorageClass>(s);
+  }
+
+  std::vector<DeclItem> declItems() {
+    std::vector<DeclItem> items;
+    for (uint32_t n = count(); n > 0 && ok_; n--) {
+      DeclItem d;
+      d.type = type();
+      d.name = name();
+      d.nameLoc = loc();
+      d.storage = storage();
+      items.push_back(std::move(d));
+    }
+    return items;
+  }
+
+  TopLevelItem item() {
+    switch (u8()) {
+    case TagStruct: {
+      StructDef s;
+      s.name = name();
+      s.nameLoc = loc();
+      for (uint32_t n = count(); n > 0 && ok_; n--) {
+        StructField f;
+        f.type = type();
+        f.name = name();
+        f.nameLoc = loc();
+        s.fields.push_back(std::move(f));
+      }
+      return s;
+    }
+    case TagEnum: {
+      EnumDef e;
+      bool named = u8() != 0;
+      Symbol enumName = name();
+      if (named) e.name = enumName;
+      e.nameLoc = loc();
+      for (uint32_t n = count(); n > 0 && ok_; n--) {
+        EnumItem ei;
+        ei.name = name();
+        ei.nameLoc = loc();
+        ei.value = i64();
+        e.items.push_back(std::move(ei));
+      }
+      return e;
+    }
+    case TagTypedef:
+      return TypedefDecl{declItems()};
+    case TagFunctionDecl: {
+      FunctionDecl f;
+      FunctionProto& p = f.proto;
+      p.returnType = type();
+      p.name = name();
+      p.nameLoc = loc();
+      for (uint32_t n = count(); n > 0 && ok_; n--) {
+        Param param;
+        param.type = type();
+        bool named = u8() != 0;
+        Symbol paramName = name();
+        if (named) param.name = paramName;
+        param.nameLoc = loc();
+        param.loc = loc();
+        p.params.push_back(std::move(param));
+      }
+      p.isVariadic = u8() != 0;
+      p.storage = storage();
+      f.semiLoc = loc();
+      return f;
+    }
+    case TagGlobalVar:
+      return GlobalVarDecl{declItems()};
+    default:
+      ok_ = false;
+      return TypedefDecl{};
+    }
+  }
+
+private:
+  std::string_view data_;
+  size_t pos_ = 0;
+  bool ok_ = true;
+};
+
+bool statInput(const std::string& path, uint64_t& size, int64_t& mtime) {
+  std::error_code ec;
+  size = std::filesystem::file_size(path, ec);
+  if (ec) return false;
+  auto time = std::filesystem::last_write_time(path, ec);
+  if (ec) return false;
+  mtime = static_cast<int64_t>(time.time_since_epoch().count());
+  return true;
+}
+
+} // namespace
+
+bool addPrecompiledHeaderInput(PrecompiledHeader& pch, const std::string& path) {
+  PrecompiledHeader::Input input;
+  input.path = path;
+  if (!statInput(path, input.size, input.mtime)) return false;
+  pch.inputs.push_back(std::move(input));
+  return true;
+}
+
+bool canPrecompile(const TopLevelItem& item, std::string& why) {
+  if (auto* f = std::get_if<FunctionDef>(&item)) {
+    why = "function definition '" + f->proto.name + "'";
+    return false;
+  }
+  if (auto* g = std::get_if<GlobalVarDecl>(&item)) {
+    for (const DeclItem& d : g->items) {
+      if (d.storage != StorageClass::Extern || d.initExpr) {
+        why = "variable definition '" + d.name + "'";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+std::string writePrecompiledHeader(const PrecompiledHeader& pch) {
+  std::string out;
+  Writer w(out);
+  out.append(kMagic, sizeof(kMagic));
+  w.u32(kVersion);
+
+  w.u32(static_cast<uint32_t>(pch.inputs.size()));
+  for (const auto& input : pch.inputs) {
+    w.str(input.path);
+    w.u64(input.size);
+    w.i64(input.mtime);
+  }
+
+  const Preprocessor::State& pp = pch.preprocessor;
+  w.u32(static_cast<uint32_t>(pp.macros.size()));
+  for (const auto& m : pp.macros) {
+    w.str(m.name);
+    w.u8(static_cast<uint8_t>(m.functionLike | m.variadic << 1));
+    w.u32(static_cast<uint32_t>(m.params.size()));
+    for (const auto& p : m.params) w.str(p);
+    w.str(m.body);
+  }
+  w.u32(static_cast<uint32_t>(pp.onceFiles.size()));
+  for (const auto& f : pp.onceFiles) w.str(f);
+  w.u32(static_cast<uint32_t>(pp.includeGuards.size()));
+  for (const auto& [file, guard] : pp.includeGuards) {
+    w.str(file);
+    w.str(guard);
+  }
+
+  // hash maps iterate in no particular order; sort for reproducible output
+  std::vector<const std::pair<const Symbol, Type>*> typedefs;
+  for (const auto& entry : pch.typedefs) typedefs.push_back(&entry);
+  std::sort(typedefs.begin(), typedefs.end(),
+            [](const auto* a, const auto* b) { return a->first < b->first; });
+  w.u32(static_cast<uint32_t>(typedefs.size()));
+  for (const auto* entry : typedefs) {
+    w.name(entry->first);
+    w.type(entry->second);
+  }
+  std::vector<std::pair<Symbol, int64_t>> constants(
+      pch.enumConstants.begin(), pch.enumConstants.end());
+  std::sort(constants.begin(), constants.end());
+  w.u32(static_cast<uint32_t>(constants.size()));
+  for (const auto& [name, value] : constants) {
+    w.name(name);
+    w.i64(value);
+  }
+
+  w.u32(static_cast<uint32_t>(pch.items.size()));
+  for (const auto& item : pch.items) w.item(item);
+  return out;
+}
+
+bool readPrecompiledHeader(std::string_view data, PrecompiledHeader& pch, std::string& err) {
+  if (data.size() < sizeof(kMagic) || data.compare(0, sizeof(kMagic), kMagic, sizeof(kMagic)) != 0) {
+    err = "not a precompiled header";
+    return false;
+  }
+  Reader r(data.substr(sizeof(kMagic)));
+  if (r.u32() != kVersion) {
+    err = "precompiled header has an unsupported version";
+    return false;
+  }
+
+  for (uint32_t n = r.count(); n > 0 && r.ok(); n--) {
+    PrecompiledHeader::Input input;
+    input.path = r.str();
+    input.size = r.u64();
+    input.mtime = r.i64();
+    pch.inputs.push_back(std::move(input));
+  }
+
+  Preprocessor::State& pp = pch.preprocessor;
+  for (uint32_t n = r.count(); n > 0 && r.ok(); n--) {
+    Preprocessor::SavedMacro m;
+    m.name = r.str();
+    uint8_t flags = r.u8();
+    m.functionLike = flags & 1;
+    m.variadic = flags & 2;
+    for (uint32_t p = r.count(); p > 0; p--) m.params.push_back(r.str());
+    m.body = r.str();
+    pp.macros.push_back(std::move(m));
+  }
+  for (uint32_t n = r.count(); n > 0 && r.ok(); n--) pp.onceFiles.push_back(r.str());
+  for (uint32_t n = r.count(); n > 0 && r.ok(); n--) {
+    std::string file = r.str();
+    pp.includeGuards.emplace_back(std::move(file), r.str());
+  }
+
+  for (uint32_t n = r.count(); n > 0 && r.ok(); n--) {
+    Symbol name = r.name();
+    pch.typedefs[name] = r.type();
+  }
+  for (uint32_t n = r.count(); n > 0 && r.ok(); n--) {
+    Symbol name = r.name();
+    pch.enumConstants[name] = r.i64();
+  }
+
+  for (uint32_t n = r.count(); n > 0 && r.ok(); n--) pch.items.push_back(r.item());
+
+  if (!r.ok() || !r.atEnd()) {
+    err = "precompiled header is corrupt";
+    return false;
+  }
+  return true;
+}
+
+std::string stalePrecompiledHeaderInput(const PrecompiledHeader& pch) {
+  for (const auto& input : pch.inputs) {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    if (!statInput(input.path, size, mtime) || size != input.size || mtime != input.mtime) {
+      return input.path;
+    }
+  }
+  return "";
+}
+
+} // namespace c99cc
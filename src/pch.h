@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "parser.h"
+#include "preprocessor.h"
+
+namespace c99cc {
+
+// A header preprocessed and parsed once (-emit-pch) and replayed in front of
+// every TU that names it with -include-pch: the macro table, the parser's
+// typedef/enum-constant state and the header's top-level declarations.
+struct PrecompiledHeader {
+  // The header and every file it included, as they were when it was built.
+  struct Input {
+    std::string path;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+  };
+  std::vector<Input> inputs;
+  Preprocessor::State preprocessor;
+  std::unordered_map<Symbol, Type> typedefs;
+  std::unordered_map<Symbol, int64_t> enumConstants;
+  // struct/enum definitions, typedefs, prototypes and extern-style variable
+  // declarations; anything that emits code or data has no place in a header
+  std::vector<TopLevelItem> items;
+};
+
+// Records `path` as an input with its current size and mtime.
+bool addPrecompiledHeaderInput(PrecompiledHeader& pch, const std::string& path);
+// Whether `item` can go into a precompiled header; otherwise `why` says why not.
+bool canPrecompile(const TopLevelItem& item, std::string& why);
+
+// Little-endian and position independent, so the file can be used straight
+// from a memory-mapped buffer.
+std::string writePrecompiledHeader(const PrecompiledHeader& pch);
+bool readPrecompiledHeader(std::string_view data, PrecompiledHeader& pch, std::string& err);
+// The first input that changed on disk since the header was built, or "".
+std::string stalePrecompiledHeaderInput(const PrecompiledHeader& pch);
+
+} // namespace c99cc
@@ -0,0 +1,111 @@
+#include "pp_profile.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace c99cc {
+
+namespace {
+
+template <typename Cost>
+std::vector<std::pair<std::string, Cost>> byTime(const std::unordered_map<std::string, Cost>& map) {
+  std::vector<std::pair<std::string, Cost>> rows(map.begin(), map.end());
+  std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+    if (a.second.time != b.second.time) return a.second.time > b.second.time;
+    return a.first < b.first;
+  });
+  return rows;
+}
+
+double millis(std::chrono::nanoseconds time) {
+  return std::chrono::duration<double, std::milli>(time).count();
+}
+
+} // namespace
+
+void PreprocessorProfile::merge(const PreprocessorProfile& other) {
+  for (const auto& [path, cost] : other.files) {
+    FileCost& total = files[path];
+    total.entered += cost.entered;
+    total.skipped += cost.skipped;
+    total.bytes += cost.bytes;
+    total.time += cost.time;
+  }
+  for (const auto& [name, cost] : other.macros) {
+    MacroCost& total = macros[name];
+    total.expansions += cost.expansions;
+    total.bytes += cost.bytes;
+    total.time += cost.time;
+  }
+}
+
+void printPreprocessorProfile(std::ostream& os, const PreprocessorProfile& profile, size_t rows) {
+  auto files = byTime(profile.files);
+  auto macros = byTime(profile.macros);
+
+  std::ios_base::fmtflags flags = os.flags();
+  os << "===-------------------------------------------------------------------===\n"
+     << "                      c99cc preprocessor profile\n"
+     << "===-------------------------------------------------------------------===\n"
+     << std::fixed << std::setprecision(3)
+     << "   Time (ms)  Entered  Skipped       Bytes  File\n";
+  for (size_t i = 0; i < files.size() && i < rows; i++) {
+    const auto& [path, cost] = files[i];
+    os << std::setw(12) << millis(cost.time) << std::setw(9) << cost.entered << std::setw(9)
+       << cost.skipped << std::setw(12) << cost.bytes << "  " << path << "\n";
+  }
+  if (files.size() > rows) os << "  ... " << files.size() - rows << " more files\n";
+
+  os << "\n   Time (ms)  Expansions   Bytes out  Macro\n";
+  for (size_t i = 0; i < macros.size() && i < rows; i++) {
+    const auto& [name, cost] = macros[i];
+    os << std::setw(12) << millis(cost.time) << std::setw(12) << cost.expansions
+       << std::setw(12) << cost.bytes << "  " << name << "\n";
+  }
+  if (macros.size() > rows) os << "  ... " << macros.size() - rows << " more macros\n";
+  os.flags(flags);
+}
+
+bool writePreprocessorProfile(
+    const std::string& path, const PreprocessorProfile& profile, std::string& err) {
+  std::error_code ec;
+  llvm::raw_fd_ostream file(path, ec, llvm::sys::fs::OF_Text);
+  if (ec) {
+    err = ec.message();
+    return false;
+  }
+  llvm::json::OStream json(file, 2);
+  json.object([&] {
+    json.attributeArray("files", [&] {
+      for (const auto& [name, cost] : byTime(profile.files)) {
+        json.object([&, &name = name, &cost = cost] {
+          json.attribute("path", name);
+          json.attribute("entered", static_cast<int64_t>(cost.entered));
+          json.attribute("skipped", static_cast<int64_t>(cost.skipped));
+          json.attribute("bytes", static_cast<int64_t>(cost.bytes));
+          json.attribute("ms", millis(cost.time));
+        });
+      }
+    });
+    json.attributeArray("macros", [&] {
+      for (const auto& [name, cost] : byTime(profile.macros)) {
+        json.object([&, &name = name, &cost = cost] {
+          json.attribute("name", name);
+          json.attribute("expansions", static_cast<int64_t>(cost.expansions));
+          json.attribute("bytes", static_cast<int64_t>(cost.bytes));
+          json.attribute("ms", millis(cost.time));
+        });
+      }
+    });
+  });
+  file << "\n";
+  return true;
+}
+
+} // namespace c99cc
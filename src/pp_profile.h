@@ -0,0 +1,39 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+
+namespace c99cc {
+
+// -fpp-profile: where preprocessing time goes, per file and per macro. Each
+// TU fills its own (no locking); the driver merges them for the report.
+struct PreprocessorProfile {
+  struct FileCost {
+    uint64_t entered = 0; // times its lines were processed
+    uint64_t skipped = 0; // #includes of it skipped by #pragma once / include guard
+    uint64_t bytes = 0;   // read, summed over every time it was entered
+    std::chrono::nanoseconds time{0}; // in its own lines, macro expansion included
+  };
+  struct MacroCost {
+    uint64_t expansions = 0;
+    uint64_t bytes = 0; // replacement text produced
+    // collecting arguments and substituting, nested expansions of the
+    // arguments included; the rescan is charged to the macros it expands
+    std::chrono::nanoseconds time{0};
+  };
+  std::unordered_map<std::string, FileCost> files;
+  std::unordered_map<std::string, MacroCost> macros;
+
+  void merge(const PreprocessorProfile& other);
+};
+
+// Files and macros, most expensive first; the tables stop after `rows` each.
+void printPreprocessorProfile(std::ostream& os, const PreprocessorProfile& profile, size_t rows = 25);
+// Everything, for tooling: {"files": [...], "macros": [...]}, sorted the same way.
+bool writePreprocessorProfile(
+    const std::string& path, const PreprocessorProfile& profile, std::string& err);
+
+} // namespace c99cc
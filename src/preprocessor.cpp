@@ -1,22 +1,47 @@
 #include "preprocessor.h"
 
+#include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <cstdlib>
 #include <ctime>
-#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <sstream>
 #include <utility>
 
+#include "llvm/Support/MemoryBuffer.h"
+
+#include "file_manager.h"
+#include "timing.h"
+
 namespace c99cc {
 
+// past this many entries the expansion cache starts over
+constexpr size_t kMaxCachedExpansions = 1 << 16;
+
 Preprocessor::Preprocessor(
     std::vector<std::string> includePaths,
     std::vector<std::string> systemIncludePaths)
     : includePaths_(std::move(includePaths)),
-      systemIncludePaths_(std::move(systemIncludePaths)) {
+      systemIncludePaths_(std::move(systemIncludePaths)),
+      diagOut_(&std::cerr) {
+  // SOURCE_DATE_EPOCH pins __DATE__/__TIME__ (in UTC) for reproducible output
+  // every -j worker builds a Preprocessor, so no shared static std::tm
   std::time_t now = std::time(nullptr);
-  std::tm tm = *std::localtime(&now);
+  std::tm tm{};
+  localtime_r(&now, &tm);
+  if (const char* epoch = std::getenv("SOURCE_DATE_EPOCH")) {
+    char* end = nullptr;
+    long long secs = std::strtoll(epoch, &end, 10);
+    if (*epoch != '\0' && *end == '\0' && secs >= 0) {
+      now = static_cast<std::time_t>(secs);
+      gmtime_r(&now, &tm);
+    }
+  }
   {
     std::ostringstream oss;
     oss << std::put_time(&tm, "%b %e %Y");
@@ -31,10 +56,32 @@ Preprocessor::Preprocessor(
 
 void Preprocessor::addIncludePath(const std::string& path) {
   includePaths_.push_back(path);
+  searchList_.reset();
 }
 
 void Preprocessor::addSystemIncludePath(const std::string& path) {
   systemIncludePaths_.push_back(path);
+  searchList_.reset();
+}
+
+void Preprocessor::setFileManager(FileManager* files) {
+  files_ = files;
+  searchList_.reset();
+}
+
+FileManager& Preprocessor::files() {
+  if (files_) return *files_;
+  if (!ownFiles_) ownFiles_ = std::make_unique<FileManager>();
+  return *ownFiles_;
+}
+
+FileManager::SearchListId Preprocessor::searchList() {
+  if (!searchList_) {
+    std::vector<std::string> dirs = includePaths_;
+    dirs.insert(dirs.end(), systemIncludePaths_.begin(), systemIncludePaths_.end());
+    searchList_ = files().searchList(dirs);
+  }
+  return *searchList_;
 }
 
 static bool isIdentStart(char c) {
@@ -53,29 +100,6 @@ static std::string trim(const std::string& s) {
   return s.substr(b, e - b);
 }
 
-static std::string ltrim(const std::string& s) {
-  size_t i = 0;
-  while (i < s.size() && std::isspace(static_cast<unsigned char>(s[i]))) i++;
-  return s.substr(i);
-}
-
-static std::string rtrim(const std::string& s) {
-  if (s.empty()) return s;
-  size_t i = s.size();
-  while (i > 0 && std::isspace(static_cast<unsigned char>(s[i - 1]))) i--;
-  return s.substr(0, i);
-}
-
-static std::string stringize(const std::string& raw) {
-  std::string out = "\"";
-  for (char c : raw) {
-    if (c == '\\' || c == '"') out.push_back('\\');
-    out.push_back(c);
-  }
-  out.push_back('"');
-  return out;
-}
-
 static std::string toStringLiteral(const std::string& raw) {
   std::string out = "\"";
   for (char c : raw) {
@@ -86,169 +110,302 @@ static std::string toStringLiteral(const std::string& raw) {
   return out;
 }
 
-static std::string replaceParams(
-    const std::string& body,
-    const std::vector<std::string>& params,
-    const std::vector<std::string>& argsRaw,
-    const std::vector<std::string>& argsExpanded,
-    bool variadic,
-    const std::string& varRaw,
-    const std::string& varExpanded) {
-  std::unordered_map<std::string, std::string> mapExpanded;
-  std::unordered_map<std::string, std::string> mapRaw;
-  for (size_t i = 0; i < params.size() && i < argsExpanded.size(); ++i) {
-    mapExpanded.emplace(params[i], argsExpanded[i]);
-    mapRaw.emplace(params[i], argsRaw[i]);
-  }
-  if (variadic) {
-    mapExpanded.emplace("__VA_ARGS__", varExpanded);
-    mapRaw.emplace("__VA_ARGS__", varRaw);
+// Punctuators the lexer would read as one token if two tokens from different
+// expansions ended up adjacent without whitespace.
+static bool wouldMerge(std::string_view prev, std::string_view next) {
+  if (prev.empty() || next.empty()) return false;
+  char a = prev.back();
+  char b = next.front();
+  if (isIdentChar(a) && (isIdentChar(b) || b == '.')) return true;
+  static const char* const pairs[] = {
+      "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "->", "+=", "-=",
+      "*=", "/=", "%=", "&=", "|=", "^=", "##", "//", "/*", ".."};
+  for (const char* p : pairs) {
+    if (p[0] == a && p[1] == b) return true;
   }
+  return false;
+}
 
-  std::string out;
+void Preprocessor::lexTokens(std::string_view text, TokenList& out, std::string_view* comment) {
+  static const char* const punct3[] = {"...", "<<=", ">>="};
+  static const char* const punct2[] = {
+      "##", "->", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||",
+      "*=", "/=", "%=", "+=", "-=", "&=", "^=", "|="};
   size_t i = 0;
-  bool pendingPaste = false;
-  while (i < body.size()) {
-    char c = body[i];
-    if (c == '"' || c == '\'') {
-      char quote = c;
-      std::string lit;
-      lit.push_back(c);
+  while (true) {
+    size_t wsStart = i;
+    while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i]))) i++;
+    if (i >= text.size()) break;
+    if (comment && text[i] == '/' && i + 1 < text.size() && text[i + 1] == '/') {
+      *comment = text.substr(wsStart);
+      break;
+    }
+    PPToken tok;
+    tok.space = text.substr(wsStart, i - wsStart);
+    size_t start = i;
+    char c = text[i];
+    if (isIdentStart(c)) {
+      tok.kind = PPToken::Ident;
+      while (i < text.size() && isIdentChar(text[i])) i++;
+    } else if (std::isdigit(static_cast<unsigned char>(c)) ||
+               (c == '.' && i + 1 < text.size() &&
+                std::isdigit(static_cast<unsigned char>(text[i + 1])))) {
+      // pp-number: also swallows suffixes and exponent signs
+      tok.kind = PPToken::Literal;
       i++;
-      while (i < body.size()) {
-        char cc = body[i];
-        lit.push_back(cc);
-        i++;
-        if (cc == '\\' && i < body.size()) {
-          lit.push_back(body[i]);
+      while (i < text.size()) {
+        char d = text[i];
+        if ((d == '+' || d == '-') && (text[i - 1] == 'e' || text[i - 1] == 'E' ||
+                                       text[i - 1] == 'p' || text[i - 1] == 'P')) {
           i++;
-          continue;
+        } else if (isIdentChar(d) || d == '.') {
+          i++;
+        } else {
+          break;
         }
-        if (cc == quote) break;
       }
-      if (pendingPaste) {
-        lit = ltrim(lit);
-        out += lit;
-        pendingPaste = false;
-      } else {
-        out += lit;
+    } else if (c == '"' || c == '\'') {
+      tok.kind = PPToken::Literal;
+      i++;
+      while (i < text.size()) {
+        char d = text[i++];
+        if (d == '\\' && i < text.size()) {
+          i++;
+          continue;
+        }
+        if (d == c) break;
       }
-      continue;
-    }
-    if (c == '#') {
-      if (i + 1 < body.size() && body[i + 1] == '#') {
-        out = rtrim(out);
-        pendingPaste = true;
-        i += 2;
-        continue;
+    } else {
+      tok.kind = PPToken::Punct;
+      size_t len = 1;
+      for (const char* p : punct3) {
+        if (text.compare(i, 3, p) == 0) len = 3;
       }
-      size_t j = i + 1;
-      while (j < body.size() && std::isspace(static_cast<unsigned char>(body[j]))) j++;
-      if (j < body.size() && isIdentStart(body[j])) {
-        size_t start = j;
-        j++;
-        while (j < body.size() && isIdentChar(body[j])) j++;
-        std::string name = body.substr(start, j - start);
-        auto it = mapRaw.find(name);
-        std::string rep;
-        if (it != mapRaw.end()) rep = stringize(it->second);
-        else rep = "#" + name;
-        if (pendingPaste) {
-          rep = ltrim(rep);
-          out += rep;
-          pendingPaste = false;
-        } else {
-          out += rep;
+      if (len == 1) {
+        for (const char* p : punct2) {
+          if (text.compare(i, 2, p) == 0) len = 2;
         }
-        i = j;
-        continue;
       }
-      out.push_back(c);
-      i++;
-      continue;
+      i += len;
     }
-    if (isIdentStart(c)) {
-      size_t start = i;
-      i++;
-      while (i < body.size() && isIdentChar(body[i])) i++;
-      std::string name = body.substr(start, i - start);
-      auto it = mapExpanded.find(name);
-      std::string rep = (it != mapExpanded.end()) ? it->second : name;
-      if (pendingPaste) {
-        rep = ltrim(rep);
-        if (!rep.empty()) out += rep;
-        pendingPaste = false;
-      } else {
-        out += rep;
+    tok.text = text.substr(start, i - start);
+    out.push_back(tok);
+  }
+}
+
+void Preprocessor::lexMacroBody(Macro& macro) {
+  std::string_view comment;
+  lexTokens(macro.body, macro.tokens, &comment);
+  // shrinking keeps the buffer, so the token views stay valid
+  if (!comment.empty()) macro.body.resize(comment.data() - macro.body.data());
+  macro.paramIndex.assign(macro.tokens.size(), -1);
+  if (!macro.functionLike) return;
+  for (size_t i = 0; i < macro.tokens.size(); i++) {
+    const PPToken& tok = macro.tokens[i];
+    if (tok.kind != PPToken::Ident) continue;
+    for (size_t p = 0; p < macro.params.size(); p++) {
+      if (tok.text == macro.params[p]) {
+        macro.paramIndex[i] = static_cast<int>(p);
+        break;
       }
-      continue;
-    }
-    if (pendingPaste && std::isspace(static_cast<unsigned char>(c))) {
-      i++;
-      continue;
     }
-    if (pendingPaste) {
-      out.push_back(c);
-      pendingPaste = false;
-      i++;
-      continue;
+    if (macro.variadic && tok.text == "__VA_ARGS__") {
+      macro.paramIndex[i] = static_cast<int>(macro.params.size());
     }
-    out.push_back(c);
-    i++;
   }
-  return out;
 }
 
-std::optional<std::string> Preprocessor::run(const std::string& path, const std::string& source) {
-  errors_.clear();
+std::optional<std::string> Preprocessor::run(const std::string& path, std::string_view source) {
+  start(path, source);
   std::string out;
-  if (!processFile(path, source, out)) return std::nullopt;
+  next(out, std::string::npos);
+  if (failed_) return std::nullopt;
   return out;
 }
 
-bool Preprocessor::processFile(const std::string& path, const std::string& source, std::string& out) {
-  return processLines(path, source, out);
+void Preprocessor::start(const std::string& path, std::string_view source) {
+  errors_.clear();
+  includedFiles_.clear();
+  dependencies_.clear();
+  dependencySet_.clear();
+  frames_.clear();
+  failed_ = false;
+  mainPath_ = path;
+  pushFile(path, source);
+}
+
+bool Preprocessor::next(std::string& out, size_t limit) {
+  if (frames_.empty()) return false;
+  // Scopes never outlive a call, so they nest properly with the consumer's
+  // own (the parser's, when streaming); a long include shows up once per call.
+  TimeScope scope("Preprocess", mainPath_);
+  std::vector<std::unique_ptr<TimeScope>> includeScopes;
+  for (size_t k = 1; k < frames_.size(); k++) {
+    includeScopes.push_back(std::make_unique<TimeScope>("Include", frames_[k].path));
+  }
+  size_t begin = out.size();
+  while (!frames_.empty() && out.size() - begin < limit) {
+    size_t depth = frames_.size();
+    PreprocessorProfile::FileCost* cost = frames_.back().cost;
+    auto lineStart = cost ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    bool ok = processLine(out);
+    if (cost) cost->time += std::chrono::steady_clock::now() - lineStart;
+    if (!ok) {
+      failed_ = true;
+      frames_.clear();
+      break;
+    }
+    if (frames_.size() > depth) {
+      includeScopes.push_back(std::make_unique<TimeScope>("Include", frames_.back().path));
+    } else if (frames_.size() < depth && !includeScopes.empty()) {
+      includeScopes.pop_back();
+    }
+  }
+  while (!includeScopes.empty()) includeScopes.pop_back(); // innermost first
+  return !failed_;
 }
 
-bool Preprocessor::processLines(const std::string& path, const std::string& source, std::string& out) {
-  std::istringstream iss(source);
-  std::string line;
-  int lineNo = 1;
-  std::vector<IfState> ifs;
+void Preprocessor::pushFile(const std::string& path, std::string_view source) {
+  FileFrame& frame = frames_.emplace_back();
+  frame.path = path;
+  frame.source = source;
+  if (profile_) {
+    // one row per file, however its #includes spell it
+    frame.cost = &profile_->files[files().uniquePath(path)];
+    frame.cost->entered++;
+    frame.cost->bytes += source.size();
+  }
+}
 
-  while (std::getline(iss, line)) {
-    size_t i = 0;
-    while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) i++;
-    if (i < line.size() && line[i] == '#') {
-      if (!handleDirective(path, lineNo, line.substr(i + 1), ifs, out)) return false;
-      lineNo++;
-      continue;
+// Directive name and, for "ifndef X" or "if !defined(X)", the macro X.
+static void guardDirective(const std::string& text, std::string& name, std::string& macro) {
+  size_t i = 0;
+  auto skipSpace = [&] {
+    while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i]))) i++;
+  };
+  auto ident = [&] {
+    size_t start = i;
+    if (i < text.size() && isIdentStart(text[i])) {
+      while (i < text.size() && isIdentChar(text[i])) i++;
+    }
+    return text.substr(start, i - start);
+  };
+  skipSpace();
+  name = ident();
+  skipSpace();
+  if (name == "if") {
+    if (i >= text.size() || text[i] != '!') return;
+    i++;
+    skipSpace();
+    if (ident() != "defined") return;
+    skipSpace();
+    bool paren = i < text.size() && text[i] == '(';
+    if (paren) i++;
+    skipSpace();
+    std::string m = ident();
+    skipSpace();
+    if (paren) {
+      if (i >= text.size() || text[i] != ')') return;
+      i++;
+      skipSpace();
     }
+    if (i == text.size() || text.compare(i, 2, "//") == 0) macro = m;
+  } else if (name == "ifndef") {
+    macro = ident();
+  }
+}
 
-    bool curActive = true;
-    if (!ifs.empty()) {
-      const IfState& st = ifs.back();
-      curActive = st.parentActive && st.condition;
+// Start of the first line at or after `pos` (a line start) whose first
+// non-blank character is '#', or source.size(); `lineNo` advances past the
+// lines skipped. Inactive groups go through here: memchr jumps from '#' to
+// '#' instead of looking at every line.
+static size_t nextDirectiveLine(std::string_view source, size_t pos, int& lineNo) {
+  const char* data = source.data();
+  const size_t end = source.size();
+  size_t lineStart = pos;
+  while (pos < end) {
+    const void* hit = std::memchr(data + pos, '#', end - pos);
+    size_t hash = hit ? static_cast<size_t>(static_cast<const char*>(hit) - data) : end;
+    for (size_t nl = pos; nl < hash; nl++) {
+      const void* p = std::memchr(data + nl, '\n', hash - nl);
+      if (!p) break;
+      nl = static_cast<size_t>(static_cast<const char*>(p) - data);
+      lineNo++;
+      lineStart = nl + 1;
+    }
+    if (hash == end) {
+      if (lineStart < end) lineNo++; // last line without a newline
+      return end;
     }
+    size_t i = lineStart;
+    while (i < hash && std::isspace(static_cast<unsigned char>(data[i]))) i++;
+    if (i == hash) return lineStart;
+    pos = hash + 1;
+  }
+  return end;
+}
 
-    if (curActive) {
-      out.append(expandLine(line, path, lineNo));
-      out.push_back('\n');
+bool Preprocessor::processLine(std::string& out) {
+  FileFrame& f = frames_.back();
+  const std::string_view source = f.source;
+  // lines in a skipped group can't matter for the guard either: a group
+  // inside the guard block is nested, and one outside has already failed it.
+  // A scan (-M) skips ordinary lines the same way once they can't matter:
+  // the file is known not to be guarded, or we are inside its guard block.
+  bool skipping = !f.ifs.empty() && !(f.ifs.back().parentActive && f.ifs.back().condition);
+  if (scanOnly_ && !skipping) {
+    skipping = f.outsideGuard || (!f.guard.empty() && !f.guardClosed && !f.ifs.empty());
+  }
+  if (skipping) f.pos = nextDirectiveLine(source, f.pos, f.lineNo);
+  if (f.pos >= source.size()) return finishFile();
+
+  size_t nl = source.find('\n', f.pos);
+  if (nl == std::string_view::npos) nl = source.size();
+  std::string_view line = source.substr(f.pos, nl - f.pos);
+  f.pos = nl + 1;
+  int lineNo = f.lineNo++;
+  size_t i = 0;
+  while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) i++;
+  if (i < line.size() && line[i] == '#') {
+    std::string text(line.substr(i + 1));
+    if (!f.outsideGuard) {
+      std::string name;
+      std::string macro;
+      guardDirective(text, name, macro);
+      if (f.ifs.empty()) {
+        if (f.guard.empty() && !macro.empty()) f.guard = macro;
+        else f.outsideGuard = true;
+      } else if (f.ifs.size() == 1 && !f.guardClosed) {
+        if (name == "endif") f.guardClosed = true;
+        else if (name == "else" || name == "elif") f.outsideGuard = true;
+      }
     }
-    lineNo++;
+    // may push an #include'd file; frames_ is a deque, so `f` stays valid
+    return handleDirective(f.path, lineNo, text, f.ifs);
   }
+  bool blank = i >= line.size() || line.compare(i, 2, "//") == 0;
+  if (!blank && (f.guard.empty() || f.guardClosed)) f.outsideGuard = true;
+  if (scanOnly_) return true;
 
-  if (!ifs.empty()) {
-    report(path, lineNo, 1, "unterminated conditional directive");
+  expandLine(line, f.path, lineNo, out);
+  out.push_back('\n');
+  return true;
+}
+
+bool Preprocessor::finishFile() {
+  FileFrame& f = frames_.back();
+  if (!f.ifs.empty()) {
+    report(f.path, f.lineNo, 1, "unterminated conditional directive");
     return false;
   }
-
+  if (!f.outsideGuard && f.guardClosed) includeGuards_[files().uniquePath(f.path)] = f.guard;
+  frames_.pop_back();
   return true;
 }
 
 bool Preprocessor::handleDirective(
     const std::string& path, int line, const std::string& lineText,
-    std::vector<IfState>& ifs, std::string& out) {
+    std::vector<IfState>& ifs) {
   size_t i = 0;
   while (i < lineText.size() && std::isspace(static_cast<unsigned char>(lineText[i]))) i++;
   size_t start = i;
@@ -276,13 +433,29 @@ bool Preprocessor::handleDirective(
       return report(path, line, static_cast<int>(nameStart + 1), "unterminated include path");
     }
     std::string header = lineText.substr(nameStart, i - nameStart);
-    std::string fullPath;
-    std::string content;
-    if (!resolveInclude(header, delim == '<', path, fullPath, content)) {
+    auto resolved = files().resolveInclude(header, delim == '<' ? "" : dirName(path), searchList());
+    if (!resolved) {
       return report(path, line, static_cast<int>(nameStart + 1),
                     "include file not found: " + header);
     }
-    if (!processFile(fullPath, content, out)) return false;
+    const std::string& fullPath = *resolved;
+    stats_.includes++;
+    if (dependencySet_.insert(fullPath).second) dependencies_.push_back(fullPath);
+    std::string uniquePath = files().uniquePath(fullPath);
+    if (includeIsRedundant(uniquePath)) {
+      stats_.skippedIncludes++;
+      if (profile_) profile_->files[uniquePath].skipped++;
+      return true;
+    }
+    FileManager::Buffer content = files().getBuffer(fullPath);
+    if (!content) {
+      return report(path, line, static_cast<int>(nameStart + 1),
+                    "cannot read include file: " + fullPath);
+    }
+    includedFiles_.push_back(fullPath);
+    llvm::StringRef text = content->getBuffer();
+    // processed line by line from here on; the FileManager keeps the buffer
+    pushFile(fullPath, std::string_view(text.data(), text.size()));
     return true;
   }
 
@@ -343,7 +516,10 @@ bool Preprocessor::handleDirective(
     }
     while (i < lineText.size() && std::isspace(static_cast<unsigned char>(lineText[i]))) i++;
     macro.body = (i < lineText.size()) ? lineText.substr(i) : "";
-    macros_[name] = std::move(macro);
+    invalidateExpansions(name);
+    Macro& slot = macros_[name];
+    slot = std::move(macro);
+    lexMacroBody(slot); // in place: the tokens view slot.body
     return true;
   }
 
@@ -355,6 +531,7 @@ bool Preprocessor::handleDirective(
     size_t nameStart = i;
     while (i < lineText.size() && isIdentChar(lineText[i])) i++;
     std::string name = lineText.substr(nameStart, i - nameStart);
+    invalidateExpansions(name);
     macros_.erase(name);
     return true;
   }
@@ -432,6 +609,16 @@ bool Preprocessor::handleDirective(
     return true;
   }
 
+  if (directive == "pragma") {
+    if (!active) return true;
+    // other pragmas are implementation-defined and ignored
+    if (lineText.compare(i, 4, "once") == 0 &&
+        (i + 4 == lineText.size() || !isIdentChar(lineText[i + 4]))) {
+      onceFiles_.insert(files().uniquePath(path));
+    }
+    return true;
+  }
+
   if (directive.empty()) {
     return true;
   }
@@ -439,47 +626,41 @@ bool Preprocessor::handleDirective(
   return report(path, line, static_cast<int>(start + 1), "unknown preprocessor directive");
 }
 
-static bool isAbsolutePath(const std::string& path) {
-  if (path.empty()) return false;
-  if (path[0] == '/') return true;
-  if (path.size() >= 2 && std::isalpha(static_cast<unsigned char>(path[0])) && path[1] == ':') {
-    return true;
+Preprocessor::State Preprocessor::saveState() const {
+  State state;
+  state.macros.reserve(macros_.size());
+  for (const auto& [name, macro] : macros_) {
+    state.macros.push_back({name, macro.functionLike, macro.variadic, macro.params, macro.body});
   }
-  return false;
+  state.onceFiles.assign(onceFiles_.begin(), onceFiles_.end());
+  state.includeGuards.assign(includeGuards_.begin(), includeGuards_.end());
+  // sorted, so the same header always gives the same precompiled bytes
+  std::sort(state.macros.begin(), state.macros.end(),
+            [](const SavedMacro& a, const SavedMacro& b) { return a.name < b.name; });
+  std::sort(state.onceFiles.begin(), state.onceFiles.end());
+  std::sort(state.includeGuards.begin(), state.includeGuards.end());
+  return state;
 }
 
-bool Preprocessor::resolveInclude(
-    const std::string& header,
-    bool isSystem,
-    const std::string& currentPath,
-    std::string& resolvedPath,
-    std::string& content) {
-  if (isAbsolutePath(header)) {
-    if (readFile(header, content)) {
-      resolvedPath = header;
-      return true;
-    }
-    return false;
-  }
-
-  std::vector<std::string> searchPaths;
-  if (!isSystem) {
-    std::string base = dirName(currentPath);
-    if (!base.empty()) searchPaths.push_back(base);
+void Preprocessor::restoreState(const State& state) {
+  for (const SavedMacro& saved : state.macros) {
+    invalidateExpansions(saved.name);
+    Macro& slot = macros_[saved.name];
+    slot = Macro();
+    slot.functionLike = saved.functionLike;
+    slot.variadic = saved.variadic;
+    slot.params = saved.params;
+    slot.body = saved.body;
+    lexMacroBody(slot);
   }
-  for (const auto& p : includePaths_) searchPaths.push_back(p);
-  for (const auto& p : systemIncludePaths_) searchPaths.push_back(p);
+  onceFiles_.insert(state.onceFiles.begin(), state.onceFiles.end());
+  for (const auto& [file, guard] : state.includeGuards) includeGuards_[file] = guard;
+}
 
-  for (const auto& base : searchPaths) {
-    std::string fullPath = base;
-    if (!fullPath.empty() && fullPath.back() != '/') fullPath += "/";
-    fullPath += header;
-    if (readFile(fullPath, content)) {
-      resolvedPath = fullPath;
-      return true;
-    }
-  }
-  return false;
+bool Preprocessor::includeIsRedundant(const std::string& key) const {
+  if (onceFiles_.count(key) > 0) return true;
+  auto it = includeGuards_.find(key);
+  return it != includeGuards_.end() && macros_.count(it->second) > 0;
 }
 
 bool Preprocessor::evalIfExpr(const std::string& expr, bool& out, std::string& err) {
@@ -772,179 +953,435 @@ bool Preprocessor::evalIfExpr(const std::string& expr, bool& out, std::string& e
   return true;
 }
 
-std::string Preprocessor::expandLine(const std::string& line, const std::string& path, int lineNo) {
-  size_t commentPos = line.find("//");
-  std::string code = line;
-  std::string comment;
-  if (commentPos != std::string::npos) {
-    code = line.substr(0, commentPos);
-    comment = line.substr(commentPos);
+void Preprocessor::expandLine(
+    std::string_view line, const std::string& path, int lineNo, std::string& out) {
+  TokenList tokens;
+  std::string_view comment;
+  lexTokens(line, tokens, &comment);
+
+  // most lines name no macro at all and are passed through untouched
+  bool hasMacro = false;
+  for (const auto& tok : tokens) {
+    if (tok.kind != PPToken::Ident) continue;
+    if ((tok.text.size() > 2 && tok.text[0] == '_' && tok.text[1] == '_') ||
+        macros_.count(std::string(tok.text)) > 0) {
+      hasMacro = true;
+      break;
+    }
+  }
+  if (!hasMacro) {
+    out.append(line);
+    return;
   }
 
-  std::unordered_map<std::string, bool> expanding;
-  std::string expanded = expandText(code, path, lineNo, expanding, 0);
-  if (!comment.empty()) expanded += comment;
-  return expanded;
+  scratch_.clear();
+  hideSets_.clear();
+  // only between lines: tokens of a dropped entry may not be in flight
+  if (macroCache_.size() > kMaxCachedExpansions) {
+    macroCache_.clear();
+    macroCacheUsers_.clear();
+  }
+  TokenList stack(tokens.rbegin(), tokens.rend());
+  TokenList expanded;
+  expanded.reserve(tokens.size());
+  expandTokens(stack, expanded, path, lineNo);
+
+  std::string_view prev;
+  for (const auto& tok : expanded) {
+    if (!tok.space.empty()) {
+      out.append(tok.space);
+    } else if (wouldMerge(prev, tok.text)) {
+      out.push_back(' ');
+    }
+    out.append(tok.text);
+    prev = tok.text;
+  }
+  out.append(comment);
 }
 
-std::string Preprocessor::expandText(
-    const std::string& text, const std::string& path, int lineNo,
-    std::unordered_map<std::string, bool>& expanding, int depth) {
-  if (depth > 32) return text;
-  std::string out;
-  size_t i = 0;
-  while (i < text.size()) {
-    char c = text[i];
-    if (c == '"' || c == '\'') {
-      char quote = c;
-      out.push_back(c);
-      i++;
-      while (i < text.size()) {
-        char cc = text[i];
-        out.push_back(cc);
-        i++;
-        if (cc == '\\' && i < text.size()) {
-          out.push_back(text[i]);
-          i++;
-          continue;
-        }
-        if (cc == quote) break;
-      }
+void Preprocessor::expandTokens(
+    TokenList& stack, TokenList& out, const std::string& path, int lineNo) {
+  while (!stack.empty()) {
+    PPToken tok = stack.back();
+    stack.pop_back();
+    if (tok.kind != PPToken::Ident) {
+      out.push_back(tok);
       continue;
     }
-    if (isIdentStart(c)) {
-      size_t start = i;
-      i++;
-      while (i < text.size() && isIdentChar(text[i])) i++;
-      std::string name = text.substr(start, i - start);
-      if (name == "__LINE__") {
-        out += std::to_string(lineNo);
+    if (expandBuiltin(tok, path, lineNo)) {
+      if (!records_.empty()) records_.back().usesBuiltin = true;
+      out.push_back(tok);
+      continue;
+    }
+    std::string name(tok.text);
+    if (!records_.empty()) records_.back().deps.push_back(name);
+    auto it = macros_.find(name);
+    if (it == macros_.end() || hideSetContains(tok.hide, &it->second)) {
+      out.push_back(tok);
+      continue;
+    }
+    const Macro& macro = it->second;
+    auto expansionStart =
+        profile_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    auto profileExpansion = [&](const TokenList& replacement) {
+      if (!profile_) return;
+      PreprocessorProfile::MacroCost& cost = profile_->macros[name];
+      cost.expansions++;
+      for (const auto& t : replacement) cost.bytes += t.space.size() + t.text.size();
+      cost.time += std::chrono::steady_clock::now() - expansionStart;
+    };
+
+    std::vector<TokenList> args;
+    const HideSet* hide = tok.hide;
+    const HideSet* rparenHide = nullptr;
+    if (macro.functionLike) {
+      if (!collectArgs(stack, macro, args, rparenHide)) {
+        // the arguments may follow this expansion in the enclosing text:
+        // stop, and leave this name and the rest to be rescanned there
+        if (!records_.empty() && records_.back().stack == &stack &&
+            (stack.empty() || stack.back().text == "(")) {
+          records_.back().open = true;
+          stack.push_back(tok);
+          return;
+        }
+        out.push_back(tok);
         continue;
       }
-      if (name == "__FILE__") {
-        out += toStringLiteral(path);
+      hide = hideSetIntersect(hide, rparenHide);
+    }
+    hide = hideSetWith(hide, &macro);
+
+    std::string cacheKey;
+    if (macroCacheKey(tok, args, rparenHide, cacheKey)) {
+      stats_.macroCacheLookups++;
+      auto cached = macroCache_.find(cacheKey);
+      if (cached != macroCache_.end()) {
+        stats_.macroCacheHits++;
+        const CachedExpansion& entry = cached->second;
+        profileExpansion(entry.tokens);
+        out.insert(out.end(), entry.tokens.begin(), entry.tokens.end());
+        if (!records_.empty()) {
+          auto& deps = records_.back().deps;
+          deps.insert(deps.end(), entry.deps.begin(), entry.deps.end());
+        }
         continue;
       }
-      if (name == "__DATE__") {
-        out += toStringLiteral(builtinDate_);
-        continue;
+    }
+    // Computing an entry: the replacement is rescanned on its own stack
+    // rather than together with the rest of the line.
+    TokenList isolated;
+    if (!cacheKey.empty()) {
+      records_.emplace_back();
+      records_.back().stack = &isolated;
+    }
+
+    TokenList result;
+    size_t resultSize = macro.tokens.size();
+    for (const auto& arg : args) resultSize += arg.size();
+    result.reserve(resultSize);
+    substitute(macro, args, path, lineNo, result);
+    // runs of tokens from one argument share a hide set; union each run once
+    const HideSet* lastIn = nullptr;
+    const HideSet* lastOut = hide;
+    for (auto& t : result) {
+      if (t.hide != lastIn) {
+        lastIn = t.hide;
+        lastOut = hideSetUnion(t.hide, hide);
       }
-      if (name == "__TIME__") {
-        out += toStringLiteral(builtinTime_);
+      t.hide = lastOut;
+    }
+    if (!result.empty()) result.front().space = tok.space;
+    profileExpansion(result);
+
+    if (!cacheKey.empty()) {
+      isolated.assign(result.rbegin(), result.rend());
+      TokenList expanded;
+      expanded.reserve(result.size());
+      expandTokens(isolated, expanded, path, lineNo);
+      ExpansionRecord record = std::move(records_.back());
+      records_.pop_back();
+      if (!records_.empty()) {
+        ExpansionRecord& parent = records_.back();
+        parent.deps.insert(parent.deps.end(), record.deps.begin(), record.deps.end());
+        parent.usesBuiltin |= record.usesBuiltin;
+      }
+      if (!record.open) {
+        if (!record.usesBuiltin) storeExpansion(cacheKey, expanded, std::move(record.deps));
+        out.insert(out.end(), expanded.begin(), expanded.end());
         continue;
       }
-      auto it = macros_.find(name);
-      if (it != macros_.end() && !expanding[name]) {
-        const Macro& macro = it->second;
-        if (macro.functionLike) {
-          if (i < text.size() && text[i] == '(') {
-            size_t pos = i + 1;
-            int parenDepth = 1;
-            std::vector<std::string> args;
-            std::string current;
-            bool sawSep = false;
-            bool ok = false;
-            while (pos < text.size()) {
-              char cc = text[pos];
-              if (cc == '"' || cc == '\'') {
-                char quote = cc;
-                current.push_back(cc);
-                pos++;
-                while (pos < text.size()) {
-                  char qc = text[pos];
-                  current.push_back(qc);
-                  pos++;
-                  if (qc == '\\' && pos < text.size()) {
-                    current.push_back(text[pos]);
-                    pos++;
-                    continue;
-                  }
-                  if (qc == quote) break;
-                }
-                continue;
-              }
-              if (cc == '(') {
-                parenDepth++;
-                current.push_back(cc);
-                pos++;
-                continue;
-              }
-              if (cc == ')') {
-                parenDepth--;
-                if (parenDepth == 0) {
-                  std::string trimmed = trim(current);
-                  if (sawSep || !trimmed.empty()) args.push_back(trimmed);
-                  pos++;
-                  ok = true;
-                  break;
-                }
-                current.push_back(cc);
-                pos++;
-                continue;
-              }
-              if (cc == ',' && parenDepth == 1) {
-                args.push_back(trim(current));
-                current.clear();
-                sawSep = true;
-                pos++;
-                continue;
-              }
-              current.push_back(cc);
-              pos++;
-            }
-            if (ok) {
-              size_t fixedCount = macro.params.size();
-              if ((!macro.variadic && args.size() == fixedCount) ||
-                  (macro.variadic && args.size() >= fixedCount)) {
-                std::vector<std::string> expArgs;
-                expArgs.reserve(args.size());
-                for (const auto& a : args) {
-                  expArgs.push_back(expandText(a, path, lineNo, expanding, depth + 1));
-                }
-                std::string varRaw;
-                std::string varExpanded;
-                if (macro.variadic) {
-                  for (size_t ai = fixedCount; ai < args.size(); ++ai) {
-                    if (ai > fixedCount) {
-                      varRaw += ",";
-                      varExpanded += ",";
-                    }
-                    varRaw += args[ai];
-                    varExpanded += expArgs[ai];
-                  }
-                }
-                std::vector<std::string> fixedRaw;
-                std::vector<std::string> fixedExpanded;
-                fixedRaw.reserve(fixedCount);
-                fixedExpanded.reserve(fixedCount);
-                for (size_t ai = 0; ai < fixedCount; ++ai) {
-                  fixedRaw.push_back(args[ai]);
-                  fixedExpanded.push_back(expArgs[ai]);
-                }
-                std::string replaced = replaceParams(
-                    macro.body, macro.params, fixedRaw, fixedExpanded,
-                    macro.variadic, varRaw, varExpanded);
-                expanding[name] = true;
-                out += expandText(replaced, path, lineNo, expanding, depth + 1);
-                expanding[name] = false;
-                i = pos;
-                continue;
-              }
-            }
-          }
-          out += name;
-        } else {
-          expanding[name] = true;
-          out += expandText(macro.body, path, lineNo, expanding, depth + 1);
-          expanding[name] = false;
-        }
+      // A function-like name wants its arguments from the line. What came
+      // before it is expanded already; the rest goes on with the line.
+      out.insert(out.end(), expanded.begin(), expanded.end());
+      stack.insert(stack.end(), isolated.begin(), isolated.end());
+      continue;
+    }
+    // rescan the replacement together with the rest of the line
+    stack.insert(stack.end(), result.rbegin(), result.rend());
+  }
+}
+
+// Invocations whose tokens all come straight from the source line: their
+// expansion is then a function of the macro definitions and the spelling
+// (whitespace included, as # sees it) alone.
+bool Preprocessor::macroCacheKey(
+    const PPToken& tok, const std::vector<TokenList>& args, const HideSet* rparenHide,
+    std::string& key) {
+  if (tok.hide || rparenHide) return false;
+  for (const auto& arg : args) {
+    for (const auto& t : arg) {
+      if (t.hide) return false;
+    }
+  }
+  key.assign(tok.text).push_back('\0');
+  key.append(tok.space);
+  for (const auto& arg : args) {
+    key.push_back('\1');
+    for (const auto& t : arg) {
+      key.push_back('\2');
+      key.append(t.space).push_back('\3');
+      key.append(t.text);
+    }
+  }
+  return true;
+}
+
+void Preprocessor::storeExpansion(
+    const std::string& key, const TokenList& tokens, std::vector<std::string> deps) {
+  // built in place: `tokens` view `storage`, which must not move afterwards
+  auto [slot, inserted] = macroCache_.try_emplace(key);
+  if (!inserted) return;
+  CachedExpansion& entry = slot->second;
+  size_t size = 0;
+  for (const auto& t : tokens) size += t.space.size() + t.text.size();
+  entry.storage.reserve(size);
+  std::unordered_map<const HideSet*, const HideSet*> copied{{nullptr, nullptr}};
+  std::function<const HideSet*(const HideSet*)> copy = [&](const HideSet* hs) {
+    auto found = copied.find(hs);
+    if (found != copied.end()) return found->second;
+    const HideSet* node = &entry.hides.emplace_back(HideSet{hs->macro, copy(hs->next)});
+    copied.emplace(hs, node);
+    return node;
+  };
+  entry.tokens.reserve(tokens.size());
+  for (const auto& t : tokens) {
+    size_t spaceAt = entry.storage.size();
+    entry.storage.append(t.space);
+    size_t textAt = entry.storage.size();
+    entry.storage.append(t.text);
+    PPToken& c = entry.tokens.emplace_back(t);
+    c.space = std::string_view(entry.storage).substr(spaceAt, t.space.size());
+    c.text = std::string_view(entry.storage).substr(textAt, t.text.size());
+    c.hide = copy(t.hide);
+  }
+  std::sort(deps.begin(), deps.end());
+  deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+  for (const auto& dep : deps) macroCacheUsers_[dep].push_back(key);
+  entry.deps = std::move(deps);
+}
+
+// Drops every cached expansion that looked `name` up, on #define or #undef.
+void Preprocessor::invalidateExpansions(const std::string& name) {
+  auto users = macroCacheUsers_.find(name);
+  if (users == macroCacheUsers_.end()) return;
+  for (const auto& key : users->second) macroCache_.erase(key);
+  macroCacheUsers_.erase(users);
+}
+
+bool Preprocessor::collectArgs(
+    TokenList& stack, const Macro& macro, std::vector<TokenList>& args,
+    const HideSet*& rparenHide) {
+  if (stack.empty() || stack.back().kind != PPToken::Punct || stack.back().text != "(") {
+    return false;
+  }
+  size_t fixedCount = macro.params.size();
+  args.clear();
+  // the stack is reversed: an argument is stack[k+1 .. argEnd-1], read backwards
+  size_t argEnd = stack.size() - 1;
+  auto takeArg = [&](size_t k) {
+    args.emplace_back(std::make_reverse_iterator(stack.begin() + argEnd),
+                      std::make_reverse_iterator(stack.begin() + k + 1));
+    argEnd = k;
+  };
+  int depth = 0;
+  for (size_t k = stack.size() - 1; k-- > 0;) {
+    const PPToken& t = stack[k];
+    if (t.kind != PPToken::Punct) continue;
+    if (t.text == "(") {
+      depth++;
+    } else if (t.text == ")" && depth > 0) {
+      depth--;
+    } else if (t.text == ")") {
+      takeArg(k);
+      // F() passes one empty argument, or none to a macro without parameters
+      if (fixedCount == 0 && !macro.variadic && args.size() == 1 && args[0].empty()) {
+        args.clear();
+      }
+      if (macro.variadic && args.size() == fixedCount) args.emplace_back();
+      if (args.size() != fixedCount + (macro.variadic ? 1 : 0)) return false;
+      rparenHide = t.hide;
+      stack.resize(k);
+      return true;
+    } else if (t.text == "," && depth == 0 &&
+               !(macro.variadic && args.size() == fixedCount)) {
+      // commas past the named parameters belong to __VA_ARGS__
+      takeArg(k);
+    }
+  }
+  return false;
+}
+
+void Preprocessor::substitute(
+    const Macro& macro, const std::vector<TokenList>& args, const std::string& path,
+    int lineNo, TokenList& out) {
+  const TokenList& body = macro.tokens;
+  // arguments are macro-expanded on first use, except as operands of # and ##
+  std::vector<TokenList> expandedArgs(args.size());
+  std::vector<bool> isExpanded(args.size(), false);
+  bool placemarker = false; // left operand of a pending ## was an empty argument
+
+  auto isPaste = [&](size_t i) {
+    return i < body.size() && body[i].kind == PPToken::Punct && body[i].text == "##";
+  };
+
+  for (size_t i = 0; i < body.size(); i++) {
+    const PPToken& t = body[i];
+    int param = macro.paramIndex[i];
+
+    if (macro.functionLike && t.kind == PPToken::Punct && t.text == "#" &&
+        i + 1 < body.size() && macro.paramIndex[i + 1] >= 0) {
+      PPToken str = stringizeTokens(args[macro.paramIndex[i + 1]]);
+      str.space = t.space;
+      out.push_back(str);
+      placemarker = false;
+      i++;
+      continue;
+    }
+
+    if (isPaste(i) && i + 1 < body.size()) {
+      i++;
+      TokenList single;
+      const TokenList* rhs = &single;
+      if (macro.paramIndex[i] >= 0) {
+        rhs = &args[macro.paramIndex[i]];
       } else {
-        out += name;
+        single.push_back(body[i]);
       }
+      if (rhs->empty()) continue;
+      if (placemarker || out.empty()) {
+        out.insert(out.end(), rhs->begin(), rhs->end());
+      } else {
+        pasteTokens(out, rhs->front());
+        out.insert(out.end(), rhs->begin() + 1, rhs->end());
+      }
+      placemarker = false;
       continue;
     }
-    out.push_back(c);
-    i++;
+
+    if (param >= 0) {
+      const TokenList* arg = &args[param];
+      placemarker = false;
+      if (isPaste(i + 1)) {
+        placemarker = arg->empty();
+      } else {
+        if (!isExpanded[param]) {
+          TokenList stack(arg->rbegin(), arg->rend());
+          expandedArgs[param].reserve(arg->size());
+          expandTokens(stack, expandedArgs[param], path, lineNo);
+          isExpanded[param] = true;
+        }
+        arg = &expandedArgs[param];
+      }
+      size_t first = out.size();
+      out.insert(out.end(), arg->begin(), arg->end());
+      if (out.size() > first) out[first].space = t.space;
+      continue;
+    }
+
+    placemarker = false;
+    out.push_back(t);
+  }
+}
+
+bool Preprocessor::expandBuiltin(PPToken& tok, const std::string& path, int lineNo) {
+  if (tok.text.size() < 8 || tok.text[0] != '_' || tok.text[1] != '_') return false;
+  std::string text;
+  if (tok.text == "__LINE__") {
+    text = std::to_string(lineNo);
+  } else if (tok.text == "__FILE__") {
+    text = toStringLiteral(path);
+  } else if (tok.text == "__DATE__") {
+    text = toStringLiteral(builtinDate_);
+  } else if (tok.text == "__TIME__") {
+    text = toStringLiteral(builtinTime_);
+  } else {
+    return false;
+  }
+  tok.kind = PPToken::Literal;
+  tok.text = scratch_.emplace_back(std::move(text));
+  return true;
+}
+
+void Preprocessor::pasteTokens(TokenList& out, const PPToken& rhs) {
+  PPToken lhs = out.back();
+  out.pop_back();
+  std::string& text = scratch_.emplace_back();
+  text.append(lhs.text).append(rhs.text);
+  // an invalid paste (not a single token) leaves the pieces it lexes to
+  size_t first = out.size();
+  lexTokens(text, out, nullptr);
+  const HideSet* hide = hideSetIntersect(lhs.hide, rhs.hide);
+  for (size_t k = first; k < out.size(); k++) out[k].hide = hide;
+  if (out.size() > first) out[first].space = lhs.space;
+}
+
+Preprocessor::PPToken Preprocessor::stringizeTokens(const TokenList& tokens) {
+  std::string& text = scratch_.emplace_back("\"");
+  for (size_t k = 0; k < tokens.size(); k++) {
+    const PPToken& tok = tokens[k];
+    if (k > 0 && !tok.space.empty()) text.push_back(' ');
+    if (tok.kind != PPToken::Literal) {
+      text.append(tok.text);
+      continue;
+    }
+    for (char c : tok.text) {
+      if (c == '\\' || c == '"') text.push_back('\\');
+      text.push_back(c);
+    }
+  }
+  text.push_back('"');
+  PPToken str;
+  str.kind = PPToken::Literal;
+  str.text = text;
+  return str;
+}
+
+bool Preprocessor::hideSetContains(const HideSet* hs, const Macro* macro) {
+  for (; hs; hs = hs->next) {
+    if (hs->macro == macro) return true;
+  }
+  return false;
+}
+
+const Preprocessor::HideSet* Preprocessor::hideSetWith(const HideSet* hs, const Macro* macro) {
+  if (hideSetContains(hs, macro)) return hs;
+  hideSets_.push_back(HideSet{macro, hs});
+  return &hideSets_.back();
+}
+
+const Preprocessor::HideSet* Preprocessor::hideSetUnion(const HideSet* a, const HideSet* b) {
+  if (!a || a == b) return b;
+  if (!b) return a;
+  const HideSet* out = b;
+  for (; a; a = a->next) out = hideSetWith(out, a->macro);
+  return out;
+}
+
+const Preprocessor::HideSet* Preprocessor::hideSetIntersect(const HideSet* a, const HideSet* b) {
+  if (a == b) return a;
+  const HideSet* out = nullptr;
+  for (; a; a = a->next) {
+    if (hideSetContains(b, a->macro)) out = hideSetWith(out, a->macro);
   }
   return out;
 }
@@ -954,20 +1391,11 @@ bool Preprocessor::report(const std::string& path, int line, int col, const std:
   oss << path << ":" << line << ":" << col << ": error: " << msg;
   errors_.push_back(oss.str());
   for (const auto& e : errors_) {
-    std::cerr << e << "\n";
+    *diagOut_ << e << "\n";
   }
   return false;
 }
 
-bool Preprocessor::readFile(const std::string& path, std::string& out) {
-  std::ifstream ifs(path);
-  if (!ifs) return false;
-  std::stringstream ss;
-  ss << ifs.rdbuf();
-  out = ss.str();
-  return true;
-}
-
 std::string Preprocessor::dirName(const std::string& path) {
   size_t pos = path.find_last_of("/\\");
   if (pos == std::string::npos) return "";
@@ -1,9 +1,18 @@
 #pragma once
+#include <deque>
+#include <iosfwd>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "file_manager.h"
+#include "pp_profile.h"
+
 namespace c99cc {
 
 class Preprocessor {
@@ -11,16 +20,107 @@ public:
   explicit Preprocessor(
       std::vector<std::string> includePaths = {},
       std::vector<std::string> systemIncludePaths = {});
-  std::optional<std::string> run(const std::string& path, const std::string& source);
+  std::optional<std::string> run(const std::string& path, std::string_view source);
+  // Streaming form of run(): after start(), each next() appends whole lines
+  // of output to `out`, stopping once it has appended at least `limit` bytes.
+  // It returns false when there is nothing left or an error was reported
+  // (then failed() is true). `source` must outlive the stream.
+  void start(const std::string& path, std::string_view source);
+  bool next(std::string& out, size_t limit = 64 * 1024);
+  bool failed() const { return failed_; }
   void addIncludePath(const std::string& path);
   void addSystemIncludePath(const std::string& path);
+  void setDiagnosticStream(std::ostream& os) { diagOut_ = &os; }
+  // Headers are read through `files` when set (not owned), otherwise through
+  // a manager private to this preprocessor.
+  void setFileManager(FileManager* files);
+  // -fpp-profile: costs are added to `profile` (not owned) when set.
+  void setProfile(PreprocessorProfile* profile) { profile_ = profile; }
+  // -M: only directives run (#include, #define, #if...); ordinary lines are
+  // neither expanded nor output, so a run yields just dependencies().
+  void setScanOnly(bool scanOnly) { scanOnly_ = scanOnly; }
+
+  struct Stats {
+    unsigned includes = 0;        // #include directives executed
+    unsigned skippedIncludes = 0; // of those, skipped by #pragma once or an include guard
+    unsigned macroCacheLookups = 0; // macro invocations eligible for the expansion cache
+    unsigned macroCacheHits = 0;
+  };
+  const Stats& stats() const { return stats_; }
+
+  // The state a precompiled header carries from one run() into another:
+  // macro definitions and what is known about #pragma once / guarded files.
+  struct SavedMacro {
+    std::string name;
+    bool functionLike = false;
+    bool variadic = false;
+    std::vector<std::string> params;
+    std::string body;
+  };
+  struct State {
+    std::vector<SavedMacro> macros;
+    std::vector<std::string> onceFiles;
+    std::vector<std::pair<std::string, std::string>> includeGuards; // file, guard macro
+  };
+  State saveState() const;
+  void restoreState(const State& state);
+  // Headers the last run() read, in include order.
+  const std::vector<std::string>& includedFiles() const { return includedFiles_; }
+  // Every file an #include of the last run() resolved to, once each in first-seen
+  // order, including those skipped by #pragma once or an include guard (-MD).
+  const std::vector<std::string>& dependencies() const { return dependencies_; }
 
 private:
+  struct Macro;
+
+  // Macros a token came out of and must not be expanded by again (C99
+  // 6.10.3.4). Immutable and shared between tokens, so extending one is a
+  // single node.
+  struct HideSet {
+    const Macro* macro;
+    const HideSet* next;
+  };
+
+  // A preprocessing token. `text` and `space` (the whitespace written before
+  // it) view the current line, a macro body or scratch_.
+  struct PPToken {
+    enum Kind : unsigned char { Ident, Literal, Punct };
+    Kind kind = Punct;
+    std::string_view text;
+    std::string_view space;
+    const HideSet* hide = nullptr;
+  };
+  using TokenList = std::vector<PPToken>;
+
   struct Macro {
+    Macro() = default;
+    Macro(Macro&&) = default;
+    Macro& operator=(Macro&&) = default;
+    Macro(const Macro&) = delete; // `tokens` view `body`
+
     bool functionLike = false;
     bool variadic = false;
     std::vector<std::string> params;
-    std::string body;
+    std::string body;            // replacement list as written
+    TokenList tokens;            // `body`, lexed once at #define
+    std::vector<int> paramIndex; // per token: parameter (__VA_ARGS__ last) or -1
+  };
+
+  // The fully rescanned expansion of one macro invocation, replayed when the
+  // same macro is invoked with the same argument spelling again. `tokens`
+  // view `storage` and carry hide sets from `hides`.
+  struct CachedExpansion {
+    std::string storage;
+    std::deque<HideSet> hides;
+    TokenList tokens;
+    std::vector<std::string> deps; // every name looked up while expanding
+  };
+  // What an expansion being computed for the cache has depended on so far.
+  struct ExpansionRecord {
+    const TokenList* stack = nullptr; // its rescan stack
+    std::vector<std::string> deps;
+    bool open = false;        // wanted tokens past its end (a trailing F without args)
+    bool usesBuiltin = false; // __LINE__ and friends differ per use
   };
 
   struct IfState {
@@ -30,34 +130,92 @@ private:
     bool taken = false;
   };
 
+  // A file being preprocessed; the innermost #include is at the back.
+  struct FileFrame {
+    std::string path;
+    std::string_view source;
+    size_t pos = 0;
+    int lineNo = 1;
+    std::vector<IfState> ifs;
+    // Include-guard detection: the file must be a single #ifndef X (or
+    // #if !defined(X)) block with only blank lines and comments around it.
+    std::string guard;
+    bool guardClosed = false;
+    bool outsideGuard = false;
+    PreprocessorProfile::FileCost* cost = nullptr; // with -fpp-profile
+  };
+
   std::unordered_map<std::string, Macro> macros_;
   std::vector<std::string> includePaths_;
   std::vector<std::string> systemIncludePaths_;
   std::string builtinDate_;
   std::string builtinTime_;
   std::vector<std::string> errors_;
+  std::ostream* diagOut_;
+  FileManager* files_ = nullptr;
+  std::unique_ptr<FileManager> ownFiles_;
+  PreprocessorProfile* profile_ = nullptr;
+  std::optional<FileManager::SearchListId> searchList_; // -I then -isystem
+  // keyed by fileKey(): files that said #pragma once, and files whose whole
+  // content sits inside an include guard (mapped to the guard macro)
+  std::unordered_set<std::string> onceFiles_;
+  std::unordered_map<std::string, std::string> includeGuards_;
+  Stats stats_;
+  std::vector<std::string> includedFiles_;
+  std::vector<std::string> dependencies_;
+  std::unordered_set<std::string> dependencySet_;
+  std::deque<FileFrame> frames_;
+  std::string mainPath_;
+  bool failed_ = false;
+  bool scanOnly_ = false;
+  // per-line storage for expansion results; cleared before each expanded line
+  std::deque<std::string> scratch_;
+  std::deque<HideSet> hideSets_;
+  std::unordered_map<std::string, CachedExpansion> macroCache_;
+  // macro name -> cache keys whose expansion looked the name up
+  std::unordered_map<std::string, std::vector<std::string>> macroCacheUsers_;
+  std::vector<ExpansionRecord> records_;
 
-  bool processFile(const std::string& path, const std::string& source, std::string& out);
-  bool processLines(const std::string& path, const std::string& source, std::string& out);
+  void pushFile(const std::string& path, std::string_view source);
+  // Handles the next line of the innermost file, or finishes that file.
+  bool processLine(std::string& out);
+  bool finishFile();
   bool handleDirective(
       const std::string& path, int line, const std::string& lineText,
-      std::vector<IfState>& ifs, std::string& out);
+      std::vector<IfState>& ifs);
 
   bool evalIfExpr(const std::string& expr, bool& out, std::string& err);
-  std::string expandLine(const std::string& line, const std::string& path, int lineNo);
-  std::string expandText(
-      const std::string& text, const std::string& path, int lineNo,
-      std::unordered_map<std::string, bool>& expanding, int depth);
+  // Appends `line`, macro-expanded, to `out`.
+  void expandLine(std::string_view line, const std::string& path, int lineNo, std::string& out);
+  // Expands `stack` (next token at the back) into `out`.
+  void expandTokens(TokenList& stack, TokenList& out, const std::string& path, int lineNo);
+  bool collectArgs(
+      TokenList& stack, const Macro& macro, std::vector<TokenList>& args,
+      const HideSet*& rparenHide);
+  void substitute(
+      const Macro& macro, const std::vector<TokenList>& args, const std::string& path,
+      int lineNo, TokenList& out);
+  bool expandBuiltin(PPToken& tok, const std::string& path, int lineNo);
+  static bool macroCacheKey(
+      const PPToken& tok, const std::vector<TokenList>& args, const HideSet* rparenHide,
+      std::string& key);
+  void storeExpansion(const std::string& key, const TokenList& tokens, std::vector<std::string> deps);
+  void invalidateExpansions(const std::string& name);
+  void pasteTokens(TokenList& out, const PPToken& rhs);
+  PPToken stringizeTokens(const TokenList& tokens);
+  static void lexTokens(std::string_view text, TokenList& out, std::string_view* comment);
+  static void lexMacroBody(Macro& macro);
+
+  static bool hideSetContains(const HideSet* hs, const Macro* macro);
+  const HideSet* hideSetWith(const HideSet* hs, const Macro* macro);
+  const HideSet* hideSetUnion(const HideSet* a, const HideSet* b);
+  const HideSet* hideSetIntersect(const HideSet* a, const HideSet* b);
 
   bool report(const std::string& path, int line, int col, const std::string& msg);
-  bool readFile(const std::string& path, std::string& out);
+  FileManager& files();
+  FileManager::SearchListId searchList();
   std::string dirName(const std::string& path);
-  bool resolveInclude(
-      const std::string& header,
-      bool isSystem,
-      const std::string& currentPath,
-      std::string& resolvedPath,
-      std::string& content);
+  bool includeIsRedundant(const std::string& key) const;
 };
 
 } // namespace c99cc
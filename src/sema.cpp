@@ -6,28 +6,30 @@
 #include <unordered_set>
 #include <vector>
 
+#include "timing.h"
+
 namespace c99cc {
 
 namespace {
 
-using Scope = std::unordered_map<std::string, Type>;
+using Scope = std::unordered_map<Symbol, const Type*>;
 using ScopeStack = std::vector<Scope>;
-using EnumConstTable = std::unordered_map<std::string, int64_t>;
-using EnumTypeTable = std::unordered_set<std::string>;
+using EnumConstTable = std::unordered_map<Symbol, int64_t>;
+using EnumTypeTable = std::unordered_set<Symbol>;
 
-static std::optional<Type> lookupVarType(const ScopeStack& scopes, const std::string& name) {
+static const Type* lookupVarType(const ScopeStack& scopes, Symbol name) {
   for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
     auto found = it->find(name);
     if (found != it->end()) return found->second;
   }
-  return std::nullopt;
+  return nullptr;
 }
 
 // ---- function table ----
 
 struct FnInfo {
-  std::vector<Type> paramTypes;
-  Type returnType;
+  std::vector<const Type*> paramTypes;
+  const Type* returnType = nullptr;
   bool isVariadic = false;
   bool hasDecl = false;
   bool hasDef = false;
@@ -35,16 +37,18 @@ struct FnInfo {
   SourceLocation firstLoc{};
 };
 
-using FnTable = std::unordered_map<std::string, FnInfo>;
+using FnTable = std::unordered_map<Symbol, FnInfo>;
 
 struct StructInfo {
   std::vector<StructField> fields;
+  // fields[i].type, interned
+  std::vector<const Type*> fieldTypes;
   SourceLocation nameLoc{};
 };
 
-using StructTable = std::unordered_map<std::string, StructInfo>;
+using StructTable = std::unordered_map<Symbol, StructInfo>;
 
-static const StructInfo* lookupStruct(const StructTable& structs, const std::string& name) {
+static const StructInfo* lookupStruct(const StructTable& structs, Symbol name) {
   auto it = structs.find(name);
   if (it == structs.end()) return nullptr;
   return &it->second;
@@ -52,31 +56,31 @@ static const StructInfo* lookupStruct(const StructTable& structs, const std::str
 
 static Type adjustParamType(const Type& t);
 
-static bool sameSignature(const FnInfo& info, const FunctionProto& proto) {
+static bool sameSignature(TypeContext& types, const FnInfo& info, const FunctionProto& proto) {
   if (info.paramTypes.size() != proto.params.size()) return false;
-  if (info.returnType != proto.returnType) return false;
+  if (info.returnType != types.get(proto.returnType)) return false;
   if (info.isVariadic != proto.isVariadic) return false;
   for (size_t i = 0; i < proto.params.size(); ++i) {
-    if (info.paramTypes[i] != adjustParamType(proto.params[i].type)) return false;
+    if (info.paramTypes[i] != types.get(adjustParamType(proto.params[i].type))) return false;
   }
   return true;
 }
 
 static bool isNullPointerConstant(const Expr& e) {
-  if (auto* lit = dynamic_cast<const IntLiteralExpr*>(&e)) return lit->value == 0;
+  if (auto* lit = dyn_cast<IntLiteralExpr>(&e)) return lit->value == 0;
   return false;
 }
 
 static Type functionPointerTypeFromFnInfo(const FnInfo& info) {
-  Type t = info.returnType;
+  Type t = *info.returnType;
   t.ptrDepth = 0;
   t.ptrConst.clear();
   t.addPointerLevel(false);
   t.arrayDims.clear();
   t.ptrOutsideArrays = false;
   auto fnTy = std::make_shared<FunctionType>();
-  fnTy->returnType = info.returnType;
-  fnTy->params = info.paramTypes;
+  fnTy->returnType = *info.returnType;
+  for (const Type* p : info.paramTypes) fnTy->params.push_back(*p);
   fnTy->isVariadic = info.isVariadic;
   t.func = std::move(fnTy);
   return t;
@@ -84,19 +88,19 @@ static Type functionPointerTypeFromFnInfo(const FnInfo& info) {
 
 // ---- expr/stmt checking ----
 
-static std::optional<Type> checkExprImpl(
-    Diagnostics& diags, ScopeStack& scopes, const FnTable& fns, const StructTable& structs,
-    const EnumConstTable& enums, Expr& e);
+static const Type* checkExprImpl(
+    Diagnostics& diags, TypeContext& types, ScopeStack& scopes, const FnTable& fns,
+    const StructTable& structs, const EnumConstTable& enums, Expr& e);
 
 static bool isScalarType(const Type& t) {
   return t.isNumeric() || t.isPointer();
 }
 
 static const StringLiteralExpr* asStringLiteral(const Expr& e) {
-  return dynamic_cast<const StringLiteralExpr*>(&e);
+  return dyn_cast<StringLiteralExpr>(&e);
 }
 
-static bool isAssignable(const Type& dst, const Type& src, const Expr& srcExpr);
+static bool isAssignable(const Type* dst, const Type* src, const Expr& srcExpr);
 
 static Type promoteInteger(const Type& t) {
   Type res = t;
@@ -220,7 +224,7 @@ static bool fillArraySizeFromString(DeclItem& item, Diagnostics& diags) {
     diags.error(item.nameLoc, "invalid array size");
     return false;
   }
-  auto* str = dynamic_cast<StringLiteralExpr*>(item.initExpr.get());
+  auto* str = dyn_cast<StringLiteralExpr>(item.initExpr.get());
   if (!str) return true;
   Type elem = item.type.elementType();
   if (elem.base != Type::Base::Char || elem.ptrDepth != 0 || !elem.arrayDims.empty()) {
@@ -238,14 +242,14 @@ static bool fillArraySizeFromInitList(DeclItem& item, Diagnostics& diags) {
     diags.error(item.nameLoc, "invalid array size");
     return false;
   }
-  if (dynamic_cast<StringLiteralExpr*>(item.initExpr.get())) return true;
-  auto* list = dynamic_cast<InitListExpr*>(item.initExpr.get());
+  if (isa<StringLiteralExpr>(item.initExpr.get())) return true;
+  auto* list = dyn_cast<InitListExpr>(item.initExpr.get());
   if (!list) {
     diags.error(item.nameLoc, "invalid array size");
     return false;
   }
   if (list->elems.size() == 1 && list->elems[0].designators.empty()) {
-    if (auto* str = dynamic_cast<StringLiteralExpr*>(list->elems[0].expr.get())) {
+    if (auto* str = dyn_cast<StringLiteralExpr>(list->elems[0].expr.get())) {
       item.type.arrayDims[0] = str->value.size() + 1;
       return true;
     }
@@ -281,36 +285,38 @@ static bool requiresEnumDef(const Type& t) {
 
 static bool checkInitializer(
     Diagnostics& diags,
+    TypeContext& types,
     ScopeStack& scopes,
     const FnTable& fns,
     const StructTable& structs,
     const EnumConstTable& enums,
-    const Type& target,
+    const Type* target,
     Expr& init,
     bool allowArrayInit);
 
 static bool checkInitList(
     Diagnostics& diags,
+    TypeContext& types,
     ScopeStack& scopes,
     const FnTable& fns,
     const StructTable& structs,
     const EnumConstTable& enums,
-    const Type& target,
+    const Type* target,
     InitListExpr& list,
     bool allowArrayInit) {
-  if (target.isArray() && !target.ptrOutsideArrays) {
+  if (target->isArray() && !target->ptrOutsideArrays) {
     if (!allowArrayInit) {
       diags.error(list.loc, "array initializer not supported");
       return false;
     }
-    if (target.arrayDims.empty() || !target.arrayDims[0].has_value()) {
+    if (target->arrayDims.empty() || !target->arrayDims[0].has_value()) {
       diags.error(list.loc, "invalid array initializer");
       return false;
     }
-    size_t size = *target.arrayDims[0];
-    Type elemTy = target.elementType();
-    if (elemTy.base == Type::Base::Char && elemTy.ptrDepth == 0 &&
-        elemTy.arrayDims.empty() && list.elems.size() == 1 &&
+    size_t size = *target->arrayDims[0];
+    const Type* elemTy = types.elementType(target);
+    if (elemTy->base == Type::Base::Char && elemTy->ptrDepth == 0 &&
+        elemTy->arrayDims.empty() && list.elems.size() == 1 &&
         list.elems[0].designators.empty()) {
       if (auto* str = asStringLiteral(*list.elems[0].expr)) {
         size_t need = str->value.size() + 1;
@@ -324,7 +330,7 @@ static bool checkInitList(
     size_t nextIndex = 0;
     for (const auto& elem : list.elems) {
       size_t idx = nextIndex;
-      Type targetTy = elemTy;
+      const Type* targetTy = elemTy;
       if (!elem.designators.empty()) {
         const auto& first = elem.designators[0];
         if (first.kind != Designator::Kind::Index) {
@@ -336,41 +342,41 @@ static bool checkInitList(
         targetTy = target;
         for (const auto& d : elem.designators) {
           if (d.kind == Designator::Kind::Index) {
-            if (!targetTy.isArray() || targetTy.ptrOutsideArrays) {
+            if (!targetTy->isArray() || targetTy->ptrOutsideArrays) {
               diags.error(d.loc, "invalid array designator");
               return false;
             }
-            if (targetTy.arrayDims.empty() || !targetTy.arrayDims[0].has_value()) {
+            if (targetTy->arrayDims.empty() || !targetTy->arrayDims[0].has_value()) {
               diags.error(d.loc, "invalid array initializer");
               return false;
             }
-            size_t arrSize = *targetTy.arrayDims[0];
+            size_t arrSize = *targetTy->arrayDims[0];
             if (d.index >= arrSize) {
               diags.error(d.loc, "array designator out of range");
               return false;
             }
-            targetTy = targetTy.elementType();
+            targetTy = types.elementType(targetTy);
           } else {
-            if (targetTy.base != Type::Base::Struct || targetTy.ptrDepth != 0) {
+            if (targetTy->base != Type::Base::Struct || targetTy->ptrDepth != 0) {
               diags.error(d.loc, "invalid struct designator");
               return false;
             }
-            const StructInfo* info = lookupStruct(structs, targetTy.structName);
+            const StructInfo* info = lookupStruct(structs, targetTy->structName);
             if (!info) {
-              diags.error(d.loc, "unknown struct type '" + targetTy.structName + "'");
+              diags.error(d.loc, "unknown struct type '" + targetTy->structName + "'");
               return false;
             }
             bool found = false;
-            for (const auto& field : info->fields) {
-              if (field.name == d.field) {
-                targetTy = field.type;
+            for (size_t fi = 0; fi < info->fields.size(); ++fi) {
+              if (info->fields[fi].name == d.field) {
+                targetTy = info->fieldTypes[fi];
                 found = true;
                 break;
               }
             }
             if (!found) {
-              diags.error(d.loc,
-                          "unknown field '" + d.field + "' in struct '" + targetTy.structName + "'");
+              diags.error(d.loc, "unknown field '" + d.field + "' in struct '" +
+                                     targetTy->structName + "'");
               return false;
             }
           }
@@ -382,23 +388,24 @@ static bool checkInitList(
         diags.error(list.loc, "excess elements in array initializer");
         return false;
       }
-      if (!checkInitializer(diags, scopes, fns, structs, enums, targetTy, *elem.expr, true)) {
+      if (!checkInitializer(diags, types, scopes, fns, structs, enums,
+                            targetTy, *elem.expr, true)) {
         return false;
       }
     }
     return true;
   }
 
-  if (target.base == Type::Base::Struct && target.ptrDepth == 0) {
-    const StructInfo* info = lookupStruct(structs, target.structName);
+  if (target->base == Type::Base::Struct && target->ptrDepth == 0) {
+    const StructInfo* info = lookupStruct(structs, target->structName);
     if (!info) {
-      diags.error(list.loc, "unknown struct type '" + target.structName + "'");
+      diags.error(list.loc, "unknown struct type '" + target->structName + "'");
       return false;
     }
     size_t nextField = 0;
     for (const auto& elem : list.elems) {
       size_t idx = nextField;
-      Type targetTy;
+      const Type* targetTy = nullptr;
       if (!elem.designators.empty()) {
         const auto& first = elem.designators[0];
         if (first.kind != Designator::Kind::Field) {
@@ -415,50 +422,50 @@ static bool checkInitList(
         }
         if (!found) {
           diags.error(first.loc,
-                      "unknown field '" + first.field + "' in struct '" + target.structName + "'");
+                      "unknown field '" + first.field + "' in struct '" + target->structName + "'");
           return false;
         }
         nextField = idx + 1;
         targetTy = target;
         for (const auto& d : elem.designators) {
           if (d.kind == Designator::Kind::Field) {
-            if (targetTy.base != Type::Base::Struct || targetTy.ptrDepth != 0) {
+            if (targetTy->base != Type::Base::Struct || targetTy->ptrDepth != 0) {
               diags.error(d.loc, "invalid struct designator");
               return false;
             }
-            const StructInfo* curInfo = lookupStruct(structs, targetTy.structName);
+            const StructInfo* curInfo = lookupStruct(structs, targetTy->structName);
             if (!curInfo) {
-              diags.error(d.loc, "unknown struct type '" + targetTy.structName + "'");
+              diags.error(d.loc, "unknown struct type '" + targetTy->structName + "'");
               return false;
             }
             bool fieldFound = false;
-            for (const auto& field : curInfo->fields) {
-              if (field.name == d.field) {
-                targetTy = field.type;
+            for (size_t fi = 0; fi < curInfo->fields.size(); ++fi) {
+              if (curInfo->fields[fi].name == d.field) {
+                targetTy = curInfo->fieldTypes[fi];
                 fieldFound = true;
                 break;
               }
             }
             if (!fieldFound) {
-              diags.error(d.loc,
-                          "unknown field '" + d.field + "' in struct '" + targetTy.structName + "'");
+              diags.error(d.loc, "unknown field '" + d.field + "' in struct '" +
+                                     targetTy->structName + "'");
               return false;
             }
           } else {
-            if (!targetTy.isArray() || targetTy.ptrOutsideArrays) {
+            if (!targetTy->isArray() || targetTy->ptrOutsideArrays) {
               diags.error(d.loc, "invalid array designator");
               return false;
             }
-            if (targetTy.arrayDims.empty() || !targetTy.arrayDims[0].has_value()) {
+            if (targetTy->arrayDims.empty() || !targetTy->arrayDims[0].has_value()) {
               diags.error(d.loc, "invalid array initializer");
               return false;
             }
-            size_t arrSize = *targetTy.arrayDims[0];
+            size_t arrSize = *targetTy->arrayDims[0];
             if (d.index >= arrSize) {
               diags.error(d.loc, "array designator out of range");
               return false;
             }
-            targetTy = targetTy.elementType();
+            targetTy = types.elementType(targetTy);
           }
         }
       } else {
@@ -467,13 +474,14 @@ static bool checkInitList(
           diags.error(list.loc, "excess elements in struct initializer");
           return false;
         }
-        targetTy = info->fields[idx].type;
+        targetTy = info->fieldTypes[idx];
       }
       if (idx >= info->fields.size()) {
         diags.error(list.loc, "excess elements in struct initializer");
         return false;
       }
-      if (!checkInitializer(diags, scopes, fns, structs, enums, targetTy, *elem.expr, true)) {
+      if (!checkInitializer(diags, types, scopes, fns, structs, enums,
+                            targetTy, *elem.expr, true)) {
         return false;
       }
     }
@@ -485,33 +493,35 @@ static bool checkInitList(
     diags.error(list.loc, "invalid initializer");
     return false;
   }
-  return checkInitializer(diags, scopes, fns, structs, enums,
+  return checkInitializer(diags, types, scopes, fns, structs, enums,
                           target, *list.elems[0].expr, allowArrayInit);
 }
 
 static bool checkInitializer(
     Diagnostics& diags,
+    TypeContext& types,
     ScopeStack& scopes,
     const FnTable& fns,
     const StructTable& structs,
     const EnumConstTable& enums,
-    const Type& target,
+    const Type* target,
     Expr& init,
     bool allowArrayInit) {
-  if (auto* list = dynamic_cast<InitListExpr*>(&init)) {
-    return checkInitList(diags, scopes, fns, structs, enums, target, *list, allowArrayInit);
+  if (auto* list = dyn_cast<InitListExpr>(&init)) {
+    return checkInitList(diags, types, scopes, fns, structs, enums,
+                         target, *list, allowArrayInit);
   }
 
-  if (target.isArray() && !target.ptrOutsideArrays) {
+  if (target->isArray() && !target->ptrOutsideArrays) {
     if (auto* str = asStringLiteral(init)) {
-      Type elem = target.elementType();
-      if (elem.base != Type::Base::Char || elem.ptrDepth != 0 || !elem.arrayDims.empty()) {
+      const Type* elem = types.elementType(target);
+      if (elem->base != Type::Base::Char || elem->ptrDepth != 0 || !elem->arrayDims.empty()) {
         diags.error(init.loc, "invalid string initializer");
         return false;
       }
-      if (!target.arrayDims.empty() && target.arrayDims[0].has_value()) {
+      if (!target->arrayDims.empty() && target->arrayDims[0].has_value()) {
         size_t need = str->value.size() + 1;
-        if (*target.arrayDims[0] < need) {
+        if (*target->arrayDims[0] < need) {
           diags.error(init.loc, "string initializer too long");
           return false;
         }
@@ -526,260 +536,264 @@ static bool checkInitializer(
     return false;
   }
 
-  auto initTy = checkExprImpl(diags, scopes, fns, structs, enums, init);
-  if (initTy && !isAssignable(target, *initTy, init)) {
+  auto initTy = checkExprImpl(diags, types, scopes, fns, structs, enums, init);
+  if (initTy && !isAssignable(target, initTy, init)) {
     diags.error(init.loc, "incompatible initializer");
     return false;
   }
   return true;
 }
 
-static std::optional<Type> resolveMemberType(
+static const Type* resolveMemberType(
     Diagnostics& diags,
     const StructTable& structs,
     const Type& baseTy,
-    const std::string& member,
+    Symbol member,
     SourceLocation memberLoc,
     bool isArrow) {
-  Type structTy = baseTy;
+  // the pointee of a struct pointer names the same struct
+  Symbol structName = baseTy.structName;
   if (isArrow) {
     if (!baseTy.isPointer() || baseTy.ptrDepth != 1 || baseTy.base != Type::Base::Struct) {
       diags.error(memberLoc, "member access requires pointer to struct");
-      return std::nullopt;
+      return nullptr;
     }
-    structTy = baseTy.pointee();
   } else {
     if (baseTy.base != Type::Base::Struct || baseTy.ptrDepth != 0) {
       diags.error(memberLoc, "member access requires struct");
-      return std::nullopt;
+      return nullptr;
     }
   }
 
-  const StructInfo* info = lookupStruct(structs, structTy.structName);
+  const StructInfo* info = lookupStruct(structs, structName);
   if (!info) {
-    diags.error(memberLoc, "unknown struct type '" + structTy.structName + "'");
-    return std::nullopt;
+    diags.error(memberLoc, "unknown struct type '" + structName + "'");
+    return nullptr;
   }
 
-  for (const auto& field : info->fields) {
-    if (field.name == member) return field.type;
+  for (size_t i = 0; i < info->fields.size(); ++i) {
+    if (info->fields[i].name == member) return info->fieldTypes[i];
   }
 
   diags.error(memberLoc,
-              "unknown field '" + member + "' in struct '" + structTy.structName + "'");
-  return std::nullopt;
+              "unknown field '" + member + "' in struct '" + structName + "'");
+  return nullptr;
 }
 
 static void checkStmtImpl(
     Diagnostics& diags,
+    TypeContext& types,
     ScopeStack& scopes,
     const FnTable& fns,
     const StructTable& structs,
     const EnumConstTable& enums,
     const EnumTypeTable& enumTypes,
-    const Type& returnType,
+    const Type* returnType,
     int loopDepth,
     int switchDepth,
     Stmt& s) {
-  if (auto* blk = dynamic_cast<BlockStmt*>(&s)) {
-    scopes.push_back({});
-    for (const auto& st : blk->stmts) {
-      checkStmtImpl(diags, scopes, fns, structs, enums, enumTypes,
-                    returnType, loopDepth, switchDepth, *st);
+  switch (s.kind) {
+    case NodeKind::BlockStmt: {
+      auto* blk = cast<BlockStmt>(&s);
+      scopes.push_back({});
+      for (const auto& st : blk->stmts) {
+        checkStmtImpl(diags, types, scopes, fns, structs, enums, enumTypes,
+                      returnType, loopDepth, switchDepth, *st);
+      }
+      scopes.pop_back();
+      return;
     }
-    scopes.pop_back();
-    return;
-  }
-
-  if (auto* iff = dynamic_cast<IfStmt*>(&s)) {
-    checkExprImpl(diags, scopes, fns, structs, enums, *iff->cond);
-    checkStmtImpl(diags, scopes, fns, structs, enums, enumTypes,
-                  returnType, loopDepth, switchDepth, *iff->thenBranch);
-    if (iff->elseBranch) {
-      checkStmtImpl(diags, scopes, fns, structs, enums, enumTypes,
-                    returnType, loopDepth, switchDepth, *iff->elseBranch);
+    case NodeKind::IfStmt: {
+      auto* iff = cast<IfStmt>(&s);
+      checkExprImpl(diags, types, scopes, fns, structs, enums, *iff->cond);
+      checkStmtImpl(diags, types, scopes, fns, structs, enums, enumTypes,
+                    returnType, loopDepth, switchDepth, *iff->thenBranch);
+      if (iff->elseBranch) {
+        checkStmtImpl(diags, types, scopes, fns, structs, enums, enumTypes,
+                      returnType, loopDepth, switchDepth, *iff->elseBranch);
+      }
+      return;
     }
-    return;
-  }
-
-  if (auto* wh = dynamic_cast<WhileStmt*>(&s)) {
-    checkExprImpl(diags, scopes, fns, structs, enums, *wh->cond);
-    checkStmtImpl(diags, scopes, fns, structs, enums, enumTypes,
-                  returnType, loopDepth + 1, switchDepth, *wh->body);
-    return;
-  }
-
-  if (auto* dw = dynamic_cast<DoWhileStmt*>(&s)) {
-    checkStmtImpl(diags, scopes, fns, structs, enums, enumTypes,
-                  returnType, loopDepth + 1, switchDepth, *dw->body);
-    checkExprImpl(diags, scopes, fns, structs, enums, *dw->cond);
-    return;
-  }
-
-  if (auto* fo = dynamic_cast<ForStmt*>(&s)) {
-    // for introduces its own scope (matches your existing tests)
-    scopes.push_back({});
-    if (fo->init) checkStmtImpl(diags, scopes, fns, structs, enums, enumTypes,
-                                returnType, loopDepth, switchDepth, *fo->init);
-    if (fo->cond) checkExprImpl(diags, scopes, fns, structs, enums, *fo->cond);
-    if (fo->inc)  checkExprImpl(diags, scopes, fns, structs, enums, *fo->inc);
-    checkStmtImpl(diags, scopes, fns, structs, enums, enumTypes,
-                  returnType, loopDepth + 1, switchDepth, *fo->body);
-    scopes.pop_back();
-    return;
-  }
-
-  if (auto* br = dynamic_cast<BreakStmt*>(&s)) {
-    if (loopDepth <= 0 && switchDepth <= 0) diags.error(br->loc, "break statement not within loop");
-    return;
-  }
-
-  if (auto* co = dynamic_cast<ContinueStmt*>(&s)) {
-    if (loopDepth <= 0) diags.error(co->loc, "continue statement not within loop");
-    return;
-  }
-
-  if (auto* sw = dynamic_cast<SwitchStmt*>(&s)) {
-    auto condTy = checkExprImpl(diags, scopes, fns, structs, enums, *sw->cond);
-    if (condTy && !condTy->isInteger()) {
-      diags.error(sw->cond->loc, "switch condition must be int");
+    case NodeKind::WhileStmt: {
+      auto* wh = cast<WhileStmt>(&s);
+      checkExprImpl(diags, types, scopes, fns, structs, enums, *wh->cond);
+      checkStmtImpl(diags, types, scopes, fns, structs, enums, enumTypes,
+                    returnType, loopDepth + 1, switchDepth, *wh->body);
+      return;
     }
-    scopes.push_back({});
-    std::unordered_set<int64_t> seenCases;
-    bool seenDefault = false;
-    for (const auto& c : sw->cases) {
-      if (c.value.has_value()) {
-        int64_t v = *c.value;
-        if (seenCases.count(v)) {
-          diags.error(c.loc, "duplicate case value '" + std::to_string(v) + "'");
-          scopes.pop_back();
-          return;
+    case NodeKind::DoWhileStmt: {
+      auto* dw = cast<DoWhileStmt>(&s);
+      checkStmtImpl(diags, types, scopes, fns, structs, enums, enumTypes,
+                    returnType, loopDepth + 1, switchDepth, *dw->body);
+      checkExprImpl(diags, types, scopes, fns, structs, enums, *dw->cond);
+      return;
+    }
+    case NodeKind::ForStmt: {
+      auto* fo = cast<ForStmt>(&s);
+      // for introduces its own scope (matches your existing tests)
+      scopes.push_back({});
+      if (fo->init) checkStmtImpl(diags, types, scopes, fns, structs, enums, enumTypes,
+                                  returnType, loopDepth, switchDepth, *fo->init);
+      if (fo->cond) checkExprImpl(diags, types, scopes, fns, structs, enums, *fo->cond);
+      if (fo->inc)  checkExprImpl(diags, types, scopes, fns, structs, enums, *fo->inc);
+      checkStmtImpl(diags, types, scopes, fns, structs, enums, enumTypes,
+                    returnType, loopDepth + 1, switchDepth, *fo->body);
+      scopes.pop_back();
+      return;
+    }
+    case NodeKind::BreakStmt: {
+      auto* br = cast<BreakStmt>(&s);
+      if (loopDepth <= 0 && switchDepth <= 0) diags.error(br->loc, "break statement not within loop");
+      return;
+    }
+    case NodeKind::ContinueStmt: {
+      auto* co = cast<ContinueStmt>(&s);
+      if (loopDepth <= 0) diags.error(co->loc, "continue statement not within loop");
+      return;
+    }
+    case NodeKind::SwitchStmt: {
+      auto* sw = cast<SwitchStmt>(&s);
+      auto condTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *sw->cond);
+      if (condTy && !condTy->isInteger()) {
+        diags.error(sw->cond->loc, "switch condition must be int");
+      }
+      scopes.push_back({});
+      std::unordered_set<int64_t> seenCases;
+      bool seenDefault = false;
+      for (const auto& c : sw->cases) {
+        if (c.value.has_value()) {
+          int64_t v = *c.value;
+          if (seenCases.count(v)) {
+            diags.error(c.loc, "duplicate case value '" + std::to_string(v) + "'");
+            scopes.pop_back();
+            return;
+          }
+          seenCases.insert(v);
+        } else {
+          if (seenDefault) {
+            diags.error(c.loc, "duplicate default label");
+            scopes.pop_back();
+            return;
+          }
+          seenDefault = true;
         }
-        seenCases.insert(v);
-      } else {
-        if (seenDefault) {
-          diags.error(c.loc, "duplicate default label");
-          scopes.pop_back();
-          return;
+        for (const auto& st : c.stmts) {
+          checkStmtImpl(diags, types, scopes, fns, structs, enums, enumTypes,
+                        returnType, loopDepth, switchDepth + 1, *st);
         }
-        seenDefault = true;
-      }
-      for (const auto& st : c.stmts) {
-        checkStmtImpl(diags, scopes, fns, structs, enums, enumTypes,
-                      returnType, loopDepth, switchDepth + 1, *st);
       }
+      scopes.pop_back();
+      return;
     }
-    scopes.pop_back();
-    return;
-  }
-
-  if (auto* decl = dynamic_cast<DeclStmt*>(&s)) {
-    auto& cur = scopes.back();
-    for (auto& item : decl->items) {
-      if (cur.count(item.name)) {
-        if (item.storage == StorageClass::Extern) {
-          if (cur[item.name] != item.type) {
-            diags.error(item.nameLoc, "conflicting types for '" + item.name + "'");
+    case NodeKind::DeclStmt: {
+      auto* decl = cast<DeclStmt>(&s);
+      auto& cur = scopes.back();
+      for (auto& item : decl->items) {
+        if (cur.count(item.name)) {
+          if (item.storage == StorageClass::Extern) {
+            if (cur[item.name] != types.get(item.type)) {
+              diags.error(item.nameLoc, "conflicting types for '" + item.name + "'");
+              return;
+            }
+          } else {
+            diags.error(item.nameLoc, "redefinition of '" + item.name + "'");
             return;
           }
-        } else {
-          diags.error(item.nameLoc, "redefinition of '" + item.name + "'");
+        }
+        if (item.storage == StorageClass::Extern && item.initExpr) {
+          diags.error(item.nameLoc, "extern declaration cannot have initializer");
           return;
         }
-      }
-      if (item.storage == StorageClass::Extern && item.initExpr) {
-        diags.error(item.nameLoc, "extern declaration cannot have initializer");
-        return;
-      }
-      if (!isValidUnsignedUse(item.type)) {
-        diags.error(item.nameLoc, "invalid use of unsigned type");
-        return;
-      }
-      if (isArrayElementVoid(item.type)) {
-        diags.error(item.nameLoc, "invalid array element type");
-        return;
-      }
-      if (item.type.isVoidObject()) {
-        diags.error(item.nameLoc, "invalid use of void type");
-        return;
-      }
-      if (!fillArraySizeFromString(item, diags)) {
-        return;
-      }
-      if (!fillArraySizeFromInitList(item, diags)) {
-        return;
-      }
-      bool allowFirstEmpty = item.storage == StorageClass::Extern && !item.initExpr;
-      if (hasInvalidArraySize(item.type, /*allowFirstEmpty=*/allowFirstEmpty)) {
-        diags.error(item.nameLoc, "invalid array size");
-        return;
-      }
-      if (requiresStructDef(item.type)) {
-        if (!lookupStruct(structs, item.type.structName)) {
-          diags.error(item.nameLoc, "unknown struct type '" + item.type.structName + "'");
+        if (!isValidUnsignedUse(item.type)) {
+          diags.error(item.nameLoc, "invalid use of unsigned type");
           return;
         }
-      }
-      if (requiresEnumDef(item.type)) {
-        if (!enumTypes.count(item.type.enumName)) {
-          diags.error(item.nameLoc, "unknown enum type '" + item.type.enumName + "'");
+        if (isArrayElementVoid(item.type)) {
+          diags.error(item.nameLoc, "invalid array element type");
           return;
         }
-      }
-
-      // initializer cannot reference the variable being declared:
-      // keep behavior by checking before insertion.
-      if (item.initExpr) {
-        bool allowArrayInit = item.type.isArray() && !item.type.ptrOutsideArrays;
-        if (!checkInitializer(diags, scopes, fns, structs, enums,
-                              item.type, *item.initExpr, allowArrayInit)) {
+        if (item.type.isVoidObject()) {
+          diags.error(item.nameLoc, "invalid use of void type");
           return;
         }
-      }
+        if (!fillArraySizeFromString(item, diags)) {
+          return;
+        }
+        if (!fillArraySizeFromInitList(item, diags)) {
+          return;
+        }
+        bool allowFirstEmpty = item.storage == StorageClass::Extern && !item.initExpr;
+        if (hasInvalidArraySize(item.type, /*allowFirstEmpty=*/allowFirstEmpty)) {
+          diags.error(item.nameLoc, "invalid array size");
+          return;
+        }
+        if (requiresStructDef(item.type)) {
+          if (!lookupStruct(structs, item.type.structName)) {
+            diags.error(item.nameLoc, "unknown struct type '" + item.type.structName + "'");
+            return;
+          }
+        }
+        if (requiresEnumDef(item.type)) {
+          if (!enumTypes.count(item.type.enumName)) {
+            diags.error(item.nameLoc, "unknown enum type '" + item.type.enumName + "'");
+            return;
+          }
+        }
 
-      cur.emplace(item.name, item.type);
-    }
-    return;
-  }
+        // initializer cannot reference the variable being declared:
+        // keep behavior by checking before insertion.
+        const Type* itemTy = types.get(item.type);
+        if (item.initExpr) {
+          bool allowArrayInit = item.type.isArray() && !item.type.ptrOutsideArrays;
+          if (!checkInitializer(diags, types, scopes, fns, structs, enums,
+                                itemTy, *item.initExpr, allowArrayInit)) {
+            return;
+          }
+        }
 
-  if (auto* as = dynamic_cast<AssignStmt*>(&s)) {
-    // legacy stmt (if still exists somewhere)
-    checkExprImpl(diags, scopes, fns, structs, enums, *as->valueExpr);
-    if (!lookupVarType(scopes, as->name).has_value()) {
-      diags.error(as->nameLoc, "assignment to undeclared identifier '" + as->name + "'");
+        cur.emplace(item.name, itemTy);
+      }
+      return;
     }
-    return;
-  }
-
-  if (auto* ret = dynamic_cast<ReturnStmt*>(&s)) {
-    if (!ret->valueExpr) {
-      if (!returnType.isVoidObject()) {
-        diags.error(ret->loc, "missing return value");
+    case NodeKind::AssignStmt: {
+      auto* as = cast<AssignStmt>(&s);
+      // legacy stmt (if still exists somewhere)
+      checkExprImpl(diags, types, scopes, fns, structs, enums, *as->valueExpr);
+      if (!lookupVarType(scopes, as->name)) {
+        diags.error(as->nameLoc, "assignment to undeclared identifier '" + as->name + "'");
       }
       return;
     }
-    auto retTy = checkExprImpl(diags, scopes, fns, structs, enums, *ret->valueExpr);
-    if (retTy && !isAssignable(returnType, *retTy, *ret->valueExpr)) {
-      diags.error(ret->loc, "incompatible return type");
+    case NodeKind::ReturnStmt: {
+      auto* ret = cast<ReturnStmt>(&s);
+      if (!ret->valueExpr) {
+        if (!returnType->isVoidObject()) {
+          diags.error(ret->loc, "missing return value");
+        }
+        return;
+      }
+      auto retTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *ret->valueExpr);
+      if (retTy && !isAssignable(returnType, retTy, *ret->valueExpr)) {
+        diags.error(ret->loc, "incompatible return type");
+      }
+      return;
     }
-    return;
-  }
-
-  if (auto* es = dynamic_cast<ExprStmt*>(&s)) {
-    checkExprImpl(diags, scopes, fns, structs, enums, *es->expr);
-    return;
-  }
-
-  if (auto* td = dynamic_cast<TypedefStmt*>(&s)) {
-    (void)td;
-    return;
+    case NodeKind::ExprStmt: {
+      auto* es = cast<ExprStmt>(&s);
+      checkExprImpl(diags, types, scopes, fns, structs, enums, *es->expr);
+      return;
+    }
+    case NodeKind::TypedefStmt:
+    case NodeKind::EmptyStmt:
+      return;
+    default:
+      break;
   }
-
-  if (dynamic_cast<EmptyStmt*>(&s)) return;
 }
 
-static std::optional<Type> checkLValue(
+static const Type* checkLValue(
     Diagnostics& diags,
+    TypeContext& types,
     ScopeStack& scopes,
     const FnTable& fns,
     const StructTable& structs,
@@ -787,657 +801,682 @@ static std::optional<Type> checkLValue(
     Expr& e,
     const char* errMsg,
     bool isAssign) {
-  if (auto* vr = dynamic_cast<VarRefExpr*>(&e)) {
-    auto ty = lookupVarType(scopes, vr->name);
-    if (!ty) {
-      if (isAssign) {
-        diags.error(vr->loc, "assignment to undeclared identifier '" + vr->name + "'");
-      } else {
-        diags.error(vr->loc, "use of undeclared identifier '" + vr->name + "'");
+  switch (e.kind) {
+    case NodeKind::VarRefExpr: {
+      auto* vr = cast<VarRefExpr>(&e);
+      auto ty = lookupVarType(scopes, vr->name);
+      if (!ty) {
+        if (isAssign) {
+          diags.error(vr->loc, "assignment to undeclared identifier '" + vr->name + "'");
+        } else {
+          diags.error(vr->loc, "use of undeclared identifier '" + vr->name + "'");
+        }
+        return nullptr;
       }
-      return std::nullopt;
-    }
-    if (ty->isArray() && !ty->ptrOutsideArrays) {
-      if (isAssign) {
-        diags.error(vr->loc, "cannot assign to array");
-        return std::nullopt;
+      if (ty->isArray() && !ty->ptrOutsideArrays) {
+        if (isAssign) {
+          diags.error(vr->loc, "cannot assign to array");
+          return nullptr;
+        }
+        diags.error(vr->loc, "cannot take address of array");
+        return nullptr;
+      }
+      if (isAssign && ty->isTopLevelConst()) {
+        diags.error(vr->loc, "cannot assign to const object");
+        return nullptr;
+      }
+      e.semaType = ty;
+      return ty;
+    }
+    case NodeKind::UnaryExpr: {
+      auto* un = cast<UnaryExpr>(&e);
+      if (un->op == TokenKind::Star) {
+        auto opTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *un->operand);
+        if (!opTy) return nullptr;
+        if (!opTy->isPointer()) {
+          diags.error(un->loc, "cannot dereference non-pointer");
+          return nullptr;
+        }
+        const Type* t = types.pointee(opTy);
+        if (isAssign && t->isTopLevelConst()) {
+          diags.error(un->loc, "cannot assign to const object");
+          return nullptr;
+        }
+        e.semaType = t;
+        return t;
       }
-      diags.error(vr->loc, "cannot take address of array");
-      return std::nullopt;
-    }
-    if (isAssign && ty->isTopLevelConst()) {
-      diags.error(vr->loc, "cannot assign to const object");
-      return std::nullopt;
-    }
-    e.semaType = *ty;
-    return *ty;
-  }
-
-  if (auto* un = dynamic_cast<UnaryExpr*>(&e)) {
-    if (un->op == TokenKind::Star) {
-      auto opTy = checkExprImpl(diags, scopes, fns, structs, enums, *un->operand);
-      if (!opTy) return std::nullopt;
-      if (!opTy->isPointer()) {
-        diags.error(un->loc, "cannot dereference non-pointer");
-        return std::nullopt;
-      }
-      Type t = opTy->pointee();
-      if (isAssign && t.isTopLevelConst()) {
-        diags.error(un->loc, "cannot assign to const object");
-        return std::nullopt;
-      }
-      e.semaType = t;
-      return t;
-    }
-  }
-
-  if (auto* sub = dynamic_cast<SubscriptExpr*>(&e)) {
-    auto baseTy = checkExprImpl(diags, scopes, fns, structs, enums, *sub->base);
-    auto idxTy = checkExprImpl(diags, scopes, fns, structs, enums, *sub->index);
-    if (!baseTy || !idxTy) return std::nullopt;
-    if (baseTy->isArray() && !baseTy->ptrOutsideArrays) {
-      Type dt = baseTy->decayType();
-      baseTy = dt;
-    }
-    if (!idxTy->isInteger()) {
-      diags.error(sub->index->loc, "array subscript must be int");
-      return std::nullopt;
-    }
-    if (baseTy->isPointer() && baseTy->isVoidPointer()) {
-      diags.error(sub->base->loc, "cannot subscript void pointer");
-      return std::nullopt;
-    }
-    if (!baseTy->isPointer()) {
-      diags.error(sub->base->loc, "subscripted value is not pointer");
-      return std::nullopt;
-    }
-    Type elem = baseTy->pointee();
-    if (isAssign && elem.isTopLevelConst()) {
-      diags.error(sub->loc, "cannot assign to const object");
-      return std::nullopt;
-    }
-    e.semaType = elem;
-    return elem;
-  }
-
-  if (auto* mem = dynamic_cast<MemberExpr*>(&e)) {
-    auto baseTy = checkExprImpl(diags, scopes, fns, structs, enums, *mem->base);
-    if (!baseTy) return std::nullopt;
-    auto fieldTy = resolveMemberType(
-        diags, structs, *baseTy, mem->member, mem->memberLoc, mem->isArrow);
-    if (!fieldTy) return std::nullopt;
-    if (fieldTy->isArray() && !fieldTy->ptrOutsideArrays) {
-      if (isAssign) {
-        diags.error(mem->memberLoc, "cannot assign to array");
-      } else {
-        diags.error(mem->memberLoc, "cannot take address of array");
+      break;
+    }
+    case NodeKind::SubscriptExpr: {
+      auto* sub = cast<SubscriptExpr>(&e);
+      auto baseTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *sub->base);
+      auto idxTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *sub->index);
+      if (!baseTy || !idxTy) return nullptr;
+      if (baseTy->isArray() && !baseTy->ptrOutsideArrays) {
+        baseTy = types.decay(baseTy);
+      }
+      if (!idxTy->isInteger()) {
+        diags.error(sub->index->loc, "array subscript must be int");
+        return nullptr;
+      }
+      if (baseTy->isPointer() && baseTy->isVoidPointer()) {
+        diags.error(sub->base->loc, "cannot subscript void pointer");
+        return nullptr;
+      }
+      if (!baseTy->isPointer()) {
+        diags.error(sub->base->loc, "subscripted value is not pointer");
+        return nullptr;
+      }
+      const Type* elem = types.pointee(baseTy);
+      if (isAssign && elem->isTopLevelConst()) {
+        diags.error(sub->loc, "cannot assign to const object");
+        return nullptr;
+      }
+      e.semaType = elem;
+      return elem;
+    }
+    case NodeKind::MemberExpr: {
+      auto* mem = cast<MemberExpr>(&e);
+      auto baseTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *mem->base);
+      if (!baseTy) return nullptr;
+      auto fieldTy = resolveMemberType(
+          diags, structs, *baseTy, mem->member, mem->memberLoc, mem->isArrow);
+      if (!fieldTy) return nullptr;
+      if (fieldTy->isArray() && !fieldTy->ptrOutsideArrays) {
+        if (isAssign) {
+          diags.error(mem->memberLoc, "cannot assign to array");
+        } else {
+          diags.error(mem->memberLoc, "cannot take address of array");
+        }
+        return nullptr;
       }
-      return std::nullopt;
-    }
-    if (isAssign && fieldTy->isTopLevelConst()) {
-      diags.error(mem->memberLoc, "cannot assign to const object");
-      return std::nullopt;
+      if (isAssign && fieldTy->isTopLevelConst()) {
+        diags.error(mem->memberLoc, "cannot assign to const object");
+        return nullptr;
+      }
+      e.semaType = fieldTy;
+      return fieldTy;
     }
-    e.semaType = *fieldTy;
-    return *fieldTy;
+    default:
+      break;
   }
 
   diags.error(e.loc, errMsg);
-  return std::nullopt;
+  return nullptr;
 }
 
-static bool isAssignable(const Type& dst, const Type& src, const Expr& srcExpr) {
-  Type d = dst;
-  Type s = src;
+static bool isAssignable(const Type* dst, const Type* src, const Expr& srcExpr) {
+  if (dst == src) return true;
+  Type d = *dst;
+  Type s = *src;
   d.clearTopLevelConst();
   s.clearTopLevelConst();
   if (d == s) return true;
   if (d.isNumeric() && s.isNumeric()) return true;
-  if (dst.isPointer() && src.isInt() && isNullPointerConstant(srcExpr)) return true;
-  if (isPointerCompatibleForAssign(dst, src)) return true;
+  if (dst->isPointer() && src->isInt() && isNullPointerConstant(srcExpr)) return true;
+  if (isPointerCompatibleForAssign(*dst, *src)) return true;
   return false;
 }
 
-static std::optional<Type> checkExprImpl(
-    Diagnostics& diags, ScopeStack& scopes, const FnTable& fns, const StructTable& structs,
-    const EnumConstTable& enums, Expr& e) {
-  if (auto* lit = dynamic_cast<IntLiteralExpr*>(&e)) {
-    Type t;
-    if (lit->longKind == 1) {
-      t.base = Type::Base::Long;
-    } else if (lit->longKind == 2) {
-      t.base = Type::Base::LongLong;
-    }
-    t.isUnsigned = lit->isUnsigned;
-    e.semaType = t;
-    return t;
-  }
-  if (auto* flt = dynamic_cast<FloatLiteralExpr*>(&e)) {
-    Type t;
-    t.base = flt->isFloat ? Type::Base::Float : Type::Base::Double;
-    e.semaType = t;
-    return t;
-  }
-  if (dynamic_cast<StringLiteralExpr*>(&e)) {
-    Type t;
-    t.base = Type::Base::Char;
-    t.addPointerLevel(false);
-    e.semaType = t;
-    return t;
-  }
-
-  if (dynamic_cast<InitListExpr*>(&e)) {
-    diags.error(e.loc, "initializer list not allowed here");
-    return std::nullopt;
-  }
-
-  if (auto* inc = dynamic_cast<IncDecExpr*>(&e)) {
-    auto lvTy = checkLValue(diags, scopes, fns, structs, enums, *inc->operand,
-                            "expected lvalue for increment/decrement",
-                            /*isAssign=*/true);
-    if (!lvTy) return std::nullopt;
-    if (lvTy->isPointer() && lvTy->isVoidPointer()) {
-      diags.error(inc->loc, "invalid operand to ++/--");
-      return std::nullopt;
+static const Type* checkExprImpl(
+    Diagnostics& diags, TypeContext& types, ScopeStack& scopes, const FnTable& fns,
+    const StructTable& structs, const EnumConstTable& enums, Expr& e) {
+  switch (e.kind) {
+    case NodeKind::IntLiteralExpr: {
+      auto* lit = cast<IntLiteralExpr>(&e);
+      Type t;
+      if (lit->longKind == 1) {
+        t.base = Type::Base::Long;
+      } else if (lit->longKind == 2) {
+        t.base = Type::Base::LongLong;
+      }
+      t.isUnsigned = lit->isUnsigned;
+      e.semaType = types.get(t);
+      return e.semaType;
     }
-    if (!lvTy->isInteger() && !lvTy->isPointer()) {
-      diags.error(inc->loc, "invalid operand to ++/--");
-      return std::nullopt;
+    case NodeKind::FloatLiteralExpr: {
+      auto* flt = cast<FloatLiteralExpr>(&e);
+      Type t;
+      t.base = flt->isFloat ? Type::Base::Float : Type::Base::Double;
+      e.semaType = types.get(t);
+      return e.semaType;
     }
-    e.semaType = *lvTy;
-    return *lvTy;
-  }
-
-  if (auto* sz = dynamic_cast<SizeofExpr*>(&e)) {
-    if (sz->isType) {
-      if (sz->type.isVoidObject()) {
-        diags.error(sz->loc, "sizeof of void");
-        return std::nullopt;
-      }
-    } else {
-      if (auto* vr = dynamic_cast<VarRefExpr*>(sz->expr.get())) {
-        auto ty = lookupVarType(scopes, vr->name);
-        if (!ty) {
-          diags.error(vr->loc, "use of undeclared identifier '" + vr->name + "'");
-          return std::nullopt;
-        }
-        if (ty->isVoidObject()) {
+    case NodeKind::StringLiteralExpr: {
+      Type t;
+      t.base = Type::Base::Char;
+      t.addPointerLevel(false);
+      e.semaType = types.get(t);
+      return e.semaType;
+    }
+    case NodeKind::InitListExpr: {
+      diags.error(e.loc, "initializer list not allowed here");
+      return nullptr;
+    }
+    case NodeKind::IncDecExpr: {
+      auto* inc = cast<IncDecExpr>(&e);
+      auto lvTy = checkLValue(diags, types, scopes, fns, structs, enums, *inc->operand,
+                              "expected lvalue for increment/decrement",
+                              /*isAssign=*/true);
+      if (!lvTy) return nullptr;
+      if (lvTy->isPointer() && lvTy->isVoidPointer()) {
+        diags.error(inc->loc, "invalid operand to ++/--");
+        return nullptr;
+      }
+      if (!lvTy->isInteger() && !lvTy->isPointer()) {
+        diags.error(inc->loc, "invalid operand to ++/--");
+        return nullptr;
+      }
+      e.semaType = lvTy;
+      return lvTy;
+    }
+    case NodeKind::SizeofExpr: {
+      auto* sz = cast<SizeofExpr>(&e);
+      if (sz->isType) {
+        if (sz->type.isVoidObject()) {
           diags.error(sz->loc, "sizeof of void");
-          return std::nullopt;
+          return nullptr;
         }
-        vr->semaType = *ty;
       } else {
-        auto ty = checkExprImpl(diags, scopes, fns, structs, enums, *sz->expr);
-        if (!ty) return std::nullopt;
-        if (ty->isVoidObject()) {
-          diags.error(sz->loc, "sizeof of void");
-          return std::nullopt;
+        if (auto* vr = dyn_cast<VarRefExpr>(sz->expr.get())) {
+          auto ty = lookupVarType(scopes, vr->name);
+          if (!ty) {
+            diags.error(vr->loc, "use of undeclared identifier '" + vr->name + "'");
+            return nullptr;
+          }
+          if (ty->isVoidObject()) {
+            diags.error(sz->loc, "sizeof of void");
+            return nullptr;
+          }
+          vr->semaType = ty;
+        } else {
+          auto ty = checkExprImpl(diags, types, scopes, fns, structs, enums, *sz->expr);
+          if (!ty) return nullptr;
+          if (ty->isVoidObject()) {
+            diags.error(sz->loc, "sizeof of void");
+            return nullptr;
+          }
         }
       }
-    }
-    Type t;
-    e.semaType = t;
-    return t;
-  }
-
-  if (auto* cast = dynamic_cast<CastExpr*>(&e)) {
-    auto opTy = checkExprImpl(diags, scopes, fns, structs, enums, *cast->expr);
-    if (!opTy) return std::nullopt;
-    if (cast->targetType.isArray()) {
-      diags.error(cast->loc, "invalid cast target");
-      return std::nullopt;
-    }
-    if (cast->targetType.isStruct()) {
-      diags.error(cast->loc, "invalid cast target");
-      return std::nullopt;
-    }
-    if (opTy->isVoidObject()) {
-      diags.error(cast->loc, "invalid cast from void");
-      return std::nullopt;
-    }
-    bool ok = false;
-    if (cast->targetType.isVoidObject()) {
-      ok = true;
-    } else if (cast->targetType.isPointer()) {
-      ok = opTy->isPointer() || opTy->isInteger();
-    } else if (cast->targetType.isInteger()) {
-      ok = opTy->isNumeric() || opTy->isPointer();
-    } else if (cast->targetType.isFloating()) {
-      ok = opTy->isNumeric();
-    }
-    if (!ok) {
-      diags.error(cast->loc, "invalid cast");
-      return std::nullopt;
-    }
-    e.semaType = cast->targetType;
-    return cast->targetType;
-  }
-
-  if (auto* vr = dynamic_cast<VarRefExpr*>(&e)) {
-    auto ty = lookupVarType(scopes, vr->name);
-    if (!ty) {
-      auto it = enums.find(vr->name);
-      if (it != enums.end()) {
-        Type t;
-        e.semaType = t;
-        return t;
-      }
-      auto fit = fns.find(vr->name);
-      if (fit != fns.end()) {
-        Type t = functionPointerTypeFromFnInfo(fit->second);
-        e.semaType = t;
-        return t;
-      }
-      diags.error(vr->loc, "use of undeclared identifier '" + vr->name + "'");
-      return std::nullopt;
-    }
-    if (ty->isArray() && !ty->ptrOutsideArrays) {
-      Type dt = ty->decayType();
-      e.semaType = dt;
-      return dt;
-    }
-    e.semaType = *ty;
-    return *ty;
-  }
-
-  if (auto* call = dynamic_cast<CallExpr*>(&e)) {
-    const FunctionType* fnTy = nullptr;
-    FunctionType fnFromInfo;
-    SourceLocation calleeLoc = call->calleeLoc;
-    if (call->calleeExpr) {
-      calleeLoc = call->calleeExpr->loc;
-      auto calleeTy = checkExprImpl(diags, scopes, fns, structs, enums, *call->calleeExpr);
-      if (!calleeTy) return std::nullopt;
-      if (!calleeTy->func || calleeTy->ptrDepth > 1) {
-        diags.error(calleeLoc, "called object is not a function");
-        for (const auto& a : call->args) checkExprImpl(diags, scopes, fns, structs, enums, *a);
-        return std::nullopt;
-      }
-      fnTy = calleeTy->func.get();
-    } else {
-      auto varTy = lookupVarType(scopes, call->callee);
-      if (varTy) {
-        if (!varTy->func || varTy->ptrDepth != 1) {
+      Type t;
+      e.semaType = types.get(t);
+      return e.semaType;
+    }
+    case NodeKind::CastExpr: {
+      auto* ce = cast<CastExpr>(&e);
+      auto opTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *ce->expr);
+      if (!opTy) return nullptr;
+      if (ce->targetType.isArray()) {
+        diags.error(ce->loc, "invalid cast target");
+        return nullptr;
+      }
+      if (ce->targetType.isStruct()) {
+        diags.error(ce->loc, "invalid cast target");
+        return nullptr;
+      }
+      if (opTy->isVoidObject()) {
+        diags.error(ce->loc, "invalid cast from void");
+        return nullptr;
+      }
+      bool ok = false;
+      if (ce->targetType.isVoidObject()) {
+        ok = true;
+      } else if (ce->targetType.isPointer()) {
+        ok = opTy->isPointer() || opTy->isInteger();
+      } else if (ce->targetType.isInteger()) {
+        ok = opTy->isNumeric() || opTy->isPointer();
+      } else if (ce->targetType.isFloating()) {
+        ok = opTy->isNumeric();
+      }
+      if (!ok) {
+        diags.error(ce->loc, "invalid cast");
+        return nullptr;
+      }
+      e.semaType = types.get(ce->targetType);
+      return e.semaType;
+    }
+    case NodeKind::VarRefExpr: {
+      auto* vr = cast<VarRefExpr>(&e);
+      auto ty = lookupVarType(scopes, vr->name);
+      if (!ty) {
+        auto it = enums.find(vr->name);
+        if (it != enums.end()) {
+          Type t;
+          e.semaType = types.get(t);
+          return e.semaType;
+        }
+        auto fit = fns.find(vr->name);
+        if (fit != fns.end()) {
+          Type t = functionPointerTypeFromFnInfo(fit->second);
+          e.semaType = types.get(t);
+          return e.semaType;
+        }
+        diags.error(vr->loc, "use of undeclared identifier '" + vr->name + "'");
+        return nullptr;
+      }
+      if (ty->isArray() && !ty->ptrOutsideArrays) {
+        const Type* dt = types.decay(ty);
+        e.semaType = dt;
+        return dt;
+      }
+      e.semaType = ty;
+      return ty;
+    }
+    case NodeKind::CallExpr: {
+      auto* call = cast<CallExpr>(&e);
+      // called through a pointer, or else the FnInfo signature (interned)
+      const FunctionType* fnTy = nullptr;
+      const Type* returnTy = nullptr;
+      std::vector<const Type*> ptrParams;
+      const std::vector<const Type*>* params = &ptrParams;
+      bool isVariadic = false;
+      SourceLocation calleeLoc = call->calleeLoc;
+      if (call->calleeExpr) {
+        calleeLoc = call->calleeExpr->loc;
+        auto calleeTy =
+            checkExprImpl(diags, types, scopes, fns, structs, enums, *call->calleeExpr);
+        if (!calleeTy) return nullptr;
+        if (!calleeTy->func || calleeTy->ptrDepth > 1) {
           diags.error(calleeLoc, "called object is not a function");
-          for (const auto& a : call->args) checkExprImpl(diags, scopes, fns, structs, enums, *a);
-          return std::nullopt;
+          for (const auto& a : call->args) {
+            checkExprImpl(diags, types, scopes, fns, structs, enums, *a);
+          }
+          return nullptr;
         }
-        fnTy = varTy->func.get();
+        fnTy = calleeTy->func.get();
       } else {
-        auto it = fns.find(call->callee);
-        if (it == fns.end()) {
-          diags.error(calleeLoc, "call to undeclared function '" + call->callee + "'");
-          for (const auto& a : call->args) checkExprImpl(diags, scopes, fns, structs, enums, *a);
-          return std::nullopt;
+        auto varTy = lookupVarType(scopes, call->callee);
+        if (varTy) {
+          if (!varTy->func || varTy->ptrDepth != 1) {
+            diags.error(calleeLoc, "called object is not a function");
+            for (const auto& a : call->args) {
+              checkExprImpl(diags, types, scopes, fns, structs, enums, *a);
+            }
+            return nullptr;
+          }
+          fnTy = varTy->func.get();
+        } else {
+          auto it = fns.find(call->callee);
+          if (it == fns.end()) {
+            diags.error(calleeLoc, "call to undeclared function '" + call->callee + "'");
+            for (const auto& a : call->args) {
+              checkExprImpl(diags, types, scopes, fns, structs, enums, *a);
+            }
+            return nullptr;
+          }
+          returnTy = it->second.returnType;
+          params = &it->second.paramTypes;
+          isVariadic = it->second.isVariadic;
         }
-        fnFromInfo.returnType = it->second.returnType;
-        fnFromInfo.params = it->second.paramTypes;
-        fnFromInfo.isVariadic = it->second.isVariadic;
-        fnTy = &fnFromInfo;
       }
-    }
+      if (fnTy) {
+        returnTy = types.get(fnTy->returnType);
+        for (const auto& p : fnTy->params) ptrParams.push_back(types.get(p));
+        isVariadic = fnTy->isVariadic;
+      }
 
-    size_t expected = fnTy->params.size();
-    size_t have = call->args.size();
-    if (fnTy->isVariadic) {
-      if (have < expected) {
+      size_t expected = params->size();
+      size_t have = call->args.size();
+      if (isVariadic) {
+        if (have < expected) {
+          diags.error(calleeLoc,
+                      "expected at least " + std::to_string(expected) +
+                          " arguments, have " + std::to_string(have));
+        }
+      } else if (expected != have) {
         diags.error(calleeLoc,
-                    "expected at least " + std::to_string(expected) +
+                    "expected " + std::to_string(expected) +
                         " arguments, have " + std::to_string(have));
       }
-    } else if (expected != have) {
-      diags.error(calleeLoc,
-                  "expected " + std::to_string(expected) +
-                      " arguments, have " + std::to_string(have));
-    }
 
-    for (size_t i = 0; i < call->args.size(); ++i) {
-      auto argTy = checkExprImpl(diags, scopes, fns, structs, enums, *call->args[i]);
-      if (!argTy || i >= fnTy->params.size()) continue;
-      if (!isAssignable(fnTy->params[i], *argTy, *call->args[i])) {
-        diags.error(call->args[i]->loc, "incompatible argument type");
+      for (size_t i = 0; i < call->args.size(); ++i) {
+        auto argTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *call->args[i]);
+        if (!argTy || i >= params->size()) continue;
+        if (!isAssignable((*params)[i], argTy, *call->args[i])) {
+          diags.error(call->args[i]->loc, "incompatible argument type");
+        }
       }
-    }
 
-    e.semaType = fnTy->returnType;
-    return fnTy->returnType;
-  }
-
-  if (auto* asn = dynamic_cast<AssignExpr*>(&e)) {
-    auto lhsTy = checkLValue(diags, scopes, fns, structs, enums, *asn->lhs,
-                             "expected lvalue on left-hand side of assignment",
-                             /*isAssign=*/true);
-    auto rhsTy = checkExprImpl(diags, scopes, fns, structs, enums, *asn->rhs);
-    if (!lhsTy || !rhsTy) return std::nullopt;
-    if (asn->op == TokenKind::Assign) {
-      if (!isAssignable(*lhsTy, *rhsTy, *asn->rhs)) {
-        diags.error(asn->loc, "incompatible assignment");
-      }
-      e.semaType = *lhsTy;
-      return *lhsTy;
+      e.semaType = returnTy;
+      return returnTy;
     }
+    case NodeKind::AssignExpr: {
+      auto* asn = cast<AssignExpr>(&e);
+      auto lhsTy = checkLValue(diags, types, scopes, fns, structs, enums, *asn->lhs,
+                               "expected lvalue on left-hand side of assignment",
+                               /*isAssign=*/true);
+      auto rhsTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *asn->rhs);
+      if (!lhsTy || !rhsTy) return nullptr;
+      if (asn->op == TokenKind::Assign) {
+        if (!isAssignable(lhsTy, rhsTy, *asn->rhs)) {
+          diags.error(asn->loc, "incompatible assignment");
+        }
+        e.semaType = lhsTy;
+        return lhsTy;
+      }
 
-    auto report = [&](const std::string& msg) -> std::optional<Type> {
-      diags.error(asn->loc, msg);
-      return std::nullopt;
-    };
+      auto report = [&](const std::string& msg) -> const Type* {
+        diags.error(asn->loc, msg);
+        return nullptr;
+      };
 
-    switch (asn->op) {
-      case TokenKind::PlusAssign:
-      case TokenKind::MinusAssign: {
-        if (lhsTy->isNumeric() && rhsTy->isNumeric()) {
-          e.semaType = *lhsTy;
-          return *lhsTy;
+      switch (asn->op) {
+        case TokenKind::PlusAssign:
+        case TokenKind::MinusAssign: {
+          if (lhsTy->isNumeric() && rhsTy->isNumeric()) {
+            e.semaType = lhsTy;
+            return lhsTy;
+          }
+          if (lhsTy->isPointer() && rhsTy->isInteger() && !lhsTy->isVoidPointer()) {
+            e.semaType = lhsTy;
+            return lhsTy;
+          }
+          return report("invalid operands to pointer arithmetic");
         }
-        if (lhsTy->isPointer() && rhsTy->isInteger() && !lhsTy->isVoidPointer()) {
-          e.semaType = *lhsTy;
-          return *lhsTy;
+        case TokenKind::StarAssign:
+        case TokenKind::SlashAssign: {
+          if (!lhsTy->isNumeric() || !rhsTy->isNumeric()) {
+            return report("invalid operands to compound assignment");
+          }
+          e.semaType = lhsTy;
+          return lhsTy;
         }
-        return report("invalid operands to pointer arithmetic");
-      }
-      case TokenKind::StarAssign:
-      case TokenKind::SlashAssign: {
-        if (!lhsTy->isNumeric() || !rhsTy->isNumeric()) {
-          return report("invalid operands to compound assignment");
+        case TokenKind::PercentAssign: {
+          if (!lhsTy->isInteger() || !rhsTy->isInteger()) {
+            return report("invalid operands to compound assignment");
+          }
+          e.semaType = lhsTy;
+          return lhsTy;
         }
-        e.semaType = *lhsTy;
-        return *lhsTy;
-      }
-      case TokenKind::PercentAssign: {
-        if (!lhsTy->isInteger() || !rhsTy->isInteger()) {
-          return report("invalid operands to compound assignment");
+        case TokenKind::LessLessAssign:
+        case TokenKind::GreaterGreaterAssign: {
+          if (!lhsTy->isInteger() || !rhsTy->isInteger()) {
+            return report("invalid operands to shift operator");
+          }
+          e.semaType = lhsTy;
+          return lhsTy;
         }
-        e.semaType = *lhsTy;
-        return *lhsTy;
-      }
-      case TokenKind::LessLessAssign:
-      case TokenKind::GreaterGreaterAssign: {
-        if (!lhsTy->isInteger() || !rhsTy->isInteger()) {
-          return report("invalid operands to shift operator");
+        case TokenKind::AmpAssign:
+        case TokenKind::PipeAssign:
+        case TokenKind::CaretAssign: {
+          if (!lhsTy->isInteger() || !rhsTy->isInteger()) {
+            return report("invalid operands to bitwise operator");
+          }
+          e.semaType = lhsTy;
+          return lhsTy;
         }
-        e.semaType = *lhsTy;
-        return *lhsTy;
+        default:
+          return report("invalid operands to compound assignment");
       }
-      case TokenKind::AmpAssign:
-      case TokenKind::PipeAssign:
-      case TokenKind::CaretAssign: {
-        if (!lhsTy->isInteger() || !rhsTy->isInteger()) {
-          return report("invalid operands to bitwise operator");
+      break;
+    }
+    case NodeKind::TernaryExpr: {
+      auto* ter = cast<TernaryExpr>(&e);
+      auto condTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *ter->cond);
+      auto thenTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *ter->thenExpr);
+      auto elseTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *ter->elseExpr);
+      if (condTy && !isScalarType(*condTy)) {
+        diags.error(ter->cond->loc, "condition must be scalar");
+      }
+      if (!thenTy || !elseTy) return nullptr;
+      if (thenTy == elseTy) {
+        e.semaType = thenTy;
+        return thenTy;
+      }
+      if (thenTy->isNumeric() && elseTy->isNumeric()) {
+        Type t = commonNumericType(*thenTy, *elseTy);
+        e.semaType = types.get(t);
+        return e.semaType;
+      }
+      if (thenTy->isPointer() && elseTy->isInt() && isNullPointerConstant(*ter->elseExpr)) {
+        e.semaType = thenTy;
+        return thenTy;
+      }
+      if (elseTy->isPointer() && thenTy->isInt() && isNullPointerConstant(*ter->thenExpr)) {
+        e.semaType = elseTy;
+        return elseTy;
+      }
+      diags.error(ter->loc, "incompatible types in conditional operator");
+      return nullptr;
+    }
+    case NodeKind::UnaryExpr: {
+      auto* un = cast<UnaryExpr>(&e);
+      if (un->op == TokenKind::Amp) {
+        auto lvTy = checkLValue(diags, types, scopes, fns, structs, enums, *un->operand,
+                                "expected lvalue for address-of operator",
+                                /*isAssign=*/false);
+        if (!lvTy) return nullptr;
+        e.semaType = types.pointerTo(lvTy);
+        return e.semaType;
+      }
+
+      auto opTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *un->operand);
+      if (!opTy) return nullptr;
+
+      if (un->op == TokenKind::Star) {
+        if (!opTy->isPointer()) {
+          diags.error(un->loc, "cannot dereference non-pointer");
+          return nullptr;
         }
-        e.semaType = *lhsTy;
-        return *lhsTy;
-      }
-      default:
-        return report("invalid operands to compound assignment");
-    }
-  }
-
-  if (auto* ter = dynamic_cast<TernaryExpr*>(&e)) {
-    auto condTy = checkExprImpl(diags, scopes, fns, structs, enums, *ter->cond);
-    auto thenTy = checkExprImpl(diags, scopes, fns, structs, enums, *ter->thenExpr);
-    auto elseTy = checkExprImpl(diags, scopes, fns, structs, enums, *ter->elseExpr);
-    if (condTy && !isScalarType(*condTy)) {
-      diags.error(ter->cond->loc, "condition must be scalar");
-    }
-    if (!thenTy || !elseTy) return std::nullopt;
-    if (*thenTy == *elseTy) {
-      e.semaType = *thenTy;
-      return *thenTy;
-    }
-    if (thenTy->isNumeric() && elseTy->isNumeric()) {
-      Type t = commonNumericType(*thenTy, *elseTy);
-      e.semaType = t;
-      return t;
-    }
-    if (thenTy->isPointer() && elseTy->isInt() && isNullPointerConstant(*ter->elseExpr)) {
-      e.semaType = *thenTy;
-      return *thenTy;
-    }
-    if (elseTy->isPointer() && thenTy->isInt() && isNullPointerConstant(*ter->thenExpr)) {
-      e.semaType = *elseTy;
-      return *elseTy;
-    }
-    diags.error(ter->loc, "incompatible types in conditional operator");
-    return std::nullopt;
-  }
-
-  if (auto* un = dynamic_cast<UnaryExpr*>(&e)) {
-    if (un->op == TokenKind::Amp) {
-      auto lvTy = checkLValue(diags, scopes, fns, structs, enums, *un->operand,
-                              "expected lvalue for address-of operator",
-                              /*isAssign=*/false);
-      if (!lvTy) return std::nullopt;
-      Type t = *lvTy;
-      t.addPointerLevel(false);
-      t.ptrOutsideArrays = false;
-      e.semaType = t;
-      return t;
-    }
-
-    auto opTy = checkExprImpl(diags, scopes, fns, structs, enums, *un->operand);
-    if (!opTy) return std::nullopt;
-
-    if (un->op == TokenKind::Star) {
-      if (!opTy->isPointer()) {
-        diags.error(un->loc, "cannot dereference non-pointer");
-        return std::nullopt;
-      }
-      if (opTy->isVoidPointer()) {
-        diags.error(un->loc, "cannot dereference void pointer");
-        return std::nullopt;
+        if (opTy->isVoidPointer()) {
+          diags.error(un->loc, "cannot dereference void pointer");
+          return nullptr;
+        }
+        const Type* t = types.pointee(opTy);
+        e.semaType = t;
+        return t;
       }
-      Type t = opTy->pointee();
-      e.semaType = t;
-      return t;
-    }
 
-    if (un->op == TokenKind::Bang) {
-      if (!isScalarType(*opTy)) {
-        diags.error(un->loc, "invalid operand to '!'");
-        return std::nullopt;
+      if (un->op == TokenKind::Bang) {
+        if (!isScalarType(*opTy)) {
+          diags.error(un->loc, "invalid operand to '!'");
+          return nullptr;
+        }
+        Type t;
+        e.semaType = types.get(t);
+        return e.semaType;
       }
-      Type t;
-      e.semaType = t;
-      return t;
-    }
 
-    if (un->op == TokenKind::Plus || un->op == TokenKind::Minus || un->op == TokenKind::Tilde) {
-      if (un->op == TokenKind::Tilde && !opTy->isInteger()) {
-        diags.error(un->loc, "invalid operand to unary operator");
-        return std::nullopt;
-      }
-      if (un->op != TokenKind::Tilde && !opTy->isNumeric()) {
-        diags.error(un->loc, "invalid operand to unary operator");
-        return std::nullopt;
+      if (un->op == TokenKind::Plus || un->op == TokenKind::Minus || un->op == TokenKind::Tilde) {
+        if (un->op == TokenKind::Tilde && !opTy->isInteger()) {
+          diags.error(un->loc, "invalid operand to unary operator");
+          return nullptr;
+        }
+        if (un->op != TokenKind::Tilde && !opTy->isNumeric()) {
+          diags.error(un->loc, "invalid operand to unary operator");
+          return nullptr;
+        }
+        e.semaType = opTy->isFloating() ? opTy : types.get(promoteInteger(*opTy));
+        return e.semaType;
       }
-      Type t = opTy->isFloating() ? *opTy : promoteInteger(*opTy);
-      e.semaType = t;
-      return t;
+      break;
     }
-  }
-
-  if (auto* bin = dynamic_cast<BinaryExpr*>(&e)) {
-    auto lhsTy = checkExprImpl(diags, scopes, fns, structs, enums, *bin->lhs);
-    auto rhsTy = checkExprImpl(diags, scopes, fns, structs, enums, *bin->rhs);
-    if (!lhsTy || !rhsTy) return std::nullopt;
+    case NodeKind::BinaryExpr: {
+      auto* bin = cast<BinaryExpr>(&e);
+      auto lhsTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *bin->lhs);
+      auto rhsTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *bin->rhs);
+      if (!lhsTy || !rhsTy) return nullptr;
 
-    switch (bin->op) {
-      case TokenKind::Comma: {
-        e.semaType = *rhsTy;
-        return *rhsTy;
-      }
-      case TokenKind::AmpAmp:
-      case TokenKind::PipePipe: {
-        if (!isScalarType(*lhsTy) || !isScalarType(*rhsTy)) {
-          diags.error(bin->loc, "invalid operands to logical operator");
-          return std::nullopt;
+      switch (bin->op) {
+        case TokenKind::Comma: {
+          e.semaType = rhsTy;
+          return rhsTy;
         }
-        Type t;
-        e.semaType = t;
-        return t;
-      }
-      case TokenKind::EqualEqual:
-      case TokenKind::BangEqual: {
-        if (*lhsTy == *rhsTy || samePointerTypeIgnoreQuals(*lhsTy, *rhsTy)) {
-          Type t;
-          e.semaType = t;
-          return t;
-        }
-        if (lhsTy->isNumeric() && rhsTy->isNumeric()) {
+        case TokenKind::AmpAmp:
+        case TokenKind::PipePipe: {
+          if (!isScalarType(*lhsTy) || !isScalarType(*rhsTy)) {
+            diags.error(bin->loc, "invalid operands to logical operator");
+            return nullptr;
+          }
           Type t;
-          e.semaType = t;
-          return t;
+          e.semaType = types.get(t);
+          return e.semaType;
         }
-        if (lhsTy->isPointer() && rhsTy->isPointer() &&
-            lhsTy->ptrDepth == 1 && rhsTy->ptrDepth == 1 &&
-            (lhsTy->base == Type::Base::Void || rhsTy->base == Type::Base::Void)) {
-          Type t;
-          e.semaType = t;
-          return t;
+        case TokenKind::EqualEqual:
+        case TokenKind::BangEqual: {
+          if (lhsTy == rhsTy || samePointerTypeIgnoreQuals(*lhsTy, *rhsTy)) {
+            Type t;
+            e.semaType = types.get(t);
+            return e.semaType;
+          }
+          if (lhsTy->isNumeric() && rhsTy->isNumeric()) {
+            Type t;
+            e.semaType = types.get(t);
+            return e.semaType;
+          }
+          if (lhsTy->isPointer() && rhsTy->isPointer() &&
+              lhsTy->ptrDepth == 1 && rhsTy->ptrDepth == 1 &&
+              (lhsTy->base == Type::Base::Void || rhsTy->base == Type::Base::Void)) {
+            Type t;
+            e.semaType = types.get(t);
+            return e.semaType;
+          }
+          if (lhsTy->isPointer() && rhsTy->isInt() && isNullPointerConstant(*bin->rhs)) {
+            Type t;
+            e.semaType = types.get(t);
+            return e.semaType;
+          }
+          if (rhsTy->isPointer() && lhsTy->isInt() && isNullPointerConstant(*bin->lhs)) {
+            Type t;
+            e.semaType = types.get(t);
+            return e.semaType;
+          }
+          diags.error(bin->loc, "invalid operands to equality operator");
+          return nullptr;
         }
-        if (lhsTy->isPointer() && rhsTy->isInt() && isNullPointerConstant(*bin->rhs)) {
+        case TokenKind::Less:
+        case TokenKind::LessEqual:
+        case TokenKind::Greater:
+        case TokenKind::GreaterEqual: {
+          if (!(lhsTy->isNumeric() && rhsTy->isNumeric())) {
+            if (!(lhsTy->isPointer() && rhsTy->isPointer() &&
+                  samePointerTypeIgnoreQuals(*lhsTy, *rhsTy) && !lhsTy->isVoidPointer())) {
+              diags.error(bin->loc, "invalid operands to relational operator");
+              return nullptr;
+            }
+          }
           Type t;
-          e.semaType = t;
-          return t;
+          e.semaType = types.get(t);
+          return e.semaType;
         }
-        if (rhsTy->isPointer() && lhsTy->isInt() && isNullPointerConstant(*bin->lhs)) {
-          Type t;
-          e.semaType = t;
-          return t;
-        }
-        diags.error(bin->loc, "invalid operands to equality operator");
-        return std::nullopt;
-      }
-      case TokenKind::Less:
-      case TokenKind::LessEqual:
-      case TokenKind::Greater:
-      case TokenKind::GreaterEqual: {
-        if (!(lhsTy->isNumeric() && rhsTy->isNumeric())) {
-          if (!(lhsTy->isPointer() && rhsTy->isPointer() &&
-                samePointerTypeIgnoreQuals(*lhsTy, *rhsTy) && !lhsTy->isVoidPointer())) {
-            diags.error(bin->loc, "invalid operands to relational operator");
-            return std::nullopt;
+        case TokenKind::Plus:
+        case TokenKind::Minus: {
+          if (lhsTy->isNumeric() && rhsTy->isNumeric()) {
+            Type t = commonNumericType(*lhsTy, *rhsTy);
+            e.semaType = types.get(t);
+            return e.semaType;
           }
+          if (lhsTy->isPointer() && rhsTy->isInteger() && !lhsTy->isVoidPointer()) {
+            e.semaType = lhsTy;
+            return lhsTy;
+          }
+          if (bin->op == TokenKind::Plus && lhsTy->isInteger() && rhsTy->isPointer() &&
+              !rhsTy->isVoidPointer()) {
+            e.semaType = rhsTy;
+            return rhsTy;
+          }
+          if (bin->op == TokenKind::Minus && lhsTy->isPointer() && rhsTy->isPointer() &&
+              samePointerTypeIgnoreQuals(*lhsTy, *rhsTy) && !lhsTy->isVoidPointer()) {
+            Type t;
+            e.semaType = types.get(t);
+            return e.semaType;
+          }
+          diags.error(bin->loc, "invalid operands to pointer arithmetic");
+          return nullptr;
         }
-        Type t;
-        e.semaType = t;
-        return t;
-      }
-      case TokenKind::Plus:
-      case TokenKind::Minus: {
-        if (lhsTy->isNumeric() && rhsTy->isNumeric()) {
+        case TokenKind::Star:
+        case TokenKind::Slash: {
+          if (!lhsTy->isNumeric() || !rhsTy->isNumeric()) {
+            diags.error(bin->loc, "invalid operands to arithmetic operator");
+            return nullptr;
+          }
           Type t = commonNumericType(*lhsTy, *rhsTy);
-          e.semaType = t;
-          return t;
-        }
-        if (lhsTy->isPointer() && rhsTy->isInteger() && !lhsTy->isVoidPointer()) {
-          e.semaType = *lhsTy;
-          return *lhsTy;
-        }
-        if (bin->op == TokenKind::Plus && lhsTy->isInteger() && rhsTy->isPointer() &&
-            !rhsTy->isVoidPointer()) {
-          e.semaType = *rhsTy;
-          return *rhsTy;
-        }
-        if (bin->op == TokenKind::Minus && lhsTy->isPointer() && rhsTy->isPointer() &&
-            samePointerTypeIgnoreQuals(*lhsTy, *rhsTy) && !lhsTy->isVoidPointer()) {
-          Type t;
-          e.semaType = t;
-          return t;
-        }
-        diags.error(bin->loc, "invalid operands to pointer arithmetic");
-        return std::nullopt;
-      }
-      case TokenKind::Star:
-      case TokenKind::Slash: {
-        if (!lhsTy->isNumeric() || !rhsTy->isNumeric()) {
-          diags.error(bin->loc, "invalid operands to arithmetic operator");
-          return std::nullopt;
+          e.semaType = types.get(t);
+          return e.semaType;
         }
-        Type t = commonNumericType(*lhsTy, *rhsTy);
-        e.semaType = t;
-        return t;
-      }
-      case TokenKind::Percent: {
-        if (!lhsTy->isInteger() || !rhsTy->isInteger()) {
-          diags.error(bin->loc, "invalid operands to arithmetic operator");
-          return std::nullopt;
+        case TokenKind::Percent: {
+          if (!lhsTy->isInteger() || !rhsTy->isInteger()) {
+            diags.error(bin->loc, "invalid operands to arithmetic operator");
+            return nullptr;
+          }
+          Type t = commonIntegerType(*lhsTy, *rhsTy);
+          e.semaType = types.get(t);
+          return e.semaType;
         }
-        Type t = commonIntegerType(*lhsTy, *rhsTy);
-        e.semaType = t;
-        return t;
-      }
-      case TokenKind::LessLess:
-      case TokenKind::GreaterGreater: {
-        if (!lhsTy->isInteger() || !rhsTy->isInteger()) {
-          diags.error(bin->loc, "invalid operands to shift operator");
-          return std::nullopt;
+        case TokenKind::LessLess:
+        case TokenKind::GreaterGreater: {
+          if (!lhsTy->isInteger() || !rhsTy->isInteger()) {
+            diags.error(bin->loc, "invalid operands to shift operator");
+            return nullptr;
+          }
+          Type t = promoteInteger(*lhsTy);
+          e.semaType = types.get(t);
+          return e.semaType;
         }
-        Type t = promoteInteger(*lhsTy);
-        e.semaType = t;
-        return t;
-      }
-      case TokenKind::Amp:
-      case TokenKind::Pipe:
-      case TokenKind::Caret: {
-        if (!lhsTy->isInteger() || !rhsTy->isInteger()) {
-          diags.error(bin->loc, "invalid operands to bitwise operator");
-          return std::nullopt;
+        case TokenKind::Amp:
+        case TokenKind::Pipe:
+        case TokenKind::Caret: {
+          if (!lhsTy->isInteger() || !rhsTy->isInteger()) {
+            diags.error(bin->loc, "invalid operands to bitwise operator");
+            return nullptr;
+          }
+          Type t = commonIntegerType(*lhsTy, *rhsTy);
+          e.semaType = types.get(t);
+          return e.semaType;
         }
-        Type t = commonIntegerType(*lhsTy, *rhsTy);
-        e.semaType = t;
-        return t;
-      }
-      default:
-        break;
-    }
-  }
-
-  if (auto* sub = dynamic_cast<SubscriptExpr*>(&e)) {
-    auto baseTy = checkExprImpl(diags, scopes, fns, structs, enums, *sub->base);
-    auto idxTy = checkExprImpl(diags, scopes, fns, structs, enums, *sub->index);
-    if (!baseTy || !idxTy) return std::nullopt;
-    if (baseTy->isArray() && !baseTy->ptrOutsideArrays) {
-      Type dt = baseTy->decayType();
-      baseTy = dt;
-    }
-    if (!idxTy->isInteger()) {
-      diags.error(sub->index->loc, "array subscript must be int");
-      return std::nullopt;
-    }
-    if (baseTy->isPointer() && baseTy->isVoidPointer()) {
-      diags.error(sub->base->loc, "cannot subscript void pointer");
-      return std::nullopt;
-    }
-    if (!baseTy->isPointer()) {
-      diags.error(sub->base->loc, "subscripted value is not pointer");
-      return std::nullopt;
-    }
-    Type elem = baseTy->pointee();
-    e.semaType = elem;
-    return elem;
-  }
-
-  if (auto* mem = dynamic_cast<MemberExpr*>(&e)) {
-    auto baseTy = checkExprImpl(diags, scopes, fns, structs, enums, *mem->base);
-    if (!baseTy) return std::nullopt;
-    auto fieldTy = resolveMemberType(
-        diags, structs, *baseTy, mem->member, mem->memberLoc, mem->isArrow);
-    if (!fieldTy) return std::nullopt;
-    if (fieldTy->isArray() && !fieldTy->ptrOutsideArrays) {
-      Type dt = fieldTy->decayType();
-      e.semaType = dt;
-      return dt;
-    }
-    e.semaType = *fieldTy;
-    return *fieldTy;
-  }
-
-  return std::nullopt;
+        default:
+          break;
+      }
+      break;
+    }
+    case NodeKind::SubscriptExpr: {
+      auto* sub = cast<SubscriptExpr>(&e);
+      auto baseTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *sub->base);
+      auto idxTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *sub->index);
+      if (!baseTy || !idxTy) return nullptr;
+      if (baseTy->isArray() && !baseTy->ptrOutsideArrays) {
+        baseTy = types.decay(baseTy);
+      }
+      if (!idxTy->isInteger()) {
+        diags.error(sub->index->loc, "array subscript must be int");
+        return nullptr;
+      }
+      if (baseTy->isPointer() && baseTy->isVoidPointer()) {
+        diags.error(sub->base->loc, "cannot subscript void pointer");
+        return nullptr;
+      }
+      if (!baseTy->isPointer()) {
+        diags.error(sub->base->loc, "subscripted value is not pointer");
+        return nullptr;
+      }
+      const Type* elem = types.pointee(baseTy);
+      e.semaType = elem;
+      return elem;
+    }
+    case NodeKind::MemberExpr: {
+      auto* mem = cast<MemberExpr>(&e);
+      auto baseTy = checkExprImpl(diags, types, scopes, fns, structs, enums, *mem->base);
+      if (!baseTy) return nullptr;
+      auto fieldTy = resolveMemberType(
+          diags, structs, *baseTy, mem->member, mem->memberLoc, mem->isArrow);
+      if (!fieldTy) return nullptr;
+      if (fieldTy->isArray() && !fieldTy->ptrOutsideArrays) {
+        const Type* dt = types.decay(fieldTy);
+        e.semaType = dt;
+        return dt;
+      }
+      e.semaType = fieldTy;
+      return fieldTy;
+    }
+    default:
+      break;
+  }
+
+  return nullptr;
 }
 
 static void addOrCheckFn(
     Diagnostics& diags,
+    TypeContext& types,
     FnTable& fns,
     const FunctionProto& proto,
     bool isDef) {
@@ -1445,8 +1484,10 @@ static void addOrCheckFn(
   if (it == fns.end()) {
     FnInfo info;
     info.paramTypes.reserve(proto.params.size());
-    for (const auto& prm : proto.params) info.paramTypes.push_back(adjustParamType(prm.type));
-    info.returnType = proto.returnType;
+    for (const auto& prm : proto.params) {
+      info.paramTypes.push_back(types.get(adjustParamType(prm.type)));
+    }
+    info.returnType = types.get(proto.returnType);
     info.isVariadic = proto.isVariadic;
     info.isStatic = (proto.storage == StorageClass::Static);
     info.firstLoc = proto.nameLoc;
@@ -1465,7 +1506,7 @@ static void addOrCheckFn(
   }
 
   // signature mismatch
-  if (!sameSignature(info, proto)) {
+  if (!sameSignature(types, info, proto)) {
     diags.error(proto.nameLoc,
                 "conflicting types for '" + proto.name + "'");
     return;
@@ -1486,10 +1527,12 @@ static void addOrCheckFn(
 } // namespace
 
 bool Sema::run(AstTranslationUnit& tu) {
+  TimeScope scope("Sema");
+  TypeContext& types = *tu.types;
   // 0) collect struct definitions
   StructTable structs;
   EnumConstTable enumConsts;
-  std::unordered_set<std::string> enumNames;
+  std::unordered_set<Symbol> enumNames;
   for (const auto& item : tu.items) {
     auto* ed = std::get_if<EnumDef>(&item);
     if (ed) {
@@ -1514,6 +1557,7 @@ bool Sema::run(AstTranslationUnit& tu) {
     }
     StructInfo info;
     info.fields = sd->fields;
+    for (const auto& field : sd->fields) info.fieldTypes.push_back(types.get(field.type));
     info.nameLoc = sd->nameLoc;
     structs.emplace(sd->name, std::move(info));
   }
@@ -1521,7 +1565,7 @@ bool Sema::run(AstTranslationUnit& tu) {
   for (const auto& item : tu.items) {
     auto* sd = std::get_if<StructDef>(&item);
     if (!sd) continue;
-    std::unordered_set<std::string> fieldNames;
+    std::unordered_set<Symbol> fieldNames;
     for (const auto& field : sd->fields) {
       if (!fieldNames.insert(field.name).second) {
         diags_.error(field.nameLoc, "duplicate field name '" + field.name + "'");
@@ -1566,9 +1610,9 @@ bool Sema::run(AstTranslationUnit& tu) {
   FnTable fns;
   for (const auto& item : tu.items) {
     if (auto* d = std::get_if<FunctionDecl>(&item)) {
-      addOrCheckFn(diags_, fns, d->proto, /*isDef=*/false);
+      addOrCheckFn(diags_, types, fns, d->proto, /*isDef=*/false);
     } else if (auto* def = std::get_if<FunctionDef>(&item)) {
-      addOrCheckFn(diags_, fns, def->proto, /*isDef=*/true);
+      addOrCheckFn(diags_, types, fns, def->proto, /*isDef=*/true);
     }
   }
 
@@ -1619,7 +1663,7 @@ bool Sema::run(AstTranslationUnit& tu) {
   {
     ScopeStack scopes;
     scopes.push_back({});
-    std::unordered_set<std::string> globalDefs;
+    std::unordered_set<Symbol> globalDefs;
 
     for (auto& item : tu.items) {
       auto* g = std::get_if<GlobalVarDecl>(&item);
@@ -1662,10 +1706,11 @@ bool Sema::run(AstTranslationUnit& tu) {
           }
         }
 
+        const Type* declTy = types.get(decl.type);
         if (decl.initExpr) {
           bool allowArrayInit = decl.type.isArray() && !decl.type.ptrOutsideArrays;
-          if (!checkInitializer(diags_, scopes, fns, structs, enumConsts,
-                                decl.type, *decl.initExpr, allowArrayInit)) {
+          if (!checkInitializer(diags_, types, scopes, fns, structs, enumConsts,
+                                declTy, *decl.initExpr, allowArrayInit)) {
             return false;
           }
         }
@@ -1673,13 +1718,13 @@ bool Sema::run(AstTranslationUnit& tu) {
         bool isExternDecl = decl.storage == StorageClass::Extern && !decl.initExpr;
         auto it = scopes.back().find(decl.name);
         if (isExternDecl) {
-          if (it != scopes.back().end() && it->second != decl.type) {
+          if (it != scopes.back().end() && it->second != declTy) {
             diags_.error(decl.nameLoc, "conflicting types for '" + decl.name + "'");
             return false;
           }
           if (it == scopes.back().end()) {
-            scopes.back().emplace(decl.name, decl.type);
-            globalScope.emplace(decl.name, decl.type);
+            scopes.back().emplace(decl.name, declTy);
+            globalScope.emplace(decl.name, declTy);
           }
           continue;
         }
@@ -1688,12 +1733,12 @@ bool Sema::run(AstTranslationUnit& tu) {
           diags_.error(decl.nameLoc, "redefinition of '" + decl.name + "'");
           return false;
         }
-        if (it != scopes.back().end() && it->second != decl.type) {
+        if (it != scopes.back().end() && it->second != declTy) {
           diags_.error(decl.nameLoc, "conflicting types for '" + decl.name + "'");
           return false;
         }
-        scopes.back()[decl.name] = decl.type;
-        globalScope[decl.name] = decl.type;
+        scopes.back()[decl.name] = declTy;
+        globalScope[decl.name] = declTy;
         globalDefs.insert(decl.name);
       }
     }
@@ -1711,18 +1756,19 @@ bool Sema::run(AstTranslationUnit& tu) {
     // parameters as locals ONLY if they have names
     for (const auto& prm : def->proto.params) {
       if (!prm.name.has_value()) continue;
-      const std::string& pname = *prm.name;
+      Symbol pname = *prm.name;
       auto& cur = scopes.back();
       if (cur.count(pname)) {
         diags_.error(prm.nameLoc, "redefinition of '" + pname + "'");
         continue;
       }
-      cur.emplace(pname, adjustParamType(prm.type));
+      cur.emplace(pname, types.get(adjustParamType(prm.type)));
     }
 
+    const Type* returnType = types.get(def->proto.returnType);
     for (const auto& st : def->body) {
-      checkStmtImpl(diags_, scopes, fns, structs, enumConsts, enumNames,
-                    def->proto.returnType,
+      checkStmtImpl(diags_, types, scopes, fns, structs, enumConsts, enumNames,
+                    returnType,
                     /*loopDepth=*/0, /*switchDepth=*/0, *st);
     }
   }
@@ -0,0 +1,54 @@
+#include "symbol.h"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+namespace c99cc {
+
+const Symbol::Entry Symbol::empty_{"", 0};
+
+namespace {
+
+// Sharded by hash so -j threads interning different names rarely meet on a
+// lock; entries live in deques, so their addresses never change.
+struct Shard {
+  std::mutex mu;
+  std::unordered_map<std::string_view, const Symbol::Entry*> index;
+  std::deque<Symbol::Entry> entries;
+};
+
+constexpr size_t kShards = 32;
+Shard shards[kShards];
+std::atomic<uint32_t> nextId{1};
+
+// Most identifiers in a TU repeat, so each thread keeps the last entry it saw
+// per hash bucket and only takes a lock for names new to it.
+constexpr size_t kCacheSlots = 4096;
+thread_local const Symbol::Entry* cache[kCacheSlots];
+
+} // namespace
+
+Symbol Symbol::intern(std::string_view text) {
+  if (text.empty()) return Symbol();
+  size_t hash = std::hash<std::string_view>()(text);
+  const Entry*& cached = cache[hash % kCacheSlots];
+  if (cached && cached->text == text) return Symbol(cached);
+
+  Shard& shard = shards[(hash / kCacheSlots) % kShards];
+  std::lock_guard<std::mutex> lock(shard.mu);
+  auto it = shard.index.find(text);
+  if (it == shard.index.end()) {
+    shard.entries.push_back(Entry{std::string(text), nextId++});
+    const Entry* entry = &shard.entries.back();
+    it = shard.index.emplace(entry->text, entry).first;
+  }
+  cached = it->second;
+  return Symbol(cached);
+}
+
+std::ostream& operator<<(std::ostream& os, Symbol s) { return os << s.str(); }
+
+} // namespace c99cc
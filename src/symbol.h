@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+namespace c99cc {
+
+// An interned identifier. Every spelling is stored once for the whole process
+// (all TUs and -j threads share the table), so a Symbol is a pointer: copies,
+// == and hashing into maps cost what they cost for an integer, and the text
+// stays valid for as long as the process runs.
+class Symbol {
+public:
+  struct Entry {
+    std::string text;
+    uint32_t id;
+  };
+
+  Symbol() : entry_(&empty_) {} // the empty name
+  static Symbol intern(std::string_view text);
+
+  // Dense, starting at 1; 0 is the empty name.
+  uint32_t id() const { return entry_->id; }
+  const std::string& str() const { return entry_->text; }
+  operator const std::string&() const { return entry_->text; }
+  bool empty() const { return entry_ == &empty_; }
+  void clear() { entry_ = &empty_; }
+
+  friend bool operator==(Symbol a, Symbol b) { return a.entry_ == b.entry_; }
+  friend bool operator!=(Symbol a, Symbol b) { return a.entry_ != b.entry_; }
+  friend bool operator==(Symbol a, std::string_view b) { return a.entry_->text == b; }
+  friend bool operator!=(Symbol a, std::string_view b) { return a.entry_->text != b; }
+  // by spelling, so sorted output does not depend on interning order
+  friend bool operator<(Symbol a, Symbol b) { return a.entry_->text < b.entry_->text; }
+
+private:
+  explicit Symbol(const Entry* entry) : entry_(entry) {}
+  static const Entry empty_;
+  const Entry* entry_;
+};
+
+// Diagnostics build messages around names.
+inline std::string operator+(const std::string& a, Symbol b) { return a + b.str(); }
+inline std::string operator+(const char* a, Symbol b) { return a + b.str(); }
+inline std::string operator+(Symbol a, const std::string& b) { return a.str() + b; }
+inline std::string operator+(Symbol a, const char* b) { return a.str() + b; }
+std::ostream& operator<<(std::ostream& os, Symbol s);
+
+} // namespace c99cc
+
+namespace std {
+template <> struct hash<c99cc::Symbol> {
+  size_t operator()(c99cc::Symbol s) const { return s.id(); }
+};
+} // namespace std
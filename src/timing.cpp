@@ -0,0 +1,95 @@
+#include "timing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace c99cc {
+
+namespace {
+
+struct PhaseTotal {
+  uint64_t count = 0;
+  std::chrono::nanoseconds time{0};
+};
+
+struct TimeReport {
+  std::atomic<bool> enabled{false};
+  std::chrono::steady_clock::time_point start;
+  std::mutex mu;
+  std::unordered_map<std::string, PhaseTotal> phases;
+};
+
+TimeReport& report() {
+  static TimeReport r;
+  return r;
+}
+
+} // namespace
+
+TimeScope::TimeScope(const char* name, llvm::StringRef detail) : trace_(name, detail) {
+  if (report().enabled.load(std::memory_order_relaxed)) {
+    name_ = name;
+    start_ = std::chrono::steady_clock::now();
+  }
+}
+
+TimeScope::TimeScope(const char* name, llvm::function_ref<std::string()> detail)
+    : trace_(name, detail) {
+  if (report().enabled.load(std::memory_order_relaxed)) {
+    name_ = name;
+    start_ = std::chrono::steady_clock::now();
+  }
+}
+
+TimeScope::~TimeScope() {
+  if (!name_) return;
+  auto elapsed = std::chrono::steady_clock::now() - start_;
+  TimeReport& r = report();
+  std::lock_guard<std::mutex> lock(r.mu);
+  PhaseTotal& total = r.phases[name_];
+  total.count++;
+  total.time += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+}
+
+void enableTimeReport() {
+  TimeReport& r = report();
+  r.start = std::chrono::steady_clock::now();
+  r.enabled = true;
+}
+
+void printTimeReport(std::ostream& os) {
+  TimeReport& r = report();
+  double wallMs =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - r.start).count();
+
+  std::vector<std::pair<std::string, PhaseTotal>> rows;
+  {
+    std::lock_guard<std::mutex> lock(r.mu);
+    rows.assign(r.phases.begin(), r.phases.end());
+  }
+  std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+    return a.second.time > b.second.time;
+  });
+
+  std::ios_base::fmtflags flags = os.flags();
+  os << "===-------------------------------------------------------------------===\n"
+     << "                      c99cc compile time report\n"
+     << "===-------------------------------------------------------------------===\n"
+     << "  Total wall time: " << std::fixed << std::setprecision(3) << wallMs << " ms\n\n"
+     << "   Time (ms)  % of wall   Count  Phase\n";
+  for (const auto& row : rows) {
+    double ms = std::chrono::duration<double, std::milli>(row.second.time).count();
+    os << std::setw(12) << ms << std::setw(10) << std::setprecision(1)
+       << (wallMs > 0 ? 100.0 * ms / wallMs : 0.0) << "%" << std::setw(8) << row.second.count
+       << "  " << row.first << "\n"
+       << std::setprecision(3);
+  }
+  os.flags(flags);
+}
+
+} // namespace c99cc
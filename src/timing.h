@@ -0,0 +1,35 @@
+#pragma once
+#include <chrono>
+#include <iosfwd>
+#include <string>
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/TimeProfiler.h"
+
+namespace c99cc {
+
+// One compile phase. It becomes a trace event when LLVM's time-trace profiler
+// is running (-ftime-trace, so LLVM's own passes land on the same timeline)
+// and its wall time is summed by name for -ftime-report.
+class TimeScope {
+public:
+  explicit TimeScope(const char* name, llvm::StringRef detail = {});
+  TimeScope(const char* name, llvm::function_ref<std::string()> detail);
+  ~TimeScope();
+
+  TimeScope(const TimeScope&) = delete;
+  TimeScope& operator=(const TimeScope&) = delete;
+
+private:
+  llvm::TimeTraceScope trace_;
+  const char* name_ = nullptr; // only set while the report is enabled
+  std::chrono::steady_clock::time_point start_;
+};
+
+void enableTimeReport();
+// Per-phase totals since enableTimeReport(). Phases running on several threads
+// (-j) are summed, and nested phases are also counted in their parents.
+void printTimeReport(std::ostream& os);
+
+} // namespace c99cc
@@ -0,0 +1,135 @@
+#include "token_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+
+#include "timing.h"
+
+namespace c99cc {
+
+namespace {
+
+// Below this a piece is not worth a thread of its own.
+constexpr size_t kMinPieceSize = 256 * 1024;
+// Dense code gets down to a token per three bytes. Reserving more than that
+// saves regrowing seven arrays, and pages that are never written cost nothing.
+constexpr size_t kBytesPerToken = 2;
+
+struct Piece {
+  std::string_view text;
+  size_t offset = 0;
+  int firstLine = 1;
+  Diagnostics diags;
+};
+
+} // namespace
+
+void TokenBuffer::reserve(size_t n) {
+  kinds_.reserve(n);
+  offsets_.reserve(n);
+  lines_.reserve(n);
+  cols_.reserve(n);
+  texts_.reserve(n);
+  lengths_.reserve(n);
+  symbols_.reserve(n);
+}
+
+void TokenBuffer::append(const Token& tok) {
+  kinds_.push_back(tok.kind);
+  offsets_.push_back(static_cast<uint32_t>(tok.loc.offset));
+  lines_.push_back(static_cast<uint32_t>(tok.loc.line));
+  cols_.push_back(static_cast<uint32_t>(tok.loc.col));
+  texts_.push_back(tok.text.data());
+  lengths_.push_back(static_cast<uint32_t>(tok.text.size()));
+  symbols_.push_back(tok.symbol);
+}
+
+Token TokenBuffer::token(size_t i) const {
+  // Pieces start at the start of a line, so the column the lexer gave each
+  // token is already the column in the whole TU.
+  SourceLocation loc{offsets_[i], static_cast<int>(lines_[i]), static_cast<int>(cols_[i])};
+  return Token{kinds_[i], std::string_view(texts_[i], lengths_[i]), loc, symbols_[i]};
+}
+
+TokenBuffer TokenBuffer::lex(std::string_view source, unsigned threads, Diagnostics& diags) {
+  TimeScope scope("PreLex");
+  TokenBuffer buffer;
+
+  size_t count = std::max<size_t>(1, std::min<size_t>(threads, source.size() / kMinPieceSize));
+  std::vector<Piece> pieces(count);
+  size_t start = 0;
+  for (size_t k = 0; k < count; k++) {
+    size_t end = source.size();
+    if (k + 1 < count) {
+      // cut just after a newline, where no token can be open
+      size_t nl = source.find('\n', std::max(start, source.size() / count * (k + 1)));
+      if (nl != std::string_view::npos) end = nl + 1;
+    }
+    pieces[k].text = source.substr(start, end - start);
+    pieces[k].offset = start;
+    start = end;
+  }
+
+  auto forEachPiece = [&](auto fn) {
+    if (count == 1) {
+      fn(pieces[0], size_t(0));
+      return;
+    }
+    llvm::ThreadPool pool(llvm::hardware_concurrency(static_cast<unsigned>(count)));
+    for (size_t k = 0; k < count; k++) pool.async([&, k] { fn(pieces[k], k); });
+    pool.wait();
+  };
+
+  // Line numbers first: a piece starts on the line after every newline
+  // before it.
+  std::vector<size_t> newlines(count);
+  forEachPiece([&](Piece& piece, size_t k) {
+    newlines[k] = static_cast<size_t>(std::count(piece.text.begin(), piece.text.end(), '\n'));
+  });
+  for (size_t k = 1; k < count; k++) {
+    pieces[k].firstLine = pieces[k - 1].firstLine + static_cast<int>(newlines[k - 1]);
+  }
+
+  std::vector<TokenBuffer> parts(count);
+  forEachPiece([&](Piece& piece, size_t k) {
+    Lexer lex(piece.text, piece.diags, SourceLocation{piece.offset, piece.firstLine, 1});
+    TokenBuffer& part = parts[k];
+    part.reserve(piece.text.size() / kBytesPerToken + 1);
+    while (true) {
+      Token tok = lex.next();
+      if (tok.kind == TokenKind::Eof && k + 1 < count) break; // only the last piece ends the TU
+      part.append(tok);
+      if (tok.kind == TokenKind::Eof) break;
+    }
+    part.storage_ = lex.releaseStorage();
+  });
+
+  for (const auto& piece : pieces) diags.append(piece.diags);
+  if (count == 1) {
+    return std::move(parts[0]);
+  }
+
+  size_t total = 0;
+  for (const auto& part : parts) total += part.size();
+  auto concat = [&](auto member) {
+    auto& out = buffer.*member;
+    out.reserve(total);
+    for (auto& part : parts) out.insert(out.end(), (part.*member).begin(), (part.*member).end());
+  };
+  concat(&TokenBuffer::kinds_);
+  concat(&TokenBuffer::offsets_);
+  concat(&TokenBuffer::lines_);
+  concat(&TokenBuffer::cols_);
+  concat(&TokenBuffer::texts_);
+  concat(&TokenBuffer::lengths_);
+  concat(&TokenBuffer::symbols_);
+  for (auto& part : parts) {
+    for (auto& block : part.storage_) buffer.storage_.push_back(std::move(block));
+  }
+  return buffer;
+}
+
+} // namespace c99cc
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "diag.h"
+#include "lexer.h"
+#include "symbol.h"
+
+namespace c99cc {
+
+// A whole TU lexed up front (-fprelex). The text is cut at line boundaries
+// (no token spans a newline), the pieces are lexed on several threads, and
+// their tokens are stitched into one structure-of-arrays, so the parser
+// reaches any token, however far ahead, by index.
+class TokenBuffer {
+public:
+  // Lexes `source`, which must outlive the buffer and be under 4 GiB, on up
+  // to `threads` threads. Errors go to `diags` in source order.
+  static TokenBuffer lex(std::string_view source, unsigned threads, Diagnostics& diags);
+
+  // Tokens including the final Eof.
+  size_t size() const { return kinds_.size(); }
+  TokenKind kind(size_t i) const { return kinds_[i]; }
+  Token token(size_t i) const;
+
+private:
+  std::vector<TokenKind> kinds_;
+  std::vector<uint32_t> offsets_;
+  std::vector<uint32_t> lines_;
+  std::vector<uint32_t> cols_;
+  // the text, which is not always in the source: see Token::text
+  std::vector<const char*> texts_;
+  std::vector<uint32_t> lengths_;
+  std::vector<Symbol> symbols_;
+  std::vector<std::unique_ptr<char[]>> storage_;
+
+  void reserve(size_t n);
+  void append(const Token& tok);
+};
+
+} // namespace c99cc
@@ -0,0 +1,73 @@
+#include "parser.h"
+
+#include <functional>
+
+namespace c99cc {
+
+namespace {
+
+void mix(size_t& h, size_t v) {
+  h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+}
+
+size_t hashType(const Type& t) {
+  size_t h = static_cast<size_t>(t.base);
+  mix(h, (size_t(t.isUnsigned) << 2) | (size_t(t.isConst) << 1) | size_t(t.ptrOutsideArrays));
+  mix(h, std::hash<Symbol>()(t.structName));
+  mix(h, std::hash<Symbol>()(t.enumName));
+  mix(h, static_cast<size_t>(t.ptrDepth));
+  for (bool c : t.ptrConst) mix(h, c);
+  for (const auto& dim : t.arrayDims) mix(h, dim ? *dim + 1 : 0);
+  if (t.func) {
+    mix(h, hashType(t.func->returnType));
+    for (const auto& p : t.func->params) mix(h, hashType(p));
+    mix(h, t.func->isVariadic);
+  }
+  return h;
+}
+
+} // namespace
+
+size_t TypeContext::Hash::operator()(const Type* t) const {
+  return hashType(*t);
+}
+
+const Type* TypeContext::get(const Type& t) {
+  auto it = interned_.find(&t);
+  if (it != interned_.end()) return *it;
+  storage_.push_back(t);
+  const Type* p = &storage_.back();
+  interned_.insert(p);
+  return p;
+}
+
+const Type* TypeContext::pointee(const Type* t) {
+  auto& d = derived_[t];
+  if (!d.pointee) d.pointee = get(t->pointee());
+  return d.pointee;
+}
+
+const Type* TypeContext::elementType(const Type* t) {
+  auto& d = derived_[t];
+  if (!d.element) d.element = get(t->elementType());
+  return d.element;
+}
+
+const Type* TypeContext::decay(const Type* t) {
+  auto& d = derived_[t];
+  if (!d.decayed) d.decayed = get(t->decayType());
+  return d.decayed;
+}
+
+const Type* TypeContext::pointerTo(const Type* t) {
+  auto& d = derived_[t];
+  if (!d.pointer) {
+    Type p = *t;
+    p.addPointerLevel(false);
+    p.ptrOutsideArrays = false;
+    d.pointer = get(p);
+  }
+  return d.pointer;
+}
+
+} // namespace c99cc
@@ -0,0 +1,8 @@
+// ERROR: invalid cast
+struct point { int x; int y; };
+
+int main() {
+  struct point p;
+  p.x = 1;
+  return (int)p;
+}
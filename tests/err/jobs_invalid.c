@@ -0,0 +1,3 @@
+// ARGS: -j x
+// ERROR: error: invalid -j value: x
+int main() { return 0; }
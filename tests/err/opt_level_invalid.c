@@ -0,0 +1,3 @@
+// ARGS: -O9
+// ERROR: error: unknown optimization level: -O9
+int main() { return 0; }
@@ -0,0 +1,8 @@
+// ARGS: -M
+// ERROR: include file not found: pp_scan_missing.h
+// -M runs #if and #include but never looks at ordinary lines
+#define WANT 2
+this is not C, and a dependency scan does not care
+#if WANT > 1
+#include "pp_scan_missing.h"
+#endif
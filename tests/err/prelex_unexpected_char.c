@@ -0,0 +1,6 @@
+// ARGS: -fprelex=2
+// ERROR: prelex_unexpected_char.c:5:24: error: unexpected character
+int main() {
+  int x = 1;
+  return x + 2 + 3 + 4 @ 5;
+}
@@ -0,0 +1,3 @@
+int mul2(int a, int b) {
+  return a * b;
+}
@@ -0,0 +1,10 @@
+// SETUP: ${TEST_DIR}/cache_multi.c -fcache-dir=${TMP_DIR}/cache tests/fixtures/multi_helper.c tests/fixtures/multi_helper2.c -o ${TMP_DIR}/cache_multi_prime.out
+// ARGS: -fcache-dir=${TMP_DIR}/cache -fcache-stats tests/fixtures/multi_helper.c tests/fixtures/multi_helper2.c
+// EXPECT: 19
+// EXPECT_STDERR: cache hits:      3
+// EXPECT_STDERR: cache misses:    0
+int add2(int a, int b);
+int mul2(int a, int b);
+int main() {
+  return add2(mul2(3, 4), 7);
+}
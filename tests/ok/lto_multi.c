@@ -0,0 +1,9 @@
+// ARGS: -flto -O2 tests/fixtures/multi_helper.c tests/fixtures/multi_helper2.c -I include
+// EXPECT: 25
+#include <string.h>
+int add2(int a, int b);
+int mul2(int a, int b);
+static int twice(int x) { return add2(x, x); }
+int main() {
+  return twice(mul2(3, 4)) + (int)strlen("a");
+}
@@ -0,0 +1,7 @@
+// ARGS: tests/fixtures/multi_helper.c tests/fixtures/multi_helper2.c -j 4
+// EXPECT: 19
+int add2(int a, int b);
+int mul2(int a, int b);
+int main() {
+  return add2(mul2(3, 4), 7);
+}
@@ -0,0 +1,13 @@
+// ARGS: -O3 -march=native
+// EXPECT: 128
+int main() {
+  int a[256];
+  int b[256];
+  for (int i = 0; i < 256; i++) {
+    a[i] = i;
+    b[i] = 255 - i;
+  }
+  long s = 0;
+  for (int i = 0; i < 256; i++) s += a[i] * b[i] + i;
+  return s % 256;
+}
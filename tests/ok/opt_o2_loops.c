@@ -0,0 +1,14 @@
+// ARGS: -O2
+// EXPECT: 42
+int sum(int* a, int n) {
+  int s = 0;
+  for (int i = 0; i < n; i++) s += a[i];
+  return s;
+}
+
+int main() {
+  int a[64];
+  for (int i = 0; i < 64; i++) a[i] = i;
+  int s = sum(a, 64);
+  return s - 1974;
+}
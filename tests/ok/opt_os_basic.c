@@ -0,0 +1,11 @@
+// ARGS: -Os
+// EXPECT: 10
+struct P { int x; int y; };
+
+static int dot(struct P a, struct P b) { return a.x * b.x + a.y * b.y; }
+
+int main() {
+  struct P a = {1, 2};
+  struct P b = {2, 4};
+  return dot(a, b);
+}
@@ -0,0 +1,19 @@
+#ifndef PCH_PRELUDE_H
+#define PCH_PRELUDE_H
+#include "pp_guard.h"
+
+#define SQUARE(x) ((x) * (x))
+#define BASE 40
+
+struct point {
+  int x;
+  int y;
+};
+enum color { RED, GREEN = 2, BLUE };
+typedef struct point point_t;
+typedef int (*binop)(int, int);
+
+int add(int a, int b);
+extern int counter;
+
+#endif
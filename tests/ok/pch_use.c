@@ -0,0 +1,19 @@
+// SETUP: -emit-pch ${TEST_DIR}/pch_prelude.h -o ${TMP_DIR}/pch_prelude.pch
+// ARGS: -include-pch ${TMP_DIR}/pch_prelude.pch
+// EXPECT: 47
+#include "pch_prelude.h"
+#include "pp_guard.h"
+
+int counter = 5;
+
+int add(int a, int b) { return a + b; }
+
+int main() {
+  point_t p;
+  struct guarded g;
+  binop f = add;
+  p.x = 2;
+  p.y = BLUE;
+  g.value = counter;
+  return f(BASE, SQUARE(p.x)) + p.y + g.value - counter + (GREEN - 2);
+}
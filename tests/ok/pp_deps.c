@@ -0,0 +1,25 @@
+// SETUP: -M ${TEST_DIR}/pp_deps.c -MF ${TMP_DIR}/pp_deps_scan.d
+// ARGS: -MD -MF ${TMP_DIR}/pp_deps.d -MT pp_deps
+// EXPECT: 9
+// EXPECT_FILE: ${TMP_DIR}/pp_deps_scan.d pp_deps.o: \
+// EXPECT_FILE: ${TMP_DIR}/pp_deps_scan.d ok/pp_deps.c \
+// EXPECT_FILE: ${TMP_DIR}/pp_deps_scan.d ok/pp_guard.h \
+// EXPECT_FILE: ${TMP_DIR}/pp_deps_scan.d ok/pp_once.h \
+// EXPECT_FILE: ${TMP_DIR}/pp_deps_scan.d ok/pp_inc.h
+// EXPECT_FILE: ${TMP_DIR}/pp_deps.d pp_deps: \
+// EXPECT_FILE: ${TMP_DIR}/pp_deps.d ok/pp_deps.c \
+// EXPECT_FILE: ${TMP_DIR}/pp_deps.d ok/pp_guard.h \
+// EXPECT_FILE: ${TMP_DIR}/pp_deps.d ok/pp_once.h \
+// EXPECT_FILE: ${TMP_DIR}/pp_deps.d ok/pp_inc.h
+#include "pp_guard.h"
+#include "pp_guard.h"
+#include "pp_once.h"
+#include "pp_inc.h"
+
+int main() {
+  struct guarded g;
+  struct once o;
+  g.value = 6;
+  o.value = BAR;
+  return g.value + o.value + FOO;
+}
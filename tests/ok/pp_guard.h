@@ -0,0 +1,9 @@
+// guarded header: a second inclusion would redefine the struct
+#ifndef PP_GUARD_H
+#define PP_GUARD_H
+
+struct guarded {
+  int value;
+};
+
+#endif // PP_GUARD_H
@@ -0,0 +1,15 @@
+// ARGS: -print-stats
+// EXPECT: 7
+// EXPECT_STDERR: 4 #include directives, 2 skipped (#pragma once / include guard)
+#include "pp_guard.h"
+#include "pp_once.h"
+#include "pp_guard.h"
+#include "pp_once.h"
+
+int main() {
+  struct guarded g;
+  struct once o;
+  g.value = 3;
+  o.value = 4;
+  return g.value + o.value;
+}
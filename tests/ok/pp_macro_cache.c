@@ -0,0 +1,31 @@
+// ARGS: -print-stats
+// EXPECT: 52
+// EXPECT_STDERR: 2 of 13 macro expansions from cache
+#define ONE 1
+#define TWO (ONE + ONE)
+#define ADD(a, b) ((a) + (b))
+#define CALL ADD
+#define SEL MODE
+#define MODE 1
+#define K X_
+#define LINE __LINE__
+
+int main() {
+  int X_ = 5;
+  int a = TWO + TWO;        // 4, the second TWO from the cache
+  int b = ADD(1, 2) + ADD(1, 2);
+  int c = SEL;
+  int d = K;
+  int line1 = LINE;
+  int line2 = LINE;
+#undef ONE
+#define ONE 10
+  int e = TWO;              // 20: TWO's cached expansion used ONE
+#undef MODE
+#define MODE 2
+  int f = SEL;
+#define X_ 7
+  int g = K;                // 7: X_ was looked up, though not a macro
+  int h = CALL(1, 2);       // CALL's expansion takes arguments from the line
+  return a + b + c + d + (line2 - line1) + e + f + g + h + (ADD(1, 2) == 3) + 2;
+}
@@ -0,0 +1,12 @@
+// ARGS: -fpp-profile=${TMP_DIR}/pp_macro_cache_open.json
+// EXPECT: 42
+// EXPECT_FILE: ${TMP_DIR}/pp_macro_cache_open.json "name": "INNER", "expansions": 1,
+// EXPECT_FILE: ${TMP_DIR}/pp_macro_cache_open.json "name": "F", "expansions": 1,
+// EXPECT_FILE: ${TMP_DIR}/pp_macro_cache_open.json "name": "G", "expansions": 1,
+#define INNER 40 +
+#define G(x) x
+#define F(a) INNER G
+
+int main() {
+  return F(1)(2); // F's expansion ends in G, which takes (2) from the line
+}
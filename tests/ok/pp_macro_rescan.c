@@ -0,0 +1,21 @@
+// EXPECT: 42
+int f(int a) { return a + 4; }
+#define str(s) #s
+#define CAT(a, b) a##b
+#define XCAT(a, b) CAT(a, b)
+#define ONE 1
+#define F G
+#define G(x) ((x) * 2)
+#define f(a) a + g
+#define g f(1)
+int xONE = 10;
+int y1 = 20;
+int main() {
+  int n = 0;
+  n = n + CAT(x, ONE);
+  n = n + XCAT(y, ONE);
+  n = n + F(3);
+  n = n + f(2); // 2 + f(1): f is not expanded again inside its own expansion
+  if (sizeof(str(a  +  "b")) != 8) return 1;
+  return n - 1;
+}
@@ -0,0 +1,8 @@
+#pragma once
+#pragma pack(push, 1)
+
+struct once {
+  int value;
+};
+
+#pragma pack(pop)
@@ -0,0 +1,17 @@
+// ARGS: -fpp-profile=${TMP_DIR}/pp_profile.json
+// EXPECT: 12
+// EXPECT_FILE: ${TMP_DIR}/pp_profile.json ok/pp_profile.c", "entered": 1, "skipped": 0,
+// EXPECT_FILE: ${TMP_DIR}/pp_profile.json ok/pp_guard.h", "entered": 1, "skipped": 1,
+// EXPECT_FILE: ${TMP_DIR}/pp_profile.json "name": "MUL", "expansions": 1,
+// EXPECT_FILE: ${TMP_DIR}/pp_profile.json "name": "SCALE", "expansions": 1,
+#include "pp_guard.h"
+#include "./pp_guard.h"
+
+#define SCALE 3
+#define MUL(a, b) ((a) * (b))
+
+int main() {
+  struct guarded g;
+  g.value = MUL(SCALE, 4);
+  return g.value;
+}
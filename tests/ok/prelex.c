@@ -0,0 +1,16 @@
+// ARGS: -fprelex=4
+// EXPECT: 42
+typedef int word;
+typedef struct pair { word a, b; } pair;
+enum { SEVEN = 7 };
+
+static word sum(pair p) { return p.a + p.b; }
+
+int main() {
+  pair p;
+  word w = (word)5;
+  p.a = SEVEN * 4;
+  p.b = w;
+  if (sizeof(word) != 4) return 1;
+  return sum(p) + (word)(SEVEN + 2);
+}
@@ -0,0 +1,10 @@
+// ARGS: --run -I include -- hello world
+// EXPECT: 3
+#include <string.h>
+// --run executes in-process, so the program's exit code is the compiler's;
+// the arguments after "--" are the program's, argv[0] is the source file.
+int main(int argc, char** argv) {
+  if (argc != 3) return 1;
+  if (strcmp(argv[1], "hello") != 0 || strcmp(argv[2], "world") != 0) return 2;
+  return 3;
+}
@@ -0,0 +1,19 @@
+// ARGS: --run -I include
+// EXPECT: 9
+#include <stdlib.h>
+#include <string.h>
+// The program's own abs and strlen take the place of the runtime's, as in a
+// static link, while labs and memcpy still come from the same runtime files.
+int abs(int v) { return v < 0 ? -v + 1 : v + 1; }
+
+size_t strlen(const char* s) {
+  size_t n = 0;
+  while (s[n]) n++;
+  return n * 2;
+}
+
+int main(void) {
+  char buf[4];
+  memcpy(buf, "ab", 3);
+  return abs(-2) + (int)strlen(buf) + (int)labs(-2L);
+}
@@ -0,0 +1,15 @@
+// ARGS: -O1 -ftime-report -ftime-trace=${TMP_DIR}/trace.json -ftime-trace-granularity=0 tests/fixtures/multi_helper.c
+// EXPECT: 7
+// EXPECT_STDERR: c99cc compile time report
+// EXPECT_STDERR: Phase
+// EXPECT_STDERR: Preprocess
+// EXPECT_STDERR: EmitLLVM
+// EXPECT_FILE: ${TMP_DIR}/trace.json "traceEvents"
+// EXPECT_FILE: ${TMP_DIR}/trace.json "name":"Preprocess"
+// EXPECT_FILE: ${TMP_DIR}/trace.json "name":"EmitLLVM"
+// EXPECT_FILE: ${TMP_DIR}/trace.json "name":"EmitObject"
+// EXPECT_FILE: ${TMP_DIR}/trace.json "name":"Link"
+int add2(int a, int b);
+int main() {
+  return add2(3, 4);
+}
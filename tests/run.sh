@@ -2,7 +2,7 @@
 set -euo pipefail
 
 ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
-BUILD_DIR="${ROOT_DIR}/build"
+BUILD_DIR="${1:-${ROOT_DIR}/build}"
 CC="${BUILD_DIR}/c99cc"
 
 echo "==> runner: ROOT=${ROOT_DIR}"
@@ -26,6 +26,67 @@ mkdir -p "${TMP_DIR}"
 pass=0
 fail=0
 
+# "// SETUP: <args>" runs the compiler with <args> before the test itself is
+# compiled, e.g. to build a precompiled header the test then uses.
+run_setup() {
+  local src="$1"
+  local errlog="$2"
+  local setup_line
+  setup_line="$(grep -Eo '^[[:space:]]*//[[:space:]]*SETUP:[[:space:]].+' "${src}" \
+    | head -n1 | sed -E 's/.*SETUP:[[:space:]]*//' || true)"
+  [[ -z "${setup_line}" ]] && return 0
+  setup_line="${setup_line//\$\{TMP_DIR\}/${TMP_DIR}}"
+  setup_line="${setup_line//\$\{TEST_DIR\}/$(dirname "${src}")}"
+  read -r -a setup_args <<< "${setup_line}"
+  "${CC}" "${setup_args[@]}" >/dev/null 2>"${errlog}"
+}
+
+# Every "// EXPECT_STDERR: <substring>" line of an ok test must appear in
+# what the compiler wrote to stderr (e.g. -print-stats or -fcache-stats).
+check_stderr() {
+  local src="$1"
+  local errlog="$2"
+  local needle
+  while IFS= read -r needle; do
+    if ! grep -Fq -- "${needle}" "${errlog}"; then
+      echo "  compiler stderr does not contain expected substring:"
+      echo "  '${needle}'"
+      echo "---- stderr ----"
+      cat "${errlog}"
+      return 1
+    fi
+  done < <(grep -E '^[[:space:]]*//[[:space:]]*EXPECT_STDERR:[[:space:]].+' "${src}" \
+    | sed -E 's/.*EXPECT_STDERR:[[:space:]]*//' || true)
+  return 0
+}
+
+# Every "// EXPECT_FILE: <path> <substring>" line of an ok test names a file
+# the compile must have written (${TMP_DIR} allowed) and a substring in it.
+# Runs of whitespace in the file, newlines included, count as one space, so
+# a substring can span lines of pretty-printed JSON.
+check_files() {
+  local src="$1"
+  local line path needle
+  while IFS= read -r line; do
+    line="${line//\$\{TMP_DIR\}/${TMP_DIR}}"
+    path="${line%% *}"
+    needle="${line#* }"
+    if [[ ! -f "${path}" ]]; then
+      echo "  expected file was not written: ${path}"
+      return 1
+    fi
+    if ! tr -s '[:space:]' ' ' < "${path}" | grep -Fq -- "${needle}"; then
+      echo "  ${path} does not contain expected substring:"
+      echo "  '${needle}'"
+      echo "---- ${path} ----"
+      cat "${path}"
+      return 1
+    fi
+  done < <(grep -E '^[[:space:]]*//[[:space:]]*EXPECT_FILE:[[:space:]].+' "${src}" \
+    | sed -E 's/.*EXPECT_FILE:[[:space:]]*//' || true)
+  return 0
+}
+
 run_ok() {
   local src="$1"
   local base
@@ -45,15 +106,46 @@ run_ok() {
     return
   fi
 
+  if ! run_setup "${src}" "${errlog}"; then
+    echo "FAIL(ok): ${src}"
+    echo "  setup command failed"
+    echo "---- stderr ----"
+    cat "${errlog}"
+    fail=$((fail+1))
+    return
+  fi
+
+  # with --run the program runs inside the compiler, whose exit code is the
+  # program's; ARGS then passes the program's arguments after "--"
+  local jit=0
   set +e
   if [[ -n "${args_line}" ]]; then
+    args_line="${args_line//\$\{TMP_DIR\}/${TMP_DIR}}"
     read -r -a extra_args <<< "${args_line}"
-    "${CC}" "${src}" "${extra_args[@]}" -o "${exe}" >"${outlog}" 2>"${errlog}"
+    if [[ " ${extra_args[*]} " == *" --run "* ]]; then
+      jit=1
+      "${CC}" "${src}" "${extra_args[@]}" >"${outlog}" 2>"${errlog}"
+    else
+      "${CC}" "${src}" "${extra_args[@]}" -o "${exe}" >"${outlog}" 2>"${errlog}"
+    fi
   else
     "${CC}" "${src}" -o "${exe}" >"${outlog}" 2>"${errlog}"
   fi
   local rc=$?
   set -e
+  if [[ ${jit} -eq 1 ]]; then
+    if [[ "${rc}" != "${expect}" ]]; then
+      echo "FAIL(ok): ${src}"
+      echo "  --run exit code ${rc}, expected ${expect}"
+      echo "---- stderr ----"
+      cat "${errlog}"
+      fail=$((fail+1))
+      return
+    fi
+    echo "PASS(ok): ${src}"
+    pass=$((pass+1))
+    return
+  fi
   if [[ ${rc} -ne 0 ]]; then
     echo "FAIL(ok): ${src}"
     echo "  compiler exited ${rc}, expected success"
@@ -63,6 +155,14 @@ run_ok() {
     return
   fi
 
+  if ! { check_stderr "${src}" "${errlog}" && check_files "${src}"; } \
+      >"${TMP_DIR}/${base}.check.log"; then
+    echo "FAIL(ok): ${src}"
+    cat "${TMP_DIR}/${base}.check.log"
+    fail=$((fail+1))
+    return
+  fi
+
   set +e
   "${exe}" >"${outlog}" 2>"${errlog}"
   local run_rc=$?
@@ -98,8 +198,18 @@ run_err() {
     return
   fi
 
+  if ! run_setup "${src}" "${errlog}"; then
+    echo "FAIL(err): ${src}"
+    echo "  setup command failed"
+    echo "---- stderr ----"
+    cat "${errlog}"
+    fail=$((fail+1))
+    return
+  fi
+
   set +e
   if [[ -n "${args_line}" ]]; then
+    args_line="${args_line//\$\{TMP_DIR\}/${TMP_DIR}}"
     read -r -a extra_args <<< "${args_line}"
     "${CC}" "${src}" "${extra_args[@]}" -o "${exe}" >"${outlog}" 2>"${errlog}"
   else
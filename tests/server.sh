@@ -0,0 +1,66 @@
+#!/usr/bin/env bash
+# Drives the compile server: starts `c99cc --server=<socket>`, compiles through
+# it with C99CC_SERVER set, and checks that a client which connects and sends
+# nothing does not hold up the next one.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+BUILD_DIR="$(cd "${1:-${ROOT_DIR}/build}" && pwd)"
+CC="${BUILD_DIR}/c99cc"
+
+TMP_DIR="$(mktemp -d "${TMPDIR:-/tmp}/c99cc_server.XXXXXX")"
+SOCK="${TMP_DIR}/server.sock"
+server_pid=""
+idle_pid=""
+
+cleanup() {
+  [[ -n "${idle_pid}" ]] && kill "${idle_pid}" 2>/dev/null || true
+  if [[ -n "${server_pid}" ]]; then
+    kill -TERM "${server_pid}" 2>/dev/null || true
+    wait "${server_pid}" 2>/dev/null || true
+  fi
+  rm -rf "${TMP_DIR}"
+}
+trap cleanup EXIT
+
+fail() {
+  echo "FAIL(server): $*"
+  [[ -f "${TMP_DIR}/server.log" ]] && cat "${TMP_DIR}/server.log"
+  exit 1
+}
+
+"${CC}" "--server=${SOCK}" 2>"${TMP_DIR}/server.log" &
+server_pid=$!
+for _ in $(seq 1 100); do
+  [[ -S "${SOCK}" ]] && break
+  sleep 0.1
+done
+[[ -S "${SOCK}" ]] || fail "server did not create ${SOCK}"
+
+mode="$(stat -c '%a' "${SOCK}" 2>/dev/null || stat -f '%Lp' "${SOCK}")"
+[[ "${mode}" == "600" ]] || fail "socket mode ${mode}, expected 600"
+
+# connects and never sends a request
+if command -v python3 >/dev/null; then
+  python3 -c 'import socket, sys, time
+s = socket.socket(socket.AF_UNIX); s.connect(sys.argv[1]); time.sleep(120)' "${SOCK}" &
+  idle_pid=$!
+  sleep 0.2
+fi
+
+cat > "${TMP_DIR}/main.c" <<'EOF'
+int main() {
+  int x = 40;
+  return x + 2;
+}
+EOF
+
+(cd "${TMP_DIR}" && C99CC_SERVER="${SOCK}" timeout 30 "${CC}" main.c -o main.out) \
+  || fail "compile through the server failed"
+set +e
+"${TMP_DIR}/main.out"
+rc=$?
+set -e
+[[ ${rc} -eq 42 ]] || fail "exit code ${rc}, expected 42"
+
+echo "PASS(server): compiled through ${SOCK}"
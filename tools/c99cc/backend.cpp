@@ -0,0 +1,271 @@
+#include "backend.h"
+
+#include <cstdlib>
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/StandardInstrumentations.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+
+#include "../../src/timing.h"
+
+namespace c99cc {
+
+namespace {
+
+enum class Pipeline { PerModule, PreLink, PostLink };
+
+llvm::OptimizationLevel passBuilderOptLevel(const CodeGenOptions& opts) {
+  if (opts.sizeLevel == 1) return llvm::OptimizationLevel::Os;
+  if (opts.sizeLevel == 2) return llvm::OptimizationLevel::Oz;
+  switch (opts.optLevel) {
+    case 0: return llvm::OptimizationLevel::O0;
+    case 1: return llvm::OptimizationLevel::O1;
+    case 3: return llvm::OptimizationLevel::O3;
+    default: return llvm::OptimizationLevel::O2;
+  }
+}
+
+// Also applied to runtime functions merged in by -flto, so the inliner sees one
+// consistent target for the whole program.
+void setTargetAttrs(llvm::Module& module, const CodeGenOptions& opts) {
+  for (auto& fn : module) {
+    if (fn.isDeclaration()) continue;
+    fn.addFnAttr("target-cpu", opts.cpu);
+    if (!opts.features.empty()) {
+      fn.addFnAttr("target-features", opts.features);
+    } else {
+      fn.removeFnAttr("target-features");
+    }
+  }
+}
+
+void prepareModule(
+    llvm::Module& module, const CodeGenOptions& opts, const std::string& triple,
+    llvm::TargetMachine& tm) {
+  module.setTargetTriple(triple);
+  module.setDataLayout(tm.createDataLayout());
+  setTargetAttrs(module, opts);
+}
+
+void optimizeModule(
+    llvm::Module& module, llvm::TargetMachine& tm, const CodeGenOptions& opts,
+    Pipeline pipeline) {
+  if (pipeline != Pipeline::PostLink) {
+    // record the level in .comment so objects can be told apart after the fact
+    llvm::NamedMDNode* ident = module.getOrInsertNamedMetadata("llvm.ident");
+    llvm::LLVMContext& ctx = module.getContext();
+    ident->addOperand(llvm::MDNode::get(
+        ctx, llvm::MDString::get(ctx, "c99cc " + optLevelName(opts))));
+  }
+
+  if (opts.optLevel == 0) return;
+  TimeScope scope("Optimize", module.getModuleIdentifier());
+
+  for (auto& fn : module) {
+    if (fn.isDeclaration()) continue;
+    if (opts.sizeLevel >= 1) fn.addFnAttr(llvm::Attribute::OptimizeForSize);
+    if (opts.sizeLevel >= 2) fn.addFnAttr(llvm::Attribute::MinSize);
+  }
+
+  llvm::PipelineTuningOptions pto;
+  pto.LoopVectorization = opts.optLevel >= 2 && opts.sizeLevel < 2;
+  pto.SLPVectorization = opts.optLevel >= 2 && opts.sizeLevel < 2;
+  pto.LoopUnrolling = opts.sizeLevel == 0;
+
+  llvm::LoopAnalysisManager lam;
+  llvm::FunctionAnalysisManager fam;
+  llvm::CGSCCAnalysisManager cgam;
+  llvm::ModuleAnalysisManager mam;
+
+  // with -ftime-trace every pass gets its own trace event
+  llvm::PassInstrumentationCallbacks pic;
+  llvm::StandardInstrumentations si(/*DebugLogging=*/false);
+  bool tracePasses = llvm::timeTraceProfilerEnabled();
+  if (tracePasses) si.registerCallbacks(pic, &fam);
+
+  llvm::PassBuilder pb(&tm, pto, llvm::None, tracePasses ? &pic : nullptr);
+  pb.registerModuleAnalyses(mam);
+  pb.registerCGSCCAnalyses(cgam);
+  pb.registerFunctionAnalyses(fam);
+  pb.registerLoopAnalyses(lam);
+  pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+  llvm::OptimizationLevel level = passBuilderOptLevel(opts);
+  llvm::ModulePassManager mpm;
+  switch (pipeline) {
+    case Pipeline::PerModule: mpm = pb.buildPerModuleDefaultPipeline(level); break;
+    case Pipeline::PreLink: mpm = pb.buildLTOPreLinkDefaultPipeline(level); break;
+    case Pipeline::PostLink: mpm = pb.buildLTODefaultPipeline(level, nullptr); break;
+  }
+  mpm.run(module, mam);
+}
+
+void emitNativeObjectOrDie(
+    llvm::Module& module, llvm::TargetMachine& tm, llvm::SmallVectorImpl<char>& out) {
+  TimeScope scope("EmitObject", module.getModuleIdentifier());
+  llvm::raw_svector_ostream dest(out);
+  llvm::legacy::PassManager pm;
+  if (tm.addPassesToEmitFile(pm, dest, nullptr, llvm::CGFT_ObjectFile)) {
+    llvm::errs() << "TargetMachine can't emit a file of this type\n";
+    std::exit(1);
+  }
+  pm.run(module);
+}
+
+} // namespace
+
+std::string optLevelName(const CodeGenOptions& opts) {
+  if (opts.sizeLevel == 1) return "-Os";
+  if (opts.sizeLevel == 2) return "-Oz";
+  return "-O" + std::to_string(opts.optLevel);
+}
+
+llvm::CodeGenOpt::Level codeGenOptLevel(const CodeGenOptions& opts) {
+  switch (opts.optLevel) {
+    case 0: return llvm::CodeGenOpt::None;
+    case 1: return llvm::CodeGenOpt::Less;
+    case 3: return llvm::CodeGenOpt::Aggressive;
+    default: return llvm::CodeGenOpt::Default;
+  }
+}
+
+TargetMachinePool::TargetMachinePool(const CodeGenOptions& opts) : opts_(opts) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  llvm::InitializeNativeTargetAsmParser();
+
+  triple_ = llvm::sys::getDefaultTargetTriple();
+  std::string err;
+  target_ = llvm::TargetRegistry::lookupTarget(triple_, err);
+  if (!target_) {
+    llvm::errs() << "Target lookup failed: " << err << "\n";
+    std::exit(1);
+  }
+}
+
+TargetMachinePool::~TargetMachinePool() = default;
+
+std::unique_ptr<llvm::TargetMachine> TargetMachinePool::acquire() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!free_.empty()) {
+      auto tm = std::move(free_.back());
+      free_.pop_back();
+      return tm;
+    }
+  }
+  llvm::TargetOptions opt;
+  llvm::Optional<llvm::Reloc::Model> rm;
+  return std::unique_ptr<llvm::TargetMachine>(target_->createTargetMachine(
+      triple_, opts_.cpu, opts_.features, opt, rm, llvm::None, codeGenOptLevel(opts_)));
+}
+
+void TargetMachinePool::release(std::unique_ptr<llvm::TargetMachine> tm) {
+  std::lock_guard<std::mutex> lock(mu_);
+  free_.push_back(std::move(tm));
+}
+
+void TargetMachinePool::prewarm() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!free_.empty()) return;
+  }
+  release(acquire());
+}
+
+void emitObjectOrDie(
+    llvm::Module& module, const CodeGenOptions& opts, TargetMachinePool& tms,
+    llvm::SmallVectorImpl<char>& out) {
+  std::unique_ptr<llvm::TargetMachine> tm = tms.acquire();
+  prepareModule(module, opts, tms.triple(), *tm);
+  if (opts.lto) {
+    optimizeModule(module, *tm, opts, Pipeline::PreLink);
+    TimeScope scope("WriteBitcode", module.getModuleIdentifier());
+    llvm::raw_svector_ostream dest(out);
+    llvm::WriteBitcodeToFile(module, dest);
+  } else {
+    optimizeModule(module, *tm, opts, Pipeline::PerModule);
+    emitNativeObjectOrDie(module, *tm, out);
+  }
+  tms.release(std::move(tm));
+}
+
+void optimizeForJIT(llvm::Module& module, const CodeGenOptions& opts, TargetMachinePool& tms) {
+  std::unique_ptr<llvm::TargetMachine> tm = tms.acquire();
+  prepareModule(module, opts, tms.triple(), *tm);
+  optimizeModule(module, *tm, opts, Pipeline::PerModule);
+  tms.release(std::move(tm));
+}
+
+bool linkTimeOptimize(
+    const std::vector<llvm::ArrayRef<char>>& bitcode,
+    const std::string& runtimeBitcode,
+    const CodeGenOptions& opts,
+    TargetMachinePool& tms,
+    llvm::SmallVectorImpl<char>& out) {
+  TimeScope scope("LTO");
+  llvm::LLVMContext ctx;
+  std::unique_ptr<llvm::TargetMachine> tm = tms.acquire();
+  auto merged = std::make_unique<llvm::Module>("c99cc-lto", ctx);
+  merged->setTargetTriple(tms.triple());
+  merged->setDataLayout(tm->createDataLayout());
+
+  llvm::Linker linker(*merged);
+  for (size_t i = 0; i < bitcode.size(); i++) {
+    llvm::StringRef data(bitcode[i].data(), bitcode[i].size());
+    auto mod = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(data, "<tu " + std::to_string(i) + ">"), ctx);
+    if (!mod) {
+      llvm::errs() << "error: " << llvm::toString(mod.takeError()) << "\n";
+      return false;
+    }
+    // conflicts are reported through the context's diagnostic handler
+    if (linker.linkInModule(std::move(*mod))) return false;
+  }
+
+  // Only the runtime functions the program actually reaches are pulled in. If
+  // the runtime bitcode can't be read the archive still provides them, just
+  // without cross-module inlining.
+  if (!runtimeBitcode.empty()) {
+    auto buf = llvm::MemoryBuffer::getFile(runtimeBitcode);
+    if (!buf) {
+      llvm::errs() << "warning: " << runtimeBitcode << ": " << buf.getError().message()
+                   << "\n";
+    } else if (auto mod = llvm::parseBitcodeFile((*buf)->getMemBufferRef(), ctx)) {
+      if (linker.linkInModule(std::move(*mod), llvm::Linker::Flags::LinkOnlyNeeded)) {
+        return false;
+      }
+    } else {
+      llvm::errs() << "warning: " << runtimeBitcode << ": "
+                   << llvm::toString(mod.takeError()) << "\n";
+    }
+  }
+
+  llvm::internalizeModule(*merged, [](const llvm::GlobalValue& gv) {
+    return gv.getName() == "main";
+  });
+
+  setTargetAttrs(*merged, opts);
+  optimizeModule(*merged, *tm, opts, Pipeline::PostLink);
+  emitNativeObjectOrDie(*merged, *tm, out);
+  tms.release(std::move(tm));
+  return true;
+}
+
+} // namespace c99cc
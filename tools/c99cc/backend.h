@@ -0,0 +1,72 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/CodeGen.h"
+
+namespace llvm {
+class Module;
+class Target;
+class TargetMachine;
+}
+
+namespace c99cc {
+
+struct CodeGenOptions {
+  unsigned optLevel = 0;  // -O0 .. -O3
+  unsigned sizeLevel = 0; // 1 == -Os, 2 == -Oz
+  std::string cpu = "generic";
+  std::string features;   // comma separated, e.g. "+avx2,-sse4a"
+  bool lto = false;       // -flto: per-TU output is bitcode, optimized again after merging
+};
+
+std::string optLevelName(const CodeGenOptions& opts);
+llvm::CodeGenOpt::Level codeGenOptLevel(const CodeGenOptions& opts);
+
+// Target registration and lookup happen once per invocation. TargetMachines are
+// not safe to use from several threads at once, so every worker borrows one from
+// this pool and hands it back; at most one machine per worker is ever created.
+class TargetMachinePool {
+public:
+  explicit TargetMachinePool(const CodeGenOptions& opts);
+  ~TargetMachinePool();
+
+  const std::string& triple() const { return triple_; }
+
+  std::unique_ptr<llvm::TargetMachine> acquire();
+  void release(std::unique_ptr<llvm::TargetMachine> tm);
+  // Makes sure one machine is ready before the first acquire().
+  void prewarm();
+
+private:
+  CodeGenOptions opts_;
+  std::string triple_;
+  const llvm::Target* target_ = nullptr;
+  std::mutex mu_;
+  std::vector<std::unique_ptr<llvm::TargetMachine>> free_;
+};
+
+// Optimizes one translation unit and emits a native object, or with -flto the
+// pre-link optimized bitcode.
+void emitObjectOrDie(
+    llvm::Module& module, const CodeGenOptions& opts, TargetMachinePool& tms,
+    llvm::SmallVectorImpl<char>& out);
+
+// --run: target setup and the per-module pipeline only; the JIT emits the code.
+void optimizeForJIT(llvm::Module& module, const CodeGenOptions& opts, TargetMachinePool& tms);
+
+// -flto: merges per-TU bitcode (plus the runtime bitcode, when a path is given)
+// into one module, internalizes everything but main, optimizes the whole
+// program and emits a single object.
+bool linkTimeOptimize(
+    const std::vector<llvm::ArrayRef<char>>& bitcode,
+    const std::string& runtimeBitcode,
+    const CodeGenOptions& opts,
+    TargetMachinePool& tms,
+    llvm::SmallVectorImpl<char>& out);
+
+} // namespace c99cc
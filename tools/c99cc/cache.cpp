@@ -0,0 +1,132 @@
+#include "cache.h"
+
+#include <ostream>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Object/SymbolicFile.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "backend.h"
+
+namespace c99cc {
+
+ObjectCache::ObjectCache(
+    std::string dir, const std::string& compilerId, const std::string& triple,
+    const CodeGenOptions& opts)
+    : dir_(std::move(dir)) {
+  // bump the leading tag whenever the entry format or key layout changes
+  config_ = "c99cc-cache-1\n" + compilerId + "\n" + triple + "\n" + opts.cpu + "\n" +
+            opts.features + "\n" + optLevelName(opts) + (opts.lto ? " -flto" : "") + "\n";
+}
+
+void ObjectCache::addInput(llvm::StringRef label, llvm::StringRef contents) {
+  config_ += label.str() + " " +
+             llvm::toHex(llvm::SHA1::hash(llvm::arrayRefFromStringRef(contents)), true) + "\n";
+}
+
+std::string ObjectCache::key(const std::string& inputPath, const std::string& preprocessed) const {
+  llvm::SHA1 sha;
+  sha.update(config_);
+  // the input path ends up in the object as the source file name
+  sha.update(inputPath);
+  sha.update(llvm::StringRef("\0", 1));
+  sha.update(preprocessed);
+  return llvm::toHex(sha.final(), /*LowerCase=*/true);
+}
+
+std::string ObjectCache::entryPath(const std::string& key) const {
+  llvm::SmallString<256> path(dir_);
+  llvm::sys::path::append(path, key.substr(0, 2), key.substr(2) + ".o");
+  return path.str().str();
+}
+
+bool ObjectCache::lookup(const std::string& key, llvm::SmallVectorImpl<char>& out) {
+  auto buf = llvm::MemoryBuffer::getFile(entryPath(key), /*IsText=*/false,
+                                         /*RequiresNullTerminator=*/false);
+  if (!buf) {
+    misses_++;
+    return false;
+  }
+  llvm::StringRef data = (*buf)->getBuffer();
+  out.assign(data.begin(), data.end());
+  hits_++;
+  bytesRead_ += data.size();
+  return true;
+}
+
+void ObjectCache::store(const std::string& key, llvm::ArrayRef<char> data) {
+  std::string path = entryPath(key);
+  if (llvm::sys::fs::create_directories(llvm::sys::path::parent_path(path))) return;
+
+  // write under a unique name and rename into place, so concurrent compilers
+  // never see a partially written entry
+  int fd = -1;
+  llvm::SmallString<256> tmp;
+  if (llvm::sys::fs::createUniqueFile(path + ".tmp-%%%%%%", fd, tmp)) return;
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    os.write(data.data(), data.size());
+    os.close();
+    if (os.has_error()) {
+      os.clear_error();
+      llvm::sys::fs::remove(tmp);
+      return;
+    }
+  }
+  if (llvm::sys::fs::rename(tmp, path)) {
+    llvm::sys::fs::remove(tmp);
+    return;
+  }
+  bytesWritten_ += data.size();
+}
+
+void ObjectCache::printStats(std::ostream& os) const {
+  uint64_t files = 0;
+  uint64_t bytes = 0;
+  std::error_code ec;
+  for (llvm::sys::fs::recursive_directory_iterator it(dir_, ec), end; it != end && !ec;
+       it.increment(ec)) {
+    llvm::sys::fs::file_status st;
+    if (llvm::sys::fs::status(it->path(), st) || st.type() != llvm::sys::fs::file_type::regular_file) {
+      continue;
+    }
+    files++;
+    bytes += st.getSize();
+  }
+  os << "cache directory: " << dir_ << "\n"
+     << "cache hits:      " << hits_ << "\n"
+     << "cache misses:    " << misses_ << "\n"
+     << "bytes read:      " << bytesRead_ << "\n"
+     << "bytes written:   " << bytesWritten_ << "\n"
+     << "cache size:      " << files << " files, " << bytes << " bytes\n";
+}
+
+bool objectMentionsMain(llvm::ArrayRef<char> data) {
+  llvm::LLVMContext ctx; // only needed to read the symbol table of bitcode
+  llvm::MemoryBufferRef buf(llvm::StringRef(data.data(), data.size()), "<cached object>");
+  auto file = llvm::object::SymbolicFile::createSymbolicFile(
+      buf, llvm::file_magic::unknown, &ctx);
+  if (!file) {
+    llvm::consumeError(file.takeError());
+    return false;
+  }
+  for (const auto& sym : (*file)->symbols()) {
+    std::string name;
+    llvm::raw_string_ostream nameOs(name);
+    if (llvm::Error err = sym.printName(nameOs)) {
+      llvm::consumeError(std::move(err));
+      continue;
+    }
+    if (nameOs.str() == "main") return true;
+  }
+  return false;
+}
+
+} // namespace c99cc
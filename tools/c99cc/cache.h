@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace c99cc {
+
+struct CodeGenOptions;
+
+// On-disk, content-addressed object cache. An entry is keyed by the SHA-1 of
+// the preprocessed source plus everything else that can change the emitted
+// object: compiler build, target triple/CPU/features and codegen options.
+// Entries are plain object files (bitcode with -flto) under <dir>/xx/<hash>.o.
+class ObjectCache {
+public:
+  ObjectCache(std::string dir, const std::string& compilerId,
+              const std::string& triple, const CodeGenOptions& opts);
+
+  // Folds an input every TU depends on besides its own source, such as a
+  // precompiled header, into all keys.
+  void addInput(llvm::StringRef label, llvm::StringRef contents);
+  std::string key(const std::string& inputPath, const std::string& preprocessed) const;
+
+  bool lookup(const std::string& key, llvm::SmallVectorImpl<char>& out);
+  // Best effort: a failure to store only costs a later miss.
+  void store(const std::string& key, llvm::ArrayRef<char> data);
+
+  void printStats(std::ostream& os) const;
+
+private:
+  std::string entryPath(const std::string& key) const;
+
+  std::string dir_;
+  std::string config_; // hashed into every key
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> bytesRead_{0};
+  std::atomic<uint64_t> bytesWritten_{0};
+};
+
+// Whether an object (or -flto bitcode) file defines or references `main`;
+// used on a cache hit in place of looking at the AST.
+bool objectMentionsMain(llvm::ArrayRef<char> data);
+
+} // namespace c99cc
@@ -0,0 +1,165 @@
+#include "jit.h"
+
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/Orc/TargetProcess/TargetExecutionUtils.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "backend.h"
+#include "../../src/timing.h"
+
+namespace c99cc {
+
+namespace {
+
+// perf picks up symbols for anonymous executable memory from
+// /tmp/perf-<pid>.map, one "<start> <size> <name>" line (hex) per function.
+class PerfMapListener : public llvm::JITEventListener {
+public:
+  PerfMapListener() {
+    std::string path = "/tmp/perf-" + std::to_string(llvm::sys::Process::getProcessId()) + ".map";
+    file_ = std::fopen(path.c_str(), "a");
+    if (!file_) std::cerr << "warning: cannot write perf map " << path << "\n";
+  }
+  ~PerfMapListener() override {
+    if (file_) std::fclose(file_);
+  }
+
+  void notifyObjectLoaded(
+      ObjectKey, const llvm::object::ObjectFile& obj,
+      const llvm::RuntimeDyld::LoadedObjectInfo& info) override {
+    if (!file_) return;
+    // the debug copy has its sections relocated to their load addresses
+    llvm::object::OwningBinary<llvm::object::ObjectFile> debugObj = info.getObjectForDebug(obj);
+    const llvm::object::ObjectFile* loaded = debugObj.getBinary() ? debugObj.getBinary() : &obj;
+
+    std::lock_guard<std::mutex> lock(mu_);
+    for (const auto& entry : llvm::object::computeSymbolSizes(*loaded)) {
+      const llvm::object::SymbolRef& sym = entry.first;
+      auto type = sym.getType();
+      auto name = sym.getName();
+      auto addr = sym.getAddress();
+      if (!type || !name || !addr) {
+        if (!type) llvm::consumeError(type.takeError());
+        if (!name) llvm::consumeError(name.takeError());
+        if (!addr) llvm::consumeError(addr.takeError());
+        continue;
+      }
+      if (*type != llvm::object::SymbolRef::ST_Function || entry.second == 0) continue;
+      std::fprintf(file_, "%llx %llx %s\n", static_cast<unsigned long long>(*addr),
+                   static_cast<unsigned long long>(entry.second), name->str().c_str());
+    }
+    std::fflush(file_);
+  }
+
+private:
+  std::FILE* file_ = nullptr;
+  std::mutex mu_;
+};
+
+bool reportError(llvm::Error err) {
+  if (!err) return true;
+  llvm::errs() << "error: " << llvm::toString(std::move(err)) << "\n";
+  return false;
+}
+
+} // namespace
+
+bool runJIT(
+    std::vector<llvm::orc::ThreadSafeModule> modules,
+    const CodeGenOptions& opts,
+    const JITRunOptions& run,
+    int& exitCode) {
+  TimeScope scope("JIT");
+  llvm::orc::JITTargetMachineBuilder jtmb((llvm::Triple(llvm::sys::getProcessTriple())));
+  jtmb.setCPU(opts.cpu);
+  jtmb.setFeatures(opts.features);
+  jtmb.setCodeGenOptLevel(codeGenOptLevel(opts));
+
+  std::unique_ptr<PerfMapListener> perfMap;
+  if (run.perfMap) perfMap = std::make_unique<PerfMapListener>();
+
+  auto jit = llvm::orc::LLJITBuilder()
+      .setJITTargetMachineBuilder(std::move(jtmb))
+      .setObjectLinkingLayerCreator(
+          [&](llvm::orc::ExecutionSession& es, const llvm::Triple&) {
+            auto layer = std::make_unique<llvm::orc::RTDyldObjectLinkingLayer>(
+                es, [] { return std::make_unique<llvm::SectionMemoryManager>(); });
+            if (perfMap) layer->registerJITEventListener(*perfMap);
+            return llvm::Expected<std::unique_ptr<llvm::orc::ObjectLayer>>(std::move(layer));
+          })
+      .create();
+  if (!jit) return reportError(jit.takeError());
+
+  llvm::orc::JITDylib& dylib = (*jit)->getMainJITDylib();
+  for (auto& module : modules) {
+    if (!reportError((*jit)->addIRModule(std::move(module)))) return false;
+  }
+
+  // The runtime gets a JITDylib of its own, searched after the program's, so
+  // a program may define its own strlen/abs/... as in a static link, where
+  // the archive only fills in what is still undefined. Its printf/malloc/...
+  // still win over the host libc, which (open, write, mmap, ...) comes last.
+  auto runtime = (*jit)->createJITDylib("c99rt");
+  if (!runtime) return reportError(runtime.takeError());
+  bool haveRuntime = false;
+  if (!run.runtimeBitcode.empty()) {
+    auto ctx = std::make_unique<llvm::LLVMContext>();
+    auto buf = llvm::MemoryBuffer::getFile(run.runtimeBitcode);
+    if (buf) {
+      auto mod = llvm::parseBitcodeFile((*buf)->getMemBufferRef(), *ctx);
+      if (mod) {
+        if (!reportError((*jit)->addIRModule(
+                *runtime, llvm::orc::ThreadSafeModule(std::move(*mod), std::move(ctx))))) {
+          return false;
+        }
+        haveRuntime = true;
+      } else {
+        llvm::consumeError(mod.takeError());
+      }
+    }
+  }
+  if (!haveRuntime) {
+    auto archive = llvm::orc::StaticLibraryDefinitionGenerator::Load(
+        (*jit)->getObjLinkingLayer(), run.runtimeArchive.c_str());
+    if (!archive) return reportError(archive.takeError());
+    runtime->addGenerator(std::move(*archive));
+  }
+  auto process = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      (*jit)->getDataLayout().getGlobalPrefix());
+  if (!process) return reportError(process.takeError());
+  runtime->addGenerator(std::move(*process));
+  dylib.addToLinkOrder(*runtime);
+  // the platform's support symbols (atexit, __dso_handle) live in main
+  runtime->addToLinkOrder(dylib);
+
+  auto mainSym = (*jit)->lookup("main");
+  if (!mainSym) return reportError(mainSym.takeError());
+  if (!reportError((*jit)->initialize(dylib))) return false;
+
+  using MainFn = int (*)(int, char**);
+  auto* mainFn = reinterpret_cast<MainFn>(static_cast<uintptr_t>(mainSym->getAddress()));
+  llvm::ArrayRef<std::string> args(run.args);
+  exitCode = llvm::orc::runAsMain(mainFn, args.drop_front(), llvm::StringRef(args.front()));
+
+  std::fflush(nullptr);
+  return reportError((*jit)->deinitialize(dylib));
+}
+
+} // namespace c99cc
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+
+namespace c99cc {
+
+struct CodeGenOptions;
+
+struct JITRunOptions {
+  std::string runtimeBitcode; // preferred when non-empty
+  std::string runtimeArchive; // objects are loaded from here on demand otherwise
+  std::vector<std::string> args; // argv for the program, argv[0] included
+  bool perfMap = false; // write /tmp/perf-<pid>.map for the JIT'd functions
+};
+
+// --run: adds the (already optimized) modules to an ORC LLJIT, resolves main
+// and runs it in this process. Returns false if the program could not be
+// materialized; `exitCode` is main's return value otherwise.
+bool runJIT(
+    std::vector<llvm::orc::ThreadSafeModule> modules,
+    const CodeGenOptions& opts,
+    const JITRunOptions& run,
+    int& exitCode);
+
+} // namespace c99cc
@@ -0,0 +1,185 @@
+#include "linker.h"
+
+#include <iostream>
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef C99CC_HAVE_LLD
+#include "lld/Common/Driver.h"
+#endif
+
+namespace c99cc {
+
+namespace {
+
+// Objects only exist in memory; the linker still wants paths. On Linux each
+// object becomes an anonymous memfd reachable as /proc/self/fd/N (inherited by
+// a spawned driver and its linker), so nothing touches the file system.
+// Elsewhere the buffers are written to temp files that are removed afterwards.
+class LinkerInputs {
+public:
+  LinkerInputs() = default;
+  LinkerInputs(const LinkerInputs&) = delete;
+  LinkerInputs& operator=(const LinkerInputs&) = delete;
+
+  ~LinkerInputs() {
+#ifdef __linux__
+    for (int fd : fds_) ::close(fd);
+#endif
+    for (const auto& path : tempFiles_) llvm::sys::fs::remove(path);
+  }
+
+  bool add(llvm::ArrayRef<char> data) {
+#ifdef __linux__
+    int fd = ::memfd_create("c99cc-obj", 0);
+    if (fd >= 0) {
+      fds_.push_back(fd);
+      if (writeAll(fd, data)) {
+        paths_.push_back("/proc/self/fd/" + std::to_string(fd));
+        return true;
+      }
+      return false;
+    }
+#endif
+    llvm::SmallString<128> tmp;
+    int tmpFd = -1;
+    if (llvm::sys::fs::createTemporaryFile("c99cc", "o", tmpFd, tmp)) return false;
+    tempFiles_.push_back(tmp.str().str());
+    llvm::raw_fd_ostream os(tmpFd, /*shouldClose=*/true);
+    os.write(data.data(), data.size());
+    os.close();
+    if (os.has_error()) {
+      os.clear_error();
+      return false;
+    }
+    paths_.push_back(tmp.str().str());
+    return true;
+  }
+
+  const std::vector<std::string>& paths() const { return paths_; }
+
+private:
+#ifdef __linux__
+  static bool writeAll(int fd, llvm::ArrayRef<char> data) {
+    size_t done = 0;
+    while (done < data.size()) {
+      ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+      if (n <= 0) return false;
+      done += static_cast<size_t>(n);
+    }
+    return true;
+  }
+  std::vector<int> fds_;
+#endif
+  std::vector<std::string> paths_;
+  std::vector<std::string> tempFiles_;
+};
+
+#ifdef C99CC_HAVE_LLD
+// C99CC_LLD_* are probed from the host C compiler at configure time; the lists
+// are '|' separated.
+static void splitList(llvm::StringRef list, std::vector<std::string>& out) {
+  llvm::SmallVector<llvm::StringRef, 8> parts;
+  list.split(parts, '|', -1, /*KeepEmpty=*/false);
+  for (auto p : parts) out.push_back(p.str());
+}
+
+static bool linkInProcess(
+    const std::vector<std::string>& inputs,
+    const std::string& runtimeArchive,
+    const std::string& outPath) {
+  std::vector<std::string> pre;
+  std::vector<std::string> post;
+  std::vector<std::string> libDirs;
+  splitList(C99CC_LLD_PRE_OBJS, pre);
+  splitList(C99CC_LLD_POST_OBJS, post);
+  splitList(C99CC_LLD_LIB_DIRS, libDirs);
+
+  std::vector<std::string> storage;
+  storage.push_back("ld.lld");
+  storage.push_back("--eh-frame-hdr");
+  storage.push_back("-dynamic-linker");
+  storage.push_back(C99CC_LLD_DYNAMIC_LINKER);
+  storage.push_back("-o");
+  storage.push_back(outPath);
+  for (const auto& o : pre) storage.push_back(o);
+  for (const auto& in : inputs) storage.push_back(in);
+  storage.push_back(runtimeArchive);
+  for (const auto& dir : libDirs) storage.push_back("-L" + dir);
+  storage.push_back("-lc");
+  for (const auto& o : post) storage.push_back(o);
+
+  std::vector<const char*> args;
+  args.reserve(storage.size());
+  for (const auto& a : storage) args.push_back(a.c_str());
+
+  std::string errText;
+  llvm::raw_string_ostream errOS(errText);
+  bool ok = lld::elf::link(args, llvm::outs(), errOS, /*exitEarly=*/false,
+                           /*disableOutput=*/false);
+  errOS.flush();
+  if (!ok) std::cerr << errText << "link failed (in-process lld)\n";
+  return ok;
+}
+#endif
+
+static bool linkWithDriver(
+    const std::vector<std::string>& inputs,
+    const std::string& runtimeArchive,
+    const std::string& outPath) {
+  auto clang = llvm::sys::findProgramByName("clang");
+  if (!clang) {
+    std::cerr << "link failed: clang not found in PATH\n";
+    return false;
+  }
+  std::vector<llvm::StringRef> args;
+  args.push_back("clang");
+  for (const auto& in : inputs) args.push_back(in);
+  args.push_back(runtimeArchive);
+  args.push_back("-o");
+  args.push_back(outPath);
+
+  std::string errMsg;
+  int rc = llvm::sys::ExecuteAndWait(*clang, args, llvm::None, {}, 0, 0, &errMsg);
+  if (rc != 0) {
+    std::string cmd;
+    for (auto a : args) cmd += (cmd.empty() ? "" : " ") + a.str();
+    std::cerr << "link failed (cmd=" << cmd << ")";
+    if (!errMsg.empty()) std::cerr << ": " << errMsg;
+    std::cerr << "\n";
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+bool linkExecutable(
+    const std::vector<llvm::ArrayRef<char>>& objects,
+    const std::string& runtimeArchive,
+    const std::string& outPath) {
+  LinkerInputs inputs;
+  for (const auto& obj : objects) {
+    if (!inputs.add(obj)) {
+      std::cerr << "link failed: could not stage object for the linker\n";
+      return false;
+    }
+  }
+#ifdef C99CC_HAVE_LLD
+  return linkInProcess(inputs.paths(), runtimeArchive, outPath);
+#else
+  return linkWithDriver(inputs.paths(), runtimeArchive, outPath);
+#endif
+}
+
+} // namespace c99cc
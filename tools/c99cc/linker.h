@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+
+namespace c99cc {
+
+// Links in-memory object files plus the runtime archive into an executable.
+// With lld available the link runs inside this process; otherwise the clang
+// driver is spawned directly (no shell).
+bool linkExecutable(
+    const std::vector<llvm::ArrayRef<char>>& objects,
+    const std::string& runtimeArchive,
+    const std::string& outPath);
+
+} // namespace c99cc
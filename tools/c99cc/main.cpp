@@ -1,21 +1,36 @@
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <cstdlib>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
 
+#include <unistd.h>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Object/Archive.h"
+#include "llvm/Object/ArchiveWriter.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/TimeProfiler.h"
 #include "llvm/Support/raw_ostream.h"
-#include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/Host.h"
-
-#include "llvm/Target/TargetMachine.h"
-#include "llvm/Target/TargetOptions.h"
-#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/xxhash.h"
 
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
-#include "llvm/IR/LegacyPassManager.h"
 
 #include "../../src/diag.h"
 #include "../../src/preprocessor.h"
@@ -23,56 +38,87 @@
 #include "../../src/parser.h"
 #include "../../src/sema.h"
 #include "../../src/codegen.h"
+#include "../../src/file_manager.h"
+#include "../../src/pch.h"
+#include "../../src/timing.h"
+#include "../../src/token_buffer.h"
 
-static std::string readFileOrDie(const std::string& path) {
-  std::ifstream ifs(path);
-  if (!ifs) {
-    std::cerr << "failed to open: " << path << "\n";
-    std::exit(1);
-  }
-  std::stringstream ss;
-  ss << ifs.rdbuf();
-  return ss.str();
-}
-
-static void writeObjOrDie(llvm::Module& module, const std::string& objPath) {
-  llvm::InitializeNativeTarget();
-  llvm::InitializeNativeTargetAsmPrinter();
-  llvm::InitializeNativeTargetAsmParser();
+#include "backend.h"
+#include "cache.h"
+#include "jit.h"
+#include "server.h"
+#include "linker.h"
 
-  std::string targetTriple = llvm::sys::getDefaultTargetTriple();
-  module.setTargetTriple(targetTriple);
+static void appendFeatures(std::string& features, const std::string& more) {
+  if (more.empty()) return;
+  if (!features.empty()) features += ",";
+  features += more;
+}
 
-  std::string err;
-  const llvm::Target* target = llvm::TargetRegistry::lookupTarget(targetTriple, err);
-  if (!target) {
-    llvm::errs() << "Target lookup failed: " << err << "\n";
-    std::exit(1);
+static std::string hostCPUFeatures() {
+  llvm::StringMap<bool> hostFeatures;
+  std::string features;
+  if (!llvm::sys::getHostCPUFeatures(hostFeatures)) return features;
+  std::vector<std::string> sorted;
+  for (const auto& f : hostFeatures) {
+    sorted.push_back((f.second ? "+" : "-") + f.first().str());
   }
+  std::sort(sorted.begin(), sorted.end());
+  for (const auto& f : sorted) appendFeatures(features, f);
+  return features;
+}
 
-  llvm::TargetOptions opt;
-  llvm::Optional<llvm::Reloc::Model> rm;
+// -march=native, -mcpu=<cpu>|native and -mattr=<+f,-g>
+static bool isTargetArg(const std::string& arg) {
+  return arg.rfind("-march=", 0) == 0 || arg.rfind("-mcpu=", 0) == 0 ||
+         arg.rfind("-mattr=", 0) == 0;
+}
 
-  std::unique_ptr<llvm::TargetMachine> tm(
-      target->createTargetMachine(targetTriple, "generic", "", opt, rm));
+static void parseTargetArg(const std::string& arg, c99cc::CodeGenOptions& opts) {
+  if (arg.rfind("-mattr=", 0) == 0) {
+    appendFeatures(opts.features, arg.substr(7));
+    return;
+  }
+  std::string value = arg.substr(arg.find('=') + 1);
+  if (value == "native") {
+    opts.cpu = llvm::sys::getHostCPUName().str();
+    std::string features = hostCPUFeatures();
+    appendFeatures(features, opts.features);
+    opts.features = std::move(features);
+  } else if (!value.empty()) {
+    opts.cpu = value;
+  }
+}
 
-  module.setDataLayout(tm->createDataLayout());
+static bool parseOptLevel(const std::string& arg, c99cc::CodeGenOptions& opts) {
+  std::string level = arg.substr(2);
+  if (level.empty() || level == "1") {
+    opts.optLevel = 1;
+    opts.sizeLevel = 0;
+  } else if (level == "0" || level == "2" || level == "3") {
+    opts.optLevel = static_cast<unsigned>(level[0] - '0');
+    opts.sizeLevel = 0;
+  } else if (level == "s") {
+    opts.optLevel = 2;
+    opts.sizeLevel = 1;
+  } else if (level == "z") {
+    opts.optLevel = 2;
+    opts.sizeLevel = 2;
+  } else {
+    return false;
+  }
+  return true;
+}
 
+static bool writeFile(const std::string& path, llvm::ArrayRef<char> data) {
   std::error_code ec;
-  llvm::raw_fd_ostream dest(objPath, ec, llvm::sys::fs::OF_None);
+  llvm::raw_fd_ostream dest(path, ec, llvm::sys::fs::OF_None);
   if (ec) {
     llvm::errs() << "Could not open file: " << ec.message() << "\n";
-    std::exit(1);
-  }
-
-  llvm::legacy::PassManager pm;
-  if (tm->addPassesToEmitFile(pm, dest, nullptr, llvm::CGFT_ObjectFile)) {
-    llvm::errs() << "TargetMachine can't emit a file of this type\n";
-    std::exit(1);
+    return false;
   }
-
-  pm.run(module);
-  dest.flush();
+  dest.write(data.data(), data.size());
+  return true;
 }
 
 static bool tuHasMain(const c99cc::AstTranslationUnit& tu) {
@@ -87,13 +133,38 @@ static bool tuHasMain(const c99cc::AstTranslationUnit& tu) {
   return false;
 }
 
-static std::string replaceExtensionWithObj(const std::string& path) {
+static std::string replaceExtension(const std::string& path, const char* ext) {
   size_t slash = path.find_last_of("/\\");
   size_t dot = path.find_last_of('.');
   if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
-    return path + ".o";
+    return path + ext;
+  }
+  return path.substr(0, dot) + ext;
+}
+
+static std::string replaceExtensionWithObj(const std::string& path) {
+  return replaceExtension(path, ".o");
+}
+
+// A make rule `target: deps...`, one prerequisite per continuation line.
+static std::string makeDependencyRule(
+    const std::string& target, const std::vector<std::string>& deps) {
+  auto escape = [](const std::string& path) {
+    std::string out;
+    for (char c : path) {
+      if (c == ' ' || c == '#') out.push_back('\\');
+      else if (c == '$') out.push_back('$');
+      out.push_back(c);
+    }
+    return out;
+  };
+  std::string rule = escape(target) + ":";
+  for (const auto& dep : deps) {
+    llvm::SmallString<128> path(dep);
+    llvm::sys::path::remove_dots(path); // "././inc/a.h" as "inc/a.h"
+    rule += " \\\n  " + escape(std::string(path));
   }
-  return path.substr(0, dot) + ".o";
+  return rule + "\n";
 }
 
 static std::string createTempObjPath() {
@@ -106,162 +177,890 @@ static std::string createTempObjPath() {
   return tmp.str().str();
 }
 
-static std::vector<std::string> buildRuntimeObjs() {
-  const char* files[] = {
-      "runtime/printf.c",
-      "runtime/scanf.c",
-      "runtime/stdio_file.c",
-      "runtime/stdlib.c",
-      "runtime/string.c",
-      "runtime/ctype.c",
-      "runtime/errno.c",
-  };
+#ifndef C99CC_VERSION
+#define C99CC_VERSION "dev"
+#endif
+#ifndef C99CC_SOURCE_DIR
+#define C99CC_SOURCE_DIR "."
+#endif
+#ifndef C99CC_RUNTIME_CC
+#define C99CC_RUNTIME_CC "clang"
+#endif
+
+static const char* const kRuntimeSources[] = {
+    "runtime/printf.c",
+    "runtime/scanf.c",
+    "runtime/stdio_file.c",
+    "runtime/stdlib.c",
+    "runtime/string.c",
+    "runtime/ctype.c",
+    "runtime/errno.c",
+};
+
+static std::string sourceTreePath(const std::string& rel) {
+  llvm::SmallString<256> path(C99CC_SOURCE_DIR);
+  llvm::sys::path::append(path, rel);
+  return path.str().str();
+}
+
+static bool newerThan(const std::string& path, llvm::sys::TimePoint<> time) {
+  llvm::sys::fs::file_status st;
+  if (llvm::sys::fs::status(path, st)) return false;
+  return st.getLastModificationTime() > time;
+}
+
+// The archive (and, when clang was available, the -flto bitcode) is built by
+// CMake next to the c99cc binary. When the runtime sources or the bundled
+// headers they use are still around and have been edited since, the build
+// output is considered stale so an outdated runtime is never linked.
+static bool runtimeFileIsStale(const std::string& path) {
+  llvm::sys::fs::file_status fileStatus;
+  if (llvm::sys::fs::status(path, fileStatus)) return true;
+  llvm::sys::TimePoint<> fileTime = fileStatus.getLastModificationTime();
+  for (const char* file : kRuntimeSources) {
+    if (newerThan(sourceTreePath(file), fileTime)) return true;
+  }
+  std::error_code ec;
+  for (llvm::sys::fs::directory_iterator it(sourceTreePath("include"), ec), end;
+       it != end && !ec; it.increment(ec)) {
+    if (newerThan(it->path(), fileTime)) return true;
+  }
+  return false;
+}
+
+static bool rebuildRuntimeArchive(const std::string& archivePath) {
   std::vector<std::string> objs;
-  for (const char* file : files) {
+  std::vector<std::string> memberNames;
+  std::vector<llvm::NewArchiveMember> members;
+  memberNames.reserve(std::size(kRuntimeSources));
+  bool ok = true;
+  for (const char* file : kRuntimeSources) {
     std::string objPath = createTempObjPath();
-    std::string cmd =
-        "clang -c -I \"include\" \"" + std::string(file) + "\" -o \"" + objPath + "\"";
-    int rc = std::system(cmd.c_str());
-    if (rc != 0) {
+    objs.push_back(objPath);
+    std::string cmd = std::string(C99CC_RUNTIME_CC) + " -c -O2 -fno-builtin -I \"" +
+                      sourceTreePath("include") + "\" \"" + sourceTreePath(file) +
+                      "\" -o \"" + objPath + "\"";
+    if (std::system(cmd.c_str()) != 0) {
       std::cerr << "runtime compile failed (cmd=" << cmd << ")\n";
-      std::exit(1);
+      ok = false;
+      break;
     }
-    objs.push_back(objPath);
+    auto member = llvm::NewArchiveMember::getFile(objPath, /*Deterministic=*/true);
+    if (!member) {
+      llvm::errs() << "runtime archive: " << llvm::toString(member.takeError()) << "\n";
+      ok = false;
+      break;
+    }
+    memberNames.push_back(llvm::sys::path::stem(file).str() + ".o");
+    member->MemberName = memberNames.back();
+    members.push_back(std::move(*member));
+  }
+  if (ok) {
+    auto kind = llvm::Triple(llvm::sys::getDefaultTargetTriple()).isOSDarwin()
+        ? llvm::object::Archive::K_DARWIN
+        : llvm::object::Archive::K_GNU;
+    if (llvm::Error err = llvm::writeArchive(
+            archivePath, members, /*WriteSymtab=*/true, kind,
+            /*Deterministic=*/true, /*Thin=*/false)) {
+      llvm::consumeError(std::move(err));
+      ok = false;
+    }
+  }
+  for (const auto& obj : objs) llvm::sys::fs::remove(obj);
+  return ok;
+}
+
+// any symbol inside the binary; lets getMainExecutable() fall back to dladdr
+static int exeAnchor;
+
+static std::string besideExecutable(const char* argv0, const char* name) {
+  std::string exePath = llvm::sys::fs::getMainExecutable(argv0, &exeAnchor);
+  llvm::SmallString<256> path(llvm::sys::path::parent_path(exePath));
+  llvm::sys::path::append(path, name);
+  return path.str().str();
+}
+
+static std::string runtimeArchiveOrDie(const char* argv0) {
+  llvm::SmallString<256> archivePath(besideExecutable(argv0, "libc99rt.a"));
+  if (!runtimeFileIsStale(archivePath.str().str())) return archivePath.str().str();
+  if (rebuildRuntimeArchive(archivePath.str().str())) return archivePath.str().str();
+
+  // binary directory not writable: keep the rebuilt archive in the temp
+  // directory, named per user and per binary, and reuse it while it is fresh
+  llvm::SmallString<128> tmp;
+  llvm::sys::path::system_temp_directory(/*ErasedOnReboot=*/true, tmp);
+  llvm::sys::path::append(tmp, "c99rt-" + std::to_string(getuid()) + "-" +
+                                   llvm::utohexstr(llvm::xxHash64(archivePath.str())) + ".a");
+  llvm::sys::fs::file_status st;
+  bool exists = !llvm::sys::fs::status(tmp, st);
+  // someone else's file in a shared directory is never linked
+  if (!exists || st.getUser() == getuid()) {
+    if (exists && !runtimeFileIsStale(tmp.str().str())) return tmp.str().str();
+    if (rebuildRuntimeArchive(tmp.str().str())) return tmp.str().str();
+  }
+  std::cerr << "error: runtime library not available: " << archivePath.str().str() << "\n";
+  std::exit(1);
+}
+
+// Identifies the compiler build for the object cache: version strings alone
+// don't change on every rebuild, so the binary's size and mtime are mixed in.
+static std::string compilerIdentity(const char* argv0) {
+  std::string id = "c99cc " C99CC_VERSION " llvm " LLVM_VERSION_STRING;
+  llvm::sys::fs::file_status st;
+  if (!llvm::sys::fs::status(llvm::sys::fs::getMainExecutable(argv0, &exeAnchor), st)) {
+    id += " " + std::to_string(st.getSize()) + " " +
+          std::to_string(llvm::sys::toTimeT(st.getLastModificationTime()));
   }
-  return objs;
+  return id;
+}
+
+// Empty when the runtime bitcode was not built (no matching clang at configure
+// time) or is out of date; -flto then optimizes the program without it and the
+// archive supplies the runtime as usual.
+static std::string runtimeBitcodePath(const char* argv0) {
+  std::string path = besideExecutable(argv0, "c99rt.bc");
+  return runtimeFileIsStale(path) ? std::string() : path;
+}
+
+struct DriverOptions {
+  std::string outPath = "a.out";
+  bool compileOnly = false;
+  std::vector<std::string> inputPaths;
+  std::vector<std::string> includePaths;
+  std::vector<std::string> systemIncludePaths;
+  c99cc::CodeGenOptions cgOpts;
+  unsigned numThreads = 1;
+  unsigned preLexThreads = 0;              // -fprelex[=<n>]; 0 streams tokens instead
+  std::string cacheDir;
+  bool cacheStats = false;
+  bool run = false;                        // --run: JIT and execute instead of linking
+  bool perfMap = false;                    // --perf-map, with --run
+  std::vector<std::string> programArgs;    // after "--", with --run
+  bool timeTrace = false;                  // -ftime-trace[=<file>]
+  std::string timeTracePath;               // default: <output>.json
+  unsigned timeTraceGranularity = 500;     // microseconds
+  bool timeReport = false;                 // -ftime-report
+  bool printStats = false;                 // -print-stats
+  bool ppProfile = false;                  // -fpp-profile[=<file>]
+  std::string ppProfilePath;               // default: <output>.pp.json
+  bool preprocessOnly = false;             // -E
+  bool depsOnly = false;                   // -M: print make dependencies, compile nothing
+  bool writeDeps = false;                  // -MD: write them alongside the compile
+  std::string depFile;                     // -MF; default: <object>.d, stdout with -M
+  std::string depTarget;                   // -MT; default: the object file
+  bool emitPch = false;                    // -emit-pch: precompile the one header input
+  std::string includePch;                  // -include-pch <file>
+  c99cc::FileManager* files = nullptr;     // the compile server keeps its own warm
+};
+
+struct CompileJob {
+  std::string inputPath;
+  std::string objPath; // only written for -c
+  llvm::SmallVector<char, 0> object; // bitcode with -flto
+  llvm::orc::ThreadSafeModule module; // --run: optimized IR for the JIT instead
+  bool ok = false;
+  bool hasMain = false;
+  std::string diagText; // printed in input order once every job has finished
+  c99cc::PreprocessorProfile ppProfile; // -fpp-profile
+  std::vector<std::string> deps; // -MD: the input and every file it pulled in
+};
+
+static std::string_view bufferText(const c99cc::FileManager::Buffer& buffer) {
+  llvm::StringRef text = buffer->getBuffer();
+  return std::string_view(text.data(), text.size());
+}
+
+// Decodes -include-pch straight from the shared (usually mapped) buffer.
+static bool loadPrecompiledHeader(
+    const std::string& path, c99cc::FileManager& files, c99cc::PrecompiledHeader& pch,
+    std::ostream& diagOut) {
+  c99cc::TimeScope scope("LoadPCH", path);
+  c99cc::FileManager::Buffer data = files.getBuffer(path);
+  if (!data) {
+    diagOut << "error: cannot read precompiled header: " << path << "\n";
+    return false;
+  }
+  std::string err;
+  if (!c99cc::readPrecompiledHeader(bufferText(data), pch, err)) {
+    diagOut << "error: " << path << ": " << err << "\n";
+    return false;
+  }
+  return true;
 }
 
 static bool compileToObject(
-    const std::string& inputPath,
-    const std::vector<std::string>& includePaths,
-    const std::vector<std::string>& systemIncludePaths,
-    const std::string& objPath,
-    bool& hasMainOut) {
-  std::string source = readFileOrDie(inputPath);
-
-  c99cc::Preprocessor pp(includePaths, systemIncludePaths);
-  auto preprocessed = pp.run(inputPath, source);
-  if (!preprocessed) {
+    CompileJob& job,
+    const DriverOptions& opts,
+    c99cc::FileManager& files,
+    c99cc::TargetMachinePool& tms,
+    c99cc::ObjectCache* cache,
+    std::ostream& diagOut) {
+  const std::string& inputPath = job.inputPath;
+  c99cc::TimeScope scope("CompileTU", inputPath);
+  c99cc::FileManager::Buffer input = files.getBuffer(inputPath);
+  if (!input) {
+    diagOut << "failed to open: " << inputPath << "\n";
     return false;
   }
-  source = *preprocessed;
 
+  // decoded per TU: its declarations are moved into this TU's AST
+  c99cc::PrecompiledHeader pch;
+  if (!opts.includePch.empty() &&
+      !loadPrecompiledHeader(opts.includePch, files, pch, diagOut)) {
+    return false;
+  }
+  c99cc::Preprocessor pp(opts.includePaths, opts.systemIncludePaths);
+  pp.setDiagnosticStream(diagOut);
+  pp.setFileManager(&files);
+  if (opts.ppProfile) pp.setProfile(&job.ppProfile);
+  pp.restoreState(pch.preprocessor);
+  auto recordDeps = [&] {
+    if (!opts.writeDeps) return;
+    job.deps.push_back(inputPath);
+    if (!opts.includePch.empty()) job.deps.push_back(opts.includePch);
+    job.deps.insert(job.deps.end(), pp.dependencies().begin(), pp.dependencies().end());
+  };
+  auto printStats = [&] {
+    if (!opts.printStats) return;
+    const auto& stats = pp.stats();
+    diagOut << inputPath << ": " << stats.includes << " #include directives, "
+            << stats.skippedIncludes << " skipped (#pragma once / include guard)\n";
+    unsigned hitRate = stats.macroCacheLookups
+        ? stats.macroCacheHits * 100 / stats.macroCacheLookups : 0;
+    diagOut << inputPath << ": " << stats.macroCacheHits << " of "
+            << stats.macroCacheLookups << " macro expansions from cache (" << hitRate << "%)\n";
+  };
+
+  // The cache key and -fprelex both need the whole expanded TU, so only then
+  // is it built up front; otherwise the lexer pulls the preprocessor's output
+  // as it is produced and the expanded text never exists in memory as a whole.
+  bool whole = cache || opts.preLexThreads;
   c99cc::Diagnostics diags;
-  c99cc::Lexer lex(source, diags);
-  c99cc::Parser parser(lex, diags);
+  std::string source;
+  std::string cacheKey;
+  std::unique_ptr<c99cc::Lexer> lex;
+  std::optional<c99cc::TokenBuffer> tokens;
+  if (whole) {
+    auto preprocessed = pp.run(inputPath, bufferText(input));
+    if (!preprocessed) {
+      return false;
+    }
+    printStats();
+    recordDeps();
+    source = std::move(*preprocessed);
 
-  auto tuOpt = parser.parse();
+    if (cache) {
+      c99cc::TimeScope lookupScope("CacheLookup");
+      cacheKey = cache->key(inputPath, source);
+      if (cache->lookup(cacheKey, job.object)) {
+        job.hasMain = c99cc::objectMentionsMain(job.object);
+        return true;
+      }
+    }
+    // token offsets are 32-bit; a larger TU streams through a Lexer instead
+    if (opts.preLexThreads && source.size() < UINT32_MAX) {
+      tokens = c99cc::TokenBuffer::lex(source, opts.preLexThreads, diags);
+    } else {
+      lex = std::make_unique<c99cc::Lexer>(source, diags);
+    }
+  } else {
+    pp.start(inputPath, bufferText(input));
+    lex = std::make_unique<c99cc::Lexer>(
+        [&pp](std::string& chunk) { return pp.next(chunk); }, diags);
+  }
+  // Diagnostics quote the expanded source; a streamed TU regenerates it.
+  auto printDiags = [&] {
+    if (whole) {
+      diags.printAll(diagOut, inputPath, source);
+      return;
+    }
+    c99cc::Preprocessor again(opts.includePaths, opts.systemIncludePaths);
+    std::ostringstream ignored; // reported the first time round
+    again.setDiagnosticStream(ignored);
+    again.setFileManager(&files);
+    again.restoreState(pch.preprocessor);
+    diags.printAll(diagOut, inputPath, again.run(inputPath, bufferText(input)).value_or(""));
+  };
+
+  std::optional<c99cc::Parser> parser;
+  if (tokens) {
+    parser.emplace(*tokens, diags);
+  } else {
+    parser.emplace(*lex, diags);
+  }
+  parser->addDeclarations(pch.typedefs, pch.enumConstants);
+
+  auto tuOpt = parser->parse();
+  if (pp.failed()) return false; // its errors are out, and the parser saw a cut-off TU
+  if (!whole) {
+    printStats();
+    recordDeps();
+  }
   if (!tuOpt || diags.hasError()) {
-    diags.printAll(inputPath, source);
+    printDiags();
     return false;
   }
+  if (opts.printStats) {
+    diagOut << inputPath << ": " << tuOpt->arena->bytesUsed() << " bytes of AST in "
+            << tuOpt->arena->bytesReserved() << " bytes of arena blocks\n";
+  }
+  tuOpt->items.insert(tuOpt->items.begin(), std::make_move_iterator(pch.items.begin()),
+                      std::make_move_iterator(pch.items.end()));
 
-  if (tuHasMain(*tuOpt)) hasMainOut = true;
+  if (tuHasMain(*tuOpt)) job.hasMain = true;
 
   c99cc::Sema sema(diags);
   if (!sema.run(*tuOpt) || diags.hasError()) {
-    diags.printAll(inputPath, source);
+    printDiags();
     return false;
   }
+  if (opts.printStats) {
+    diagOut << inputPath << ": " << tuOpt->types->size() << " distinct types\n";
+  }
+
+  if (opts.run) {
+    auto ctx = std::make_unique<llvm::LLVMContext>();
+    auto mod = c99cc::CodeGen::emitLLVM(*ctx, *tuOpt, inputPath);
+    c99cc::optimizeForJIT(*mod, opts.cgOpts, tms);
+    job.module = llvm::orc::ThreadSafeModule(std::move(mod), std::move(ctx));
+    return true;
+  }
 
   llvm::LLVMContext ctx;
   auto mod = c99cc::CodeGen::emitLLVM(ctx, *tuOpt, inputPath);
-  writeObjOrDie(*mod, objPath);
+  c99cc::emitObjectOrDie(*mod, opts.cgOpts, tms, job.object);
+  if (cache) cache->store(cacheKey, job.object);
   return true;
 }
 
-int main(int argc, char** argv) {
-  if (argc < 2) {
-    std::cerr
-        << "usage: c99cc <input.c>... [-o <output>] [-c] [-I <path>] [-isystem <path>]\n";
-    return 1;
+static void runCompileJobs(
+    std::vector<CompileJob>& jobs,
+    const DriverOptions& opts,
+    c99cc::FileManager& files,
+    c99cc::TargetMachinePool& tms,
+    c99cc::ObjectCache* cache) {
+  auto run = [&](CompileJob& job) {
+    // pool threads need their own profiler instance; it is merged into the
+    // main thread's trace when the thread finishes
+    bool poolThread = opts.timeTrace && !llvm::timeTraceProfilerEnabled();
+    if (poolThread) llvm::timeTraceProfilerInitialize(opts.timeTraceGranularity, "c99cc");
+    std::ostringstream diag;
+    job.ok = compileToObject(job, opts, files, tms, cache, diag);
+    job.diagText = diag.str();
+    if (poolThread) llvm::timeTraceProfilerFinishThread();
+  };
+
+  if (opts.numThreads <= 1 || jobs.size() <= 1) {
+    for (auto& job : jobs) run(job);
+    return;
   }
+  llvm::ThreadPool pool(llvm::hardware_concurrency(opts.numThreads));
+  for (auto& job : jobs) {
+    pool.async([&run, &job] { run(job); });
+  }
+  pool.wait();
+}
 
-  std::string outPath = "a.out";
-  bool compileOnly = false;
-  std::vector<std::string> inputPaths;
-  std::vector<std::string> includePaths;
-  std::vector<std::string> systemIncludePaths;
+// Reports problems on `err` and returns false; `args` excludes argv[0].
+static bool parseArgs(
+    const std::vector<std::string>& args, DriverOptions& opts, std::ostream& err) {
+  if (const char* env = std::getenv("C99CC_CACHE_DIR")) opts.cacheDir = env;
 
-  for (int i = 1; i < argc; i++) {
-    std::string a = argv[i];
-    if (a == "-o" && i + 1 < argc) {
-      outPath = argv[++i];
+  for (size_t i = 0; i < args.size(); i++) {
+    const std::string& a = args[i];
+    if (a == "-o" && i + 1 < args.size()) {
+      opts.outPath = args[++i];
     } else if (a == "-c") {
-      compileOnly = true;
-    } else if (a == "-I" && i + 1 < argc) {
-      includePaths.push_back(argv[++i]);
+      opts.compileOnly = true;
+    } else if (a == "--run") {
+      opts.run = true;
+    } else if (a == "--perf-map") {
+      opts.perfMap = true;
+    } else if (a == "--" && opts.run) {
+      opts.programArgs.assign(args.begin() + i + 1, args.end());
+      break;
+    } else if (a == "-flto") {
+      opts.cgOpts.lto = true;
+    } else if (a == "-fno-lto") {
+      opts.cgOpts.lto = false;
+    } else if (a.rfind("-fcache-dir=", 0) == 0) {
+      opts.cacheDir = a.substr(12);
+      if (opts.cacheDir.empty()) {
+        err << "error: missing directory after -fcache-dir=\n";
+        return false;
+      }
+    } else if (a == "-fno-cache") {
+      opts.cacheDir.clear();
+    } else if (a == "-fcache-stats") {
+      opts.cacheStats = true;
+    } else if (a == "-ftime-trace") {
+      opts.timeTrace = true;
+    } else if (a.rfind("-ftime-trace=", 0) == 0) {
+      opts.timeTrace = true;
+      opts.timeTracePath = a.substr(13);
+    } else if (a.rfind("-ftime-trace-granularity=", 0) == 0) {
+      if (llvm::StringRef(a).drop_front(25).getAsInteger(10, opts.timeTraceGranularity)) {
+        err << "error: invalid -ftime-trace-granularity value: " << a.substr(25) << "\n";
+        return false;
+      }
+    } else if (a == "-ftime-report") {
+      opts.timeReport = true;
+    } else if (a == "-print-stats") {
+      opts.printStats = true;
+    } else if (a == "-fpp-profile") {
+      opts.ppProfile = true;
+    } else if (a.rfind("-fpp-profile=", 0) == 0) {
+      opts.ppProfile = true;
+      opts.ppProfilePath = a.substr(13);
+    } else if (a == "-E") {
+      opts.preprocessOnly = true;
+    } else if (a == "-M") {
+      opts.depsOnly = true;
+    } else if (a == "-MD") {
+      opts.writeDeps = true;
+    } else if ((a == "-MF" || a == "-MT") && i + 1 < args.size()) {
+      (a == "-MF" ? opts.depFile : opts.depTarget) = args[++i];
+    } else if (a == "-MF" || a == "-MT") {
+      err << "missing path after " << a << "\n";
+      return false;
+    } else if (a == "-emit-pch") {
+      opts.emitPch = true;
+    } else if (a == "-include-pch" && i + 1 < args.size()) {
+      opts.includePch = args[++i];
+    } else if (a == "-include-pch") {
+      err << "missing path after -include-pch\n";
+      return false;
+    } else if (a.rfind("-O", 0) == 0) {
+      if (!parseOptLevel(a, opts.cgOpts)) {
+        err << "error: unknown optimization level: " << a << "\n";
+        return false;
+      }
+    } else if (a.rfind("-j", 0) == 0) {
+      llvm::StringRef value = a.size() > 2 ? llvm::StringRef(a).drop_front(2) : "";
+      if (value.empty() && i + 1 < args.size()) value = args[++i];
+      if (value.empty() || value.getAsInteger(10, opts.numThreads)) {
+        err << "error: invalid -j value: " << value.str() << "\n";
+        return false;
+      }
+      if (opts.numThreads == 0) {
+        opts.numThreads = llvm::hardware_concurrency().compute_thread_count();
+      }
+    } else if (a == "-fprelex") {
+      opts.preLexThreads = llvm::hardware_concurrency().compute_thread_count();
+    } else if (a.rfind("-fprelex=", 0) == 0) {
+      if (llvm::StringRef(a).drop_front(9).getAsInteger(10, opts.preLexThreads) ||
+          opts.preLexThreads == 0) {
+        err << "error: invalid -fprelex value: " << a.substr(9) << "\n";
+        return false;
+      }
+    } else if (a == "-fno-prelex") {
+      opts.preLexThreads = 0;
+    } else if (isTargetArg(a)) {
+      parseTargetArg(a, opts.cgOpts);
+    } else if (a == "-I" && i + 1 < args.size()) {
+      opts.includePaths.push_back(args[++i]);
     } else if (a == "-I") {
-      std::cerr << "missing path after -I\n";
-      return 1;
+      err << "missing path after -I\n";
+      return false;
     } else if (a.rfind("-I", 0) == 0 && a.size() > 2) {
-      includePaths.push_back(a.substr(2));
-    } else if (a == "-isystem" && i + 1 < argc) {
-      systemIncludePaths.push_back(argv[++i]);
+      opts.includePaths.push_back(a.substr(2));
+    } else if (a == "-isystem" && i + 1 < args.size()) {
+      opts.systemIncludePaths.push_back(args[++i]);
     } else if (a == "-isystem") {
-      std::cerr << "missing path after -isystem\n";
-      return 1;
+      err << "missing path after -isystem\n";
+      return false;
     } else if (!a.empty() && a[0] == '-') {
-      std::cerr << "unknown arg: " << a << "\n";
-      return 1;
+      err << "unknown arg: " << a << "\n";
+      return false;
     } else {
-      inputPaths.push_back(a);
+      opts.inputPaths.push_back(a);
     }
   }
 
-  if (inputPaths.empty()) {
-    std::cerr << "error: no input files\n";
-    return 1;
+  if (opts.inputPaths.empty()) {
+    err << "error: no input files\n";
+    return false;
   }
 
-  if (compileOnly && inputPaths.size() > 1 && outPath != "a.out") {
-    std::cerr << "error: -o with -c requires a single input file\n";
-    return 1;
+  if (opts.compileOnly && opts.inputPaths.size() > 1 && opts.outPath != "a.out") {
+    err << "error: -o with -c requires a single input file\n";
+    return false;
   }
 
-  bool hasMain = false;
-  std::vector<std::string> objPaths;
-  objPaths.reserve(inputPaths.size());
-
-  for (size_t i = 0; i < inputPaths.size(); i++) {
-    const std::string& inputPath = inputPaths[i];
-    std::string objPath;
-    if (compileOnly) {
-      if (inputPaths.size() == 1 && outPath != "a.out") {
-        objPath = outPath;
+  if (opts.run && opts.compileOnly) {
+    err << "error: --run cannot be combined with -c\n";
+    return false;
+  }
+
+  if (opts.preprocessOnly && (opts.compileOnly || opts.run || opts.emitPch)) {
+    err << "error: -E cannot be combined with -c, --run or -emit-pch\n";
+    return false;
+  }
+
+  if (opts.depsOnly && (opts.preprocessOnly || opts.compileOnly || opts.run || opts.emitPch)) {
+    err << "error: -M cannot be combined with -E, -c, --run or -emit-pch\n";
+    return false;
+  }
+
+  if (!opts.depFile.empty() && opts.inputPaths.size() > 1) {
+    err << "error: -MF requires a single input file\n";
+    return false;
+  }
+
+  if (opts.emitPch) {
+    if (opts.inputPaths.size() > 1) {
+      err << "error: -emit-pch requires a single header\n";
+      return false;
+    }
+    if (opts.compileOnly || opts.run || !opts.includePch.empty()) {
+      err << "error: -emit-pch cannot be combined with -c, --run or -include-pch\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+// One pool per distinct target configuration, kept for the whole process so
+// the compile server builds each TargetMachine once and every worker inherits it.
+static c99cc::TargetMachinePool& targetMachinePoolFor(const c99cc::CodeGenOptions& opts) {
+  static std::map<std::string, std::unique_ptr<c99cc::TargetMachinePool>> pools;
+  std::string key = opts.cpu + "|" + opts.features + "|" + c99cc::optLevelName(opts);
+  auto& pool = pools[key];
+  if (!pool) pool = std::make_unique<c99cc::TargetMachinePool>(opts);
+  return *pool;
+}
+
+// -fpp-profile: every TU's costs together, as a table on stderr and as JSON.
+static void reportPreprocessorProfile(const std::vector<CompileJob>& jobs, const DriverOptions& opts) {
+  c99cc::PreprocessorProfile total;
+  for (const auto& job : jobs) total.merge(job.ppProfile);
+  c99cc::printPreprocessorProfile(std::cerr, total);
+  std::string path = opts.ppProfilePath.empty() ? opts.outPath + ".pp.json" : opts.ppProfilePath;
+  std::string err;
+  if (!c99cc::writePreprocessorProfile(path, total, err)) {
+    std::cerr << "warning: cannot write preprocessor profile " << path << ": " << err << "\n";
+  }
+}
+
+static int compileAndLink(const DriverOptions& opts, const char* argv0) {
+  std::vector<CompileJob> jobs(opts.inputPaths.size());
+  for (size_t i = 0; i < opts.inputPaths.size(); i++) {
+    CompileJob& job = jobs[i];
+    job.inputPath = opts.inputPaths[i];
+    if (opts.compileOnly) {
+      if (opts.inputPaths.size() == 1 && opts.outPath != "a.out") {
+        job.objPath = opts.outPath;
       } else {
-        objPath = replaceExtensionWithObj(inputPath);
+        job.objPath = replaceExtensionWithObj(job.inputPath);
       }
-    } else {
-      objPath = createTempObjPath();
     }
-    if (!compileToObject(
-            inputPath, includePaths, systemIncludePaths, objPath, hasMain)) {
+  }
+
+  // one FileManager for all TUs, so shared headers are read and resolved once
+  c99cc::FileManager localFiles;
+  c99cc::FileManager& files = opts.files ? *opts.files : localFiles;
+
+  c99cc::TargetMachinePool& tms = targetMachinePoolFor(opts.cgOpts);
+  std::unique_ptr<c99cc::ObjectCache> cache;
+  if (!opts.cacheDir.empty() && !opts.run) {
+    cache = std::make_unique<c99cc::ObjectCache>(
+        opts.cacheDir, compilerIdentity(argv0), tms.triple(), opts.cgOpts);
+  }
+
+  if (!opts.includePch.empty()) {
+    // checked once here; each TU then trusts the header and its inputs
+    c99cc::PrecompiledHeader pch;
+    if (!loadPrecompiledHeader(opts.includePch, files, pch, std::cerr)) return 1;
+    std::string stale = c99cc::stalePrecompiledHeaderInput(pch);
+    if (!stale.empty()) {
+      std::cerr << "error: precompiled header '" << opts.includePch
+                << "' is out of date: '" << stale << "' has changed\n";
       return 1;
     }
-    objPaths.push_back(objPath);
+    if (cache) cache->addInput("pch", bufferText(files.getBuffer(opts.includePch)));
   }
+  runCompileJobs(jobs, opts, files, tms, cache.get());
+  if (cache && opts.cacheStats) cache->printStats(std::cerr);
+  if (opts.ppProfile) reportPreprocessorProfile(jobs, opts);
 
-  if (!compileOnly) {
-    if (!hasMain) {
-      std::cerr << "error: no 'main' function defined\n";
-      return 1;
+  bool failed = false;
+  bool hasMain = false;
+  std::vector<llvm::ArrayRef<char>> objects;
+  objects.reserve(jobs.size());
+  for (const auto& job : jobs) {
+    std::cerr << job.diagText;
+    if (!job.ok) failed = true;
+    if (job.hasMain) hasMain = true;
+    objects.push_back(job.object);
+  }
+  if (failed) return 1;
+
+  if (opts.writeDeps) {
+    for (const auto& job : jobs) {
+      std::string obj = opts.compileOnly ? job.objPath : replaceExtensionWithObj(job.inputPath);
+      std::string rule = makeDependencyRule(
+          opts.depTarget.empty() ? obj : opts.depTarget, job.deps);
+      std::string path = opts.depFile.empty() ? replaceExtension(obj, ".d") : opts.depFile;
+      if (!writeFile(path, llvm::ArrayRef<char>(rule.data(), rule.size()))) return 1;
     }
+  }
 
-    auto rtObjs = buildRuntimeObjs();
-    objPaths.insert(objPaths.end(), rtObjs.begin(), rtObjs.end());
+  if (opts.compileOnly) {
+    for (const auto& job : jobs) {
+      if (!writeFile(job.objPath, job.object)) return 1;
+    }
+    return 0;
+  }
 
-    std::string cmd = "clang";
-    for (const auto& obj : objPaths) {
-      cmd += " \"" + obj + "\"";
+  if (!hasMain) {
+    std::cerr << "error: no 'main' function defined\n";
+    return 1;
+  }
+
+  if (opts.run) {
+    std::vector<llvm::orc::ThreadSafeModule> modules;
+    for (auto& job : jobs) modules.push_back(std::move(job.module));
+    c99cc::JITRunOptions run;
+    run.runtimeBitcode = runtimeBitcodePath(argv0);
+    run.runtimeArchive = runtimeArchiveOrDie(argv0);
+    run.args.push_back(opts.inputPaths.front());
+    run.args.insert(run.args.end(), opts.programArgs.begin(), opts.programArgs.end());
+    run.perfMap = opts.perfMap;
+    int exitCode = 1;
+    if (!c99cc::runJIT(std::move(modules), opts.cgOpts, run, exitCode)) return 1;
+    return exitCode;
+  }
+
+  llvm::SmallVector<char, 0> ltoObject;
+  if (opts.cgOpts.lto) {
+    if (!c99cc::linkTimeOptimize(
+            objects, runtimeBitcodePath(argv0), opts.cgOpts, tms, ltoObject)) {
+      return 1;
     }
-    cmd += " -o \"" + outPath + "\"";
-    int rc = std::system(cmd.c_str());
-    if (rc != 0) {
-      std::cerr << "link failed (cmd=" << cmd << ")\n";
+    objects.assign(1, ltoObject);
+  }
+
+  c99cc::TimeScope linkScope("Link");
+  if (!c99cc::linkExecutable(objects, runtimeArchiveOrDie(argv0), opts.outPath)) return 1;
+  return 0;
+}
+
+// -E: the preprocessed text of every input, streamed to -o or stdout.
+static int preprocessOnly(const DriverOptions& opts) {
+  c99cc::FileManager localFiles;
+  c99cc::FileManager& files = opts.files ? *opts.files : localFiles;
+  c99cc::PrecompiledHeader pch;
+  if (!opts.includePch.empty() &&
+      !loadPrecompiledHeader(opts.includePch, files, pch, std::cerr)) {
+    return 1;
+  }
+
+  std::unique_ptr<llvm::raw_fd_ostream> file;
+  if (opts.outPath != "a.out") {
+    std::error_code ec;
+    file = std::make_unique<llvm::raw_fd_ostream>(opts.outPath, ec, llvm::sys::fs::OF_None);
+    if (ec) {
+      llvm::errs() << "Could not open file: " << ec.message() << "\n";
       return 1;
     }
   }
+  llvm::raw_ostream& os = file ? *file : llvm::outs();
 
+  for (const auto& inputPath : opts.inputPaths) {
+    c99cc::FileManager::Buffer input = files.getBuffer(inputPath);
+    if (!input) {
+      std::cerr << "failed to open: " << inputPath << "\n";
+      return 1;
+    }
+    c99cc::Preprocessor pp(opts.includePaths, opts.systemIncludePaths);
+    pp.setFileManager(&files);
+    pp.restoreState(pch.preprocessor);
+    pp.start(inputPath, bufferText(input));
+    std::string chunk;
+    while (pp.next(chunk)) {
+      os << chunk;
+      chunk.clear();
+    }
+    if (pp.failed()) return 1;
+  }
+  os.flush();
   return 0;
 }
+
+// -M: runs only the directives of every input and prints which files its
+// object depends on, to -MF, -o or stdout.
+static int scanDependencies(const DriverOptions& opts) {
+  c99cc::FileManager localFiles;
+  c99cc::FileManager& files = opts.files ? *opts.files : localFiles;
+  c99cc::PrecompiledHeader pch;
+  if (!opts.includePch.empty() &&
+      !loadPrecompiledHeader(opts.includePch, files, pch, std::cerr)) {
+    return 1;
+  }
+
+  std::string rules;
+  for (const auto& inputPath : opts.inputPaths) {
+    c99cc::TimeScope scope("ScanDeps", inputPath);
+    c99cc::FileManager::Buffer input = files.getBuffer(inputPath);
+    if (!input) {
+      std::cerr << "failed to open: " << inputPath << "\n";
+      return 1;
+    }
+    c99cc::Preprocessor pp(opts.includePaths, opts.systemIncludePaths);
+    pp.setFileManager(&files);
+    pp.setScanOnly(true);
+    pp.restoreState(pch.preprocessor);
+    if (!pp.run(inputPath, bufferText(input))) return 1;
+
+    std::vector<std::string> deps{inputPath};
+    if (!opts.includePch.empty()) deps.push_back(opts.includePch);
+    deps.insert(deps.end(), pp.dependencies().begin(), pp.dependencies().end());
+    rules += makeDependencyRule(
+        opts.depTarget.empty() ? replaceExtensionWithObj(inputPath) : opts.depTarget, deps);
+  }
+
+  std::string outPath = !opts.depFile.empty() ? opts.depFile
+      : opts.outPath != "a.out" ? opts.outPath : "";
+  if (outPath.empty()) {
+    llvm::outs() << rules;
+    llvm::outs().flush();
+    return 0;
+  }
+  return writeFile(outPath, llvm::ArrayRef<char>(rules.data(), rules.size())) ? 0 : 1;
+}
+
+// -emit-pch: preprocesses and parses the header once, for every later
+// -include-pch compile to start from its macros and declarations.
+static int emitPrecompiledHeader(const DriverOptions& opts) {
+  const std::string& headerPath = opts.inputPaths.front();
+  c99cc::TimeScope scope("EmitPCH", headerPath);
+  c99cc::FileManager localFiles;
+  c99cc::FileManager& files = opts.files ? *opts.files : localFiles;
+  c99cc::FileManager::Buffer input = files.getBuffer(headerPath);
+  if (!input) {
+    std::cerr << "failed to open: " << headerPath << "\n";
+    return 1;
+  }
+
+  c99cc::Preprocessor pp(opts.includePaths, opts.systemIncludePaths);
+  pp.setFileManager(&files);
+  auto preprocessed = pp.run(headerPath, bufferText(input));
+  if (!preprocessed) return 1;
+  const std::string& source = *preprocessed;
+
+  c99cc::Diagnostics diags;
+  c99cc::Lexer lex(source, diags);
+  c99cc::Parser parser(lex, diags);
+  auto tuOpt = parser.parse();
+  if (!tuOpt || diags.hasError()) {
+    diags.printAll(std::cerr, headerPath, source);
+    return 1;
+  }
+  for (const auto& item : tuOpt->items) {
+    std::string why;
+    if (!c99cc::canPrecompile(item, why)) {
+      std::cerr << "error: " << headerPath << ": cannot precompile " << why << "\n";
+      return 1;
+    }
+  }
+  c99cc::Sema sema(diags);
+  if (!sema.run(*tuOpt) || diags.hasError()) {
+    diags.printAll(std::cerr, headerPath, source);
+    return 1;
+  }
+
+  c99cc::PrecompiledHeader pch;
+  std::vector<std::string> inputs{headerPath};
+  inputs.insert(inputs.end(), pp.includedFiles().begin(), pp.includedFiles().end());
+  for (const auto& path : inputs) {
+    if (!c99cc::addPrecompiledHeaderInput(pch, files.uniquePath(path))) {
+      std::cerr << "error: cannot stat " << path << "\n";
+      return 1;
+    }
+  }
+  pch.preprocessor = pp.saveState();
+  // including the header again after -include-pch is a no-op
+  pch.preprocessor.onceFiles.push_back(files.uniquePath(headerPath));
+  pch.typedefs = parser.typedefs();
+  pch.enumConstants = parser.enumConstants();
+  pch.items = std::move(tuOpt->items);
+
+  std::string data = c99cc::writePrecompiledHeader(pch);
+  std::string outPath = opts.outPath == "a.out" ? headerPath + ".pch" : opts.outPath;
+  return writeFile(outPath, llvm::ArrayRef<char>(data.data(), data.size())) ? 0 : 1;
+}
+
+static int runDriver(const DriverOptions& opts, const char* argv0) {
+  if (opts.timeTrace) llvm::timeTraceProfilerInitialize(opts.timeTraceGranularity, "c99cc");
+  if (opts.timeReport) c99cc::enableTimeReport();
+
+  int exitCode;
+  {
+    c99cc::TimeScope scope("ExecuteCompiler");
+    if (opts.preprocessOnly) exitCode = preprocessOnly(opts);
+    else if (opts.depsOnly) exitCode = scanDependencies(opts);
+    else if (opts.emitPch) exitCode = emitPrecompiledHeader(opts);
+    else exitCode = compileAndLink(opts, argv0);
+  }
+
+  if (opts.timeTrace) {
+    std::string path = opts.timeTracePath.empty() ? opts.outPath + ".json" : opts.timeTracePath;
+    if (llvm::Error err = llvm::timeTraceProfilerWrite(path, opts.outPath)) {
+      std::cerr << "warning: cannot write time trace: " << llvm::toString(std::move(err)) << "\n";
+    }
+    llvm::timeTraceProfilerCleanup();
+  }
+  if (opts.timeReport) c99cc::printTimeReport(std::cerr);
+  return exitCode;
+}
+
+static int runServerMode(const std::string& socketPath, const char* argv0) {
+  // Everything the parent sets up here is inherited by each forked worker.
+  static c99cc::FileManager files;
+  runtimeArchiveOrDie(argv0); // rebuild a stale runtime now, not in the first request
+  targetMachinePoolFor(c99cc::CodeGenOptions()).prewarm();
+
+  c99cc::ServerHooks hooks;
+  hooks.warm = [](const std::vector<std::string>& args) {
+    DriverOptions opts;
+    std::ostringstream err;
+    if (!parseArgs(args, opts, err)) return;
+    targetMachinePoolFor(opts.cgOpts).prewarm();
+  };
+  hooks.compile = [argv0](const std::vector<std::string>& args) {
+    DriverOptions opts;
+    if (!parseArgs(args, opts, std::cerr)) return 1;
+    files.invalidate(); // the disk may have changed since the last request
+    opts.files = &files;
+    return runDriver(opts, argv0);
+  };
+  return c99cc::runServer(socketPath, files, hooks);
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr
+        << "usage: c99cc <input.c>... [-o <output>] [-c | -E] [-O<level>] [-march=native]"
+           " [-mcpu=<cpu>] [-mattr=<features>] [-flto] [-j <n>] [-fcache-dir=<dir>] [-fprelex[=<n>]]"
+           " [-fcache-stats] [-ftime-trace[=<file>]] [-ftime-report]"
+           " [-print-stats] [-fpp-profile[=<file>]] [-include-pch <file>] [-I <path>] [-isystem <path>]\n"
+           "       c99cc -emit-pch <header.h> [-o <header.pch>] [-I <path>] [-isystem <path>]\n"
+           "       c99cc --run [--perf-map] <input.c>... [options] [-- <program args>...]\n"
+           "       c99cc --server[=<socket>]\n";
+    return 1;
+  }
+
+  std::vector<std::string> args(argv + 1, argv + argc);
+  if (args[0] == "--server") return runServerMode(c99cc::defaultServerSocket(), argv[0]);
+  if (args[0].rfind("--server=", 0) == 0) return runServerMode(args[0].substr(9), argv[0]);
+
+  // with a server configured this process only forwards the request
+  if (const char* server = std::getenv("C99CC_SERVER")) {
+    int exitCode = 1;
+    if (*server && c99cc::forwardToServer(server, args, exitCode)) return exitCode;
+  }
+
+  DriverOptions opts;
+  if (!parseArgs(args, opts, std::cerr)) return 1;
+  return runDriver(opts, argv[0]);
+}
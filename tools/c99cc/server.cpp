@@ -0,0 +1,506 @@
+#include "server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "../../src/file_manager.h"
+
+#ifndef _WIN32
+extern char** environ;
+#endif
+
+namespace c99cc {
+
+#ifdef _WIN32
+
+std::string defaultServerSocket() { return std::string(); }
+
+int runServer(const std::string&, FileManager&, const ServerHooks&) {
+  std::cerr << "error: --server is not supported on this platform\n";
+  return 1;
+}
+
+bool forwardToServer(const std::string&, const std::vector<std::string>&, int&) {
+  return false;
+}
+
+#else
+
+namespace {
+
+// Requests are a 4 byte length followed by NUL-terminated strings:
+//   <argc> argv[1..] <cwd> <envc> env...
+// The client's stdin, stdout and stderr travel alongside the length as
+// SCM_RIGHTS, so the worker (and a --run program) use them directly. The reply is the 4 byte exit
+// code, sent by the server once the worker has been reaped.
+constexpr uint32_t kMaxRequestSize = 16u << 20;
+// a client that hasn't sent its whole request by then is dropped
+constexpr std::chrono::seconds kRequestTimeout{10};
+
+void appendString(std::string& buf, const std::string& s) {
+  buf += s;
+  buf.push_back('\0');
+}
+
+bool writeAll(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t n = ::write(fd, p, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool readAll(int fd, void* data, size_t size) {
+  char* p = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t n = ::read(fd, p, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+void setCloseOnExec(int fd) { ::fcntl(fd, F_SETFD, FD_CLOEXEC); }
+
+bool socketAddress(const std::string& path, sockaddr_un& addr) {
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) return false;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+int connectTo(const std::string& path) {
+  sockaddr_un addr;
+  if (!socketAddress(path, addr)) return -1;
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+struct Request {
+  std::vector<std::string> args;
+  std::string cwd;
+  std::vector<std::string> env;
+  int fds[3] = {-1, -1, -1}; // client stdin, stdout, stderr
+};
+
+void closeAll(Request& req) {
+  for (int& fd : req.fds) {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+  }
+}
+
+// A connection whose request is still arriving. The poll loop reads it a
+// piece at a time, so a slow or silent client holds up no one else.
+struct PendingRequest {
+  int conn = -1;
+  Request req;
+  std::string data; // length prefix, then payload
+  std::chrono::steady_clock::time_point deadline;
+};
+
+enum class ReadStatus { More, Done, Failed };
+
+bool parseRequest(const std::string& payload, Request& req) {
+  std::vector<std::string> fields;
+  size_t pos = 0;
+  while (pos < payload.size()) {
+    size_t end = payload.find('\0', pos);
+    if (end == std::string::npos) return false;
+    fields.push_back(payload.substr(pos, end - pos));
+    pos = end + 1;
+  }
+  size_t i = 0;
+  auto takeCount = [&](size_t& count) {
+    if (i >= fields.size()) return false;
+    char* end = nullptr;
+    count = std::strtoul(fields[i].c_str(), &end, 10);
+    return *end == '\0' && count <= fields.size() - ++i;
+  };
+  size_t argc = 0;
+  if (!takeCount(argc)) return false;
+  req.args.assign(fields.begin() + i, fields.begin() + i + argc);
+  i += argc;
+  if (i >= fields.size()) return false;
+  req.cwd = fields[i++];
+  size_t envc = 0;
+  if (!takeCount(envc)) return false;
+  req.env.assign(fields.begin() + i, fields.begin() + i + envc);
+  return true;
+}
+
+// Reads what has arrived on the (non-blocking) connection so far.
+ReadStatus readRequest(PendingRequest& p) {
+  Request& req = p.req;
+  for (;;) {
+    uint32_t size = 0;
+    size_t want = sizeof(size) - std::min(p.data.size(), sizeof(size));
+    if (want == 0) {
+      std::memcpy(&size, p.data.data(), sizeof(size));
+      if (size > kMaxRequestSize) return ReadStatus::Failed;
+      want = sizeof(size) + size - p.data.size();
+    }
+    if (want == 0) {
+      if (req.fds[0] < 0) return ReadStatus::Failed;
+      return parseRequest(p.data.substr(sizeof(size)), req) ? ReadStatus::Done
+                                                            : ReadStatus::Failed;
+    }
+
+    char chunk[4096];
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(req.fds))];
+    iovec iov{chunk, std::min(want, sizeof(chunk))};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = ::recvmsg(p.conn, &msg, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return ReadStatus::More;
+    if (n <= 0) return ReadStatus::Failed;
+    for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+      if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+      int fds[3];
+      size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      std::memcpy(fds, CMSG_DATA(c), std::min(count, size_t(3)) * sizeof(int));
+      if (count == 3 && req.fds[0] < 0) {
+        std::memcpy(req.fds, fds, sizeof(fds));
+        for (int fd : req.fds) setCloseOnExec(fd);
+      } else {
+        for (size_t k = 0; k < std::min(count, size_t(3)); k++) ::close(fds[k]);
+      }
+    }
+    p.data.append(chunk, static_cast<size_t>(n));
+  }
+}
+
+// Only the user running the server may compile through it: a worker
+// writes wherever the request says, with the server's permissions.
+bool peerIsOwner(int conn) {
+#ifdef SO_PEERCRED
+  ucred cred{};
+  socklen_t len = sizeof(cred);
+  if (::getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) return false;
+  return cred.uid == ::geteuid();
+#else
+  uid_t uid;
+  gid_t gid;
+  if (::getpeereid(conn, &uid, &gid) != 0) return false;
+  return uid == ::geteuid();
+#endif
+}
+
+volatile sig_atomic_t stopRequested = 0;
+int wakePipe[2] = {-1, -1};
+
+void wake() {
+  int saved = errno;
+  char c = 0;
+  ssize_t ignored = ::write(wakePipe[1], &c, 1);
+  (void)ignored;
+  errno = saved;
+}
+
+void onStopSignal(int) {
+  stopRequested = 1;
+  wake();
+}
+
+void onChildSignal(int) { wake(); }
+
+[[noreturn]] void runWorker(
+    Request& req, int reportFd, FileManager& headers, const ServerHooks& hooks) {
+  ::signal(SIGCHLD, SIG_DFL);
+  ::signal(SIGINT, SIG_DFL);
+  ::signal(SIGTERM, SIG_DFL);
+  for (int i = 0; i < 3; i++) {
+    ::dup2(req.fds[i], i);
+    ::close(req.fds[i]);
+  }
+
+  if (::chdir(req.cwd.c_str()) != 0) {
+    std::cerr << "error: compile server cannot enter " << req.cwd << ": "
+              << std::strerror(errno) << "\n";
+    std::_Exit(1);
+  }
+  static std::vector<char*> env;
+  for (auto& var : req.env) env.push_back(var.data());
+  env.push_back(nullptr);
+  environ = env.data();
+
+  int rc = hooks.compile(req.args);
+  std::cout.flush();
+  std::cerr.flush();
+  llvm::outs().flush();
+  llvm::errs().flush();
+  std::fflush(nullptr);
+
+  // one line per header; writes up to PIPE_BUF are atomic, so workers that
+  // finish together don't interleave
+  for (const auto& path : headers.takeLoaded()) {
+    std::string line = path + "\n";
+    if (line.size() <= PIPE_BUF) writeAll(reportFd, line.data(), line.size());
+  }
+  std::_Exit(rc);
+}
+
+void reapWorkers(std::map<pid_t, int>& running, bool block) {
+  int status = 0;
+  pid_t pid;
+  while (!running.empty() && (pid = ::waitpid(-1, &status, block ? 0 : WNOHANG)) > 0) {
+    auto it = running.find(pid);
+    if (it == running.end()) continue;
+    int32_t code = WIFEXITED(status) ? WEXITSTATUS(status)
+                 : WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                 : 1;
+    writeAll(it->second, &code, sizeof(code));
+    ::close(it->second);
+    running.erase(it);
+  }
+}
+
+} // namespace
+
+std::string defaultServerSocket() {
+  if (const char* env = std::getenv("C99CC_SERVER")) {
+    if (*env) return env;
+  }
+  llvm::SmallString<128> path;
+  llvm::sys::path::system_temp_directory(/*ErasedOnReboot=*/true, path);
+  llvm::sys::path::append(path, "c99cc-" + std::to_string(::getuid()) + ".sock");
+  return path.str().str();
+}
+
+int runServer(const std::string& socketPath, FileManager& headers, const ServerHooks& hooks) {
+  sockaddr_un addr;
+  if (!socketAddress(socketPath, addr)) {
+    std::cerr << "error: invalid server socket path: " << socketPath << "\n";
+    return 1;
+  }
+  int probe = connectTo(socketPath);
+  if (probe >= 0) {
+    ::close(probe);
+    std::cerr << "error: a compile server is already listening on " << socketPath << "\n";
+    return 1;
+  }
+  ::unlink(socketPath.c_str()); // left behind by a server that didn't shut down cleanly
+
+  // the socket is created 0600, not made so after others could connect
+  int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  mode_t oldMask = ::umask(077);
+  bool bound =
+      listenFd >= 0 && ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+  ::umask(oldMask);
+  if (!bound || ::chmod(socketPath.c_str(), 0600) != 0 || ::listen(listenFd, 64) != 0) {
+    std::cerr << "error: cannot listen on " << socketPath << ": " << std::strerror(errno) << "\n";
+    if (listenFd >= 0) ::close(listenFd);
+    return 1;
+  }
+  setCloseOnExec(listenFd);
+
+  int reportPipe[2];
+  if (::pipe(wakePipe) != 0 || ::pipe(reportPipe) != 0) {
+    std::cerr << "error: pipe: " << std::strerror(errno) << "\n";
+    return 1;
+  }
+  for (int fd : {wakePipe[0], wakePipe[1], reportPipe[0], reportPipe[1]}) setCloseOnExec(fd);
+  for (int fd : {wakePipe[0], wakePipe[1], reportPipe[0]}) ::fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  ::signal(SIGPIPE, SIG_IGN);
+  ::signal(SIGINT, onStopSignal);
+  ::signal(SIGTERM, onStopSignal);
+  ::signal(SIGCHLD, onChildSignal);
+
+  std::cerr << "c99cc: compile server listening on " << socketPath << "\n";
+
+  std::map<pid_t, int> running; // worker -> client connection
+  std::vector<PendingRequest> pending;
+  std::string reportBuf;
+  auto startWorker = [&](int conn, Request& req) {
+    hooks.warm(req.args);
+    headers.takeLoaded(); // only what the worker reads itself gets reported
+
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      ::close(listenFd);
+      ::close(conn);
+      for (auto& other : pending) ::close(other.conn);
+      ::close(reportPipe[0]);
+      ::close(wakePipe[0]);
+      ::close(wakePipe[1]);
+      runWorker(req, reportPipe[1], headers, hooks);
+    }
+    closeAll(req);
+    // the exit code goes back with a blocking write
+    ::fcntl(conn, F_SETFL, ::fcntl(conn, F_GETFL) & ~O_NONBLOCK);
+    if (pid < 0) {
+      int32_t code = 1;
+      writeAll(conn, &code, sizeof(code));
+      ::close(conn);
+      return;
+    }
+    running[pid] = conn;
+  };
+
+  while (!stopRequested) {
+    std::vector<pollfd> fds = {
+        {listenFd, POLLIN, 0}, {wakePipe[0], POLLIN, 0}, {reportPipe[0], POLLIN, 0}};
+    int timeoutMs = -1;
+    auto now = std::chrono::steady_clock::now();
+    for (const auto& p : pending) {
+      fds.push_back({p.conn, POLLIN, 0});
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(p.deadline - now);
+      int ms = static_cast<int>(std::max<int64_t>(left.count(), 0)) + 1;
+      if (timeoutMs < 0 || ms < timeoutMs) timeoutMs = ms;
+    }
+    if (::poll(fds.data(), fds.size(), timeoutMs) < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      char drain[64];
+      while (::read(wakePipe[0], drain, sizeof(drain)) > 0) {
+      }
+      reapWorkers(running, /*block=*/false);
+    }
+
+    if (fds[2].revents & POLLIN) {
+      char chunk[4096];
+      ssize_t n;
+      while ((n = ::read(reportPipe[0], chunk, sizeof(chunk))) > 0) reportBuf.append(chunk, n);
+      size_t nl;
+      while ((nl = reportBuf.find('\n')) != std::string::npos) {
+        headers.preload(reportBuf.substr(0, nl));
+        reportBuf.erase(0, nl + 1);
+      }
+    }
+
+    // requests still arriving; fds[3 + i] is pending[i]
+    now = std::chrono::steady_clock::now();
+    std::vector<PendingRequest> waiting;
+    for (size_t i = 0; i < pending.size(); i++) {
+      PendingRequest& p = pending[i];
+      ReadStatus status = ReadStatus::More;
+      if (fds[3 + i].revents) status = readRequest(p);
+      if (status == ReadStatus::More && now >= p.deadline) status = ReadStatus::Failed;
+      if (status == ReadStatus::More) {
+        waiting.push_back(std::move(p));
+      } else if (status == ReadStatus::Done) {
+        startWorker(p.conn, p.req);
+      } else {
+        closeAll(p.req);
+        ::close(p.conn);
+      }
+    }
+    pending = std::move(waiting);
+
+    if (fds[0].revents & POLLIN) {
+      int conn = ::accept(listenFd, nullptr, nullptr);
+      if (conn < 0) continue;
+      setCloseOnExec(conn);
+      if (!peerIsOwner(conn)) {
+        ::close(conn);
+        continue;
+      }
+      ::fcntl(conn, F_SETFL, ::fcntl(conn, F_GETFL) | O_NONBLOCK);
+      PendingRequest p;
+      p.conn = conn;
+      p.deadline = std::chrono::steady_clock::now() + kRequestTimeout;
+      pending.push_back(std::move(p));
+    }
+  }
+
+  for (auto& p : pending) {
+    closeAll(p.req);
+    ::close(p.conn);
+  }
+  ::close(listenFd);
+  ::unlink(socketPath.c_str());
+  reapWorkers(running, /*block=*/true);
+  return 0;
+}
+
+bool forwardToServer(
+    const std::string& socketPath, const std::vector<std::string>& args, int& exitCode) {
+  int fd = connectTo(socketPath);
+  if (fd < 0) return false;
+  ::signal(SIGPIPE, SIG_IGN);
+
+  llvm::SmallString<256> cwd;
+  llvm::sys::fs::current_path(cwd);
+  std::string payload;
+  appendString(payload, std::to_string(args.size()));
+  for (const auto& a : args) appendString(payload, a);
+  appendString(payload, cwd.str().str());
+  size_t envc = 0;
+  for (char** e = environ; *e; e++) envc++;
+  appendString(payload, std::to_string(envc));
+  for (char** e = environ; *e; e++) appendString(payload, *e);
+
+  uint32_t size = static_cast<uint32_t>(payload.size());
+  int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+  std::memset(control, 0, sizeof(control));
+  iovec iov{&size, sizeof(size)};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr* c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN(sizeof(fds));
+  std::memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+  int32_t code = 1;
+  if (::sendmsg(fd, &msg, 0) != static_cast<ssize_t>(sizeof(size)) ||
+      !writeAll(fd, payload.data(), payload.size()) || !readAll(fd, &code, sizeof(code))) {
+    std::cerr << "error: lost connection to compile server " << socketPath << "\n";
+    code = 1;
+  }
+  ::close(fd);
+  exitCode = code;
+  return true;
+}
+
+#endif
+
+} // namespace c99cc
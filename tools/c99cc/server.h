@@ -0,0 +1,32 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace c99cc {
+
+class FileManager;
+
+struct ServerHooks {
+  // Runs in the server before each request is forked off, to build state (e.g.
+  // TargetMachines) the request and every later one will inherit.
+  std::function<void(const std::vector<std::string>& args)> warm;
+  // Runs in the forked worker once cwd, environment and standard streams are
+  // the client's. Returns the exit code sent back to the client.
+  std::function<int(const std::vector<std::string>& args)> compile;
+};
+
+// $C99CC_SERVER if set, otherwise a per-user socket in the temp directory.
+std::string defaultServerSocket();
+
+// `c99cc --server`: serves compiles on a Unix socket until SIGINT/SIGTERM.
+// Every request runs in a fork of the warm server process; headers a worker
+// had to read from disk are reported back and loaded into `headers`.
+int runServer(const std::string& socketPath, FileManager& headers, const ServerHooks& hooks);
+
+// Thin client: forwards argv/cwd/environment plus stdin/stdout/stderr to the server
+// and waits for the exit code. Returns false if no server could be reached.
+bool forwardToServer(
+    const std::string& socketPath, const std::vector<std::string>& args, int& exitCode);
+
+} // namespace c99cc